@@ -21,10 +21,12 @@
  */
 #ifndef MBEDTLS_BASE64_H
 #define MBEDTLS_BASE64_H
+#include "mbedtls/private_access.h"
 
 #include "mbedtls/build_info.h"
 
 #include <stddef.h>
+#include <stdint.h>
 
 /** Output buffer too small. */
 #define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL               -0x002A
@@ -77,6 +79,70 @@ int mbedtls_base64_encode( unsigned char *dst, size_t dlen, size_t *olen,
 int mbedtls_base64_decode( unsigned char *dst, size_t dlen, size_t *olen,
                    const unsigned char *src, size_t slen );
 
+/**
+ * \brief          Incremental base64 decoding context
+ */
+typedef struct mbedtls_base64_decode_context
+{
+    uint32_t MBEDTLS_PRIVATE(acc);          /*!< digits of the current group  */
+    unsigned MBEDTLS_PRIVATE(digits);       /*!< digits in the current group  */
+    unsigned MBEDTLS_PRIVATE(equals);       /*!< padding characters seen      */
+    int MBEDTLS_PRIVATE(spaces);            /*!< spaces seen since last digit */
+    int MBEDTLS_PRIVATE(cr);                /*!< last character was a CR      */
+}
+mbedtls_base64_decode_context;
+
+/**
+ * \brief          Initialize an incremental base64 decoding context
+ *
+ * \param ctx      The context to initialize.
+ */
+void mbedtls_base64_decode_init( mbedtls_base64_decode_context *ctx );
+
+/**
+ * \brief          Decode a chunk of base64-formatted data
+ *
+ *                 The input may be split at any position, including in the
+ *                 middle of a group of four digits or of a CRLF line break.
+ *                 The same input syntax as mbedtls_base64_decode() is
+ *                 accepted. Decoded bytes are written as soon as a full
+ *                 group of four digits is available.
+ *
+ * \param ctx      The decoding context.
+ * \param dst      Destination buffer.
+ * \param dlen     Size of the destination buffer. This must be at least
+ *                 `3 * ( ( pending + slen ) / 4 )` bytes, where pending is
+ *                 the number of digits held in \p ctx (at most 3), so
+ *                 `3 * ( ( slen + 3 ) / 4 )` is always enough.
+ * \param olen     Number of bytes written.
+ * \param src      Next chunk of base64 data.
+ * \param slen     Length of \p src in bytes.
+ *
+ * \return         0 if successful.
+ * \return         #MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL if \p dlen is too
+ *                 small. Nothing is consumed and \c *olen is set to the
+ *                 required size.
+ * \return         #MBEDTLS_ERR_BASE64_INVALID_CHARACTER if the input is not
+ *                 valid. The context must not be used afterwards except
+ *                 to reinitialize it.
+ */
+int mbedtls_base64_decode_update( mbedtls_base64_decode_context *ctx,
+                                  unsigned char *dst, size_t dlen,
+                                  size_t *olen,
+                                  const unsigned char *src, size_t slen );
+
+/**
+ * \brief          Finish an incremental base64 decoding
+ *
+ * \param ctx      The decoding context. It is wiped on return.
+ *
+ * \return         0 if the data decoded so far forms complete base64
+ *                 groups.
+ * \return         #MBEDTLS_ERR_BASE64_INVALID_CHARACTER if the input ended
+ *                 in the middle of a group or of a CRLF line break.
+ */
+int mbedtls_base64_decode_finish( mbedtls_base64_decode_context *ctx );
+
 #if defined(MBEDTLS_SELF_TEST)
 /**
  * \brief          Checkup routine
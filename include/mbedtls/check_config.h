@@ -71,6 +71,11 @@
 #error "MBEDTLS_CTR_DRBG_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE) &&                               \
+    ( MBEDTLS_CTR_DRBG_BUFFER_SIZE < 64 || MBEDTLS_CTR_DRBG_BUFFER_SIZE % 16 != 0 )
+#error "MBEDTLS_CTR_DRBG_BUFFER_SIZE must be a multiple of 16 and at least 64"
+#endif
+
 #if defined(MBEDTLS_DHM_C) && !defined(MBEDTLS_BIGNUM_C)
 #error "MBEDTLS_DHM_C defined, but not all prerequisites"
 #endif
@@ -668,6 +673,29 @@
 #error "MBEDTLS_PSA_INJECT_ENTROPY is not compatible with MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG"
 #endif
 
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD) &&  \
+    !( defined(MBEDTLS_PSA_CRYPTO_C) &&            \
+       defined(MBEDTLS_THREADING_PTHREAD) )
+#error "MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD) &&  \
+    defined(MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG)
+#error "MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD is not compatible with MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG"
+#endif
+
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC) && \
+    !defined(MBEDTLS_PSA_CRYPTO_C)
+#error "MBEDTLS_PSA_KEY_STORE_DYNAMIC defined, but not all prerequisites"
+#endif
+
+/* The volatile key identifiers of a dynamic key store must fit between the
+ * start of the vendor range and the built-in key range. */
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC) && \
+    defined(MBEDTLS_PSA_KEY_SLOT_COUNT) && MBEDTLS_PSA_KEY_SLOT_COUNT > 4096
+#error "MBEDTLS_PSA_KEY_SLOT_COUNT is too large for MBEDTLS_PSA_KEY_STORE_DYNAMIC"
+#endif
+
 #if defined(MBEDTLS_PSA_ITS_FILE_C) && \
     !defined(MBEDTLS_FS_IO)
 #error "MBEDTLS_PSA_ITS_FILE_C defined, but not all prerequisites"
@@ -826,6 +854,12 @@
 #error "MBEDTLS_SSL_PROTO_TLS1_3 defined without MBEDTLS_SSL_KEEP_PEER_CERTIFICATE"
 #endif
 
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT) &&                     \
+    ( !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE) ||                    \
+      !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_SESSION_LAZY_PEER_CERT defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2) &&                                    \
     !(defined(MBEDTLS_KEY_EXCHANGE_RSA_ENABLED) ||                          \
       defined(MBEDTLS_KEY_EXCHANGE_DHE_RSA_ENABLED) ||                      \
@@ -849,6 +883,31 @@
 #error "MBEDTLS_SSL_EARLY_DATA  defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C) && \
+    ( !defined(MBEDTLS_SSL_MAX_EARLY_DATA_SIZE) ||                 \
+      MBEDTLS_SSL_MAX_EARLY_DATA_SIZE < 0 ||                       \
+      MBEDTLS_SSL_MAX_EARLY_DATA_SIZE > 4294967295 )
+#error "MBEDTLS_SSL_MAX_EARLY_DATA_SIZE must be defined and between 0 and UINT32_MAX"
+#endif
+
+#if defined(MBEDTLS_SSL_REPLAY_C) &&                                   \
+    ( !defined(MBEDTLS_SSL_EARLY_DATA) || !defined(MBEDTLS_SSL_SRV_C) || \
+      !defined(MBEDTLS_SSL_PROTO_TLS1_3) || !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_REPLAY_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_BUFFER_POOL_C) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_BUFFER_POOL_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_KEY_POOL_C) &&                                  \
+    ( !defined(MBEDTLS_PSA_CRYPTO_C) || !defined(MBEDTLS_ECDH_C) ||       \
+      !defined(MBEDTLS_ECP_C) ||                                          \
+      !( defined(MBEDTLS_USE_PSA_CRYPTO) ||                               \
+         defined(MBEDTLS_SSL_PROTO_TLS1_3) ) )
+#error "MBEDTLS_SSL_KEY_POOL_C defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)     && \
     !defined(MBEDTLS_SSL_PROTO_TLS1_2)
 #error "MBEDTLS_SSL_PROTO_DTLS defined, but not all prerequisites"
@@ -923,6 +982,38 @@
 #error "MBEDTLS_SSL_TICKET_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_CACHE_SHARED) &&                                 \
+    ( !defined(MBEDTLS_SSL_CACHE_C) || !defined(MBEDTLS_THREADING_PTHREAD) )
+#error "MBEDTLS_SSL_CACHE_SHARED defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CACHE_SHARED_WAYS) &&                           \
+    ( MBEDTLS_SSL_CACHE_SHARED_WAYS < 1 || MBEDTLS_SSL_CACHE_SHARED_WAYS > 64 )
+#error "MBEDTLS_SSL_CACHE_SHARED_WAYS must be between 1 and 64"
+#endif
+
+#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX) &&                  \
+    ( MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX < 64 ||                    \
+      MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX > 16384 ||                 \
+      MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX % 64 != 0 )
+#error "MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX must be a multiple of 64 between 64 and 16384"
+#endif
+
+#if defined(MBEDTLS_SSL_DTLS_ENDPOINT_C) &&                              \
+    ( !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_SSL_PROTO_DTLS) )
+#error "MBEDTLS_SSL_DTLS_ENDPOINT_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_DTLS_ENDPOINT_BATCH) &&                          \
+    ( MBEDTLS_SSL_DTLS_ENDPOINT_BATCH < 1 || MBEDTLS_SSL_DTLS_ENDPOINT_BATCH > 1024 )
+#error "MBEDTLS_SSL_DTLS_ENDPOINT_BATCH must be between 1 and 1024"
+#endif
+
+#if defined(MBEDTLS_SSL_TICKET_MAX_KEYS) && \
+    ( MBEDTLS_SSL_TICKET_MAX_KEYS < 2 || MBEDTLS_SSL_TICKET_MAX_KEYS > 127 )
+#error "MBEDTLS_SSL_TICKET_MAX_KEYS must be between 2 and 127"
+#endif
+
 #if defined(MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH) && \
     MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH >= 256
 #error "MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH must be less than 256"
@@ -1011,6 +1102,10 @@
 #error "MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_CONTEXT_PARKING defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION) && !( defined(MBEDTLS_GCM_C) || defined(MBEDTLS_CCM_C) || defined(MBEDTLS_CHACHAPOLY_C) )
 #error "MBEDTLS_SSL_CONTEXT_SERIALIZATION defined, but not all prerequisites"
 #endif
@@ -135,6 +135,19 @@
 /**< The maximum size of seed or reseed buffer in bytes. */
 #endif
 
+/** \def MBEDTLS_CTR_DRBG_BUFFER_SIZE
+ *
+ * \brief The size of the keystream buffer used by contexts that have
+ *        output buffering enabled, in bytes.
+ *
+ * If this macro is not defined, output buffering is not available and
+ * mbedtls_ctr_drbg_set_buffering() is not declared.
+ * See mbedtls_ctr_drbg_set_buffering() for more information.
+ */
+#if defined(__DOXYGEN__)
+#define MBEDTLS_CTR_DRBG_BUFFER_SIZE        512
+#endif
+
 /** \} name SECTION: Module settings */
 
 #define MBEDTLS_CTR_DRBG_PR_OFF             0
@@ -142,6 +155,11 @@
 #define MBEDTLS_CTR_DRBG_PR_ON              1
 /**< Prediction resistance is enabled. */
 
+#define MBEDTLS_CTR_DRBG_BUFFERING_OFF      0
+/**< Output buffering is disabled. */
+#define MBEDTLS_CTR_DRBG_BUFFERING_ON       1
+/**< Output buffering is enabled. */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -192,6 +210,16 @@ typedef struct mbedtls_ctr_drbg_context
 
     mbedtls_aes_context MBEDTLS_PRIVATE(aes_ctx);        /*!< The AES context. */
 
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+    int MBEDTLS_PRIVATE(buffering);              /*!< This determines whether
+                                 * small requests are served from \c buf. */
+    size_t MBEDTLS_PRIVATE(buf_len);             /*!< The number of unused
+                                 * bytes at the end of \c buf. */
+    unsigned char MBEDTLS_PRIVATE(buf)[MBEDTLS_CTR_DRBG_BUFFER_SIZE];
+                                /*!< Keystream generated ahead of requests.
+                                 * Bytes are wiped as they are handed out. */
+#endif
+
     /*
      * Callbacks (Entropy)
      */
@@ -356,6 +384,41 @@ void mbedtls_ctr_drbg_free( mbedtls_ctr_drbg_context *ctx );
 void mbedtls_ctr_drbg_set_prediction_resistance( mbedtls_ctr_drbg_context *ctx,
                                          int resistance );
 
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+/**
+ * \brief               This function turns output buffering on or off.
+ *                      The default value is off.
+ *
+ * When buffering is enabled, requests without additional input are
+ * served from a buffer of #MBEDTLS_CTR_DRBG_BUFFER_SIZE bytes of
+ * keystream that is generated in a single pass. The first
+ * #MBEDTLS_CTR_DRBG_SEEDLEN bytes of each refill immediately replace
+ * the key and the counter ("fast key erasure"), and every byte is wiped
+ * from the buffer as soon as it is returned. Thus a later compromise of
+ * the context reveals neither past outputs nor the key that produced
+ * them, but it does reveal the outputs still waiting in the buffer.
+ *
+ * This amortizes the state update and the AES key schedule of
+ * mbedtls_ctr_drbg_random_with_add() over many small requests.
+ *
+ * \note                With buffering enabled, the output is no longer
+ *                      the one specified by NIST SP 800-90A, and the
+ *                      reseed interval counts buffer refills rather than
+ *                      calls. Requests that carry additional input,
+ *                      requests larger than the buffer, and all requests
+ *                      made while prediction resistance is enabled take
+ *                      the standard path.
+ * \note                Reseeding, updating the state and turning
+ *                      buffering off discard the buffered output.
+ *
+ * \param ctx           The CTR_DRBG context.
+ * \param buffering     #MBEDTLS_CTR_DRBG_BUFFERING_ON or
+ *                      #MBEDTLS_CTR_DRBG_BUFFERING_OFF.
+ */
+void mbedtls_ctr_drbg_set_buffering( mbedtls_ctr_drbg_context *ctx,
+                                     int buffering );
+#endif /* MBEDTLS_CTR_DRBG_BUFFER_SIZE */
+
 /**
  * \brief               This function sets the amount of entropy grabbed on each
  *                      seed or reseed.
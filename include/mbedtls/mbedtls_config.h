@@ -1232,6 +1232,31 @@
  */
 //#define MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG
 
+/** \def MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD
+ *
+ * Give each thread its own DRBG instance for psa_generate_random() and
+ * mbedtls_psa_get_random(), instead of sharing one DRBG protected by a
+ * mutex between all threads.
+ *
+ * The DRBG of a thread is created and seeded from the shared entropy
+ * context the first time the thread needs random data, and freed when the
+ * thread exits or when mbedtls_psa_crypto_free() is called. It reseeds
+ * itself from the shared entropy context according to its reseed interval,
+ * and when it is first used in a child process after fork().
+ *
+ * With this option, #MBEDTLS_PSA_RANDOM_STATE is \c NULL, and
+ * mbedtls_psa_get_random() is a function that uses the DRBG of the calling
+ * thread.
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_C, MBEDTLS_THREADING_PTHREAD
+ *
+ * This option is not compatible with #MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG.
+ *
+ * Uncomment this to avoid contention on the random generator in
+ * multithreaded applications.
+ */
+//#define MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD
+
 /**
  * \def MBEDTLS_PSA_CRYPTO_SPM
  *
@@ -1259,6 +1284,31 @@
  */
 //#define MBEDTLS_PSA_INJECT_ENTROPY
 
+/**
+ * \def MBEDTLS_PSA_KEY_STORE_DYNAMIC
+ *
+ * Let the PSA key store grow on demand instead of being limited to
+ * #MBEDTLS_PSA_KEY_SLOT_COUNT key slots.
+ *
+ * When this option is enabled, key slots are allocated on the heap in
+ * slices of increasing size, the first one holding
+ * #MBEDTLS_PSA_KEY_SLOT_COUNT slots and each following one holding twice as
+ * many as the previous one, up to 2^16 - 1 times #MBEDTLS_PSA_KEY_SLOT_COUNT
+ * slots in total. Slots that have been allocated are only released by
+ * mbedtls_psa_crypto_free(). Loaded persistent keys are only evicted from
+ * memory once the store has reached its maximum size.
+ *
+ * When this option is disabled, the key store is a static array of
+ * #MBEDTLS_PSA_KEY_SLOT_COUNT key slots.
+ *
+ * Module:  library/psa_crypto_slot_management.c
+ * Requires: MBEDTLS_PSA_CRYPTO_C
+ *
+ * Uncomment this to support many simultaneous volatile keys, for example
+ * one or more keys per connection on a busy TLS server.
+ */
+//#define MBEDTLS_PSA_KEY_STORE_DYNAMIC
+
 /**
  * \def MBEDTLS_RSA_NO_CRT
  *
@@ -1357,6 +1407,20 @@
  */
 //#define MBEDTLS_SSL_ASYNC_PRIVATE
 
+/**
+ * \def MBEDTLS_SSL_CACHE_SHARED
+ *
+ * Enable a variant of the SSL session cache that stores its entries in
+ * shared memory, so that all the worker processes of a pre-fork server
+ * share one cache. See mbedtls_ssl_cache_shared_setup().
+ *
+ * Requires: MBEDTLS_SSL_CACHE_C, MBEDTLS_THREADING_PTHREAD
+ *           A POSIX platform with mmap() and process-shared robust mutexes.
+ *
+ * Uncomment this macro to enable the shared-memory session cache.
+ */
+//#define MBEDTLS_SSL_CACHE_SHARED
+
 /**
  * \def MBEDTLS_SSL_CONTEXT_SERIALIZATION
  *
@@ -1458,6 +1522,30 @@
  */
 #define MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
 
+/**
+ * \def MBEDTLS_SSL_SESSION_LAZY_PEER_CERT
+ *
+ * Defer parsing of the peer's certificate when loading a serialized
+ * session, for example when a server accepts a session ticket or a
+ * session from an external cache.
+ *
+ * With this option, mbedtls_ssl_session_load() only keeps the raw DER of
+ * the peer's end-entity certificate, and the certificate is parsed when
+ * the application calls mbedtls_ssl_load_peer_cert() on a connection using
+ * that session. Until then, mbedtls_ssl_get_peer_cert() returns \c NULL
+ * for that connection. Resumed handshakes that never look at the
+ * certificate do not pay for X.509 parsing at all.
+ *
+ * \note With this option, a malformed certificate in serialized session
+ *       data is not reported by mbedtls_ssl_session_load(), but by
+ *       mbedtls_ssl_load_peer_cert().
+ *
+ * Requires: MBEDTLS_SSL_KEEP_PEER_CERTIFICATE, MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment this macro to enable lazy parsing of resumed peer certificates.
+ */
+//#define MBEDTLS_SSL_SESSION_LAZY_PEER_CERT
+
 /**
  * \def MBEDTLS_SSL_RENEGOTIATION
  *
@@ -1649,6 +1737,20 @@
 */
 //#define MBEDTLS_SSL_EARLY_DATA
 
+/**
+ * \def MBEDTLS_SSL_MAX_EARLY_DATA_SIZE
+ *
+ * The default maximum amount of 0-RTT data a TLS 1.3 server accepts. See
+ * the documentation of \c mbedtls_ssl_tls13_conf_max_early_data_size() for
+ * more information.
+ *
+ * It must be between 0 and UINT32_MAX; 0 disables early data in tickets.
+ *
+ * If MBEDTLS_SSL_EARLY_DATA is not defined, this default value does not
+ * have any impact on the build.
+ */
+#define MBEDTLS_SSL_MAX_EARLY_DATA_SIZE        1024
+
 /**
  * \def MBEDTLS_SSL_PROTO_DTLS
  *
@@ -1786,6 +1888,20 @@
  */
 //#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
 
+/**
+ * \def MBEDTLS_SSL_CONTEXT_PARKING
+ *
+ * Enable mbedtls_ssl_park(), which releases the record buffers of an idle
+ * connection until it is used again. This reduces the memory held by a
+ * server for idle keep-alive connections to the SSL context, the session
+ * and the transform.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment this macro to enable support for parking SSL contexts.
+ */
+//#define MBEDTLS_SSL_CONTEXT_PARKING
+
 /**
  * \def MBEDTLS_TEST_CONSTANT_FLOW_MEMSAN
  *
@@ -3108,6 +3224,23 @@
  */
 //#define MBEDTLS_SHA512_USE_A64_CRYPTO_ONLY
 
+/**
+ * \def MBEDTLS_SSL_BUFFER_POOL_C
+ *
+ * Enable the pool of record buffers shared by SSL contexts. It keeps the
+ * buffers released by finished connections for the next ones, with a small
+ * lock-free list per thread when MBEDTLS_THREADING_PTHREAD is enabled. See
+ * mbedtls_ssl_conf_buffer_pool().
+ *
+ * Module:  library/ssl_buffer_pool.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment to enable the record buffer pool.
+ */
+//#define MBEDTLS_SSL_BUFFER_POOL_C
+
 /**
  * \def MBEDTLS_SSL_CACHE_C
  *
@@ -3130,6 +3263,58 @@
  */
 #define MBEDTLS_SSL_COOKIE_C
 
+/**
+ * \def MBEDTLS_SSL_DTLS_ENDPOINT_C
+ *
+ * Enable the DTLS server endpoint, which serves many associations on one
+ * datagram socket: it demultiplexes incoming datagrams by connection ID or
+ * peer address and checks the cookie of new clients before keeping any
+ * state for them.
+ *
+ * Module:  library/ssl_dtls_endpoint.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_SSL_PROTO_DTLS
+ *
+ * Uncomment to enable the DTLS server endpoint.
+ */
+//#define MBEDTLS_SSL_DTLS_ENDPOINT_C
+
+/**
+ * \def MBEDTLS_SSL_KEY_POOL_C
+ *
+ * Enable the pool of pre-generated ECDHE key pairs. The application fills
+ * it while idle, and TLS 1.3 key shares and TLS 1.2 ServerKeyExchange
+ * messages take a key pair from it instead of generating one. See
+ * mbedtls_ssl_conf_key_share_pool().
+ *
+ * Module:  library/ssl_key_pool.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_PSA_CRYPTO_C, MBEDTLS_ECDH_C, MBEDTLS_ECP_C and
+ *           MBEDTLS_USE_PSA_CRYPTO or MBEDTLS_SSL_PROTO_TLS1_3
+ *
+ * Uncomment to enable the key share pool.
+ */
+//#define MBEDTLS_SSL_KEY_POOL_C
+
+/**
+ * \def MBEDTLS_SSL_REPLAY_C
+ *
+ * Enable the TLS 1.3 0-RTT anti-replay filter. It records the PSK binders
+ * of ClientHellos that offered early data in a Bloom filter covering a
+ * sliding time window, so that a replayed ClientHello is detected and only
+ * gets a 1-RTT handshake. See mbedtls_ssl_tls13_conf_early_data_replay().
+ *
+ * Module:  library/ssl_replay.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_EARLY_DATA, MBEDTLS_SSL_SRV_C, MBEDTLS_HAVE_TIME
+ *
+ * Uncomment to enable the early data anti-replay filter.
+ */
+//#define MBEDTLS_SSL_REPLAY_C
+
 /**
  * \def MBEDTLS_SSL_TICKET_C
  *
@@ -3464,6 +3649,7 @@
 //#define MBEDTLS_CTR_DRBG_MAX_INPUT                256 /**< Maximum number of additional input bytes */
 //#define MBEDTLS_CTR_DRBG_MAX_REQUEST             1024 /**< Maximum number of requested bytes per call */
 //#define MBEDTLS_CTR_DRBG_MAX_SEED_INPUT           384 /**< Maximum size of (re)seed buffer */
+//#define MBEDTLS_CTR_DRBG_BUFFER_SIZE              512 /**< Size of the output buffer; enables mbedtls_ctr_drbg_set_buffering() */
 
 /* HMAC_DRBG options */
 //#define MBEDTLS_HMAC_DRBG_RESEED_INTERVAL   10000 /**< Interval before reseed is performed by default */
@@ -3563,9 +3749,16 @@
  */
 //#define MBEDTLS_PSA_KEY_SLOT_COUNT 32
 
+/* SSL buffer pool options */
+//#define MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE        4 /**< Free buffers kept per thread, 0 to disable the per-thread lists */
+
 /* SSL Cache options */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_TIMEOUT       86400 /**< 1 day  */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_MAX_ENTRIES      50 /**< Maximum entries in cache */
+//#define MBEDTLS_SSL_CACHE_SHARED_WAYS               4 /**< Entries per bucket of a shared cache */
+
+/* SSL ticket options */
+//#define MBEDTLS_SSL_TICKET_MAX_KEYS                 2 /**< Maximum number of ticket keys accepted at once */
 
 /* SSL options */
 
@@ -3645,9 +3838,13 @@
  * Maximum number of heap-allocated bytes for the purpose of
  * DTLS handshake message reassembly and future message buffering.
  *
- * This should be at least 9/8 * MBEDTLS_SSL_IN_CONTENT_LEN
+ * This many bytes are allocated in one block the first time a handshake
+ * needs to buffer a message, and freed at the end of the handshake, so
+ * that out-of-order and fragmented messages need no further allocation.
+ *
+ * This should be at least MBEDTLS_SSL_IN_CONTENT_LEN + 12
  * to account for a reassembled handshake message of maximum size,
- * together with its reassembly bitmap.
+ * together with its header.
  *
  * A value of 2 * MBEDTLS_SSL_IN_CONTENT_LEN (32768 by default)
  * should be sufficient for all practical situations as it allows
@@ -3657,8 +3854,24 @@
  */
 //#define MBEDTLS_SSL_DTLS_MAX_BUFFERING             32768
 
+/** \def MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX
+ *
+ * Maximum size, in records, of the DTLS anti-replay window that can be
+ * selected at runtime with mbedtls_ssl_conf_dtls_anti_replay_window(). The
+ * default window is 64 records regardless of this setting.
+ *
+ * The window is kept in every SSL context as a ring of
+ * (MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX / 64 + 1) 64-bit words. Raise it
+ * if many more than 64 records can be reordered in flight, so that late
+ * records are not discarded as replays.
+ *
+ * Must be a multiple of 64, between 64 and 16384.
+ */
+//#define MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX     64
+
 //#define MBEDTLS_PSK_MAX_LEN               32 /**< Max size of TLS pre-shared keys, in bytes (default 256 bits) */
 //#define MBEDTLS_SSL_COOKIE_TIMEOUT        60 /**< Default expiration delay of DTLS cookies, in seconds if HAVE_TIME, or in number of cookies issued */
+//#define MBEDTLS_SSL_DTLS_ENDPOINT_BATCH   16 /**< Maximum number of datagrams received or sent per transport call by a DTLS endpoint */
 
 /** \def MBEDTLS_TLS_EXT_CID
  *
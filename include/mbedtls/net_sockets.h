@@ -283,6 +283,52 @@ int mbedtls_net_send( void *ctx, const unsigned char *buf, size_t len );
 int mbedtls_net_recv_timeout( void *ctx, unsigned char *buf, size_t len,
                       uint32_t timeout );
 
+/**
+ * \brief          Receive several datagrams from a UDP socket at once,
+ *                 together with the address each one came from.
+ *                 This is a \c mbedtls_ssl_recv_batch_t callback.
+ *
+ * \note           On Linux this uses a single recvmmsg() call. On other
+ *                 platforms it receives one datagram per call.
+ *
+ * \note           On a blocking socket, this function blocks until at
+ *                 least one datagram is available, and then returns the
+ *                 datagrams that are already queued.
+ *
+ * \param ctx      Socket, bound or connected with #MBEDTLS_NET_PROTO_UDP
+ * \param dgrams   Array of \p count datagram descriptors, see
+ *                 #mbedtls_ssl_dgram
+ * \param count    Number of entries in \p dgrams
+ *
+ * \return         The number of datagrams received (at least 1),
+ *                 or a non-zero error code; with a non-blocking socket,
+ *                 MBEDTLS_ERR_SSL_WANT_READ indicates that no datagram is
+ *                 available.
+ */
+int mbedtls_net_recv_batch( void *ctx, mbedtls_ssl_dgram *dgrams,
+                            size_t count );
+
+/**
+ * \brief          Send several datagrams on a UDP socket at once, each to
+ *                 its own address. This is a \c mbedtls_ssl_send_batch_t
+ *                 callback.
+ *
+ * \note           On Linux this uses a single sendmmsg() call. On other
+ *                 platforms it sends one datagram per call.
+ *
+ * \param ctx      Socket, bound or connected with #MBEDTLS_NET_PROTO_UDP
+ * \param dgrams   Datagrams to send. An entry with \c addr_len 0 is sent
+ *                 to the peer of a connected socket.
+ * \param count    Number of entries in \p dgrams
+ *
+ * \return         The number of datagrams sent, starting with the first
+ *                 one, or a non-zero error code if none could be sent;
+ *                 with a non-blocking socket, MBEDTLS_ERR_SSL_WANT_WRITE
+ *                 indicates that sending would block.
+ */
+int mbedtls_net_send_batch( void *ctx, const mbedtls_ssl_dgram *dgrams,
+                            size_t count );
+
 /**
  * \brief          Closes down the connection and free associated data
  *
@@ -98,7 +98,8 @@
 #define MBEDTLS_ERR_SSL_BAD_CERTIFICATE                   -0x7A00
 /** Received NewSessionTicket Post Handshake Message */
 #define MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET       -0x7B00
-/* Error space gap */
+/** Early data has been received, read it with mbedtls_ssl_read_early_data(). */
+#define MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA               -0x7C00
 /* Error space gap */
 /* Error space gap */
 /* Error space gap */
@@ -323,6 +324,9 @@
 #define MBEDTLS_SSL_SESSION_TICKETS_DISABLED     0
 #define MBEDTLS_SSL_SESSION_TICKETS_ENABLED      1
 
+#define MBEDTLS_SSL_NEW_SESSION_TICKETS_IMMEDIATE 0
+#define MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED  1
+
 #define MBEDTLS_SSL_PRESET_DEFAULT              0
 #define MBEDTLS_SSL_PRESET_SUITEB               2
 
@@ -332,6 +336,10 @@
 #define MBEDTLS_SSL_EARLY_DATA_DISABLED        0
 #define MBEDTLS_SSL_EARLY_DATA_ENABLED         1
 
+#define MBEDTLS_SSL_EARLY_DATA_STATUS_NOT_SENT  0
+#define MBEDTLS_SSL_EARLY_DATA_STATUS_ACCEPTED  1
+#define MBEDTLS_SSL_EARLY_DATA_STATUS_REJECTED  2
+
 #define MBEDTLS_SSL_DTLS_SRTP_MKI_UNSUPPORTED    0
 #define MBEDTLS_SSL_DTLS_SRTP_MKI_SUPPORTED      1
 
@@ -387,6 +395,13 @@
 #define MBEDTLS_SSL_DTLS_MAX_BUFFERING 32768
 #endif
 
+/*
+ * Maximum size of the DTLS anti-replay window, in records.
+ */
+#if !defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX)
+#define MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX 64
+#endif
+
 /*
  * Maximum length of CIDs for incoming and outgoing messages.
  */
@@ -521,6 +536,7 @@
 #define MBEDTLS_SSL_HS_SERVER_HELLO             2
 #define MBEDTLS_SSL_HS_HELLO_VERIFY_REQUEST     3
 #define MBEDTLS_SSL_HS_NEW_SESSION_TICKET       4
+#define MBEDTLS_SSL_HS_END_OF_EARLY_DATA        5 // NEW IN TLS 1.3
 #define MBEDTLS_SSL_HS_ENCRYPTED_EXTENSIONS     8 // NEW IN TLS 1.3
 #define MBEDTLS_SSL_HS_CERTIFICATE             11
 #define MBEDTLS_SSL_HS_SERVER_KEY_EXCHANGE     12
@@ -672,6 +688,7 @@ typedef enum
     MBEDTLS_SSL_SERVER_CCS_AFTER_SERVER_HELLO,
     MBEDTLS_SSL_SERVER_CCS_AFTER_HELLO_RETRY_REQUEST,
     MBEDTLS_SSL_NEW_SESSION_TICKET_FLUSH,
+    MBEDTLS_SSL_END_OF_EARLY_DATA,
 }
 mbedtls_ssl_states;
 
@@ -746,6 +763,75 @@ typedef int mbedtls_ssl_recv_timeout_t( void *ctx,
                                         unsigned char *buf,
                                         size_t len,
                                         uint32_t timeout );
+
+/** Maximum size of the transport address in a #mbedtls_ssl_dgram.
+ *  This is large enough for a struct sockaddr_in6. */
+#define MBEDTLS_SSL_DGRAM_ADDR_MAX      32
+
+/**
+ * \brief          One datagram in a batch exchanged through
+ *                 \c mbedtls_ssl_send_batch_t or \c mbedtls_ssl_recv_batch_t.
+ *
+ * \note           The address is opaque to the library: it is whatever
+ *                 the transport uses to identify a peer (for BSD sockets,
+ *                 a struct sockaddr). Two datagrams come from the same
+ *                 peer if and only if their addresses have the same
+ *                 length and contents.
+ */
+typedef struct mbedtls_ssl_dgram
+{
+    unsigned char *buf;     /*!< Datagram payload                       */
+    size_t len;             /*!< Send: length of the payload.
+                                 Receive: size of \c buf on input,
+                                 length of the payload on output.       */
+    unsigned char addr[MBEDTLS_SSL_DGRAM_ADDR_MAX]; /*!< Peer address   */
+    size_t addr_len;        /*!< Length of \c addr, or 0 to send to the
+                                 default peer of a connected socket.    */
+}
+mbedtls_ssl_dgram;
+
+/**
+ * \brief          Callback type: send several datagrams at once
+ *
+ * \param ctx      Context for the send callback (typically a file descriptor)
+ * \param dgrams   Datagrams to send, each to its own address
+ * \param count    Number of entries in \p dgrams
+ *
+ * \return         The callback must return the number of datagrams sent,
+ *                 starting with the first one, which may be fewer than
+ *                 \p count, or a negative error code:
+ *                 \c MBEDTLS_ERR_SSL_WANT_WRITE if no datagram could be
+ *                 sent without blocking.
+ */
+typedef int mbedtls_ssl_send_batch_t( void *ctx,
+                                      const mbedtls_ssl_dgram *dgrams,
+                                      size_t count );
+
+/**
+ * \brief          Callback type: receive several datagrams at once
+ *
+ * \param ctx      Context for the receive callback (typically a file
+ *                 descriptor)
+ * \param dgrams   Array of \p count entries. On input, \c buf and \c len
+ *                 of each entry describe an empty buffer. On output, the
+ *                 callback sets \c len, \c addr and \c addr_len of the
+ *                 entries it filled.
+ * \param count    Number of entries in \p dgrams
+ *
+ * \return         The callback must return the number of datagrams
+ *                 received, which is at least 1 and at most \p count,
+ *                 or a negative error code:
+ *                 \c MBEDTLS_ERR_SSL_WANT_READ if no datagram is available
+ *                 without blocking.
+ *
+ * \note           The callback should block (unless the transport is
+ *                 non-blocking) only until the first datagram is
+ *                 available, and then return whatever else is already
+ *                 queued, up to \p count datagrams.
+ */
+typedef int mbedtls_ssl_recv_batch_t( void *ctx,
+                                      mbedtls_ssl_dgram *dgrams,
+                                      size_t count );
 /**
  * \brief          Callback type: set a pair of timers/delays to watch
  *
@@ -794,6 +880,7 @@ typedef struct mbedtls_ssl_config  mbedtls_ssl_config;
 typedef struct mbedtls_ssl_transform mbedtls_ssl_transform;
 typedef struct mbedtls_ssl_handshake_params mbedtls_ssl_handshake_params;
 typedef struct mbedtls_ssl_sig_hash_set_t mbedtls_ssl_sig_hash_set_t;
+typedef struct mbedtls_ssl_ciphersuite_index_entry mbedtls_ssl_ciphersuite_index_entry;
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 typedef struct mbedtls_ssl_key_cert mbedtls_ssl_key_cert;
 #endif
@@ -895,6 +982,15 @@ typedef int mbedtls_ssl_cache_set_t( void *data,
  *                  `Ecdsa-Sig-Value` defined in
  *                  [RFC 4492 section 5.4](https://tools.ietf.org/html/rfc4492#section-5.4).
  *
+ * \note            In TLS 1.3, this callback is also used for the
+ *                  CertificateVerify signature, by servers and by clients
+ *                  doing certificate authentication. RSA signatures must
+ *                  then use RSASSA-PSS as with mbedtls_pk_sign_ext() and
+ *                  #MBEDTLS_PK_RSASSA_PSS, with \p md_alg as the hash and
+ *                  MGF1 hash. Call mbedtls_ssl_get_async_sig_alg() from
+ *                  this callback to get the TLS 1.3 signature algorithm
+ *                  that was chosen for the signature.
+ *
  * \param ssl             The SSL connection instance. It should not be
  *                        modified other than via
  *                        mbedtls_ssl_set_async_operation_data().
@@ -1168,6 +1264,12 @@ struct mbedtls_ssl_session
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
     mbedtls_x509_crt *MBEDTLS_PRIVATE(peer_cert);       /*!< peer X.509 cert chain */
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    /*! DER of the peer's end-entity certificate after session loading,
+     *  until it is parsed into \c peer_cert on first use. */
+    unsigned char *MBEDTLS_PRIVATE(peer_cert_der);
+    size_t MBEDTLS_PRIVATE(peer_cert_der_len);
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
 #else /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
     /*! The digest of the peer's end-CRT. This must be kept to detect CRT
      *  changes during renegotiation, mitigating the triple handshake attack. */
@@ -1191,6 +1293,13 @@ struct mbedtls_ssl_session
     uint8_t MBEDTLS_PRIVATE(resumption_key_len);            /*!< resumption_key length */
     unsigned char MBEDTLS_PRIVATE(resumption_key)[MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN];
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    uint32_t MBEDTLS_PRIVATE(max_early_data_size);          /*!< max_early_data_size of the ticket, 0 if early data is not allowed */
+#if defined(MBEDTLS_SSL_ALPN) && defined(MBEDTLS_SSL_SRV_C)
+    char *MBEDTLS_PRIVATE(ticket_alpn);                     /*!< ALPN protocol negotiated when the ticket was issued */
+#endif /* MBEDTLS_SSL_ALPN && MBEDTLS_SSL_SRV_C */
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION) && defined(MBEDTLS_SSL_CLI_C)
     char *MBEDTLS_PRIVATE(hostname);             /*!< host name binded with tickets */
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION && MBEDTLS_SSL_CLI_C */
@@ -1339,6 +1448,8 @@ struct mbedtls_ssl_config
     defined(MBEDTLS_SSL_SRV_C) && \
     defined(MBEDTLS_SSL_PROTO_TLS1_3)
     uint16_t MBEDTLS_PRIVATE(new_session_tickets_count);   /*!< number of NewSessionTicket */
+    uint8_t MBEDTLS_PRIVATE(new_session_tickets_mode);     /*!< send tickets with the
+                                                                handshake or on first write */
 #endif
 
 #if defined(MBEDTLS_SSL_SRV_C)
@@ -1365,6 +1476,11 @@ struct mbedtls_ssl_config
     /** Allowed ciphersuites for (D)TLS 1.2 (0-terminated)                  */
     const int *MBEDTLS_PRIVATE(ciphersuite_list);
 
+    /** Lookup table for ciphersuite_list, sorted by ciphersuite identifier,
+     *  built by mbedtls_ssl_conf_precompute() (NULL if not built)         */
+    mbedtls_ssl_ciphersuite_index_entry *MBEDTLS_PRIVATE(ciphersuite_index);
+    size_t MBEDTLS_PRIVATE(ciphersuite_index_len); /*!< entries in the table */
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     /** Allowed TLS 1.3 key exchange modes.                                 */
     int MBEDTLS_PRIVATE(tls13_kex_modes);
@@ -1420,8 +1536,32 @@ struct mbedtls_ssl_config
             unsigned char *, const unsigned char *, size_t *, uint32_t * );
     /** Callback to parse a session ticket into a session structure         */
     int (*MBEDTLS_PRIVATE(f_ticket_parse))( void *, mbedtls_ssl_session *, unsigned char *, size_t);
+    /** Callback to create & write several session tickets at once          */
+    int (*MBEDTLS_PRIVATE(f_ticket_write_batch))( void *, const mbedtls_ssl_session *,
+            size_t, unsigned char *, const unsigned char *, size_t *, uint32_t * );
     void *MBEDTLS_PRIVATE(p_ticket);                 /*!< context for the ticket callbacks   */
 #endif /* MBEDTLS_SSL_SESSION_TICKETS && MBEDTLS_SSL_SRV_C */
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    /** Callback to reject replayed 0-RTT ClientHellos                      */
+    int (*MBEDTLS_PRIVATE(f_early_data_replay))( void *, const unsigned char *, size_t,
+                                                 const unsigned char *, size_t );
+    void *MBEDTLS_PRIVATE(p_early_data_replay);      /*!< context for the anti-replay callback */
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
+#if ( defined(MBEDTLS_USE_PSA_CRYPTO) || defined(MBEDTLS_SSL_PROTO_TLS1_3) ) && \
+    defined(MBEDTLS_ECDH_C)
+    /** Callback to take a pre-generated ECDHE key share                    */
+    int (*MBEDTLS_PRIVATE(f_key_share_pop))( void *, uint16_t, mbedtls_svc_key_id_t *,
+                                             unsigned char *, size_t, size_t * );
+    void *MBEDTLS_PRIVATE(p_key_share);              /*!< context for the key share callback */
+#endif /* ( MBEDTLS_USE_PSA_CRYPTO || MBEDTLS_SSL_PROTO_TLS1_3 ) && MBEDTLS_ECDH_C */
+
+    /** Callback to take a record buffer                                    */
+    unsigned char * (*MBEDTLS_PRIVATE(f_buf_get))( void *, size_t );
+    /** Callback to give a record buffer back                               */
+    void (*MBEDTLS_PRIVATE(f_buf_put))( void *, unsigned char *, size_t );
+    void *MBEDTLS_PRIVATE(p_buf_pool);               /*!< context for the buffer callbacks */
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     size_t MBEDTLS_PRIVATE(cid_len); /*!< The length of CIDs for incoming DTLS records.      */
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
@@ -1503,6 +1643,10 @@ struct mbedtls_ssl_config
     int MBEDTLS_PRIVATE(early_data_enabled);     /*!< Early data enablement:
                                                   *   - MBEDTLS_SSL_EARLY_DATA_DISABLED,
                                                   *   - MBEDTLS_SSL_EARLY_DATA_ENABLED */
+#if defined(MBEDTLS_SSL_SRV_C)
+    uint32_t MBEDTLS_PRIVATE(max_early_data_size); /*!< max_early_data_size
+                                                    *   advertised in tickets */
+#endif /* MBEDTLS_SSL_SRV_C */
 #endif /* MBEDTLS_SSL_EARLY_DATA */
 
 #if defined(MBEDTLS_SSL_ALPN)
@@ -1537,6 +1681,10 @@ struct mbedtls_ssl_config
 
     unsigned int MBEDTLS_PRIVATE(badmac_limit);      /*!< limit of records with a bad MAC    */
 
+#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
+    uint16_t MBEDTLS_PRIVATE(anti_replay_window);    /*!< anti-replay window (records)       */
+#endif
+
 #if defined(MBEDTLS_DHM_C) && defined(MBEDTLS_SSL_CLI_C)
     unsigned int MBEDTLS_PRIVATE(dhm_min_bitlen);    /*!< min. bit length of the DHM prime   */
 #endif
@@ -1590,6 +1738,12 @@ struct mbedtls_ssl_context
 
     unsigned MBEDTLS_PRIVATE(badmac_seen);       /*!< records with a bad MAC received    */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    /** Status of the 0-RTT data offered by the client, one of the
+     *  \c MBEDTLS_SSL_EARLY_DATA_STATUS_xxx values. */
+    int MBEDTLS_PRIVATE(early_data_status);
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
     /** Callback to customize X.509 certificate chain verification          */
     int (*MBEDTLS_PRIVATE(f_vrfy))(void *, mbedtls_x509_crt *, int, uint32_t *);
@@ -1674,7 +1828,10 @@ struct mbedtls_ssl_context
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
     uint64_t MBEDTLS_PRIVATE(in_window_top);     /*!< last validated record seq_num    */
-    uint64_t MBEDTLS_PRIVATE(in_window);         /*!< bitmask for replay detection     */
+    uint64_t MBEDTLS_PRIVATE(in_window)[MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX / 64 + 1];
+                                                 /*!< ring of bitmasks for replay
+                                                      detection, indexed by
+                                                      seq_num / 64             */
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
 
     size_t MBEDTLS_PRIVATE(in_hslen);            /*!< current handshake message length,
@@ -1725,6 +1882,14 @@ struct mbedtls_ssl_context
 
     unsigned char MBEDTLS_PRIVATE(cur_out_ctr)[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN]; /*!<  Outgoing record sequence  number. */
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+    int MBEDTLS_PRIVATE(parked);                 /*!< record buffers released  */
+    unsigned char MBEDTLS_PRIVATE(parked_in_ctr)[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN];
+                                                 /*!< incoming record counter
+                                                      while parked (in_ctr
+                                                      points here)     */
+#endif /* MBEDTLS_SSL_CONTEXT_PARKING */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     uint16_t MBEDTLS_PRIVATE(mtu);               /*!< path mtu, used to fragment outgoing messages */
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
@@ -1936,6 +2101,74 @@ void mbedtls_ssl_conf_authmode( mbedtls_ssl_config *conf, int authmode );
 */
 void mbedtls_ssl_tls13_conf_early_data( mbedtls_ssl_config *conf,
                                         int early_data_enabled );
+
+#if defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief    Set the maximum amount of 0-RTT data the server accepts
+ *           (server only).
+ *           Default: #MBEDTLS_SSL_MAX_EARLY_DATA_SIZE
+ *
+ * \note     This value is advertised in the NewSessionTicket messages
+ *           and stored in the tickets. Early data is only accepted with
+ *           a ticket that has a non-zero value. The same limit applies to
+ *           the early data skipped by the server when it rejects it.
+ *
+ * \param conf                The SSL configuration to use.
+ * \param max_early_data_size The maximum number of bytes of early data.
+ *                            A value of 0 means that tickets do not allow
+ *                            early data.
+ *
+ * \warning This interface is experimental and may change without notice.
+ */
+void mbedtls_ssl_tls13_conf_max_early_data_size( mbedtls_ssl_config *conf,
+                                                 uint32_t max_early_data_size );
+
+/**
+ * \brief           Callback type: check a 0-RTT ClientHello for replay
+ *
+ * \note            This callback is called when a ClientHello offering
+ *                  early data resumes a valid ticket. It can implement a
+ *                  single-use ticket store (RFC 8446 section 8.1) keyed on
+ *                  \p identity, or record ClientHellos (section 8.2) keyed
+ *                  on \p binder, which is unique per ClientHello.
+ *
+ * \note            Only early data is rejected if the callback fails: the
+ *                  handshake continues as a 1-RTT resumption.
+ *
+ * \param p_replay  Context for the callback
+ * \param identity  The PSK identity of the ClientHello, i.e. the ticket.
+ * \param identity_len Length of \p identity in bytes.
+ * \param binder    The verified PSK binder of the ClientHello.
+ * \param binder_len Length of \p binder in bytes.
+ *
+ * \return          0 if the ClientHello was not seen before and early data
+ *                  may be accepted, or a non-zero value otherwise.
+ */
+typedef int mbedtls_ssl_early_data_replay_t( void *p_replay,
+                                             const unsigned char *identity,
+                                             size_t identity_len,
+                                             const unsigned char *binder,
+                                             size_t binder_len );
+
+/**
+ * \brief    Set the anti-replay callback for early data (server only).
+ *           Default: none.
+ *
+ * \note     Without a callback, early data is accepted from any valid
+ *           ticket and may be replayed by an attacker until the ticket
+ *           age check fails. mbedtls_ssl_replay_check() from
+ *           ssl_replay.h implements this callback.
+ *
+ * \param conf      The SSL configuration to use.
+ * \param f_replay  The anti-replay callback, or \c NULL.
+ * \param p_replay  Context for the callback.
+ *
+ * \warning This interface is experimental and may change without notice.
+ */
+void mbedtls_ssl_tls13_conf_early_data_replay( mbedtls_ssl_config *conf,
+                                               mbedtls_ssl_early_data_replay_t *f_replay,
+                                               void *p_replay );
+#endif /* MBEDTLS_SSL_SRV_C */
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_EARLY_DATA */
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
@@ -2440,6 +2673,38 @@ typedef int mbedtls_ssl_ticket_parse_t( void *p_ticket,
                                         unsigned char *buf,
                                         size_t len );
 
+/**
+ * \brief           Callback type: generate and write several session tickets
+ *
+ * \note            This describes what a callback implementation should do.
+ *                  This callback should do the same as
+ *                  mbedtls_ssl_ticket_write_t for each of the sessions in
+ *                  turn, writing the tickets one after the other, and stop
+ *                  at the first ticket that does not fit in the output
+ *                  buffer. It lets the implementation share work between
+ *                  the tickets, such as key lookup and locking.
+ *
+ * \param p_ticket  Context for the callback
+ * \param sessions  SSL sessions to be written in the tickets
+ * \param count     Number of sessions, at least 1
+ * \param start     Start of the output buffer
+ * \param end       End of the output buffer
+ * \param tlens     Array of \p count elements. On exit, the length of
+ *                  each ticket written.
+ * \param lifetime  On exit, holds the lifetime of the tickets in seconds
+ *
+ * \return          The number of tickets written, between 1 and \p count,
+ *                  MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if no ticket fits, or
+ *                  another negative MBEDTLS_ERR_XXX code.
+ */
+typedef int mbedtls_ssl_ticket_write_batch_t( void *p_ticket,
+                                              const mbedtls_ssl_session *sessions,
+                                              size_t count,
+                                              unsigned char *start,
+                                              const unsigned char *end,
+                                              size_t *tlens,
+                                              uint32_t *lifetime );
+
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_SRV_C)
 /**
  * \brief           Configure SSL session ticket callbacks (server only).
@@ -2459,6 +2724,22 @@ void mbedtls_ssl_conf_session_tickets_cb( mbedtls_ssl_config *conf,
         mbedtls_ssl_ticket_write_t *f_ticket_write,
         mbedtls_ssl_ticket_parse_t *f_ticket_parse,
         void *p_ticket );
+
+/**
+ * \brief           Configure a callback writing several session tickets at
+ *                  once (server only, TLS 1.3 only). (Default: none.)
+ *
+ * \note            When set, the server generates all the NewSessionTicket
+ *                  messages of a connection with this callback rather than
+ *                  calling the \c f_ticket_write callback for each one. It
+ *                  uses the context set with
+ *                  mbedtls_ssl_conf_session_tickets_cb().
+ *
+ * \param conf      SSL configuration context
+ * \param f_ticket_write_batch Callback for writing tickets, or \c NULL
+ */
+void mbedtls_ssl_conf_session_tickets_batch_cb( mbedtls_ssl_config *conf,
+        mbedtls_ssl_ticket_write_batch_t *f_ticket_write_batch );
 #endif /* MBEDTLS_SSL_SESSION_TICKETS && MBEDTLS_SSL_SRV_C */
 
 /**
@@ -2673,6 +2954,33 @@ void *mbedtls_ssl_conf_get_async_config_data( const mbedtls_ssl_config *conf );
  */
 void *mbedtls_ssl_get_async_operation_data( const mbedtls_ssl_context *ssl );
 
+/**
+ * \brief           Retrieve the TLS 1.3 signature algorithm of the pending
+ *                  asynchronous signature operation.
+ *
+ *                  This is meant to be called from the sign callback
+ *                  (see ::mbedtls_ssl_async_sign_t) and the resume callback
+ *                  to find out which signature scheme the peer expects.
+ *                  For RSA keys, the RSASSA-PSS schemes
+ *                  #MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA256 and friends
+ *                  require a signature made with mbedtls_pk_sign_ext() and
+ *                  #MBEDTLS_PK_RSASSA_PSS.
+ *
+ * \note            This function may only be called while a handshake
+ *                  is in progress.
+ *
+ * \param ssl       The SSL context to access.
+ *
+ * \return          The TLS 1.3 SignatureScheme of the CertificateVerify
+ *                  signature being computed, for example
+ *                  #MBEDTLS_TLS1_3_SIG_ECDSA_SECP256R1_SHA256.
+ * \return          #MBEDTLS_TLS1_3_SIG_NONE if no TLS 1.3 signature
+ *                  operation is pending, in particular in TLS 1.2 where
+ *                  the signature algorithm follows from \p md_alg and the
+ *                  key type.
+ */
+uint16_t mbedtls_ssl_get_async_sig_alg( const mbedtls_ssl_context *ssl );
+
 /**
  * \brief           Retrieve the asynchronous operation user context.
  *
@@ -2799,6 +3107,27 @@ int mbedtls_ssl_set_client_transport_id( mbedtls_ssl_context *ssl,
  *                 transmission strategy, then you'll want to disable this.
  */
 void mbedtls_ssl_conf_dtls_anti_replay( mbedtls_ssl_config *conf, char mode );
+
+/**
+ * \brief          Set the size of the DTLS anti-replay window, that is how
+ *                 far behind the highest record number seen so far a record
+ *                 may arrive and still be accepted (if not seen before).
+ *                 (DTLS only, no effect on TLS.)
+ *                 Default: 64.
+ *
+ * \param conf     SSL configuration
+ * \param window   Window size in records, between 1 and
+ *                 MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX.
+ *
+ * \note           RFC 6347 requires a window of at least 32 records, and
+ *                 recommends 64. Larger windows help when many records are
+ *                 reordered in flight, for example on multipath links.
+ *
+ * \return         0 on success, or #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if
+ *                 \p window is out of range.
+ */
+int mbedtls_ssl_conf_dtls_anti_replay_window( mbedtls_ssl_config *conf,
+                                              size_t window );
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
 
 /**
@@ -3017,6 +3346,11 @@ int mbedtls_ssl_set_session( mbedtls_ssl_context *ssl, const mbedtls_ssl_session
  *                 Mbed TLS.
  * \return         Another negative value for other kinds of errors (for
  *                 example, unsupported features in the embedded certificate).
+ *
+ * \note           If #MBEDTLS_SSL_SESSION_LAZY_PEER_CERT is enabled, the
+ *                 embedded certificate is only parsed by
+ *                 mbedtls_ssl_load_peer_cert(), so errors in it are not
+ *                 reported by this function.
  */
 int mbedtls_ssl_session_load( mbedtls_ssl_session *session,
                               const unsigned char *buf,
@@ -3083,6 +3417,9 @@ int mbedtls_ssl_session_save( const mbedtls_ssl_session *session,
  *                      the client's preferred ciphersuite among those that
  *                      the server supports.
  *
+ * \note                This function discards any lookup table previously
+ *                      built by mbedtls_ssl_conf_precompute().
+ *
  * \warning             The ciphersuites array \p ciphersuites is not copied.
  *                      It must remain valid for the lifetime of the SSL
  *                      configuration \p conf.
@@ -3096,6 +3433,46 @@ int mbedtls_ssl_session_save( const mbedtls_ssl_session *session,
 void mbedtls_ssl_conf_ciphersuites( mbedtls_ssl_config *conf,
                                     const int *ciphersuites );
 
+/**
+ * \brief               Precompute lookup tables for the negotiation
+ *                      parameters of an SSL configuration.
+ *
+ *                      Without these tables, each ClientHello (or
+ *                      ServerHello) is matched against the configured
+ *                      ciphersuites by walking the configured list for
+ *                      every ciphersuite offered by the peer. Once the
+ *                      tables are built, each offered ciphersuite is looked
+ *                      up in logarithmic time, so the cost of ciphersuite
+ *                      selection is linear in the length of the peer's list.
+ *
+ *                      Call this function once the configuration is complete,
+ *                      before it is shared between SSL contexts. The tables
+ *                      are only read during handshakes, so a configuration
+ *                      with precomputed tables can be used concurrently by
+ *                      several contexts.
+ *
+ * \note                The tables reflect the configuration at the time of the
+ *                      call. Setting a new ciphersuite list with
+ *                      mbedtls_ssl_conf_ciphersuites() discards them; call
+ *                      this function again afterwards to rebuild them.
+ *                      The ciphersuite list itself must not be modified in
+ *                      place while the tables exist.
+ *
+ * \note                Identifiers of ciphersuites that are not supported by
+ *                      this build are ignored, as are repeated identifiers
+ *                      (the first occurrence determines the preference).
+ *
+ * \param conf          The SSL configuration to prepare.
+ *
+ * \return              \c 0 on success.
+ * \return              #MBEDTLS_ERR_SSL_ALLOC_FAILED on memory allocation
+ *                      failure. The configuration remains usable without
+ *                      the tables in this case.
+ * \return              #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the ciphersuite list
+ *                      has more than 256 entries.
+ */
+int mbedtls_ssl_conf_precompute( mbedtls_ssl_config *conf );
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
 /**
  * \brief Set the supported key exchange modes for TLS 1.3 connections.
@@ -3631,6 +4008,103 @@ void MBEDTLS_DEPRECATED mbedtls_ssl_conf_curves( mbedtls_ssl_config *conf,
 void mbedtls_ssl_conf_groups( mbedtls_ssl_config *conf,
                               const uint16_t *groups );
 
+#if ( defined(MBEDTLS_USE_PSA_CRYPTO) || defined(MBEDTLS_SSL_PROTO_TLS1_3) ) && \
+    defined(MBEDTLS_ECDH_C)
+/**
+ * \brief           Callback type: take a pre-generated ECDHE key pair
+ *
+ * \note            The callback hands over the ownership of \p key: the
+ *                  handshake uses it for a single key agreement and then
+ *                  destroys it. It must never return the same key twice.
+ *
+ * \param p_pool    Context for the callback
+ * \param named_group The IANA NamedGroup the key pair must belong to.
+ * \param key       On success, the PSA key holding the private key. It
+ *                  must allow #PSA_ALG_ECDH with #PSA_KEY_USAGE_DERIVE.
+ * \param pub       Buffer receiving the public key, in the format of
+ *                  psa_export_public_key().
+ * \param pub_size  Size of \p pub in bytes.
+ * \param pub_len   On success, the length of the public key in bytes.
+ *
+ * \return          0 if a key pair was returned, or a non-zero value if
+ *                  none is available, in which case the handshake
+ *                  generates the key pair itself.
+ */
+typedef int mbedtls_ssl_key_share_pop_t( void *p_pool,
+                                         uint16_t named_group,
+                                         mbedtls_svc_key_id_t *key,
+                                         unsigned char *pub,
+                                         size_t pub_size,
+                                         size_t *pub_len );
+
+/**
+ * \brief    Set a source of pre-generated ECDHE key pairs. Default: none.
+ *
+ * \note     The TLS 1.3 key share and the TLS 1.2 ServerKeyExchange take
+ *           their ephemeral key pair from this callback when it has one,
+ *           which removes a key generation from the handshake latency.
+ *           mbedtls_ssl_key_pool_pop() from ssl_key_pool.h implements it.
+ *
+ * \param conf      SSL configuration
+ * \param f_pop     The key share callback, or \c NULL.
+ * \param p_pool    Context for the callback.
+ */
+void mbedtls_ssl_conf_key_share_pool( mbedtls_ssl_config *conf,
+                                      mbedtls_ssl_key_share_pop_t *f_pop,
+                                      void *p_pool );
+#endif /* ( MBEDTLS_USE_PSA_CRYPTO || MBEDTLS_SSL_PROTO_TLS1_3 ) && MBEDTLS_ECDH_C */
+
+/**
+ * \brief           Callback type: take a record buffer
+ *
+ * \param p_pool    Context for the callback
+ * \param len       Size of the buffer in bytes
+ *
+ * \return          A buffer of at least \p len bytes, all set to zero,
+ *                  or \c NULL if no memory is available.
+ */
+typedef unsigned char *mbedtls_ssl_buffer_get_t( void *p_pool, size_t len );
+
+/**
+ * \brief           Callback type: give a record buffer back
+ *
+ * \param p_pool    Context for the callback
+ * \param buf       A buffer returned by the matching
+ *                  mbedtls_ssl_buffer_get_t callback. Its first \p len
+ *                  bytes have been set to zero.
+ * \param len       The length that \p buf was requested with
+ */
+typedef void mbedtls_ssl_buffer_put_t( void *p_pool,
+                                       unsigned char *buf,
+                                       size_t len );
+
+/**
+ * \brief    Set the allocator of the record buffers of the SSL contexts
+ *           using this configuration. Default: mbedtls_calloc() and
+ *           mbedtls_free().
+ *
+ * \note     mbedtls_ssl_setup() takes an input and an output buffer of
+ *           about 16 KiB each, mbedtls_ssl_free() gives them back, and so
+ *           do mbedtls_ssl_park() and mbedtls_ssl_unpark() when
+ *           MBEDTLS_SSL_CONTEXT_PARKING is enabled. A pool shared by all
+ *           contexts avoids a large allocation per connection.
+ *           mbedtls_ssl_buffer_pool_get() and mbedtls_ssl_buffer_pool_put()
+ *           from ssl_buffer_pool.h implement these callbacks.
+ *
+ * \warning  The callbacks must not change while contexts set up with this
+ *           configuration hold buffers.
+ *
+ * \param conf      SSL configuration
+ * \param f_get     The callback taking a buffer, or \c NULL for the default.
+ * \param f_put     The callback giving a buffer back, or \c NULL for the
+ *                  default. It must be set if and only if \p f_get is.
+ * \param p_pool    Context for the callbacks.
+ */
+void mbedtls_ssl_conf_buffer_pool( mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_buffer_get_t *f_get,
+                                   mbedtls_ssl_buffer_put_t *f_put,
+                                   void *p_pool );
+
 #if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
 #if !defined(MBEDTLS_DEPRECATED_REMOVED) && defined(MBEDTLS_SSL_PROTO_TLS1_2)
 /**
@@ -4190,6 +4664,33 @@ void mbedtls_ssl_conf_session_tickets( mbedtls_ssl_config *conf, int use_tickets
  */
 void mbedtls_ssl_conf_new_session_tickets( mbedtls_ssl_config *conf,
                                            uint16_t num_tickets );
+
+/**
+ * \brief   Choose when the server sends its NewSessionTicket messages.
+ *          (Default: MBEDTLS_SSL_NEW_SESSION_TICKETS_IMMEDIATE.)
+ *
+ * \note    With MBEDTLS_SSL_NEW_SESSION_TICKETS_IMMEDIATE, the tickets are
+ *          sent by mbedtls_ssl_handshake() after the handshake completes.
+ *          With MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED,
+ *          mbedtls_ssl_handshake() returns as soon as the handshake
+ *          completes and the tickets are sent by the first call to
+ *          mbedtls_ssl_write(), ahead of the application data, so that
+ *          they do not delay the handshake. No ticket is sent if the
+ *          connection is closed before that.
+ *
+ * \note    With MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED, the handshake
+ *          parameters of the connection stay allocated until the tickets
+ *          are sent, that is until the first call to mbedtls_ssl_write(),
+ *          or for the lifetime of the connection if the server never
+ *          writes. In the meantime, the context cannot be parked with
+ *          mbedtls_ssl_park().
+ *
+ * \param conf    SSL configuration
+ * \param mode    MBEDTLS_SSL_NEW_SESSION_TICKETS_IMMEDIATE or
+ *                MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED
+ */
+void mbedtls_ssl_conf_new_session_tickets_mode( mbedtls_ssl_config *conf,
+                                                int mode );
 #endif /* MBEDTLS_SSL_SESSION_TICKETS &&
           MBEDTLS_SSL_SRV_C &&
           MBEDTLS_SSL_PROTO_TLS1_3*/
@@ -4500,6 +5001,9 @@ int mbedtls_ssl_get_max_in_record_payload( const mbedtls_ssl_context *ssl );
  *                 (PSK-based ciphersuites, for example), or because
  *                 #MBEDTLS_SSL_KEEP_PEER_CERTIFICATE has been disabled,
  *                 allowing the stack to free the peer's CRT to save memory.
+ *                 With #MBEDTLS_SSL_SESSION_LAZY_PEER_CERT, it is also
+ *                 \c NULL for a resumed session until
+ *                 mbedtls_ssl_load_peer_cert() has been called.
  *
  * \note           For one-time inspection of the peer's certificate during
  *                 the handshake, consider registering an X.509 CRT verification
@@ -4518,6 +5022,26 @@ int mbedtls_ssl_get_max_in_record_payload( const mbedtls_ssl_context *ssl );
  *                 you must make a copy.
  */
 const mbedtls_x509_crt *mbedtls_ssl_get_peer_cert( const mbedtls_ssl_context *ssl );
+
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+/**
+ * \brief          Parse the peer certificate of a resumed session, which
+ *                 mbedtls_ssl_session_load() kept in DER form, so that
+ *                 mbedtls_ssl_get_peer_cert() returns it.
+ *
+ * \note           This modifies the session of \p ssl. Like the other
+ *                 functions taking a non-const SSL context, it must not be
+ *                 called while another thread uses \p ssl.
+ *
+ * \param  ssl     The SSL context to use. This must be initialized and setup.
+ *
+ * \return         \c 0 if successful, including when the certificate is
+ *                 already parsed or there is no peer certificate.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if memory allocation failed.
+ * \return         An X.509 error code if the certificate cannot be parsed.
+ */
+int mbedtls_ssl_load_peer_cert( mbedtls_ssl_context *ssl );
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_CLI_C)
@@ -4722,6 +5246,11 @@ int mbedtls_ssl_renegotiate( mbedtls_ssl_context *ssl );
  * \return         #MBEDTLS_ERR_SSL_CLIENT_RECONNECT if we're at the server
  *                 side of a DTLS connection and the client is initiating a
  *                 new connection using the same source port. See below.
+ * \return         #MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA if we're at the
+ *                 server side of a TLS 1.3 connection and early data has
+ *                 been received - in this case read it with
+ *                 mbedtls_ssl_read_early_data() and call this function
+ *                 again.
  * \return         Another SSL error code - in this case you must stop using
  *                 the context (see below).
  *
@@ -4768,6 +5297,52 @@ int mbedtls_ssl_renegotiate( mbedtls_ssl_context *ssl );
  */
 int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len );
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief          Read at most 'len' bytes of early data (server only)
+ *
+ * \note           This function may only be called after
+ *                 mbedtls_ssl_handshake(), mbedtls_ssl_handshake_step() or
+ *                 mbedtls_ssl_read() returned
+ *                 #MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA. It returns data of
+ *                 the current early data record only. Once the record has
+ *                 been read entirely, continue the handshake: it either
+ *                 returns #MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA again for the
+ *                 next record or proceeds with the client Finished message.
+ *                 If the record is not read entirely, continuing the
+ *                 handshake returns #MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA for
+ *                 the rest of it.
+ *
+ * \warning        Early data is not protected against replay by the
+ *                 protocol itself, and the client is not authenticated yet
+ *                 when it is received. See
+ *                 mbedtls_ssl_tls13_conf_early_data_replay().
+ *
+ * \param ssl      SSL context
+ * \param buf      buffer that will hold the data
+ * \param len      maximum number of bytes to read
+ *
+ * \return         The (positive) number of bytes read if successful.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if no early data is
+ *                 available.
+ */
+int mbedtls_ssl_read_early_data( mbedtls_ssl_context *ssl,
+                                 unsigned char *buf, size_t len );
+
+/**
+ * \brief          Get the status of the early data offered by the client
+ *                 (server only)
+ *
+ * \param ssl      SSL context. The ServerHello must have been sent.
+ *
+ * \return         #MBEDTLS_SSL_EARLY_DATA_STATUS_NOT_SENT if the client did
+ *                 not offer early data,
+ *                 #MBEDTLS_SSL_EARLY_DATA_STATUS_ACCEPTED if it is accepted,
+ *                 #MBEDTLS_SSL_EARLY_DATA_STATUS_REJECTED if it is rejected.
+ */
+int mbedtls_ssl_get_early_data_status( const mbedtls_ssl_context *ssl );
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
 /**
  * \brief          Try to write exactly 'len' application data bytes
  *
@@ -4864,6 +5439,76 @@ int mbedtls_ssl_send_alert_message( mbedtls_ssl_context *ssl,
  */
 int mbedtls_ssl_close_notify( mbedtls_ssl_context *ssl );
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+/**
+ * \brief          Release the record buffers of an idle connection.
+ *
+ *                 A parked context keeps its session and transform, but
+ *                 not its input and output buffers, which account for most
+ *                 of the memory used by an established connection. The
+ *                 buffers are allocated again by the next call to
+ *                 mbedtls_ssl_read(), mbedtls_ssl_write(),
+ *                 mbedtls_ssl_send_alert_message(),
+ *                 mbedtls_ssl_close_notify(), mbedtls_ssl_renegotiate() or
+ *                 mbedtls_ssl_session_reset(), or by mbedtls_ssl_unpark().
+ *
+ *                 A typical event-driven server parks a connection when
+ *                 mbedtls_ssl_read() returns #MBEDTLS_ERR_SSL_WANT_READ, and
+ *                 calls mbedtls_ssl_read() again when the socket becomes
+ *                 readable.
+ *
+ * \note           Parking requires the handshake to be completed and no
+ *                 incoming data to be pending, see
+ *                 mbedtls_ssl_check_pending(). With DTLS, the handshake
+ *                 is only completed once the first record of the peer
+ *                 protected with the new keys has been received. With
+ *                 TLS 1.3, a server context can be parked once its
+ *                 NewSessionTicket messages have been sent, and a client
+ *                 context cannot be parked, since it keeps the handshake
+ *                 state to receive NewSessionTicket messages.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         0 if successful or if the context is already parked.
+ * \return         #MBEDTLS_ERR_SSL_WANT_WRITE if pending outgoing data
+ *                 could not be sent yet. Call this function again later.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a handshake is in
+ *                 progress or incoming data is pending. The context is
+ *                 left unchanged in this case.
+ * \return         Another negative error code if flushing the output
+ *                 failed.
+ */
+int mbedtls_ssl_park( mbedtls_ssl_context *ssl );
+
+/**
+ * \brief          Allocate the record buffers of a parked context again.
+ *
+ * \note           The functions that need the buffers call this function
+ *                 themselves. Calling it explicitly is only useful to
+ *                 handle an allocation failure separately.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         0 if successful or if the context is not parked.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if the buffers could not be
+ *                 allocated. The context stays parked in this case.
+ */
+int mbedtls_ssl_unpark( mbedtls_ssl_context *ssl );
+
+/**
+ * \brief          Check whether an SSL context is parked.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         1 if the record buffers of \p ssl are released,
+ *                 0 otherwise.
+ */
+static inline int mbedtls_ssl_is_parked( const mbedtls_ssl_context *ssl )
+{
+    return( ssl->MBEDTLS_PRIVATE(parked) );
+}
+#endif /* MBEDTLS_SSL_CONTEXT_PARKING */
+
 /**
  * \brief          Free referenced items in an SSL context and clear memory
  *
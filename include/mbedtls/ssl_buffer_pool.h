@@ -0,0 +1,206 @@
+/**
+ * \file ssl_buffer_pool.h
+ *
+ * \brief Pool of record buffers shared by SSL contexts
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#ifndef MBEDTLS_SSL_BUFFER_POOL_H
+#define MBEDTLS_SSL_BUFFER_POOL_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE)
+#define MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE        4   /*!< Free buffers kept per thread */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Usage statistics of a buffer pool, to size it
+ */
+typedef struct mbedtls_ssl_buffer_pool_stats
+{
+    size_t buf_len;     /*!< Size of the pooled buffers in bytes            */
+    size_t allocated;   /*!< Pooled buffers currently allocated, in use or
+                             free                                           */
+    size_t peak;        /*!< Highest value of \c allocated                  */
+    size_t free;        /*!< Buffers on the shared free list                */
+    size_t misses;      /*!< Buffers allocated because none was free        */
+    size_t oversized;   /*!< Requests larger than \c buf_len, which were
+                             served by the heap                             */
+}
+mbedtls_ssl_buffer_pool_stats;
+
+#if defined(MBEDTLS_THREADING_PTHREAD) && MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE > 0
+/**
+ * \brief   Free buffers kept by one thread
+ */
+typedef struct mbedtls_ssl_buffer_pool_cache
+{
+    struct mbedtls_ssl_buffer_pool *MBEDTLS_PRIVATE(pool);
+    struct mbedtls_ssl_buffer_pool_cache *MBEDTLS_PRIVATE(next);
+    unsigned char *MBEDTLS_PRIVATE(head);       /*!< free list            */
+    size_t MBEDTLS_PRIVATE(count);              /*!< buffers on the list  */
+}
+mbedtls_ssl_buffer_pool_cache;
+#endif
+
+/**
+ * \brief   Record buffer pool context
+ *
+ * The pool hands out buffers of a single size, large enough for the input
+ * and output buffers of an SSL context by default. Buffers given back are
+ * kept on free lists instead of being released to the heap: first in a
+ * small list of the calling thread, which needs no lock, then in a list
+ * shared by all threads.
+ */
+typedef struct mbedtls_ssl_buffer_pool
+{
+    size_t MBEDTLS_PRIVATE(buf_len);            /*!< size of the buffers  */
+    size_t MBEDTLS_PRIVATE(max_free);           /*!< shared list limit    */
+    unsigned char *MBEDTLS_PRIVATE(head);       /*!< shared free list     */
+    size_t MBEDTLS_PRIVATE(nfree);              /*!< buffers on the list  */
+    size_t MBEDTLS_PRIVATE(allocated);
+    size_t MBEDTLS_PRIVATE(peak);
+    size_t MBEDTLS_PRIVATE(misses);
+    size_t MBEDTLS_PRIVATE(oversized);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+#endif
+#if defined(MBEDTLS_THREADING_PTHREAD) && MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE > 0
+    pthread_key_t MBEDTLS_PRIVATE(thread_key);
+    int MBEDTLS_PRIVATE(thread_key_created);
+    mbedtls_ssl_buffer_pool_cache *MBEDTLS_PRIVATE(caches);
+#endif
+}
+mbedtls_ssl_buffer_pool;
+
+/**
+ * \brief          Initialize a buffer pool
+ *
+ * \param pool     Pool to be initialized
+ */
+void mbedtls_ssl_buffer_pool_init( mbedtls_ssl_buffer_pool *pool );
+
+/**
+ * \brief          Set up a buffer pool
+ *
+ * \param pool     Pool to be set up
+ * \param buf_len  Size of the pooled buffers in bytes, or 0 for the size of
+ *                 the input and output buffers of an SSL context. Larger
+ *                 requests are served by the heap.
+ * \param max_free Maximum number of buffers kept on the shared free list,
+ *                 or 0 for no limit. Each thread also keeps up to
+ *                 MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE buffers when
+ *                 MBEDTLS_THREADING_PTHREAD is enabled.
+ *
+ * \return         0 if successful,
+ *                 #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p buf_len is too small
+ *                 for a buffer,
+ *                 #MBEDTLS_ERR_SSL_ALLOC_FAILED if the thread-specific data
+ *                 key could not be created.
+ */
+int mbedtls_ssl_buffer_pool_setup( mbedtls_ssl_buffer_pool *pool,
+                                   size_t buf_len,
+                                   size_t max_free );
+
+/**
+ * \brief          Allocate buffers ahead of the connections
+ *
+ * \param pool     Pool to fill
+ * \param count    Number of buffers to put on the shared free list. It is
+ *                 capped by the \c max_free limit of the pool.
+ *
+ * \return         0 if successful,
+ *                 #MBEDTLS_ERR_SSL_ALLOC_FAILED if the allocation failed.
+ */
+int mbedtls_ssl_buffer_pool_reserve( mbedtls_ssl_buffer_pool *pool,
+                                     size_t count );
+
+/**
+ * \brief          Take a buffer from the pool
+ *                 (Implementation of mbedtls_ssl_buffer_get_t)
+ *
+ * \param p_pool   Pool (mbedtls_ssl_buffer_pool *)
+ * \param len      Size of the buffer in bytes
+ *
+ * \return         A buffer of at least \p len bytes set to zero, or \c NULL
+ *                 if no memory is available.
+ */
+unsigned char *mbedtls_ssl_buffer_pool_get( void *p_pool, size_t len );
+
+/**
+ * \brief          Give a buffer back to the pool
+ *                 (Implementation of mbedtls_ssl_buffer_put_t)
+ *
+ * \param p_pool   Pool (mbedtls_ssl_buffer_pool *)
+ * \param buf      Buffer returned by mbedtls_ssl_buffer_pool_get(), with
+ *                 its first \p len bytes set to zero
+ * \param len      The length the buffer was requested with
+ */
+void mbedtls_ssl_buffer_pool_put( void *p_pool, unsigned char *buf, size_t len );
+
+/**
+ * \brief          Get the usage statistics of a buffer pool
+ *
+ * \note           Buffers held by the per-thread lists are counted in
+ *                 \c allocated but not in \c free.
+ *
+ * \param pool     Pool to query
+ * \param stats    Statistics of \p pool
+ *
+ * \return         0 if successful, or a threading error code.
+ */
+int mbedtls_ssl_buffer_pool_get_stats( mbedtls_ssl_buffer_pool *pool,
+                                       mbedtls_ssl_buffer_pool_stats *stats );
+
+/**
+ * \brief          Free a buffer pool and the free buffers it holds
+ *
+ * \note           The SSL contexts using the pool must be freed first, and
+ *                 no other thread may use the pool during this call.
+ *
+ * \param pool     Pool to be cleared
+ */
+void mbedtls_ssl_buffer_pool_free( mbedtls_ssl_buffer_pool *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_buffer_pool.h */
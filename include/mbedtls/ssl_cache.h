@@ -47,6 +47,10 @@
 #define MBEDTLS_SSL_CACHE_DEFAULT_MAX_ENTRIES      50   /*!< Maximum entries in cache */
 #endif
 
+#if !defined(MBEDTLS_SSL_CACHE_SHARED_WAYS)
+#define MBEDTLS_SSL_CACHE_SHARED_WAYS               4   /*!< Entries per bucket of a shared cache */
+#endif
+
 /** \} name SECTION: Module settings */
 
 #ifdef __cplusplus
@@ -154,6 +158,128 @@ void mbedtls_ssl_cache_set_max_entries( mbedtls_ssl_cache_context *cache, int ma
  */
 void mbedtls_ssl_cache_free( mbedtls_ssl_cache_context *cache );
 
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+/**
+ * \brief Shared cache context
+ *
+ *        The cache entries live in a shared memory mapping created by
+ *        mbedtls_ssl_cache_shared_setup(). Processes forked after the setup
+ *        share the entries, so a session stored by one worker of a pre-fork
+ *        server can be resumed by any other worker.
+ */
+typedef struct mbedtls_ssl_cache_shared_context
+{
+    void *MBEDTLS_PRIVATE(shm);                 /*!< shared mapping         */
+    size_t MBEDTLS_PRIVATE(shm_len);            /*!< size of the mapping    */
+}
+mbedtls_ssl_cache_shared_context;
+
+/**
+ * \brief          Initialize a shared SSL cache context
+ *
+ * \param cache    Shared SSL cache context
+ */
+void mbedtls_ssl_cache_shared_init( mbedtls_ssl_cache_shared_context *cache );
+
+/**
+ * \brief          Create the shared memory holding the cache entries.
+ *
+ *                 The entries are stored in fixed-size slots grouped into
+ *                 buckets of #MBEDTLS_SSL_CACHE_SHARED_WAYS entries, each
+ *                 bucket having its own process-shared lock. When a bucket
+ *                 is full, its oldest entry is evicted.
+ *
+ * \note           Call this before forking the processes that are to share
+ *                 the cache. Each of them then uses its copy of \p cache.
+ *
+ * \param cache    Shared SSL cache context, initialized with
+ *                 mbedtls_ssl_cache_shared_init().
+ * \param max_entries      Number of entries, rounded up to a multiple of
+ *                         #MBEDTLS_SSL_CACHE_SHARED_WAYS.
+ * \param max_session_len  Maximum size of a serialized session, see
+ *                         mbedtls_ssl_session_save(). Larger sessions are
+ *                         not cached.
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a parameter is invalid.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if the shared memory could
+ *                 not be created.
+ */
+int mbedtls_ssl_cache_shared_setup( mbedtls_ssl_cache_shared_context *cache,
+                                    size_t max_entries,
+                                    size_t max_session_len );
+
+/**
+ * \brief          Shared cache get callback implementation
+ *                 (Thread-safe and safe across processes)
+ *
+ * \param data            The shared SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        for the session to load.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The address at which to store the session
+ *                        associated with \p session_id, if present.
+ */
+int mbedtls_ssl_cache_shared_get( void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  mbedtls_ssl_session *session );
+
+/**
+ * \brief          Shared cache set callback implementation
+ *                 (Thread-safe and safe across processes)
+ *
+ * \param data            The shared SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        associated to \p session.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The session to store.
+ */
+int mbedtls_ssl_cache_shared_set( void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  const mbedtls_ssl_session *session );
+
+/**
+ * \brief          Remove the entry with the given session ID, if any.
+ *                 (Thread-safe and safe across processes)
+ *
+ * \param data            The shared SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        of the entry to remove.
+ * \param session_id_len  The length of \p session_id in bytes.
+ *
+ * \return         \c 0 if an entry was removed, \c 1 if there was none.
+ */
+int mbedtls_ssl_cache_shared_remove( void *data,
+                                     unsigned char const *session_id,
+                                     size_t session_id_len );
+
+#if defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Set the cache timeout for all processes sharing the cache
+ *                 (Default: MBEDTLS_SSL_CACHE_DEFAULT_TIMEOUT (1 day))
+ *
+ *                 A timeout of 0 indicates no timeout.
+ *
+ * \param cache    Shared SSL cache context
+ * \param timeout  cache entry timeout in seconds
+ */
+void mbedtls_ssl_cache_shared_set_timeout( mbedtls_ssl_cache_shared_context *cache,
+                                           int timeout );
+#endif /* MBEDTLS_HAVE_TIME */
+
+/**
+ * \brief          Unmap the shared memory from this process.
+ *
+ *                 The entries remain available to the other processes
+ *                 sharing the cache until they call this function too.
+ *
+ * \param cache    Shared SSL cache context
+ */
+void mbedtls_ssl_cache_shared_free( mbedtls_ssl_cache_shared_context *cache );
+#endif /* MBEDTLS_SSL_CACHE_SHARED */
+
 #ifdef __cplusplus
 }
 #endif
@@ -27,11 +27,9 @@
 
 #include "mbedtls/ssl.h"
 
-#if !defined(MBEDTLS_USE_PSA_CRYPTO)
 #if defined(MBEDTLS_THREADING_C)
 #include "mbedtls/threading.h"
 #endif
-#endif /* !MBEDTLS_USE_PSA_CRYPTO */
 
 /**
  * \name SECTION: Module settings
@@ -50,16 +48,27 @@
 extern "C" {
 #endif
 
+/** Number of key slots: the current key, the previous one, and one being
+ *  generated by mbedtls_ssl_cookie_rotate(). */
+#define MBEDTLS_SSL_COOKIE_KEY_SLOTS    3
+
+typedef struct mbedtls_ssl_cookie_key mbedtls_ssl_cookie_key;
+
 /**
  * \brief          Context for the default cookie functions.
+ *
+ * \note           mbedtls_ssl_cookie_write() and mbedtls_ssl_cookie_check()
+ *                 only hold the lock to read the current key slot, and
+ *                 compute the HMAC without it, so they may run concurrently
+ *                 in any number of threads.
  */
 typedef struct mbedtls_ssl_cookie_ctx
 {
+    mbedtls_ssl_cookie_key *MBEDTLS_PRIVATE(keys);  /*!< key slots           */
+    unsigned int    MBEDTLS_PRIVATE(current);       /*!< slot of the key used
+                                                         to write cookies    */
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    mbedtls_svc_key_id_t    MBEDTLS_PRIVATE(psa_hmac_key);  /*!< key id for the HMAC portion   */
-    psa_algorithm_t         MBEDTLS_PRIVATE(psa_hmac_alg);  /*!< key algorithm for the HMAC portion   */
-#else
-    mbedtls_md_context_t    MBEDTLS_PRIVATE(hmac_ctx);   /*!< context for the HMAC portion   */
+    psa_algorithm_t MBEDTLS_PRIVATE(psa_hmac_alg);  /*!< key algorithm for the HMAC portion   */
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 #if !defined(MBEDTLS_HAVE_TIME)
     unsigned long   MBEDTLS_PRIVATE(serial);     /*!< serial number for expiration   */
@@ -67,13 +76,25 @@ typedef struct mbedtls_ssl_cookie_ctx
     unsigned long   MBEDTLS_PRIVATE(timeout);    /*!< timeout delay, in seconds if HAVE_TIME,
                                      or in number of tickets issued */
 
-#if !defined(MBEDTLS_USE_PSA_CRYPTO)
 #if defined(MBEDTLS_THREADING_C)
-    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< protects current
+                                                           and serial       */
 #endif
-#endif /* !MBEDTLS_USE_PSA_CRYPTO */
 } mbedtls_ssl_cookie_ctx;
 
+/**
+ * \brief          One cookie to check with mbedtls_ssl_cookie_check_batch()
+ */
+typedef struct mbedtls_ssl_cookie_query
+{
+    const unsigned char *cookie;    /*!< cookie from the ClientHello        */
+    size_t cookie_len;
+    const unsigned char *cli_id;    /*!< client's transport-level ID        */
+    size_t cli_id_len;
+    int result;                     /*!< output: 0 if the cookie is valid,
+                                         -1 otherwise                       */
+} mbedtls_ssl_cookie_query;
+
 /**
  * \brief          Initialize cookie context
  */
@@ -97,6 +118,30 @@ int mbedtls_ssl_cookie_setup( mbedtls_ssl_cookie_ctx *ctx,
  */
 void mbedtls_ssl_cookie_set_timeout( mbedtls_ssl_cookie_ctx *ctx, unsigned long delay );
 
+/**
+ * \brief          Replace the cookie key with a fresh random key.
+ *
+ *                 Cookies written with the previous key remain valid until
+ *                 the next rotation (and within their expiration delay),
+ *                 so clients in the middle of a handshake are not affected.
+ *                 Call this regularly, for example every few minutes.
+ *
+ * \note           This may run concurrently with cookie checks and writes,
+ *                 as long as two rotations are not closer in time than
+ *                 the duration of a single check or write.
+ *
+ * \param ctx      Cookie context, set up
+ * \param f_rng    RNG function (used when MBEDTLS_USE_PSA_CRYPTO is not
+ *                 enabled)
+ * \param p_rng    RNG context
+ *
+ * \return         0 if successful, or a negative error code. On error,
+ *                 the current key remains in use.
+ */
+int mbedtls_ssl_cookie_rotate( mbedtls_ssl_cookie_ctx *ctx,
+                               int (*f_rng)(void *, unsigned char *, size_t),
+                               void *p_rng );
+
 /**
  * \brief          Free cookie context
  */
@@ -112,6 +157,24 @@ mbedtls_ssl_cookie_write_t mbedtls_ssl_cookie_write;
  */
 mbedtls_ssl_cookie_check_t mbedtls_ssl_cookie_check;
 
+/**
+ * \brief          Verify many cookies in one call, for example those of
+ *                 a batch of ClientHello datagrams.
+ *
+ *                 This reads the clock and the key slots once for the whole
+ *                 batch, and sets the \c result field of every query.
+ *
+ * \param ctx      Cookie context
+ * \param queries  Array of \p count queries
+ * \param count    Number of queries
+ *
+ * \return         The number of valid cookies, or a negative error code
+ *                 if the context or the arguments are invalid.
+ */
+int mbedtls_ssl_cookie_check_batch( mbedtls_ssl_cookie_ctx *ctx,
+                                    mbedtls_ssl_cookie_query *queries,
+                                    size_t count );
+
 #ifdef __cplusplus
 }
 #endif
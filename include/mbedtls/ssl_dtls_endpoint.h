@@ -0,0 +1,252 @@
+/**
+ * \file ssl_dtls_endpoint.h
+ *
+ * \brief DTLS server endpoint: many associations on one datagram socket
+ *
+ * The endpoint receives datagrams in batches from a single transport
+ * (typically one unconnected UDP socket), routes each of them to the
+ * SSL context of its association, by connection ID if the record carries
+ * one and by peer address otherwise, and creates associations for new
+ * clients once they have returned a valid HelloVerifyRequest cookie.
+ * No state is kept for a client before that.
+ *
+ * The application is notified through a single callback when an
+ * association is established, has data to read, or is about to be freed.
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#ifndef MBEDTLS_SSL_DTLS_ENDPOINT_H
+#define MBEDTLS_SSL_DTLS_ENDPOINT_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+#ifndef MBEDTLS_SSL_DTLS_ENDPOINT_BATCH
+#define MBEDTLS_SSL_DTLS_ENDPOINT_BATCH   16 /**< Maximum number of datagrams received or sent per transport call */
+#endif
+
+/** \} name SECTION: Module settings */
+
+/** The handshake of a new association has completed. */
+#define MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_CONNECTED   1
+/** A datagram was delivered to an established association:
+ *  call mbedtls_ssl_read() until it returns #MBEDTLS_ERR_SSL_WANT_READ. */
+#define MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_READABLE    2
+/** The association is about to be freed. The return value is ignored. */
+#define MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_CLOSED      3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Callback type: event on an association
+ *
+ * \param p_ctx    Context set with mbedtls_ssl_dtls_endpoint_set_callback()
+ * \param ssl      SSL context of the association. It remains valid until
+ *                 the #MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_CLOSED event.
+ *                 The application may use mbedtls_ssl_set_user_data_p()
+ *                 on it to attach its own data.
+ * \param event    One of the MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_XXX values
+ *
+ * \return         0 to keep the association, or any other value to close
+ *                 it (with a close_notify alert) and free it.
+ */
+typedef int mbedtls_ssl_dtls_endpoint_cb_t( void *p_ctx,
+                                            mbedtls_ssl_context *ssl,
+                                            int event );
+
+typedef struct mbedtls_ssl_dtls_assoc mbedtls_ssl_dtls_assoc;
+
+/**
+ * \brief          DTLS server endpoint context
+ */
+typedef struct mbedtls_ssl_dtls_endpoint
+{
+    const mbedtls_ssl_config *MBEDTLS_PRIVATE(conf);
+
+    void *MBEDTLS_PRIVATE(p_bio);
+    mbedtls_ssl_send_batch_t *MBEDTLS_PRIVATE(f_send);
+    mbedtls_ssl_recv_batch_t *MBEDTLS_PRIVATE(f_recv);
+
+    mbedtls_ssl_dtls_endpoint_cb_t *MBEDTLS_PRIVATE(f_event);
+    void *MBEDTLS_PRIVATE(p_event);
+
+    uint16_t MBEDTLS_PRIVATE(mtu);          /*!< max size of sent datagrams */
+    size_t MBEDTLS_PRIVATE(max_assocs);     /*!< max number of associations */
+    size_t MBEDTLS_PRIVATE(count);          /*!< current associations       */
+    uint32_t MBEDTLS_PRIVATE(now);          /*!< clock, in milliseconds     */
+
+    uint32_t MBEDTLS_PRIVATE(hash_key);     /*!< random key for the maps    */
+    size_t MBEDTLS_PRIVATE(hash_mask);      /*!< number of buckets - 1      */
+    mbedtls_ssl_dtls_assoc **MBEDTLS_PRIVATE(by_addr); /*!< map from peer address */
+    mbedtls_ssl_dtls_assoc **MBEDTLS_PRIVATE(by_cid);  /*!< map from our CID      */
+
+    mbedtls_ssl_dtls_assoc *MBEDTLS_PRIVATE(timers);    /*!< running timers   */
+    mbedtls_ssl_dtls_assoc *MBEDTLS_PRIVATE(free_list); /*!< contexts to reuse */
+
+    mbedtls_ssl_dgram *MBEDTLS_PRIVATE(rx);     /*!< receive batch          */
+    mbedtls_ssl_dgram *MBEDTLS_PRIVATE(tx);     /*!< send queue             */
+    size_t MBEDTLS_PRIVATE(tx_count);
+    unsigned char *MBEDTLS_PRIVATE(rx_buf);
+    unsigned char *MBEDTLS_PRIVATE(tx_buf);
+    unsigned char *MBEDTLS_PRIVATE(check_buf); /*!< for mbedtls_ssl_check_record() */
+}
+mbedtls_ssl_dtls_endpoint;
+
+/**
+ * \brief          Initialize an endpoint context
+ */
+void mbedtls_ssl_dtls_endpoint_init( mbedtls_ssl_dtls_endpoint *ep );
+
+/**
+ * \brief          Set up an endpoint
+ *
+ * \param ep       Endpoint context, initialized
+ * \param conf     DTLS server configuration shared by all associations.
+ *                 It must have a random generator, and it should have
+ *                 cookie callbacks (mbedtls_ssl_conf_dtls_cookies()),
+ *                 otherwise associations are created without checking
+ *                 that the client can receive at its address.
+ *                 If it has a connection ID length
+ *                 (mbedtls_ssl_conf_cid()), each association gets a
+ *                 random connection ID of that length.
+ *                 It must not be modified or freed while in use.
+ * \param max_assocs Maximum number of concurrent associations. ClientHello
+ *                 messages from new clients are dropped when it is reached.
+ * \param mtu      Maximum size of the datagrams sent, see
+ *                 mbedtls_ssl_set_mtu().
+ *
+ * \note           Memory for the hash maps and the datagram buffers is
+ *                 allocated here. Each association additionally has a
+ *                 full SSL context, allocated when it is first needed and
+ *                 kept for reuse after the association closes.
+ *
+ * \return         0 if successful,
+ *                 #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the configuration is
+ *                 not suitable, or #MBEDTLS_ERR_SSL_ALLOC_FAILED.
+ */
+int mbedtls_ssl_dtls_endpoint_setup( mbedtls_ssl_dtls_endpoint *ep,
+                                     const mbedtls_ssl_config *conf,
+                                     size_t max_assocs, uint16_t mtu );
+
+/**
+ * \brief          Set the datagram transport of the endpoint
+ *
+ * \param ep       Endpoint context
+ * \param p_bio    Context for the callbacks, for example an
+ *                 mbedtls_net_context bound with #MBEDTLS_NET_PROTO_UDP
+ * \param f_send   Batch send callback, for example mbedtls_net_send_batch()
+ * \param f_recv   Batch receive callback, for example
+ *                 mbedtls_net_recv_batch(). It should not block: use a
+ *                 non-blocking socket.
+ *
+ * \note           Datagrams that cannot be sent without blocking are
+ *                 dropped, as a lossy network would, and DTLS
+ *                 retransmission takes care of handshake messages.
+ */
+void mbedtls_ssl_dtls_endpoint_set_bio( mbedtls_ssl_dtls_endpoint *ep,
+                                        void *p_bio,
+                                        mbedtls_ssl_send_batch_t *f_send,
+                                        mbedtls_ssl_recv_batch_t *f_recv );
+
+/**
+ * \brief          Set the callback for events on associations
+ *
+ * \param ep       Endpoint context
+ * \param f_event  Event callback
+ * \param p_event  Context for the callback
+ */
+void mbedtls_ssl_dtls_endpoint_set_callback( mbedtls_ssl_dtls_endpoint *ep,
+                                             mbedtls_ssl_dtls_endpoint_cb_t *f_event,
+                                             void *p_event );
+
+/**
+ * \brief          Receive one batch of datagrams, dispatch them to their
+ *                 associations, run the expired retransmission timers,
+ *                 and send everything that was written.
+ *
+ * \param ep       Endpoint context
+ * \param now_ms   Current time in milliseconds, from a monotonic clock.
+ *                 It may wrap around. Timers advance only when this
+ *                 function is called, so call it at least every few tens
+ *                 of milliseconds even when no datagram is pending.
+ *
+ * \note           Inside the event callback, the application may read and
+ *                 write on the association. A datagram for an established
+ *                 association is available to mbedtls_ssl_read() only
+ *                 during the #MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_READABLE
+ *                 event that delivers it.
+ *
+ * \return         The number of datagrams received (possibly 0),
+ *                 or a negative error code from the transport.
+ */
+int mbedtls_ssl_dtls_endpoint_process( mbedtls_ssl_dtls_endpoint *ep,
+                                       uint32_t now_ms );
+
+/**
+ * \brief          Send the datagrams written by associations outside of
+ *                 mbedtls_ssl_dtls_endpoint_process()
+ *
+ * \param ep       Endpoint context
+ *
+ * \return         0 if successful, or a negative error code from the
+ *                 transport.
+ */
+int mbedtls_ssl_dtls_endpoint_flush( mbedtls_ssl_dtls_endpoint *ep );
+
+/**
+ * \brief          Close an association with a close_notify alert and
+ *                 free it. This must not be called from the event
+ *                 callback: return a non-zero value from it instead.
+ *
+ * \param ep       Endpoint context
+ * \param ssl      SSL context of the association, as passed to the event
+ *                 callback
+ *
+ * \return         0 if successful, or #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if
+ *                 \p ssl is not an association of \p ep.
+ */
+int mbedtls_ssl_dtls_endpoint_close( mbedtls_ssl_dtls_endpoint *ep,
+                                     mbedtls_ssl_context *ssl );
+
+/**
+ * \brief          Get the current number of associations, including those
+ *                 that are still handshaking.
+ */
+size_t mbedtls_ssl_dtls_endpoint_count( const mbedtls_ssl_dtls_endpoint *ep );
+
+/**
+ * \brief          Free an endpoint and all of its associations, without
+ *                 sending alerts or calling the event callback.
+ */
+void mbedtls_ssl_dtls_endpoint_free( mbedtls_ssl_dtls_endpoint *ep );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_dtls_endpoint.h */
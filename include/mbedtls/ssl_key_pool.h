@@ -0,0 +1,184 @@
+/**
+ * \file ssl_key_pool.h
+ *
+ * \brief Pool of pre-generated ephemeral ECDH key shares
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#ifndef MBEDTLS_SSL_KEY_POOL_H
+#define MBEDTLS_SSL_KEY_POOL_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   One pre-generated key pair: the PSA key holding the private key
+ *          and its exported public key
+ */
+typedef struct mbedtls_ssl_key_pool_entry
+{
+    mbedtls_svc_key_id_t MBEDTLS_PRIVATE(key);
+    unsigned char MBEDTLS_PRIVATE(pub)[PSA_KEY_EXPORT_ECC_PUBLIC_KEY_MAX_SIZE(
+                                          PSA_VENDOR_ECC_MAX_CURVE_BITS )];
+    size_t MBEDTLS_PRIVATE(pub_len);
+}
+mbedtls_ssl_key_pool_entry;
+
+/**
+ * \brief   Ring of pre-generated key pairs for one group
+ */
+typedef struct mbedtls_ssl_key_pool_group
+{
+    uint16_t MBEDTLS_PRIVATE(tls_id);           /*!< IANA NamedGroup      */
+    psa_key_type_t MBEDTLS_PRIVATE(type);       /*!< PSA key type         */
+    size_t MBEDTLS_PRIVATE(bits);               /*!< PSA key size         */
+    mbedtls_ssl_key_pool_entry *MBEDTLS_PRIVATE(ring);
+    size_t MBEDTLS_PRIVATE(head);               /*!< oldest entry         */
+    size_t MBEDTLS_PRIVATE(count);              /*!< available entries    */
+}
+mbedtls_ssl_key_pool_group;
+
+/**
+ * \brief   Key share pool context
+ *
+ * The pool keeps up to \c size single-use ECDH key pairs for each of its
+ * groups. mbedtls_ssl_key_pool_fill() generates them outside of the
+ * handshakes, for example from an idle hook of the application, and
+ * handshakes take them with mbedtls_ssl_key_pool_pop() instead of
+ * generating a key pair themselves.
+ *
+ * Each key pair is a volatile PSA key, which is handed over to exactly one
+ * handshake. The handshake destroys it after the key agreement, and the
+ * pool destroys the keys it still holds when it is freed.
+ */
+typedef struct mbedtls_ssl_key_pool
+{
+    mbedtls_ssl_key_pool_group *MBEDTLS_PRIVATE(groups);
+    size_t MBEDTLS_PRIVATE(ngroups);
+    size_t MBEDTLS_PRIVATE(size);               /*!< key pairs per group  */
+    size_t MBEDTLS_PRIVATE(next);               /*!< next group to fill   */
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+#endif
+}
+mbedtls_ssl_key_pool;
+
+/**
+ * \brief          Initialize a key share pool
+ *
+ * \param pool     Pool to be initialized
+ */
+void mbedtls_ssl_key_pool_init( mbedtls_ssl_key_pool *pool );
+
+/**
+ * \brief          Set up a key share pool
+ *
+ * \note           Every key pair in the pool takes a PSA key slot: the
+ *                 number of groups times \p size must leave enough of the
+ *                 MBEDTLS_PSA_KEY_SLOT_COUNT slots to the handshakes.
+ *
+ * \param pool     Pool to be set up
+ * \param groups   List of ECDHE groups to keep key pairs for, terminated
+ *                 by 0, for example MBEDTLS_SSL_IANA_TLS_GROUP_X25519 and
+ *                 MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1.
+ * \param size     Number of key pairs to keep per group (at least 1)
+ *
+ * \return         0 if successful,
+ *                 #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a group is not a
+ *                 supported elliptic curve group or \p size is 0,
+ *                 #MBEDTLS_ERR_SSL_ALLOC_FAILED if the allocation failed.
+ */
+int mbedtls_ssl_key_pool_setup( mbedtls_ssl_key_pool *pool,
+                                const uint16_t *groups,
+                                size_t size );
+
+/**
+ * \brief          Generate key pairs until the pool is full
+ *
+ * \note           Call this function when the application is idle, or from
+ *                 a low-priority thread. The pool lock is not held while a
+ *                 key pair is generated, so handshakes are not delayed.
+ *                 The PSA crypto subsystem must be safe to use from that
+ *                 thread concurrently with the handshakes.
+ *
+ * \param pool     Pool to fill
+ * \param max      Maximum number of key pairs to generate in this call,
+ *                 or 0 for no limit. Groups are served in turn.
+ *
+ * \return         The number of key pairs generated (0 if the pool is
+ *                 full), or a negative error code.
+ */
+int mbedtls_ssl_key_pool_fill( mbedtls_ssl_key_pool *pool, size_t max );
+
+/**
+ * \brief          Take a key pair from the pool
+ *                 (Implementation of mbedtls_ssl_key_share_pop_t)
+ *
+ * \param p_pool   Pool (mbedtls_ssl_key_pool *)
+ * \param named_group IANA NamedGroup of the key pair
+ * \param key      On success, the PSA key holding the private key. The
+ *                 caller owns it and must destroy it after use.
+ * \param pub      Buffer receiving the public key
+ * \param pub_size Size of \p pub in bytes
+ * \param pub_len  On success, length of the public key in bytes
+ *
+ * \return         0 if successful,
+ *                 #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the pool has no
+ *                 key pair for \p named_group at the moment,
+ *                 #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if \p pub is too small.
+ */
+int mbedtls_ssl_key_pool_pop( void *p_pool,
+                              uint16_t named_group,
+                              mbedtls_svc_key_id_t *key,
+                              unsigned char *pub,
+                              size_t pub_size,
+                              size_t *pub_len );
+
+/**
+ * \brief          Return the number of key pairs available for a group
+ *
+ * \param pool     Pool to query
+ * \param named_group IANA NamedGroup
+ *
+ * \return         The number of key pairs ready for \p named_group
+ */
+size_t mbedtls_ssl_key_pool_available( mbedtls_ssl_key_pool *pool,
+                                       uint16_t named_group );
+
+/**
+ * \brief          Free a key share pool and destroy the keys it holds
+ *
+ * \param pool     Pool to be cleared
+ */
+void mbedtls_ssl_key_pool_free( mbedtls_ssl_key_pool *pool );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_key_pool.h */
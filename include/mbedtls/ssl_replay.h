@@ -0,0 +1,140 @@
+/**
+ * \file ssl_replay.h
+ *
+ * \brief TLS 1.3 0-RTT anti-replay filter (server side)
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#ifndef MBEDTLS_SSL_REPLAY_H
+#define MBEDTLS_SSL_REPLAY_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/platform_time.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_REPLAY_DEFAULT_BITS)
+#define MBEDTLS_SSL_REPLAY_DEFAULT_BITS    ( 1 << 20 ) /*!< Bits per filter generation */
+#endif
+
+/** \} name SECTION: Module settings */
+
+/** Number of filter bits set per ClientHello */
+#define MBEDTLS_SSL_REPLAY_HASHES           4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Anti-replay filter context
+ *
+ * The filter remembers the PSK binders of the 0-RTT ClientHellos it has
+ * seen in two Bloom filters, the current and the previous generation, each
+ * covering \c window seconds. A binder is remembered for at least
+ * \c window seconds, which covers the ticket age tolerance of the server:
+ * older replays fail the ticket age check.
+ *
+ * The filter may report false positives, at a rate depending on its size
+ * and on the number of 0-RTT handshakes per window. A false positive only
+ * makes the server reject early data and proceed with a 1-RTT handshake.
+ */
+typedef struct mbedtls_ssl_replay_context
+{
+    unsigned char *MBEDTLS_PRIVATE(bits);       /*!< both generations     */
+    size_t MBEDTLS_PRIVATE(nbits);              /*!< bits per generation  */
+    unsigned char MBEDTLS_PRIVATE(current);     /*!< current generation   */
+    uint32_t MBEDTLS_PRIVATE(window);           /*!< generation length (s)*/
+    mbedtls_time_t MBEDTLS_PRIVATE(start);      /*!< current generation start */
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+#endif
+}
+mbedtls_ssl_replay_context;
+
+/**
+ * \brief          Initialize an anti-replay filter context
+ *
+ * \param ctx      Context to be initialized
+ */
+void mbedtls_ssl_replay_init( mbedtls_ssl_replay_context *ctx );
+
+/**
+ * \brief          Set up an anti-replay filter
+ *
+ * \param ctx      Context to be set up
+ * \param nbits    Number of bits of each of the two generations. It must be
+ *                 a power of two between 2^10 and 2^31, or 0 to use
+ *                 #MBEDTLS_SSL_REPLAY_DEFAULT_BITS. The filter uses
+ *                 \c nbits / 4 bytes of memory.
+ * \param window   Length of a generation in seconds, at least
+ *                 #MBEDTLS_SSL_TLS1_3_TICKET_AGE_TOLERANCE milliseconds
+ *                 rounded up to seconds plus 2, or 0 to use this minimum.
+ *
+ * \return         0 if successful,
+ *                 #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a parameter is invalid,
+ *                 #MBEDTLS_ERR_SSL_ALLOC_FAILED if the allocation failed.
+ */
+int mbedtls_ssl_replay_setup( mbedtls_ssl_replay_context *ctx,
+                              size_t nbits, uint32_t window );
+
+/**
+ * \brief          Check a 0-RTT ClientHello for replay and remember it
+ *                 (Implementation of mbedtls_ssl_early_data_replay_t)
+ *
+ * \param p_replay Context (mbedtls_ssl_replay_context *)
+ * \param identity The PSK identity (unused)
+ * \param identity_len Length of \p identity
+ * \param binder   The PSK binder of the ClientHello, at least 16 bytes
+ * \param binder_len Length of \p binder
+ *
+ * \return         0 if the ClientHello was not seen in the current window,
+ *                 #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if it may have been,
+ *                 or another error code on failure.
+ */
+int mbedtls_ssl_replay_check( void *p_replay,
+                              const unsigned char *identity,
+                              size_t identity_len,
+                              const unsigned char *binder,
+                              size_t binder_len );
+
+/**
+ * \brief          Free an anti-replay filter context
+ *
+ * \param ctx      Context to be cleared
+ */
+void mbedtls_ssl_replay_free( mbedtls_ssl_replay_context *ctx );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_replay.h */
@@ -50,8 +50,23 @@
 extern "C" {
 #endif
 
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_TICKET_MAX_KEYS)
+#define MBEDTLS_SSL_TICKET_MAX_KEYS         2   /*!< Maximum number of ticket keys accepted at once */
+#endif
+
+/** \} name SECTION: Module settings */
+
 #define MBEDTLS_SSL_TICKET_MAX_KEY_BYTES 32          /*!< Max supported key length in bytes */
 #define MBEDTLS_SSL_TICKET_KEY_NAME_BYTES 4          /*!< key name length in bytes */
+#define MBEDTLS_SSL_TICKET_KEY_INDEX_SIZE ( 2 * MBEDTLS_SSL_TICKET_MAX_KEYS ) /*!< key name hash table size */
 
 /**
  * \brief   Information for session ticket protection
@@ -70,6 +85,11 @@ typedef struct mbedtls_ssl_ticket_key
     psa_algorithm_t MBEDTLS_PRIVATE(alg);            /*!< algorithm of auth enc/decryption   */
     psa_key_type_t MBEDTLS_PRIVATE(key_type);        /*!< key type                           */
     size_t MBEDTLS_PRIVATE(key_bits);                /*!< key length in bits                 */
+#endif
+    unsigned int MBEDTLS_PRIVATE(refs);              /*!< one for the key set, plus one per
+                                                          ticket being written or parsed  */
+#if defined(MBEDTLS_THREADING_C) && !defined(MBEDTLS_USE_PSA_CRYPTO)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< serializes use of \c ctx       */
 #endif
 }
 mbedtls_ssl_ticket_key;
@@ -79,8 +99,20 @@ mbedtls_ssl_ticket_key;
  */
 typedef struct mbedtls_ssl_ticket_context
 {
-    mbedtls_ssl_ticket_key MBEDTLS_PRIVATE(keys)[2]; /*!< ticket protection keys             */
+    mbedtls_ssl_ticket_key *MBEDTLS_PRIVATE(keys)[MBEDTLS_SSL_TICKET_MAX_KEYS];
+                                                     /*!< ticket protection keys, oldest first */
+    unsigned char MBEDTLS_PRIVATE(key_count);        /*!< number of keys in \c keys          */
     unsigned char MBEDTLS_PRIVATE(active);           /*!< index of the currently active key  */
+    unsigned char MBEDTLS_PRIVATE(index)[MBEDTLS_SSL_TICKET_KEY_INDEX_SIZE];
+                                                     /*!< open-addressing table from key name
+                                                          to index in \c keys plus one, or 0 */
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    psa_algorithm_t MBEDTLS_PRIVATE(alg);            /*!< algorithm for new keys             */
+    psa_key_type_t MBEDTLS_PRIVATE(key_type);        /*!< key type for new keys              */
+#else
+    const mbedtls_cipher_info_t *MBEDTLS_PRIVATE(cipher_info); /*!< cipher for new keys      */
+#endif
+    size_t MBEDTLS_PRIVATE(key_bits);                /*!< key length for new keys, in bits   */
 
     uint32_t MBEDTLS_PRIVATE(ticket_lifetime);       /*!< lifetime of tickets in seconds     */
 
@@ -89,7 +121,8 @@ typedef struct mbedtls_ssl_ticket_context
     void *MBEDTLS_PRIVATE(p_rng);                    /*!< context for the RNG function       */
 
 #if defined(MBEDTLS_THREADING_C)
-    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< protects the key set and the
+                                                           reference counts only         */
 #endif
 }
 mbedtls_ssl_ticket_context;
@@ -155,9 +188,15 @@ int mbedtls_ssl_ticket_setup( mbedtls_ssl_ticket_context *ctx,
  * \note            \c klength must be sufficient for use by cipher specified
  *                  to \c mbedtls_ssl_ticket_setup
  *
- * \note            The lifetime of the keys is twice the lifetime of tickets.
- *                  It is recommended to pick a reasonable lifetime so as not
- *                  to negate the benefits of forward secrecy.
+ * \note            The new key is used to protect new tickets. Tickets
+ *                  protected by the previous keys remain valid until their
+ *                  key is evicted: the context keeps the
+ *                  #MBEDTLS_SSL_TICKET_MAX_KEYS most recently installed
+ *                  keys. A key with the same name as \c name is replaced.
+ *                  With the default of 2 keys, the lifetime of the keys is
+ *                  twice the lifetime of tickets. It is recommended to pick
+ *                  a reasonable lifetime so as not to negate the benefits
+ *                  of forward secrecy.
  *
  * \return          0 if successful,
  *                  or a specific MBEDTLS_ERR_XXX error code
@@ -167,6 +206,36 @@ int mbedtls_ssl_ticket_rotate( mbedtls_ssl_ticket_context *ctx,
     const unsigned char *k, size_t klength,
     uint32_t lifetime );
 
+/**
+ * \brief           Add a session ticket key that is accepted when parsing
+ *                  tickets, without using it to protect new tickets.
+ *
+ *                  This lets a fleet of servers sharing ticket keys
+ *                  distribute a new key everywhere before any server starts
+ *                  issuing tickets with it (with mbedtls_ssl_ticket_rotate()
+ *                  using the same name and key), and keep accepting tickets
+ *                  issued by peers under older keys.
+ *
+ * \param ctx       Context set up with mbedtls_ssl_ticket_setup()
+ * \param name      Session ticket encryption key name
+ * \param nlength   Session ticket encryption key name length in bytes
+ * \param k         Session ticket encryption key
+ * \param klength   Session ticket encryption key length in bytes
+ *
+ * \note            If the context already holds
+ *                  #MBEDTLS_SSL_TICKET_MAX_KEYS keys, the oldest key other
+ *                  than the active one is evicted. A key with the same name
+ *                  as \c name is replaced, unless it is the active key.
+ *
+ * \return          0 if successful,
+ *                  #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \c name is the name of
+ *                  the active key,
+ *                  or a specific MBEDTLS_ERR_XXX error code
+ */
+int mbedtls_ssl_ticket_add_key( mbedtls_ssl_ticket_context *ctx,
+    const unsigned char *name, size_t nlength,
+    const unsigned char *k, size_t klength );
+
 /**
  * \brief           Implementation of the ticket write callback
  *
@@ -174,6 +243,15 @@ int mbedtls_ssl_ticket_rotate( mbedtls_ssl_ticket_context *ctx,
  */
 mbedtls_ssl_ticket_write_t mbedtls_ssl_ticket_write;
 
+/**
+ * \brief           Implementation of the batch ticket write callback
+ *
+ * \note            See \c mbedtls_ssl_ticket_write_batch_t for description.
+ *                  The whole batch is written with the same key, taking the
+ *                  context lock and calling the random generator once.
+ */
+mbedtls_ssl_ticket_write_batch_t mbedtls_ssl_ticket_write_batch;
+
 /**
  * \brief           Implementation of the ticket parse callback
  *
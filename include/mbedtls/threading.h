@@ -109,6 +109,12 @@ extern mbedtls_threading_mutex_t mbedtls_threading_readdir_mutex;
 extern mbedtls_threading_mutex_t mbedtls_threading_gmtime_mutex;
 #endif /* MBEDTLS_HAVE_TIME_DATE && !MBEDTLS_PLATFORM_GMTIME_R_ALT */
 
+#if defined(MBEDTLS_PSA_CRYPTO_C)
+/* This mutex protects the PSA key store: the key slot table, the index of
+ * key identifiers and the lock counters of the key slots. */
+extern mbedtls_threading_mutex_t mbedtls_threading_key_slot_mutex;
+#endif /* MBEDTLS_PSA_CRYPTO_C */
+
 #endif /* MBEDTLS_THREADING_C */
 
 #ifdef __cplusplus
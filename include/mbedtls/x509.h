@@ -251,6 +251,12 @@ typedef struct mbedtls_x509_time
 }
 mbedtls_x509_time;
 
+/**
+ * Bump allocator that parsed X.509 structures can be carved from, so that
+ * they are released together. The layout is private to the library.
+ */
+typedef struct mbedtls_x509_arena mbedtls_x509_arena;
+
 /** \} name Structures for parsing X.509 certificates, CRLs and CSRs */
 
 /**
@@ -99,6 +99,15 @@ typedef struct mbedtls_x509_crl
     mbedtls_pk_type_t MBEDTLS_PRIVATE(sig_pk);           /**< Internal representation of the Public Key algorithm of the signature algorithm, e.g. MBEDTLS_PK_RSA */
     void *MBEDTLS_PRIVATE(sig_opts);             /**< Signature options to be passed to mbedtls_pk_verify_ext(), e.g. for RSASSA-PSS */
 
+    /** Contiguous storage for the entries following \c entry in the
+     * linked list, or \c NULL if the CRL has at most one entry. */
+    mbedtls_x509_crl_entry *MBEDTLS_PRIVATE(entries);
+    /** Number of revoked certificates listed in this CRL. */
+    size_t MBEDTLS_PRIVATE(entry_count);
+    /** Entries sorted by serial number, for mbedtls_x509_crl_find_entry().
+     * \c NULL if the CRL has no entries. */
+    const mbedtls_x509_crl_entry **MBEDTLS_PRIVATE(serial_index);
+
     /** Next element in the linked list of CRL.
      * \p NULL indicates the end of the list.
      * Do not modify this field directly. */
@@ -146,6 +155,25 @@ int mbedtls_x509_crl_parse( mbedtls_x509_crl *chain, const unsigned char *buf, s
 int mbedtls_x509_crl_parse_file( mbedtls_x509_crl *chain, const char *path );
 #endif /* MBEDTLS_FS_IO */
 
+/**
+ * \brief          Look up the entry for a serial number in a CRL
+ *
+ * \note           The lookup uses an index of the serial numbers that is
+ *                 built when the CRL is parsed, so its cost is logarithmic
+ *                 in the number of entries of the CRL.
+ *
+ * \param crl      The CRL to search (only this element of the chain is
+ *                 searched, not the following ones)
+ * \param serial   The serial number to look for, in the format returned
+ *                 by mbedtls_x509_get_serial()
+ *
+ * \return         The matching CRL entry, or \c NULL if \p serial is
+ *                 not listed in \p crl.
+ */
+const mbedtls_x509_crl_entry *mbedtls_x509_crl_find_entry(
+                                        const mbedtls_x509_crl *crl,
+                                        const mbedtls_x509_buf *serial );
+
 #if !defined(MBEDTLS_X509_REMOVE_INFO)
 /**
  * \brief          Returns an informational string about the CRL.
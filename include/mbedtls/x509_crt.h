@@ -96,6 +96,8 @@ typedef struct mbedtls_x509_crt
     mbedtls_pk_type_t MBEDTLS_PRIVATE(sig_pk);           /**< Internal representation of the Public Key algorithm of the signature algorithm, e.g. MBEDTLS_PK_RSA */
     void *MBEDTLS_PRIVATE(sig_opts);             /**< Signature options to be passed to mbedtls_pk_verify_ext(), e.g. for RSASSA-PSS */
 
+    mbedtls_x509_arena *MBEDTLS_PRIVATE(arena);  /**< Allocator shared by the whole chain, see mbedtls_x509_crt_use_arena(). NULL if parsed data is allocated individually. */
+
     /** Next certificate in the linked list that constitutes the CA chain.
      * \p NULL indicates the end of the list.
      * Do not modify this field directly. */
@@ -395,6 +397,38 @@ extern const mbedtls_x509_crt_profile mbedtls_x509_crt_profile_suiteb;
  */
 extern const mbedtls_x509_crt_profile mbedtls_x509_crt_profile_none;
 
+/**
+ * \brief          Make all certificates subsequently parsed into \p chain
+ *                 share a single bump allocator.
+ *
+ *                 The certificate structures, their copies of the DER data
+ *                 and their name and sequence lists are carved from large
+ *                 blocks instead of being allocated one by one, so that
+ *                 parsing a certificate usually takes a single allocation
+ *                 and mbedtls_x509_crt_free() releases a few blocks instead
+ *                 of walking every list. Public key contexts are still
+ *                 allocated separately.
+ *
+ * \note           Memory is only given back when the whole chain is freed.
+ *                 This suits chains that are parsed once and then kept
+ *                 unchanged, such as a trusted CA list or a peer chain.
+ *
+ * \param chain      The chain to configure. It must have been initialized
+ *                   with mbedtls_x509_crt_init() and not hold any
+ *                   certificate yet. mbedtls_x509_crt_free() turns it back
+ *                   into an ordinary chain.
+ * \param block_size The minimum size of a block, or \c 0 for a default
+ *                   suitable for typical certificates. Each certificate
+ *                   gets a block large enough for its DER data whatever
+ *                   this value.
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if \p chain is not empty
+ *                 or already uses an arena.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_x509_crt_use_arena( mbedtls_x509_crt *chain, size_t block_size );
+
 /**
  * \brief          Parse a single DER formatted certificate and add it
  *                 to the end of the provided chained list.
@@ -22,12 +22,13 @@
 #if defined(MBEDTLS_BASE64_C)
 
 #include "mbedtls/base64.h"
+#include "mbedtls/platform_util.h"
 #include "constant_time_internal.h"
 
 #include <stdint.h>
+#include <string.h>
 
 #if defined(MBEDTLS_SELF_TEST)
-#include <string.h>
 #include "mbedtls/platform.h"
 #endif /* MBEDTLS_SELF_TEST */
 
@@ -206,6 +207,111 @@ int mbedtls_base64_decode( unsigned char *dst, size_t dlen, size_t *olen,
     return( 0 );
 }
 
+/*
+ * Incremental decoding
+ */
+void mbedtls_base64_decode_init( mbedtls_base64_decode_context *ctx )
+{
+    memset( ctx, 0, sizeof( mbedtls_base64_decode_context ) );
+}
+
+int mbedtls_base64_decode_update( mbedtls_base64_decode_context *ctx,
+                                  unsigned char *dst, size_t dlen,
+                                  size_t *olen,
+                                  const unsigned char *src, size_t slen )
+{
+    size_t i;
+    size_t n; /* upper bound of the output length */
+    unsigned char *p = dst;
+    signed char value;
+
+    /* Compute ( ctx->digits + slen ) / 4 * 3 without risk of overflow */
+    n = 3 * ( slen / 4 ) + 3 * ( ( ctx->digits + slen % 4 ) / 4 );
+
+    if( dlen < n )
+    {
+        *olen = n;
+        return( MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL );
+    }
+
+    for( i = 0; i < slen; i++ )
+    {
+        /* A CR is only allowed as part of a CRLF line break */
+        if( ctx->cr )
+        {
+            if( src[i] != '\n' )
+                return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+            ctx->cr = 0;
+            ctx->spaces = 0;
+            continue;
+        }
+
+        if( src[i] == ' ' )
+        {
+            ctx->spaces = 1;
+            continue;
+        }
+
+        if( src[i] == '\r' )
+        {
+            ctx->cr = 1;
+            continue;
+        }
+
+        /* Spaces are allowed before a line break or at the end */
+        if( src[i] == '\n' )
+        {
+            ctx->spaces = 0;
+            continue;
+        }
+
+        if( ctx->spaces || src[i] > 127 )
+            return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+
+        if( src[i] == '=' )
+        {
+            if( ++ctx->equals > 2 )
+                return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+            value = 0;
+        }
+        else
+        {
+            if( ctx->equals != 0 )
+                return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+            value = mbedtls_ct_base64_dec_value( src[i] );
+            if( value < 0 )
+                return( MBEDTLS_ERR_BASE64_INVALID_CHARACTER );
+        }
+
+        ctx->acc = ( ctx->acc << 6 ) | (uint32_t) value;
+
+        if( ++ctx->digits == 4 )
+        {
+            ctx->digits = 0;
+            *p++ = MBEDTLS_BYTE_2( ctx->acc );
+            if( ctx->equals <= 1 ) *p++ = MBEDTLS_BYTE_1( ctx->acc );
+            if( ctx->equals <= 0 ) *p++ = MBEDTLS_BYTE_0( ctx->acc );
+            ctx->acc = 0;
+        }
+    }
+
+    *olen = p - dst;
+
+    return( 0 );
+}
+
+int mbedtls_base64_decode_finish( mbedtls_base64_decode_context *ctx )
+{
+    int ret = 0;
+
+    if( ctx->digits != 0 || ctx->cr )
+        ret = MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_base64_decode_context ) );
+
+    return( ret );
+}
+
 #if defined(MBEDTLS_SELF_TEST)
 
 static const unsigned char base64_test_dec[64] =
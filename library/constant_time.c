@@ -37,6 +37,10 @@
 #include "ssl_misc.h"
 #endif
 
+#if defined(MBEDTLS_MD_C)
+#include "md_wrap.h"
+#endif
+
 #if defined(MBEDTLS_RSA_C)
 #include "mbedtls/rsa.h"
 #endif
@@ -579,7 +583,8 @@ int mbedtls_ct_hmac( mbedtls_md_context_t *ctx,
      *
      * HMAC(msg) is defined as HASH(okey + HASH(ikey + msg)) where + means
      * concatenation, and okey/ikey are the XOR of the key with some fixed bit
-     * patterns (see RFC 2104, sec. 2), which are stored in ctx->hmac_ctx.
+     * patterns (see RFC 2104, sec. 2). The MD module keeps the hash states
+     * after absorbing ikey and okey in ctx->hmac_ctx.
      *
      * We'll first compute inner_hash = HASH(ikey + msg) by hashing up to
      * minlen, then cloning the context, and for each byte up to maxlen
@@ -587,12 +592,6 @@ int mbedtls_ct_hmac( mbedtls_md_context_t *ctx,
      *
      * Then we only need to compute HASH(okey + inner_hash) and we're done.
      */
-    const mbedtls_md_type_t md_alg = mbedtls_md_get_type( ctx->md_info );
-    /* TLS 1.2 only supports SHA-384, SHA-256, SHA-1, MD-5,
-     * all of which have the same block size except SHA-384. */
-    const size_t block_size = md_alg == MBEDTLS_MD_SHA384 ? 128 : 64;
-    const unsigned char * const ikey = ctx->hmac_ctx;
-    const unsigned char * const okey = ikey + block_size;
     const size_t hash_size = mbedtls_md_get_size( ctx->md_info );
 
     unsigned char aux_out[MBEDTLS_MD_MAX_SIZE];
@@ -639,8 +638,7 @@ int mbedtls_ct_hmac( mbedtls_md_context_t *ctx,
     MD_CHK( mbedtls_md_finish( ctx, aux_out ) );
 
     /* Now compute HASH(okey + inner_hash) */
-    MD_CHK( mbedtls_md_starts( ctx ) );
-    MD_CHK( mbedtls_md_update( ctx, okey, block_size ) );
+    MD_CHK( mbedtls_md_hmac_outer_starts( ctx ) );
     MD_CHK( mbedtls_md_update( ctx, output, hash_size ) );
     MD_CHK( mbedtls_md_finish( ctx, output ) );
 
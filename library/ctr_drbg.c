@@ -78,6 +78,25 @@ void mbedtls_ctr_drbg_set_prediction_resistance( mbedtls_ctr_drbg_context *ctx,
     ctx->prediction_resistance = resistance;
 }
 
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+/*
+ * Wipe any keystream that has been generated but not handed out yet.
+ */
+static void ctr_drbg_discard_buffer( mbedtls_ctr_drbg_context *ctx )
+{
+    mbedtls_platform_zeroize( ctx->buf, sizeof( ctx->buf ) );
+    ctx->buf_len = 0;
+}
+
+void mbedtls_ctr_drbg_set_buffering( mbedtls_ctr_drbg_context *ctx,
+                                     int buffering )
+{
+    if( ! buffering )
+        ctr_drbg_discard_buffer( ctx );
+    ctx->buffering = buffering;
+}
+#endif /* MBEDTLS_CTR_DRBG_BUFFER_SIZE */
+
 void mbedtls_ctr_drbg_set_entropy_len( mbedtls_ctr_drbg_context *ctx,
                                        size_t len )
 {
@@ -316,6 +335,10 @@ int mbedtls_ctr_drbg_update( mbedtls_ctr_drbg_context *ctx,
     if( add_len == 0 )
         return( 0 );
 
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+    ctr_drbg_discard_buffer( ctx );
+#endif
+
     if( ( ret = block_cipher_df( add_input, additional, add_len ) ) != 0 )
         goto exit;
     if( ( ret = ctr_drbg_update_internal( ctx, add_input ) ) != 0 )
@@ -355,6 +378,11 @@ static int mbedtls_ctr_drbg_reseed_internal( mbedtls_ctr_drbg_context *ctx,
     if( len > MBEDTLS_CTR_DRBG_MAX_SEED_INPUT - ctx->entropy_len - nonce_len )
         return( MBEDTLS_ERR_CTR_DRBG_INPUT_TOO_BIG );
 
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+    /* Output buffered before the reseed must not be served after it. */
+    ctr_drbg_discard_buffer( ctx );
+#endif
+
     memset( seed, 0, MBEDTLS_CTR_DRBG_MAX_SEED_INPUT );
 
     /* Gather entropy_len bytes of entropy to seed state. */
@@ -490,6 +518,94 @@ int mbedtls_ctr_drbg_seed( mbedtls_ctr_drbg_context *ctx,
  *   returned_bits = output[:output_len]
  *   ctx contains new_working_state
  */
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+/*
+ * Refill the output buffer with fast key erasure:
+ *   ks = AES_K(V+1) || ... || AES_K(V+n)   (n blocks filling the buffer)
+ *   K || V = ks[:SEEDLEN]
+ * and keep ks[SEEDLEN:] for subsequent requests. This is the
+ * CTR_DRBG_Update of SP 800-90A without provided data, except that the
+ * output is taken after the new key and counter rather than before, so
+ * that the key schedule runs once per buffer instead of once per request.
+ */
+static int ctr_drbg_refill_buffer( mbedtls_ctr_drbg_context *ctx )
+{
+    int ret = 0;
+    unsigned char *p;
+    int i;
+
+    if( ctx->reseed_counter > ctx->reseed_interval )
+    {
+        if( ( ret = mbedtls_ctr_drbg_reseed( ctx, NULL, 0 ) ) != 0 )
+            return( ret );
+    }
+
+    for( p = ctx->buf; p < ctx->buf + sizeof( ctx->buf );
+         p += MBEDTLS_CTR_DRBG_BLOCKSIZE )
+    {
+        for( i = MBEDTLS_CTR_DRBG_BLOCKSIZE; i > 0; i-- )
+            if( ++ctx->counter[i - 1] != 0 )
+                break;
+
+        if( ( ret = mbedtls_aes_crypt_ecb( &ctx->aes_ctx, MBEDTLS_AES_ENCRYPT,
+                                           ctx->counter, p ) ) != 0 )
+        {
+            goto exit;
+        }
+    }
+
+    if( ( ret = mbedtls_aes_setkey_enc( &ctx->aes_ctx, ctx->buf,
+                                        MBEDTLS_CTR_DRBG_KEYBITS ) ) != 0 )
+    {
+        goto exit;
+    }
+    memcpy( ctx->counter, ctx->buf + MBEDTLS_CTR_DRBG_KEYSIZE,
+            MBEDTLS_CTR_DRBG_BLOCKSIZE );
+    mbedtls_platform_zeroize( ctx->buf, MBEDTLS_CTR_DRBG_SEEDLEN );
+
+    ctx->buf_len = sizeof( ctx->buf ) - MBEDTLS_CTR_DRBG_SEEDLEN;
+    ctx->reseed_counter++;
+
+exit:
+    if( ret != 0 )
+        ctr_drbg_discard_buffer( ctx );
+    return( ret );
+}
+
+/*
+ * Serve a request from the output buffer, refilling it as needed.
+ * The caller guarantees that output_len does not exceed the buffer capacity.
+ */
+static int ctr_drbg_random_buffered( mbedtls_ctr_drbg_context *ctx,
+                                     unsigned char *output, size_t output_len )
+{
+    int ret;
+    unsigned char *p;
+    size_t use_len;
+
+    while( output_len > 0 )
+    {
+        if( ctx->buf_len == 0 )
+        {
+            if( ( ret = ctr_drbg_refill_buffer( ctx ) ) != 0 )
+                return( ret );
+        }
+
+        p = ctx->buf + sizeof( ctx->buf ) - ctx->buf_len;
+        use_len = ( output_len > ctx->buf_len ) ? ctx->buf_len : output_len;
+
+        memcpy( output, p, use_len );
+        mbedtls_platform_zeroize( p, use_len );
+
+        ctx->buf_len -= use_len;
+        output += use_len;
+        output_len -= use_len;
+    }
+
+    return( 0 );
+}
+#endif /* MBEDTLS_CTR_DRBG_BUFFER_SIZE */
+
 int mbedtls_ctr_drbg_random_with_add( void *p_rng,
                               unsigned char *output, size_t output_len,
                               const unsigned char *additional, size_t add_len )
@@ -508,6 +624,17 @@ int mbedtls_ctr_drbg_random_with_add( void *p_rng,
     if( add_len > MBEDTLS_CTR_DRBG_MAX_INPUT )
         return( MBEDTLS_ERR_CTR_DRBG_INPUT_TOO_BIG );
 
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+    if( ctx->buffering && add_len == 0 && ! ctx->prediction_resistance &&
+        output_len <= sizeof( ctx->buf ) - MBEDTLS_CTR_DRBG_SEEDLEN )
+    {
+        return( ctr_drbg_random_buffered( ctx, output, output_len ) );
+    }
+    /* Additional input must influence all subsequent output. */
+    if( add_len > 0 )
+        ctr_drbg_discard_buffer( ctx );
+#endif /* MBEDTLS_CTR_DRBG_BUFFER_SIZE */
+
     memset( add_input, 0, MBEDTLS_CTR_DRBG_SEEDLEN );
 
     if( ctx->reseed_counter > ctx->reseed_interval ||
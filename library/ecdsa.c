@@ -34,6 +34,7 @@
 
 #if defined(MBEDTLS_ECDSA_DETERMINISTIC)
 #include "mbedtls/hmac_drbg.h"
+#include "hmac_drbg_internal.h"
 #endif
 
 #include "mbedtls/platform.h"
@@ -416,6 +417,8 @@ static int ecdsa_sign_det_restartable( mbedtls_ecp_group *grp,
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_hmac_drbg_context rng_ctx;
     mbedtls_hmac_drbg_context *p_rng = &rng_ctx;
+    /* The DRBG lives for a single signature: keep its state on the stack. */
+    mbedtls_md_hmac_storage_t rng_storage;
     unsigned char data[2 * MBEDTLS_ECP_MAX_BYTES];
     size_t grp_len = ( grp->nbits + 7 ) / 8;
     const mbedtls_md_info_t *md_info;
@@ -445,7 +448,13 @@ static int ecdsa_sign_det_restartable( mbedtls_ecp_group *grp,
     MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( d, data, grp_len ) );
     MBEDTLS_MPI_CHK( derive_mpi( grp, &h, buf, blen ) );
     MBEDTLS_MPI_CHK( mbedtls_mpi_write_binary( &h, data + grp_len, grp_len ) );
-    mbedtls_hmac_drbg_seed_buf( p_rng, md_info, data, 2 * grp_len );
+    if( p_rng == &rng_ctx )
+        MBEDTLS_MPI_CHK( mbedtls_hmac_drbg_seed_buf_with_storage(
+                             p_rng, md_info, &rng_storage,
+                             data, 2 * grp_len ) );
+    else
+        MBEDTLS_MPI_CHK( mbedtls_hmac_drbg_seed_buf( p_rng, md_info,
+                                                     data, 2 * grp_len ) );
 
 #if defined(MBEDTLS_ECP_RESTARTABLE)
     if( rs_ctx != NULL && rs_ctx->det != NULL )
@@ -465,7 +474,8 @@ sign:
 #endif /* MBEDTLS_ECDSA_SIGN_ALT */
 
 cleanup:
-    mbedtls_hmac_drbg_free( &rng_ctx );
+    mbedtls_hmac_drbg_free_with_storage( &rng_ctx, &rng_storage );
+    mbedtls_platform_zeroize( data, sizeof( data ) );
     mbedtls_mpi_free( &h );
 
     ECDSA_RS_LEAVE( det );
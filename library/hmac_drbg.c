@@ -28,6 +28,7 @@
 #if defined(MBEDTLS_HMAC_DRBG_C)
 
 #include "mbedtls/hmac_drbg.h"
+#include "hmac_drbg_internal.h"
 #include "mbedtls/platform_util.h"
 #include "mbedtls/error.h"
 
@@ -100,15 +101,13 @@ exit:
 /*
  * Simplified HMAC_DRBG initialisation (for use with deterministic ECDSA)
  */
-int mbedtls_hmac_drbg_seed_buf( mbedtls_hmac_drbg_context *ctx,
-                        const mbedtls_md_info_t * md_info,
-                        const unsigned char *data, size_t data_len )
+static int hmac_drbg_seed_buf_core( mbedtls_hmac_drbg_context *ctx,
+                                    const mbedtls_md_info_t * md_info,
+                                    const unsigned char *data,
+                                    size_t data_len )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    if( ( ret = mbedtls_md_setup( &ctx->md_ctx, md_info, 1 ) ) != 0 )
-        return( ret );
-
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_mutex_init( &ctx->mutex );
 #endif
@@ -129,6 +128,33 @@ int mbedtls_hmac_drbg_seed_buf( mbedtls_hmac_drbg_context *ctx,
     return( 0 );
 }
 
+int mbedtls_hmac_drbg_seed_buf( mbedtls_hmac_drbg_context *ctx,
+                        const mbedtls_md_info_t * md_info,
+                        const unsigned char *data, size_t data_len )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if( ( ret = mbedtls_md_setup( &ctx->md_ctx, md_info, 1 ) ) != 0 )
+        return( ret );
+
+    return( hmac_drbg_seed_buf_core( ctx, md_info, data, data_len ) );
+}
+
+int mbedtls_hmac_drbg_seed_buf_with_storage( mbedtls_hmac_drbg_context *ctx,
+                                             const mbedtls_md_info_t *md_info,
+                                             mbedtls_md_hmac_storage_t *storage,
+                                             const unsigned char *data,
+                                             size_t data_len )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if( ( ret = mbedtls_md_setup_hmac_with_storage( &ctx->md_ctx, md_info,
+                                                    storage ) ) != 0 )
+        return( ret );
+
+    return( hmac_drbg_seed_buf_core( ctx, md_info, data, data_len ) );
+}
+
 /*
  * Internal function used both for seeding and reseeding the DRBG.
  * Comments starting with arabic numbers refer to section 10.1.2.4
@@ -419,6 +445,21 @@ void mbedtls_hmac_drbg_free( mbedtls_hmac_drbg_context *ctx )
     ctx->reseed_interval = MBEDTLS_HMAC_DRBG_RESEED_INTERVAL;
 }
 
+void mbedtls_hmac_drbg_free_with_storage( mbedtls_hmac_drbg_context *ctx,
+                                          mbedtls_md_hmac_storage_t *storage )
+{
+    if( ctx == NULL )
+        return;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ctx->md_ctx.md_info != NULL )
+        mbedtls_mutex_free( &ctx->mutex );
+#endif
+    mbedtls_md_free_with_storage( &ctx->md_ctx, storage );
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_hmac_drbg_context ) );
+    ctx->reseed_interval = MBEDTLS_HMAC_DRBG_RESEED_INTERVAL;
+}
+
 #if defined(MBEDTLS_FS_IO)
 int mbedtls_hmac_drbg_write_seed_file( mbedtls_hmac_drbg_context *ctx, const char *path )
 {
@@ -0,0 +1,66 @@
+/**
+ * \file hmac_drbg_internal.h
+ *
+ * \brief HMAC_DRBG functions for use inside the library only
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MBEDTLS_HMAC_DRBG_INTERNAL_H
+#define MBEDTLS_HMAC_DRBG_INTERNAL_H
+
+#include "common.h"
+
+#include "mbedtls/hmac_drbg.h"
+#include "md_wrap.h"
+
+/**
+ * \brief           Variant of mbedtls_hmac_drbg_seed_buf() that keeps the
+ *                  HMAC state in \p storage instead of allocating it.
+ *
+ *                  This is meant for short-lived instances such as the
+ *                  one behind each deterministic ECDSA signature, where
+ *                  both the context and \p storage can live on the stack.
+ *                  Release the context with
+ *                  mbedtls_hmac_drbg_free_with_storage().
+ *
+ * \param ctx       The HMAC_DRBG context to seed. It must be initialized.
+ * \param md_info   The hash algorithm to use for HMAC_DRBG.
+ * \param storage   The storage for the HMAC state. It must outlive \p ctx.
+ * \param data      The entropy and nonce, concatenated.
+ * \param data_len  The length of \p data in bytes.
+ *
+ * \return          \c 0 on success, or an \c MBEDTLS_ERR_MD_XXX error code.
+ */
+int mbedtls_hmac_drbg_seed_buf_with_storage( mbedtls_hmac_drbg_context *ctx,
+                                             const mbedtls_md_info_t *md_info,
+                                             mbedtls_md_hmac_storage_t *storage,
+                                             const unsigned char *data,
+                                             size_t data_len );
+
+/**
+ * \brief           Free a context seeded with
+ *                  mbedtls_hmac_drbg_seed_buf_with_storage() and wipe
+ *                  \p storage. The context may also be merely initialized.
+ *
+ * \param ctx       The HMAC_DRBG context to free.
+ * \param storage   The storage passed when seeding \p ctx.
+ */
+void mbedtls_hmac_drbg_free_with_storage( mbedtls_hmac_drbg_context *ctx,
+                                          mbedtls_md_hmac_storage_t *storage );
+
+#endif /* MBEDTLS_HMAC_DRBG_INTERNAL_H */
@@ -230,198 +230,326 @@ const mbedtls_md_info_t *mbedtls_md_info_from_ctx(
     return( ctx->MBEDTLS_PRIVATE(md_info) );
 }
 
-void mbedtls_md_init( mbedtls_md_context_t *ctx )
-{
-    memset( ctx, 0, sizeof( mbedtls_md_context_t ) );
-}
-
-void mbedtls_md_free( mbedtls_md_context_t *ctx )
+/*
+ * Size of the hash context used by the given algorithm, or 0 if the
+ * algorithm is not supported.
+ */
+static size_t md_hash_ctx_size( mbedtls_md_type_t type )
 {
-    if( ctx == NULL || ctx->md_info == NULL )
-        return;
-
-    if( ctx->md_ctx != NULL )
+    switch( type )
     {
-        switch( ctx->md_info->type )
-        {
 #if defined(MBEDTLS_MD5_C)
-            case MBEDTLS_MD_MD5:
-                mbedtls_md5_free( ctx->md_ctx );
-                break;
+        case MBEDTLS_MD_MD5:
+            return( sizeof( mbedtls_md5_context ) );
 #endif
 #if defined(MBEDTLS_RIPEMD160_C)
-            case MBEDTLS_MD_RIPEMD160:
-                mbedtls_ripemd160_free( ctx->md_ctx );
-                break;
+        case MBEDTLS_MD_RIPEMD160:
+            return( sizeof( mbedtls_ripemd160_context ) );
 #endif
 #if defined(MBEDTLS_SHA1_C)
-            case MBEDTLS_MD_SHA1:
-                mbedtls_sha1_free( ctx->md_ctx );
-                break;
+        case MBEDTLS_MD_SHA1:
+            return( sizeof( mbedtls_sha1_context ) );
 #endif
 #if defined(MBEDTLS_SHA224_C)
-            case MBEDTLS_MD_SHA224:
-                mbedtls_sha256_free( ctx->md_ctx );
-                break;
+        case MBEDTLS_MD_SHA224:
+            return( sizeof( mbedtls_sha256_context ) );
 #endif
 #if defined(MBEDTLS_SHA256_C)
-            case MBEDTLS_MD_SHA256:
-                mbedtls_sha256_free( ctx->md_ctx );
-                break;
+        case MBEDTLS_MD_SHA256:
+            return( sizeof( mbedtls_sha256_context ) );
 #endif
 #if defined(MBEDTLS_SHA384_C)
-            case MBEDTLS_MD_SHA384:
-                mbedtls_sha512_free( ctx->md_ctx );
-                break;
+        case MBEDTLS_MD_SHA384:
+            return( sizeof( mbedtls_sha512_context ) );
 #endif
 #if defined(MBEDTLS_SHA512_C)
-            case MBEDTLS_MD_SHA512:
-                mbedtls_sha512_free( ctx->md_ctx );
-                break;
+        case MBEDTLS_MD_SHA512:
+            return( sizeof( mbedtls_sha512_context ) );
 #endif
-            default:
-                /* Shouldn't happen */
-                break;
-        }
-        mbedtls_free( ctx->md_ctx );
-    }
-
-    if( ctx->hmac_ctx != NULL )
-    {
-        mbedtls_platform_zeroize( ctx->hmac_ctx,
-                                  2 * ctx->md_info->block_size );
-        mbedtls_free( ctx->hmac_ctx );
+        default:
+            return( 0 );
     }
-
-    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_md_context_t ) );
 }
 
-int mbedtls_md_clone( mbedtls_md_context_t *dst,
-                      const mbedtls_md_context_t *src )
+static void md_hash_ctx_init( mbedtls_md_type_t type, void *hash_ctx )
 {
-    if( dst == NULL || dst->md_info == NULL ||
-        src == NULL || src->md_info == NULL ||
-        dst->md_info != src->md_info )
+    switch( type )
     {
-        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+#if defined(MBEDTLS_MD5_C)
+        case MBEDTLS_MD_MD5:
+            mbedtls_md5_init( hash_ctx );
+            break;
+#endif
+#if defined(MBEDTLS_RIPEMD160_C)
+        case MBEDTLS_MD_RIPEMD160:
+            mbedtls_ripemd160_init( hash_ctx );
+            break;
+#endif
+#if defined(MBEDTLS_SHA1_C)
+        case MBEDTLS_MD_SHA1:
+            mbedtls_sha1_init( hash_ctx );
+            break;
+#endif
+#if defined(MBEDTLS_SHA224_C)
+        case MBEDTLS_MD_SHA224:
+            mbedtls_sha256_init( hash_ctx );
+            break;
+#endif
+#if defined(MBEDTLS_SHA256_C)
+        case MBEDTLS_MD_SHA256:
+            mbedtls_sha256_init( hash_ctx );
+            break;
+#endif
+#if defined(MBEDTLS_SHA384_C)
+        case MBEDTLS_MD_SHA384:
+            mbedtls_sha512_init( hash_ctx );
+            break;
+#endif
+#if defined(MBEDTLS_SHA512_C)
+        case MBEDTLS_MD_SHA512:
+            mbedtls_sha512_init( hash_ctx );
+            break;
+#endif
+        default:
+            /* Shouldn't happen */
+            break;
     }
+}
 
-    switch( src->md_info->type )
+static void md_hash_ctx_free( mbedtls_md_type_t type, void *hash_ctx )
+{
+    switch( type )
     {
 #if defined(MBEDTLS_MD5_C)
         case MBEDTLS_MD_MD5:
-            mbedtls_md5_clone( dst->md_ctx, src->md_ctx );
+            mbedtls_md5_free( hash_ctx );
             break;
 #endif
 #if defined(MBEDTLS_RIPEMD160_C)
         case MBEDTLS_MD_RIPEMD160:
-            mbedtls_ripemd160_clone( dst->md_ctx, src->md_ctx );
+            mbedtls_ripemd160_free( hash_ctx );
             break;
 #endif
 #if defined(MBEDTLS_SHA1_C)
         case MBEDTLS_MD_SHA1:
-            mbedtls_sha1_clone( dst->md_ctx, src->md_ctx );
+            mbedtls_sha1_free( hash_ctx );
             break;
 #endif
 #if defined(MBEDTLS_SHA224_C)
         case MBEDTLS_MD_SHA224:
-            mbedtls_sha256_clone( dst->md_ctx, src->md_ctx );
+            mbedtls_sha256_free( hash_ctx );
             break;
 #endif
 #if defined(MBEDTLS_SHA256_C)
         case MBEDTLS_MD_SHA256:
-            mbedtls_sha256_clone( dst->md_ctx, src->md_ctx );
+            mbedtls_sha256_free( hash_ctx );
             break;
 #endif
 #if defined(MBEDTLS_SHA384_C)
         case MBEDTLS_MD_SHA384:
-            mbedtls_sha512_clone( dst->md_ctx, src->md_ctx );
+            mbedtls_sha512_free( hash_ctx );
             break;
 #endif
 #if defined(MBEDTLS_SHA512_C)
         case MBEDTLS_MD_SHA512:
-            mbedtls_sha512_clone( dst->md_ctx, src->md_ctx );
+            mbedtls_sha512_free( hash_ctx );
             break;
 #endif
         default:
-            return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+            /* Shouldn't happen */
+            break;
     }
-
-    return( 0 );
 }
 
-#define ALLOC( type )                                                   \
-    do {                                                                \
-        ctx->md_ctx = mbedtls_calloc( 1, sizeof( mbedtls_##type##_context ) ); \
-        if( ctx->md_ctx == NULL )                                       \
-            return( MBEDTLS_ERR_MD_ALLOC_FAILED );                      \
-        mbedtls_##type##_init( ctx->md_ctx );                           \
-    }                                                                   \
-    while( 0 )
-
-int mbedtls_md_setup( mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac )
+static void md_hash_ctx_clone( mbedtls_md_type_t type,
+                               void *dst, const void *src )
 {
-    if( md_info == NULL || ctx == NULL )
-        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
-
-    ctx->md_info = md_info;
-    ctx->md_ctx = NULL;
-    ctx->hmac_ctx = NULL;
-
-    switch( md_info->type )
+    switch( type )
     {
 #if defined(MBEDTLS_MD5_C)
         case MBEDTLS_MD_MD5:
-            ALLOC( md5 );
+            mbedtls_md5_clone( dst, src );
             break;
 #endif
 #if defined(MBEDTLS_RIPEMD160_C)
         case MBEDTLS_MD_RIPEMD160:
-            ALLOC( ripemd160 );
+            mbedtls_ripemd160_clone( dst, src );
             break;
 #endif
 #if defined(MBEDTLS_SHA1_C)
         case MBEDTLS_MD_SHA1:
-            ALLOC( sha1 );
+            mbedtls_sha1_clone( dst, src );
             break;
 #endif
 #if defined(MBEDTLS_SHA224_C)
         case MBEDTLS_MD_SHA224:
-            ALLOC( sha256 );
+            mbedtls_sha256_clone( dst, src );
             break;
 #endif
 #if defined(MBEDTLS_SHA256_C)
         case MBEDTLS_MD_SHA256:
-            ALLOC( sha256 );
+            mbedtls_sha256_clone( dst, src );
             break;
 #endif
 #if defined(MBEDTLS_SHA384_C)
         case MBEDTLS_MD_SHA384:
-            ALLOC( sha512 );
+            mbedtls_sha512_clone( dst, src );
             break;
 #endif
 #if defined(MBEDTLS_SHA512_C)
         case MBEDTLS_MD_SHA512:
-            ALLOC( sha512 );
+            mbedtls_sha512_clone( dst, src );
             break;
 #endif
         default:
-            return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+            /* Shouldn't happen */
+            break;
     }
+}
+
+/*
+ * The HMAC part of a context holds two hash contexts: the state after
+ * absorbing K xor ipad, followed by the state after absorbing K xor opad.
+ * Resetting or finishing an HMAC computation copies one of them instead of
+ * hashing a full block of padded key again.
+ */
+static void *md_hmac_inner( const mbedtls_md_context_t *ctx )
+{
+    return( ctx->hmac_ctx );
+}
+
+static void *md_hmac_outer( const mbedtls_md_context_t *ctx )
+{
+    return( (unsigned char *) ctx->hmac_ctx +
+            md_hash_ctx_size( ctx->md_info->type ) );
+}
+
+void mbedtls_md_init( mbedtls_md_context_t *ctx )
+{
+    memset( ctx, 0, sizeof( mbedtls_md_context_t ) );
+}
+
+/*
+ * Free the hash states of a context without releasing their storage.
+ */
+static void md_free_states( mbedtls_md_context_t *ctx )
+{
+    mbedtls_md_type_t type = ctx->md_info->type;
+
+    if( ctx->md_ctx != NULL )
+        md_hash_ctx_free( type, ctx->md_ctx );
+
+    if( ctx->hmac_ctx != NULL )
+    {
+        md_hash_ctx_free( type, md_hmac_inner( ctx ) );
+        md_hash_ctx_free( type, md_hmac_outer( ctx ) );
+    }
+}
+
+void mbedtls_md_free( mbedtls_md_context_t *ctx )
+{
+    if( ctx == NULL || ctx->md_info == NULL )
+        return;
+
+    md_free_states( ctx );
+
+    if( ctx->md_ctx != NULL )
+        mbedtls_free( ctx->md_ctx );
+
+    if( ctx->hmac_ctx != NULL )
+    {
+        mbedtls_platform_zeroize( ctx->hmac_ctx,
+                            2 * md_hash_ctx_size( ctx->md_info->type ) );
+        mbedtls_free( ctx->hmac_ctx );
+    }
+
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_md_context_t ) );
+}
+
+int mbedtls_md_clone( mbedtls_md_context_t *dst,
+                      const mbedtls_md_context_t *src )
+{
+    if( dst == NULL || dst->md_info == NULL ||
+        src == NULL || src->md_info == NULL ||
+        dst->md_info != src->md_info )
+    {
+        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+    }
+
+    if( md_hash_ctx_size( src->md_info->type ) == 0 )
+        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+
+    md_hash_ctx_clone( src->md_info->type, dst->md_ctx, src->md_ctx );
+
+    return( 0 );
+}
+
+int mbedtls_md_setup( mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac )
+{
+    size_t ctx_size;
+
+    if( md_info == NULL || ctx == NULL )
+        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+
+    ctx->md_info = md_info;
+    ctx->md_ctx = NULL;
+    ctx->hmac_ctx = NULL;
+
+    ctx_size = md_hash_ctx_size( md_info->type );
+    if( ctx_size == 0 )
+        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+
+    ctx->md_ctx = mbedtls_calloc( 1, ctx_size );
+    if( ctx->md_ctx == NULL )
+        return( MBEDTLS_ERR_MD_ALLOC_FAILED );
+    md_hash_ctx_init( md_info->type, ctx->md_ctx );
 
     if( hmac != 0 )
     {
-        ctx->hmac_ctx = mbedtls_calloc( 2, md_info->block_size );
+        ctx->hmac_ctx = mbedtls_calloc( 2, ctx_size );
         if( ctx->hmac_ctx == NULL )
         {
             mbedtls_md_free( ctx );
             return( MBEDTLS_ERR_MD_ALLOC_FAILED );
         }
+        md_hash_ctx_init( md_info->type, md_hmac_inner( ctx ) );
+        md_hash_ctx_init( md_info->type, md_hmac_outer( ctx ) );
     }
 
     return( 0 );
 }
-#undef ALLOC
+
+int mbedtls_md_setup_hmac_with_storage( mbedtls_md_context_t *ctx,
+                                        const mbedtls_md_info_t *md_info,
+                                        mbedtls_md_hmac_storage_t *storage )
+{
+    if( md_info == NULL || ctx == NULL || storage == NULL ||
+        md_hash_ctx_size( md_info->type ) == 0 )
+    {
+        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+    }
+
+    ctx->md_info = md_info;
+    ctx->md_ctx = &storage->hash;
+    ctx->hmac_ctx = storage->hmac;
+
+    md_hash_ctx_init( md_info->type, ctx->md_ctx );
+    md_hash_ctx_init( md_info->type, md_hmac_inner( ctx ) );
+    md_hash_ctx_init( md_info->type, md_hmac_outer( ctx ) );
+
+    return( 0 );
+}
+
+void mbedtls_md_free_with_storage( mbedtls_md_context_t *ctx,
+                                   mbedtls_md_hmac_storage_t *storage )
+{
+    if( ctx == NULL || ctx->md_info == NULL )
+        return;
+
+    md_free_states( ctx );
+    mbedtls_platform_zeroize( storage, sizeof( *storage ) );
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_md_context_t ) );
+}
 
 int mbedtls_md_starts( mbedtls_md_context_t *ctx )
 {
@@ -632,12 +760,16 @@ int mbedtls_md_hmac_starts( mbedtls_md_context_t *ctx, const unsigned char *key,
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     unsigned char sum[MBEDTLS_MD_MAX_SIZE];
-    unsigned char *ipad, *opad;
+    unsigned char ipad[MBEDTLS_MD_MAX_BLOCK_SIZE];
+    unsigned char opad[MBEDTLS_MD_MAX_BLOCK_SIZE];
+    mbedtls_md_type_t type;
     size_t i;
 
     if( ctx == NULL || ctx->md_info == NULL || ctx->hmac_ctx == NULL )
         return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
 
+    type = ctx->md_info->type;
+
     if( keylen > (size_t) ctx->md_info->block_size )
     {
         if( ( ret = mbedtls_md_starts( ctx ) ) != 0 )
@@ -651,9 +783,6 @@ int mbedtls_md_hmac_starts( mbedtls_md_context_t *ctx, const unsigned char *key,
         key = sum;
     }
 
-    ipad = (unsigned char *) ctx->hmac_ctx;
-    opad = (unsigned char *) ctx->hmac_ctx + ctx->md_info->block_size;
-
     memset( ipad, 0x36, ctx->md_info->block_size );
     memset( opad, 0x5C, ctx->md_info->block_size );
 
@@ -663,14 +792,26 @@ int mbedtls_md_hmac_starts( mbedtls_md_context_t *ctx, const unsigned char *key,
         opad[i] = (unsigned char)( opad[i] ^ key[i] );
     }
 
+    /* Precompute the states after the padded key blocks, then leave the
+     * context ready to absorb the message. */
+    if( ( ret = mbedtls_md_starts( ctx ) ) != 0 )
+        goto cleanup;
+    if( ( ret = mbedtls_md_update( ctx, opad,
+                                   ctx->md_info->block_size ) ) != 0 )
+        goto cleanup;
+    md_hash_ctx_clone( type, md_hmac_outer( ctx ), ctx->md_ctx );
+
     if( ( ret = mbedtls_md_starts( ctx ) ) != 0 )
         goto cleanup;
     if( ( ret = mbedtls_md_update( ctx, ipad,
                                    ctx->md_info->block_size ) ) != 0 )
         goto cleanup;
+    md_hash_ctx_clone( type, md_hmac_inner( ctx ), ctx->md_ctx );
 
 cleanup:
     mbedtls_platform_zeroize( sum, sizeof( sum ) );
+    mbedtls_platform_zeroize( ipad, sizeof( ipad ) );
+    mbedtls_platform_zeroize( opad, sizeof( opad ) );
 
     return( ret );
 }
@@ -683,43 +824,44 @@ int mbedtls_md_hmac_update( mbedtls_md_context_t *ctx, const unsigned char *inpu
     return( mbedtls_md_update( ctx, input, ilen ) );
 }
 
+int mbedtls_md_hmac_outer_starts( mbedtls_md_context_t *ctx )
+{
+    if( ctx == NULL || ctx->md_info == NULL || ctx->hmac_ctx == NULL )
+        return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
+
+    md_hash_ctx_clone( ctx->md_info->type, ctx->md_ctx, md_hmac_outer( ctx ) );
+    return( 0 );
+}
+
 int mbedtls_md_hmac_finish( mbedtls_md_context_t *ctx, unsigned char *output )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     unsigned char tmp[MBEDTLS_MD_MAX_SIZE];
-    unsigned char *opad;
 
     if( ctx == NULL || ctx->md_info == NULL || ctx->hmac_ctx == NULL )
         return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
 
-    opad = (unsigned char *) ctx->hmac_ctx + ctx->md_info->block_size;
-
     if( ( ret = mbedtls_md_finish( ctx, tmp ) ) != 0 )
-        return( ret );
-    if( ( ret = mbedtls_md_starts( ctx ) ) != 0 )
-        return( ret );
-    if( ( ret = mbedtls_md_update( ctx, opad,
-                                   ctx->md_info->block_size ) ) != 0 )
-        return( ret );
+        goto cleanup;
+    if( ( ret = mbedtls_md_hmac_outer_starts( ctx ) ) != 0 )
+        goto cleanup;
     if( ( ret = mbedtls_md_update( ctx, tmp,
                                    ctx->md_info->size ) ) != 0 )
-        return( ret );
-    return( mbedtls_md_finish( ctx, output ) );
+        goto cleanup;
+    ret = mbedtls_md_finish( ctx, output );
+
+cleanup:
+    mbedtls_platform_zeroize( tmp, sizeof( tmp ) );
+    return( ret );
 }
 
 int mbedtls_md_hmac_reset( mbedtls_md_context_t *ctx )
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    unsigned char *ipad;
-
     if( ctx == NULL || ctx->md_info == NULL || ctx->hmac_ctx == NULL )
         return( MBEDTLS_ERR_MD_BAD_INPUT_DATA );
 
-    ipad = (unsigned char *) ctx->hmac_ctx;
-
-    if( ( ret = mbedtls_md_starts( ctx ) ) != 0 )
-        return( ret );
-    return( mbedtls_md_update( ctx, ipad, ctx->md_info->block_size ) );
+    md_hash_ctx_clone( ctx->md_info->type, ctx->md_ctx, md_hmac_inner( ctx ) );
+    return( 0 );
 }
 
 int mbedtls_md_hmac( const mbedtls_md_info_t *md_info,
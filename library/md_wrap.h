@@ -30,6 +30,12 @@
 
 #include "mbedtls/md.h"
 
+#include "mbedtls/md5.h"
+#include "mbedtls/ripemd160.h"
+#include "mbedtls/sha1.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/sha512.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -75,6 +81,86 @@ extern const mbedtls_md_info_t mbedtls_sha384_info;
 extern const mbedtls_md_info_t mbedtls_sha512_info;
 #endif
 
+/**
+ * A hash context of any type supported by the MD module.
+ */
+typedef union
+{
+#if defined(MBEDTLS_MD5_C)
+    mbedtls_md5_context md5;
+#endif
+#if defined(MBEDTLS_RIPEMD160_C)
+    mbedtls_ripemd160_context ripemd160;
+#endif
+#if defined(MBEDTLS_SHA1_C)
+    mbedtls_sha1_context sha1;
+#endif
+#if defined(MBEDTLS_SHA224_C) || defined(MBEDTLS_SHA256_C)
+    mbedtls_sha256_context sha256;
+#endif
+#if defined(MBEDTLS_SHA384_C) || defined(MBEDTLS_SHA512_C)
+    mbedtls_sha512_context sha512;
+#endif
+    unsigned char dummy;
+} mbedtls_md_hash_context_t;
+
+/**
+ * Caller-provided storage for an HMAC context, so that short-lived HMAC
+ * computations do not need the heap.
+ */
+typedef struct
+{
+    mbedtls_md_hash_context_t hash;     /*!< The running hash state */
+    mbedtls_md_hash_context_t hmac[2];  /*!< Inner and outer key states */
+} mbedtls_md_hmac_storage_t;
+
+/**
+ * \brief           Set up an HMAC context whose state lives in \p storage.
+ *
+ *                  This is equivalent to mbedtls_md_setup() with \c hmac
+ *                  set to 1, but never allocates memory. \p storage must
+ *                  outlive the context, which must be released with
+ *                  mbedtls_md_free_with_storage() instead of
+ *                  mbedtls_md_free().
+ *
+ * \param ctx       The context to set up. It must be initialized.
+ * \param md_info   The hash algorithm.
+ * \param storage   The storage for the hash states.
+ *
+ * \return          \c 0 on success.
+ * \return          #MBEDTLS_ERR_MD_BAD_INPUT_DATA on parameter failure.
+ */
+int mbedtls_md_setup_hmac_with_storage( mbedtls_md_context_t *ctx,
+                                        const mbedtls_md_info_t *md_info,
+                                        mbedtls_md_hmac_storage_t *storage );
+
+/**
+ * \brief           Release a context set up with
+ *                  mbedtls_md_setup_hmac_with_storage() and wipe \p storage.
+ *
+ * \param ctx       The context to release.
+ * \param storage   The storage passed when setting up \p ctx.
+ */
+void mbedtls_md_free_with_storage( mbedtls_md_context_t *ctx,
+                                   mbedtls_md_hmac_storage_t *storage );
+
+/**
+ * \brief           Load the precomputed outer HMAC state, that is the hash
+ *                  state after absorbing the key xor opad, into the running
+ *                  hash state of \p ctx.
+ *
+ *                  This is for code that finishes the inner hash itself,
+ *                  such as mbedtls_ct_hmac(). Continue with
+ *                  mbedtls_md_update() on the inner hash and
+ *                  mbedtls_md_finish().
+ *
+ * \param ctx       An HMAC context set up with a key.
+ *
+ * \return          \c 0 on success.
+ * \return          #MBEDTLS_ERR_MD_BAD_INPUT_DATA on parameter failure.
+ */
+int mbedtls_md_hmac_outer_starts( mbedtls_md_context_t *ctx );
+
 #ifdef __cplusplus
 }
 #endif
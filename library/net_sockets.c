@@ -26,6 +26,10 @@
 #ifndef _XOPEN_SOURCE
 #define _XOPEN_SOURCE 600 /* sockaddr_storage */
 #endif
+/* Enable definition of recvmmsg() and sendmmsg() on Linux. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 
 #include "common.h"
 
@@ -91,6 +95,11 @@ static int wsa_init_done = 0;
 
 #define IS_EINTR( ret ) ( ( ret ) == EINTR )
 
+/* Batched datagram I/O with a single system call */
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define NET_HAVE_MMSG
+#endif
+
 #endif /* ( _WIN32 || _WIN32_WCE ) && !EFIX64 && !EFI32 */
 
 /* Some MS functions want int and MSVC warns if we pass size_t,
@@ -108,6 +117,7 @@ static int wsa_init_done = 0;
 #endif
 
 #include <stdint.h>
+#include <limits.h>
 
 /*
  * Prepare for using the sockets interface
@@ -681,6 +691,204 @@ int mbedtls_net_send( void *ctx, const unsigned char *buf, size_t len )
     return( ret );
 }
 
+/*
+ * Error code for a failed datagram system call
+ */
+static int net_dgram_error( void *ctx, int would_block, int failed )
+{
+    if( net_would_block( ctx ) != 0 )
+        return( would_block );
+
+#if ( defined(_WIN32) || defined(_WIN32_WCE) ) && !defined(EFIX64) && \
+    !defined(EFI32)
+    if( WSAGetLastError() == WSAECONNRESET )
+        return( MBEDTLS_ERR_NET_CONN_RESET );
+#else
+    if( errno == EPIPE || errno == ECONNRESET )
+        return( MBEDTLS_ERR_NET_CONN_RESET );
+
+    if( errno == EINTR )
+        return( would_block );
+#endif
+
+    return( failed );
+}
+
+#if defined(NET_HAVE_MMSG)
+/* Maximum number of datagrams per recvmmsg() or sendmmsg() call */
+#define NET_BATCH_MAX   32
+#endif
+
+/*
+ * Receive up to 'count' datagrams
+ */
+int mbedtls_net_recv_batch( void *ctx, mbedtls_ssl_dgram *dgrams,
+                            size_t count )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int fd = ((mbedtls_net_context *) ctx)->fd;
+
+    ret = check_fd( fd, 0 );
+    if( ret != 0 )
+        return( ret );
+
+    if( dgrams == NULL || count == 0 )
+        return( MBEDTLS_ERR_NET_BAD_INPUT_DATA );
+
+#if defined(NET_HAVE_MMSG)
+    {
+        struct mmsghdr msgs[NET_BATCH_MAX];
+        struct iovec iov[NET_BATCH_MAX];
+        unsigned int i, n;
+
+        n = count > NET_BATCH_MAX ? NET_BATCH_MAX : (unsigned int) count;
+
+        memset( msgs, 0, sizeof( msgs ) );
+        for( i = 0; i < n; i++ )
+        {
+            iov[i].iov_base = dgrams[i].buf;
+            iov[i].iov_len  = dgrams[i].len;
+            msgs[i].msg_hdr.msg_iov     = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen  = 1;
+            msgs[i].msg_hdr.msg_name    = dgrams[i].addr;
+            msgs[i].msg_hdr.msg_namelen = sizeof( dgrams[i].addr );
+        }
+
+        /* Block (on a blocking socket) for the first datagram only */
+        ret = recvmmsg( fd, msgs, n, MSG_WAITFORONE, NULL );
+
+        if( ret < 0 )
+            return( net_dgram_error( ctx, MBEDTLS_ERR_SSL_WANT_READ,
+                                     MBEDTLS_ERR_NET_RECV_FAILED ) );
+
+        for( i = 0; i < (unsigned int) ret; i++ )
+        {
+            if( msgs[i].msg_hdr.msg_namelen > sizeof( dgrams[i].addr ) )
+                return( MBEDTLS_ERR_NET_BUFFER_TOO_SMALL );
+
+            dgrams[i].len      = msgs[i].msg_len;
+            dgrams[i].addr_len = msgs[i].msg_hdr.msg_namelen;
+        }
+
+        return( ret );
+    }
+#else
+    {
+        struct sockaddr_storage addr;
+#if defined(__socklen_t_defined) || defined(_SOCKLEN_T) ||  \
+    defined(_SOCKLEN_T_DECLARED) || defined(__DEFINED_socklen_t) || \
+    defined(socklen_t) || (defined(_POSIX_VERSION) && _POSIX_VERSION >= 200112L)
+        socklen_t n = (socklen_t) sizeof( addr );
+#else
+        int n = (int) sizeof( addr );
+#endif
+
+        ret = (int) recvfrom( fd, (char *) dgrams[0].buf,
+                              MSVC_INT_CAST dgrams[0].len, 0,
+                              (struct sockaddr *) &addr, &n );
+
+        if( ret < 0 )
+            return( net_dgram_error( ctx, MBEDTLS_ERR_SSL_WANT_READ,
+                                     MBEDTLS_ERR_NET_RECV_FAILED ) );
+
+        if( (size_t) n > sizeof( dgrams[0].addr ) )
+            return( MBEDTLS_ERR_NET_BUFFER_TOO_SMALL );
+
+        memcpy( dgrams[0].addr, &addr, (size_t) n );
+        dgrams[0].addr_len = (size_t) n;
+        dgrams[0].len      = (size_t) ret;
+
+        return( 1 );
+    }
+#endif /* NET_HAVE_MMSG */
+}
+
+/*
+ * Send up to 'count' datagrams
+ */
+int mbedtls_net_send_batch( void *ctx, const mbedtls_ssl_dgram *dgrams,
+                            size_t count )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int fd = ((mbedtls_net_context *) ctx)->fd;
+
+    ret = check_fd( fd, 0 );
+    if( ret != 0 )
+        return( ret );
+
+    if( dgrams == NULL || count == 0 )
+        return( MBEDTLS_ERR_NET_BAD_INPUT_DATA );
+
+#if defined(NET_HAVE_MMSG)
+    {
+        struct mmsghdr msgs[NET_BATCH_MAX];
+        struct iovec iov[NET_BATCH_MAX];
+        unsigned int i, n;
+
+        n = count > NET_BATCH_MAX ? NET_BATCH_MAX : (unsigned int) count;
+
+        memset( msgs, 0, sizeof( msgs ) );
+        for( i = 0; i < n; i++ )
+        {
+            if( dgrams[i].addr_len > sizeof( dgrams[i].addr ) )
+                return( MBEDTLS_ERR_NET_BAD_INPUT_DATA );
+
+            iov[i].iov_base = dgrams[i].buf;
+            iov[i].iov_len  = dgrams[i].len;
+            msgs[i].msg_hdr.msg_iov    = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if( dgrams[i].addr_len != 0 )
+            {
+                msgs[i].msg_hdr.msg_name    = (void *) dgrams[i].addr;
+                msgs[i].msg_hdr.msg_namelen = (socklen_t) dgrams[i].addr_len;
+            }
+        }
+
+        ret = sendmmsg( fd, msgs, n, 0 );
+
+        if( ret < 0 )
+            return( net_dgram_error( ctx, MBEDTLS_ERR_SSL_WANT_WRITE,
+                                     MBEDTLS_ERR_NET_SEND_FAILED ) );
+
+        return( ret );
+    }
+#else
+    {
+        size_t i;
+
+        if( count > INT_MAX )
+            count = INT_MAX;
+
+        for( i = 0; i < count; i++ )
+        {
+            if( dgrams[i].addr_len > sizeof( dgrams[i].addr ) )
+                return( MBEDTLS_ERR_NET_BAD_INPUT_DATA );
+
+            if( dgrams[i].addr_len == 0 )
+                ret = (int) send( fd, (const char *) dgrams[i].buf,
+                                  MSVC_INT_CAST dgrams[i].len, 0 );
+            else
+                ret = (int) sendto( fd, (const char *) dgrams[i].buf,
+                                    MSVC_INT_CAST dgrams[i].len, 0,
+                                    (const struct sockaddr *) dgrams[i].addr,
+                                    MSVC_INT_CAST dgrams[i].addr_len );
+
+            if( ret < 0 )
+            {
+                /* Report the datagrams already sent, if any */
+                if( i > 0 )
+                    return( (int) i );
+
+                return( net_dgram_error( ctx, MBEDTLS_ERR_SSL_WANT_WRITE,
+                                         MBEDTLS_ERR_NET_SEND_FAILED ) );
+            }
+        }
+
+        return( (int) count );
+    }
+#endif /* NET_HAVE_MMSG */
+}
+
 /*
  * Close the connection
  */
@@ -53,6 +53,10 @@
 /*
  * Macro to generate an internal function for oid_XXX_from_asn1() (used by
  * the other functions)
+ *
+ * The OIDs of a list mostly share a long common prefix and differ in their
+ * last byte, so compare the last byte before the whole OID: most entries
+ * are then rejected without calling memcmp().
  */
 #define FN_OID_TYPED_FROM_ASN1( TYPE_T, NAME, LIST )                    \
     static const TYPE_T * oid_ ## NAME ## _from_asn1(                   \
@@ -61,10 +65,12 @@
         const TYPE_T *p = (LIST);                                       \
         const mbedtls_oid_descriptor_t *cur =                           \
             (const mbedtls_oid_descriptor_t *) p;                       \
-        if( p == NULL || oid == NULL ) return( NULL );                  \
+        if( p == NULL || oid == NULL || oid->len == 0 ) return( NULL ); \
         while( cur->asn1 != NULL ) {                                    \
             if( cur->asn1_len == oid->len &&                            \
-                memcmp( cur->asn1, oid->p, oid->len ) == 0 ) {          \
+                (unsigned char) cur->asn1[oid->len - 1] ==              \
+                oid->p[oid->len - 1] &&                                 \
+                memcmp( cur->asn1, oid->p, oid->len - 1 ) == 0 ) {      \
                 return( p );                                            \
             }                                                           \
             p++;                                                        \
@@ -313,9 +313,10 @@ int mbedtls_pem_read_buffer( mbedtls_pem_context *ctx, const char *header, const
                      size_t pwdlen, size_t *use_len )
 {
     int ret, enc;
-    size_t len;
+    size_t len, buflen;
     unsigned char *buf;
     const unsigned char *s1, *s2, *end;
+    mbedtls_base64_decode_context b64;
 #if defined(PEM_RFC1421)
     unsigned char pem_iv[16];
     mbedtls_cipher_type_t enc_alg = MBEDTLS_CIPHER_NONE;
@@ -422,17 +423,31 @@ int mbedtls_pem_read_buffer( mbedtls_pem_context *ctx, const char *header, const
     if( s1 >= s2 )
         return( MBEDTLS_ERR_PEM_INVALID_DATA );
 
-    ret = mbedtls_base64_decode( NULL, 0, &len, s1, s2 - s1 );
-
-    if( ret == MBEDTLS_ERR_BASE64_INVALID_CHARACTER )
-        return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_PEM_INVALID_DATA, ret ) );
+    /*
+     * Decode in a single pass into a buffer sized for the worst case, that
+     * is, as if the encapsulated text contained no line breaks.
+     */
+    buflen = 3 * ( ( (size_t) ( s2 - s1 ) + 3 ) / 4 );
 
-    if( ( buf = mbedtls_calloc( 1, len ) ) == NULL )
+    if( ( buf = mbedtls_calloc( 1, buflen ) ) == NULL )
         return( MBEDTLS_ERR_PEM_ALLOC_FAILED );
 
-    if( ( ret = mbedtls_base64_decode( buf, len, &len, s1, s2 - s1 ) ) != 0 )
+    mbedtls_base64_decode_init( &b64 );
+    ret = mbedtls_base64_decode_update( &b64, buf, buflen, &len,
+                                        s1, s2 - s1 );
+    if( ret == 0 )
     {
-        mbedtls_platform_zeroize( buf, len );
+        /* As with mbedtls_base64_decode(), which was used before, ignore
+         * the digits of a partial final group */
+        b64.digits = 0;
+        ret = mbedtls_base64_decode_finish( &b64 );
+    }
+    else
+        mbedtls_platform_zeroize( &b64, sizeof( b64 ) );
+
+    if( ret != 0 )
+    {
+        mbedtls_platform_zeroize( buf, buflen );
         mbedtls_free( buf );
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_PEM_INVALID_DATA, ret ) );
     }
@@ -29,6 +29,7 @@
 #include "psa/crypto.h"
 #include "psa/crypto_values.h"
 
+#include "psa_crypto_aead.h"
 #include "psa_crypto_cipher.h"
 #include "psa_crypto_core.h"
 #include "psa_crypto_invasive.h"
@@ -113,7 +114,8 @@ typedef struct
 
 static psa_global_data_t global_data;
 
-#if !defined(MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG)
+#if !defined(MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG) && \
+    !defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
 mbedtls_psa_drbg_context_t *const mbedtls_psa_random_state =
     &global_data.rng.drbg;
 #endif
@@ -981,6 +983,15 @@ psa_status_t psa_remove_key_data_from_memory( psa_key_slot_t *slot )
     slot->key.data = NULL;
     slot->key.bytes = 0;
 
+#if defined(MBEDTLS_PSA_BUILTIN_AEAD)
+    if( slot->aead_keyed != NULL )
+    {
+        mbedtls_psa_aead_abort( slot->aead_keyed );
+        mbedtls_free( slot->aead_keyed );
+        slot->aead_keyed = NULL;
+    }
+#endif
+
     return( PSA_SUCCESS );
 }
 
@@ -1009,10 +1020,7 @@ psa_status_t psa_wipe_key_slot( psa_key_slot_t *slot )
      * the key slot: if they need to access the key after the setup
      * phase, they have a copy of the key. Note that this means that
      * key material can linger until all operations are completed. */
-    /* At this point, key material and other type-specific content has
-     * been wiped. Clear remaining metadata. We can call memset and not
-     * zeroize because the metadata is not particularly sensitive. */
-    memset( slot, 0, sizeof( *slot ) );
+    psa_free_key_slot( slot );
     return( status );
 }
 
@@ -1039,6 +1047,13 @@ psa_status_t psa_destroy_key( mbedtls_svc_key_id_t key )
     if( status != PSA_SUCCESS )
         return( status );
 
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+    {
+        psa_unlock_key_slot( slot );
+        return( status );
+    }
+
     /*
      * If the key slot containing the key description is under access by the
      * library (apart from the present access), the key cannot be destroyed
@@ -1048,10 +1063,21 @@ psa_status_t psa_destroy_key( mbedtls_svc_key_id_t key )
      */
     if( slot->lock_count > 1 )
     {
+       psa_key_store_unlock( );
        psa_unlock_key_slot( slot );
        return( PSA_ERROR_GENERIC_ERROR );
     }
 
+    /* From now on, the key cannot be looked up and locked anymore, so we
+     * can work on the key slot without holding the key store mutex. */
+    slot->state = PSA_SLOT_PENDING_DELETION;
+    status = psa_key_store_unlock( );
+    if( status != PSA_SUCCESS )
+    {
+        overall_status = status;
+        goto exit;
+    }
+
     if( PSA_KEY_LIFETIME_IS_READ_ONLY( slot->attr.lifetime ) )
     {
         /* Refuse the destruction of a read-only key (which may or may not work
@@ -1125,7 +1151,20 @@ psa_status_t psa_destroy_key( mbedtls_svc_key_id_t key )
 #endif /* MBEDTLS_PSA_CRYPTO_SE_C */
 
 exit:
-    status = psa_wipe_key_slot( slot );
+    status = psa_key_store_lock( );
+    if( status == PSA_SUCCESS )
+    {
+        status = psa_wipe_key_slot( slot );
+        if( psa_key_store_unlock( ) != PSA_SUCCESS &&
+            status == PSA_SUCCESS )
+            status = PSA_ERROR_GENERIC_ERROR;
+    }
+    else
+    {
+        /* The slot cannot go back to the free list without the key store
+         * mutex, but nobody else can reach it: at least wipe the key. */
+        (void) psa_remove_key_data_from_memory( slot );
+    }
     /* Prioritize CORRUPTION_DETECTED from wiping over a storage error */
     if( status != PSA_SUCCESS )
         overall_status = status;
@@ -1758,6 +1797,10 @@ static psa_status_t psa_finish_key_creation(
     }
 #endif /* MBEDTLS_PSA_CRYPTO_SE_C */
 
+    /* Make the key visible to other users of the key store. */
+    if( status == PSA_SUCCESS )
+        status = psa_publish_key_slot( slot );
+
     if( status == PSA_SUCCESS )
     {
         *key = slot->attr.id;
@@ -1806,7 +1849,10 @@ static void psa_fail_key_creation( psa_key_slot_t *slot,
     (void) psa_crypto_stop_transaction( );
 #endif /* MBEDTLS_PSA_CRYPTO_SE_C */
 
+    if( psa_key_store_lock( ) != PSA_SUCCESS )
+        return;
     psa_wipe_key_slot( slot );
+    (void) psa_key_store_unlock( );
 }
 
 /** Validate optional attributes during key creation.
@@ -3603,6 +3649,79 @@ static psa_status_t psa_aead_check_algorithm( psa_algorithm_t alg )
     return( PSA_SUCCESS );
 }
 
+#if defined(MBEDTLS_PSA_BUILTIN_AEAD) && \
+    !defined(PSA_CRYPTO_ACCELERATOR_DRIVER_PRESENT)
+/* Get the expanded form of the key in slot for one-shot AEAD operations with
+ * alg, creating it if needed. Any failure means that the operation has to go
+ * through the driver wrapper instead. */
+static psa_status_t psa_aead_get_keyed( psa_key_slot_t *slot,
+                                        psa_algorithm_t alg,
+                                        const mbedtls_psa_aead_operation_t **keyed )
+{
+    psa_status_t status;
+    mbedtls_psa_aead_operation_t *operation;
+    psa_key_attributes_t attributes = {
+      .core = slot->attr
+    };
+
+    if( PSA_KEY_LIFETIME_GET_LOCATION( slot->attr.lifetime ) !=
+        PSA_KEY_LOCATION_LOCAL_STORAGE )
+        return( PSA_ERROR_NOT_SUPPORTED );
+
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+        return( status );
+    operation = slot->aead_keyed;
+    status = psa_key_store_unlock( );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    if( operation == NULL )
+    {
+        operation = mbedtls_calloc( 1, sizeof( *operation ) );
+        if( operation == NULL )
+            return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+        status = mbedtls_psa_aead_keyed_setup( operation, &attributes,
+                                               slot->key.data, slot->key.bytes,
+                                               alg );
+        if( status != PSA_SUCCESS )
+        {
+            mbedtls_free( operation );
+            return( status );
+        }
+
+        /* Another thread using the same key may have been faster. The
+         * context is not modified once set, so keep the first one. */
+        status = psa_key_store_lock( );
+        if( status == PSA_SUCCESS )
+        {
+            if( slot->aead_keyed == NULL )
+            {
+                slot->aead_keyed = operation;
+                operation = NULL;
+            }
+            status = psa_key_store_unlock( );
+        }
+        if( operation != NULL )
+        {
+            mbedtls_psa_aead_abort( operation );
+            mbedtls_free( operation );
+        }
+        if( status != PSA_SUCCESS )
+            return( status );
+    }
+
+    /* A key whose policy allows several AEAD algorithms keeps the context
+     * of the first one used. */
+    if( slot->aead_keyed->alg != PSA_ALG_AEAD_WITH_DEFAULT_LENGTH_TAG( alg ) )
+        return( PSA_ERROR_NOT_SUPPORTED );
+
+    *keyed = slot->aead_keyed;
+    return( PSA_SUCCESS );
+}
+#endif /* MBEDTLS_PSA_BUILTIN_AEAD && !PSA_CRYPTO_ACCELERATOR_DRIVER_PRESENT */
+
 psa_status_t psa_aead_encrypt( mbedtls_svc_key_id_t key,
                                psa_algorithm_t alg,
                                const uint8_t *nonce,
@@ -3617,6 +3736,10 @@ psa_status_t psa_aead_encrypt( mbedtls_svc_key_id_t key,
 {
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
     psa_key_slot_t *slot;
+#if defined(MBEDTLS_PSA_BUILTIN_AEAD) && \
+    !defined(PSA_CRYPTO_ACCELERATOR_DRIVER_PRESENT)
+    const mbedtls_psa_aead_operation_t *keyed;
+#endif
 
     *ciphertext_length = 0;
 
@@ -3637,6 +3760,17 @@ psa_status_t psa_aead_encrypt( mbedtls_svc_key_id_t key,
     if( status != PSA_SUCCESS )
         goto exit;
 
+#if defined(MBEDTLS_PSA_BUILTIN_AEAD) && \
+    !defined(PSA_CRYPTO_ACCELERATOR_DRIVER_PRESENT)
+    if( psa_aead_get_keyed( slot, alg, &keyed ) == PSA_SUCCESS )
+        status = mbedtls_psa_aead_encrypt_keyed(
+            keyed, alg,
+            nonce, nonce_length,
+            additional_data, additional_data_length,
+            plaintext, plaintext_length,
+            ciphertext, ciphertext_size, ciphertext_length );
+    else
+#endif
     status = psa_driver_wrapper_aead_encrypt(
         &attributes, slot->key.data, slot->key.bytes,
         alg,
@@ -3668,6 +3802,10 @@ psa_status_t psa_aead_decrypt( mbedtls_svc_key_id_t key,
 {
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
     psa_key_slot_t *slot;
+#if defined(MBEDTLS_PSA_BUILTIN_AEAD) && \
+    !defined(PSA_CRYPTO_ACCELERATOR_DRIVER_PRESENT)
+    const mbedtls_psa_aead_operation_t *keyed;
+#endif
 
     *plaintext_length = 0;
 
@@ -3688,6 +3826,17 @@ psa_status_t psa_aead_decrypt( mbedtls_svc_key_id_t key,
     if( status != PSA_SUCCESS )
         goto exit;
 
+#if defined(MBEDTLS_PSA_BUILTIN_AEAD) && \
+    !defined(PSA_CRYPTO_ACCELERATOR_DRIVER_PRESENT)
+    if( psa_aead_get_keyed( slot, alg, &keyed ) == PSA_SUCCESS )
+        status = mbedtls_psa_aead_decrypt_keyed(
+            keyed, alg,
+            nonce, nonce_length,
+            additional_data, additional_data_length,
+            ciphertext, ciphertext_length,
+            plaintext, plaintext_size, plaintext_length );
+    else
+#endif
     status = psa_driver_wrapper_aead_decrypt(
         &attributes, slot->key.data, slot->key.bytes,
         alg,
@@ -6000,10 +6149,135 @@ static void mbedtls_psa_random_init( mbedtls_psa_random_context_t *rng )
                                 MBEDTLS_ENTROPY_SOURCE_STRONG );
 #endif
 
-    mbedtls_psa_drbg_init( MBEDTLS_PSA_RANDOM_STATE );
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+    rng->thread_rngs = NULL;
+    mbedtls_mutex_init( &rng->mutex );
+#else
+    mbedtls_psa_drbg_init( &rng->drbg );
+#endif
 #endif /* MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG */
 }
 
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+/** Destructor of the DRBG of a thread, called when the thread exits.
+ */
+static void mbedtls_psa_thread_rng_free( void *data )
+{
+    mbedtls_psa_thread_rng_t *thread_rng = data;
+    mbedtls_psa_thread_rng_t **p;
+    int found = 0;
+
+    if( mbedtls_mutex_lock( &global_data.rng.mutex ) != 0 )
+        return;
+    for( p = &global_data.rng.thread_rngs; *p != NULL; p = &( *p )->next )
+    {
+        if( *p == thread_rng )
+        {
+            *p = thread_rng->next;
+            found = 1;
+            break;
+        }
+    }
+    (void) mbedtls_mutex_unlock( &global_data.rng.mutex );
+
+    /* If the DRBG is not in the list, mbedtls_psa_crypto_free() has already
+     * freed it. */
+    if( found )
+    {
+        mbedtls_psa_drbg_free( &thread_rng->drbg );
+        mbedtls_free( thread_rng );
+    }
+}
+
+/* Number of fork() calls that led to this process, counted by a handler
+ * registered with pthread_atfork(). It is only written in a child process
+ * before it can have other threads, so the thread DRBGs can compare it with
+ * their own copy without locking. */
+static unsigned mbedtls_psa_fork_generation = 0;
+static pthread_once_t mbedtls_psa_atfork_once = PTHREAD_ONCE_INIT;
+static int mbedtls_psa_atfork_ret = 0;
+
+static void mbedtls_psa_atfork_child( void )
+{
+    mbedtls_psa_fork_generation++;
+}
+
+static void mbedtls_psa_atfork_register( void )
+{
+    mbedtls_psa_atfork_ret = pthread_atfork( NULL, NULL,
+                                             mbedtls_psa_atfork_child );
+}
+
+/** Get the DRBG of the calling thread.
+ *
+ * The DRBG is created and seeded from the shared entropy context the first
+ * time a thread needs it. It is reseeded if the process has forked since
+ * it was last seeded. Apart from that, it reseeds itself from the entropy
+ * context according to its own reseed interval.
+ */
+static psa_status_t mbedtls_psa_get_thread_drbg(
+    mbedtls_psa_random_context_t *rng,
+    mbedtls_psa_drbg_context_t **p_drbg )
+{
+    const unsigned char drbg_seed[] = "PSA thread";
+    mbedtls_psa_thread_rng_t *thread_rng;
+    psa_status_t status;
+    int ret;
+
+    thread_rng = pthread_getspecific( rng->thread_key );
+    if( thread_rng != NULL )
+    {
+        if( thread_rng->fork_generation != mbedtls_psa_fork_generation )
+        {
+            ret = mbedtls_psa_drbg_reseed( &thread_rng->drbg );
+            if( ret != 0 )
+                return( mbedtls_to_psa_error( ret ) );
+            thread_rng->fork_generation = mbedtls_psa_fork_generation;
+        }
+        *p_drbg = &thread_rng->drbg;
+        return( PSA_SUCCESS );
+    }
+
+    thread_rng = mbedtls_calloc( 1, sizeof( *thread_rng ) );
+    if( thread_rng == NULL )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    mbedtls_psa_drbg_init( &thread_rng->drbg );
+    ret = mbedtls_psa_drbg_seed( &thread_rng->drbg, &rng->entropy,
+                                 drbg_seed, sizeof( drbg_seed ) - 1 );
+    if( ret != 0 )
+    {
+        status = mbedtls_to_psa_error( ret );
+        goto error;
+    }
+    thread_rng->fork_generation = mbedtls_psa_fork_generation;
+
+    if( pthread_setspecific( rng->thread_key, thread_rng ) != 0 )
+    {
+        status = PSA_ERROR_INSUFFICIENT_MEMORY;
+        goto error;
+    }
+
+    if( mbedtls_mutex_lock( &rng->mutex ) != 0 )
+    {
+        (void) pthread_setspecific( rng->thread_key, NULL );
+        status = PSA_ERROR_BAD_STATE;
+        goto error;
+    }
+    thread_rng->next = rng->thread_rngs;
+    rng->thread_rngs = thread_rng;
+    (void) mbedtls_mutex_unlock( &rng->mutex );
+
+    *p_drbg = &thread_rng->drbg;
+    return( PSA_SUCCESS );
+
+error:
+    mbedtls_psa_drbg_free( &thread_rng->drbg );
+    mbedtls_free( thread_rng );
+    return( status );
+}
+#endif /* MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD */
+
 /** Deinitialize the PSA random generator.
  */
 static void mbedtls_psa_random_free( mbedtls_psa_random_context_t *rng )
@@ -6011,7 +6285,28 @@ static void mbedtls_psa_random_free( mbedtls_psa_random_context_t *rng )
 #if defined(MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG)
     memset( rng, 0, sizeof( *rng ) );
 #else /* MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG */
-    mbedtls_psa_drbg_free( MBEDTLS_PSA_RANDOM_STATE );
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+    mbedtls_psa_thread_rng_t *thread_rng;
+
+    /* Free the DRBGs of all threads, including the ones that are still
+     * running: they must not use the PSA subsystem after this point. */
+    if( mbedtls_mutex_lock( &rng->mutex ) == 0 )
+    {
+        while( rng->thread_rngs != NULL )
+        {
+            thread_rng = rng->thread_rngs;
+            rng->thread_rngs = thread_rng->next;
+            mbedtls_psa_drbg_free( &thread_rng->drbg );
+            mbedtls_free( thread_rng );
+        }
+        (void) mbedtls_mutex_unlock( &rng->mutex );
+    }
+    if( rng->thread_key_created )
+        (void) pthread_key_delete( rng->thread_key );
+    mbedtls_mutex_free( &rng->mutex );
+#else
+    mbedtls_psa_drbg_free( &rng->drbg );
+#endif
     rng->entropy_free( &rng->entropy );
 #endif /* MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG */
 }
@@ -6024,9 +6319,27 @@ static psa_status_t mbedtls_psa_random_seed( mbedtls_psa_random_context_t *rng )
     /* Do nothing: the external RNG seeds itself. */
     (void) rng;
     return( PSA_SUCCESS );
+#elif defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+    /* Seed the DRBG of the calling thread now, to report entropy
+     * failures from psa_crypto_init(). */
+    mbedtls_psa_drbg_context_t *drbg;
+
+    /* The fork handler cannot be unregistered, so register it only once
+     * even if the PSA subsystem is initialized several times. */
+    if( pthread_once( &mbedtls_psa_atfork_once,
+                      mbedtls_psa_atfork_register ) != 0 ||
+        mbedtls_psa_atfork_ret != 0 )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    if( pthread_key_create( &rng->thread_key,
+                            mbedtls_psa_thread_rng_free ) != 0 )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+    rng->thread_key_created = 1;
+
+    return( mbedtls_psa_get_thread_drbg( rng, &drbg ) );
 #else /* MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG */
     const unsigned char drbg_seed[] = "PSA";
-    int ret = mbedtls_psa_drbg_seed( &rng->entropy,
+    int ret = mbedtls_psa_drbg_seed( &rng->drbg, &rng->entropy,
                                      drbg_seed, sizeof( drbg_seed ) - 1 );
     return mbedtls_to_psa_error( ret );
 #endif /* MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG */
@@ -6053,14 +6366,26 @@ psa_status_t psa_generate_random( uint8_t *output,
 
 #else /* MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG */
 
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+    mbedtls_psa_drbg_context_t *drbg;
+    psa_status_t status = mbedtls_psa_get_thread_drbg( &global_data.rng,
+                                                       &drbg );
+    if( status != PSA_SUCCESS )
+        return( status );
+#endif
+
     while( output_size > 0 )
     {
         size_t request_size =
             ( output_size > MBEDTLS_PSA_RANDOM_MAX_REQUEST ?
               MBEDTLS_PSA_RANDOM_MAX_REQUEST :
               output_size );
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+        int ret = mbedtls_psa_drbg_generate( drbg, output, request_size );
+#else
         int ret = mbedtls_psa_get_random( MBEDTLS_PSA_RANDOM_STATE,
                                           output, request_size );
+#endif
         if( ret != 0 )
             return( mbedtls_to_psa_error( ret ) );
         output_size -= request_size;
@@ -6102,6 +6427,27 @@ int mbedtls_psa_get_random( void *p_rng,
 }
 #endif /* MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG */
 
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+/* With one DRBG per thread, there is no global DRBG state that could be
+ * passed to an `mbedtls_xxx_drbg_random` function: look up the DRBG of the
+ * calling thread instead. Unlike psa_generate_random(), this function does
+ * not split large requests, so as to report the same errors as the DRBG
+ * functions. */
+int mbedtls_psa_get_random( void *p_rng,
+                            unsigned char *output,
+                            size_t output_size )
+{
+    mbedtls_psa_drbg_context_t *drbg;
+
+    (void) p_rng;
+    if( global_data.rng_state != RNG_SEEDED ||
+        mbedtls_psa_get_thread_drbg( &global_data.rng, &drbg ) != PSA_SUCCESS )
+        return( MBEDTLS_ERR_ENTROPY_SOURCE_FAILED );
+
+    return( mbedtls_psa_drbg_generate( drbg, output, output_size ) );
+}
+#endif /* MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD */
+
 #if defined(MBEDTLS_PSA_INJECT_ENTROPY)
 #include "entropy_poll.h"
 
@@ -124,72 +124,62 @@ static psa_status_t psa_aead_setup(
     return( PSA_SUCCESS );
 }
 
-psa_status_t mbedtls_psa_aead_encrypt(
-    const psa_key_attributes_t *attributes,
-    const uint8_t *key_buffer, size_t key_buffer_size,
-    psa_algorithm_t alg,
+/* Encrypt with an operation object that has been set up with the key. */
+static psa_status_t psa_aead_encrypt_with_operation(
+    mbedtls_psa_aead_operation_t *operation,
     const uint8_t *nonce, size_t nonce_length,
     const uint8_t *additional_data, size_t additional_data_length,
     const uint8_t *plaintext, size_t plaintext_length,
     uint8_t *ciphertext, size_t ciphertext_size, size_t *ciphertext_length )
 {
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-    mbedtls_psa_aead_operation_t operation = MBEDTLS_PSA_AEAD_OPERATION_INIT;
     uint8_t *tag;
 
-    status = psa_aead_setup( &operation, attributes, key_buffer,
-                             key_buffer_size, alg );
-
-    if( status != PSA_SUCCESS )
-        goto exit;
-
     /* For all currently supported modes, the tag is at the end of the
      * ciphertext. */
-    if( ciphertext_size < ( plaintext_length + operation.tag_length ) )
+    if( ciphertext_size < ( plaintext_length + operation->tag_length ) )
     {
-        status = PSA_ERROR_BUFFER_TOO_SMALL;
-        goto exit;
+        return( PSA_ERROR_BUFFER_TOO_SMALL );
     }
     tag = ciphertext + plaintext_length;
 
 #if defined(MBEDTLS_PSA_BUILTIN_ALG_CCM)
-    if( operation.alg == PSA_ALG_CCM )
+    if( operation->alg == PSA_ALG_CCM )
     {
         status = mbedtls_to_psa_error(
-            mbedtls_ccm_encrypt_and_tag( &operation.ctx.ccm,
+            mbedtls_ccm_encrypt_and_tag( &operation->ctx.ccm,
                                          plaintext_length,
                                          nonce, nonce_length,
                                          additional_data,
                                          additional_data_length,
                                          plaintext, ciphertext,
-                                         tag, operation.tag_length ) );
+                                         tag, operation->tag_length ) );
     }
     else
 #endif /* MBEDTLS_PSA_BUILTIN_ALG_CCM */
 #if defined(MBEDTLS_PSA_BUILTIN_ALG_GCM)
-    if( operation.alg == PSA_ALG_GCM )
+    if( operation->alg == PSA_ALG_GCM )
     {
         status = mbedtls_to_psa_error(
-            mbedtls_gcm_crypt_and_tag( &operation.ctx.gcm,
+            mbedtls_gcm_crypt_and_tag( &operation->ctx.gcm,
                                        MBEDTLS_GCM_ENCRYPT,
                                        plaintext_length,
                                        nonce, nonce_length,
                                        additional_data, additional_data_length,
                                        plaintext, ciphertext,
-                                       operation.tag_length, tag ) );
+                                       operation->tag_length, tag ) );
     }
     else
 #endif /* MBEDTLS_PSA_BUILTIN_ALG_GCM */
 #if defined(MBEDTLS_PSA_BUILTIN_ALG_CHACHA20_POLY1305)
-    if( operation.alg == PSA_ALG_CHACHA20_POLY1305 )
+    if( operation->alg == PSA_ALG_CHACHA20_POLY1305 )
     {
-        if( operation.tag_length != 16 )
+        if( operation->tag_length != 16 )
         {
-            status = PSA_ERROR_NOT_SUPPORTED;
-            goto exit;
+            return( PSA_ERROR_NOT_SUPPORTED );
         }
         status = mbedtls_to_psa_error(
-            mbedtls_chachapoly_encrypt_and_tag( &operation.ctx.chachapoly,
+            mbedtls_chachapoly_encrypt_and_tag( &operation->ctx.chachapoly,
                                                 plaintext_length,
                                                 nonce,
                                                 additional_data,
@@ -211,9 +201,35 @@ psa_status_t mbedtls_psa_aead_encrypt(
     }
 
     if( status == PSA_SUCCESS )
-        *ciphertext_length = plaintext_length + operation.tag_length;
+        *ciphertext_length = plaintext_length + operation->tag_length;
+
+    return( status );
+}
+
+psa_status_t mbedtls_psa_aead_encrypt(
+    const psa_key_attributes_t *attributes,
+    const uint8_t *key_buffer, size_t key_buffer_size,
+    psa_algorithm_t alg,
+    const uint8_t *nonce, size_t nonce_length,
+    const uint8_t *additional_data, size_t additional_data_length,
+    const uint8_t *plaintext, size_t plaintext_length,
+    uint8_t *ciphertext, size_t ciphertext_size, size_t *ciphertext_length )
+{
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    mbedtls_psa_aead_operation_t operation = MBEDTLS_PSA_AEAD_OPERATION_INIT;
+
+    status = psa_aead_setup( &operation, attributes, key_buffer,
+                             key_buffer_size, alg );
+
+    if( status == PSA_SUCCESS )
+        status = psa_aead_encrypt_with_operation( &operation,
+                                                  nonce, nonce_length,
+                                                  additional_data,
+                                                  additional_data_length,
+                                                  plaintext, plaintext_length,
+                                                  ciphertext, ciphertext_size,
+                                                  ciphertext_length );
 
-exit:
     mbedtls_psa_aead_abort( &operation );
 
     return( status );
@@ -240,70 +256,61 @@ static psa_status_t psa_aead_unpadded_locate_tag( size_t tag_length,
     return( PSA_SUCCESS );
 }
 
-psa_status_t mbedtls_psa_aead_decrypt(
-    const psa_key_attributes_t *attributes,
-    const uint8_t *key_buffer, size_t key_buffer_size,
-    psa_algorithm_t alg,
+/* Decrypt with an operation object that has been set up with the key. */
+static psa_status_t psa_aead_decrypt_with_operation(
+    mbedtls_psa_aead_operation_t *operation,
     const uint8_t *nonce, size_t nonce_length,
     const uint8_t *additional_data, size_t additional_data_length,
     const uint8_t *ciphertext, size_t ciphertext_length,
     uint8_t *plaintext, size_t plaintext_size, size_t *plaintext_length )
 {
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-    mbedtls_psa_aead_operation_t operation = MBEDTLS_PSA_AEAD_OPERATION_INIT;
     const uint8_t *tag = NULL;
 
-    status = psa_aead_setup( &operation, attributes, key_buffer,
-                             key_buffer_size, alg );
-
-    if( status != PSA_SUCCESS )
-        goto exit;
-
-    status = psa_aead_unpadded_locate_tag( operation.tag_length,
+    status = psa_aead_unpadded_locate_tag( operation->tag_length,
                                            ciphertext, ciphertext_length,
                                            plaintext_size, &tag );
     if( status != PSA_SUCCESS )
-        goto exit;
+        return( status );
 
 #if defined(MBEDTLS_PSA_BUILTIN_ALG_CCM)
-    if( operation.alg == PSA_ALG_CCM )
+    if( operation->alg == PSA_ALG_CCM )
     {
         status = mbedtls_to_psa_error(
-            mbedtls_ccm_auth_decrypt( &operation.ctx.ccm,
-                                      ciphertext_length - operation.tag_length,
+            mbedtls_ccm_auth_decrypt( &operation->ctx.ccm,
+                                      ciphertext_length - operation->tag_length,
                                       nonce, nonce_length,
                                       additional_data,
                                       additional_data_length,
                                       ciphertext, plaintext,
-                                      tag, operation.tag_length ) );
+                                      tag, operation->tag_length ) );
     }
     else
 #endif /* MBEDTLS_PSA_BUILTIN_ALG_CCM */
 #if defined(MBEDTLS_PSA_BUILTIN_ALG_GCM)
-    if( operation.alg == PSA_ALG_GCM )
+    if( operation->alg == PSA_ALG_GCM )
     {
         status = mbedtls_to_psa_error(
-            mbedtls_gcm_auth_decrypt( &operation.ctx.gcm,
-                                      ciphertext_length - operation.tag_length,
+            mbedtls_gcm_auth_decrypt( &operation->ctx.gcm,
+                                      ciphertext_length - operation->tag_length,
                                       nonce, nonce_length,
                                       additional_data,
                                       additional_data_length,
-                                      tag, operation.tag_length,
+                                      tag, operation->tag_length,
                                       ciphertext, plaintext ) );
     }
     else
 #endif /* MBEDTLS_PSA_BUILTIN_ALG_GCM */
 #if defined(MBEDTLS_PSA_BUILTIN_ALG_CHACHA20_POLY1305)
-    if( operation.alg == PSA_ALG_CHACHA20_POLY1305 )
+    if( operation->alg == PSA_ALG_CHACHA20_POLY1305 )
     {
-        if( operation.tag_length != 16 )
+        if( operation->tag_length != 16 )
         {
-            status = PSA_ERROR_NOT_SUPPORTED;
-            goto exit;
+            return( PSA_ERROR_NOT_SUPPORTED );
         }
         status = mbedtls_to_psa_error(
-            mbedtls_chachapoly_auth_decrypt( &operation.ctx.chachapoly,
-                                             ciphertext_length - operation.tag_length,
+            mbedtls_chachapoly_auth_decrypt( &operation->ctx.chachapoly,
+                                             ciphertext_length - operation->tag_length,
                                              nonce,
                                              additional_data,
                                              additional_data_length,
@@ -323,13 +330,137 @@ psa_status_t mbedtls_psa_aead_decrypt(
     }
 
     if( status == PSA_SUCCESS )
-        *plaintext_length = ciphertext_length - operation.tag_length;
+        *plaintext_length = ciphertext_length - operation->tag_length;
 
-exit:
-    mbedtls_psa_aead_abort( &operation );
+    return( status );
+}
+
+psa_status_t mbedtls_psa_aead_decrypt(
+    const psa_key_attributes_t *attributes,
+    const uint8_t *key_buffer, size_t key_buffer_size,
+    psa_algorithm_t alg,
+    const uint8_t *nonce, size_t nonce_length,
+    const uint8_t *additional_data, size_t additional_data_length,
+    const uint8_t *ciphertext, size_t ciphertext_length,
+    uint8_t *plaintext, size_t plaintext_size, size_t *plaintext_length )
+{
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    mbedtls_psa_aead_operation_t operation = MBEDTLS_PSA_AEAD_OPERATION_INIT;
+
+    status = psa_aead_setup( &operation, attributes, key_buffer,
+                             key_buffer_size, alg );
 
     if( status == PSA_SUCCESS )
-        *plaintext_length = ciphertext_length - operation.tag_length;
+        status = psa_aead_decrypt_with_operation( &operation,
+                                                  nonce, nonce_length,
+                                                  additional_data,
+                                                  additional_data_length,
+                                                  ciphertext, ciphertext_length,
+                                                  plaintext, plaintext_size,
+                                                  plaintext_length );
+
+    mbedtls_psa_aead_abort( &operation );
+
+    return( status );
+}
+
+/*
+ * One-shot operations with a context that already holds the expanded key.
+ *
+ * The context is never modified: each call works on a shallow copy of it.
+ * The copy shares the key schedule of the underlying block cipher, which
+ * the CCM and GCM modules only use through ECB encryption and therefore
+ * only read. This lets concurrent callers use the same context.
+ */
+#if !defined(MBEDTLS_CCM_ALT) && !defined(MBEDTLS_GCM_ALT) && \
+    !defined(MBEDTLS_CHACHAPOLY_ALT)
+#define PSA_AEAD_KEYED_CONTEXT_SUPPORTED
+#endif
+
+psa_status_t mbedtls_psa_aead_keyed_setup(
+    mbedtls_psa_aead_operation_t *keyed,
+    const psa_key_attributes_t *attributes,
+    const uint8_t *key_buffer, size_t key_buffer_size,
+    psa_algorithm_t alg )
+{
+#if defined(PSA_AEAD_KEYED_CONTEXT_SUPPORTED)
+    psa_status_t status;
+
+    status = psa_aead_setup( keyed, attributes, key_buffer,
+                             key_buffer_size, alg );
+    if( status != PSA_SUCCESS )
+        mbedtls_psa_aead_abort( keyed );
+
+    return( status );
+#else
+    (void) keyed;
+    (void) attributes;
+    (void) key_buffer;
+    (void) key_buffer_size;
+    (void) alg;
+    return( PSA_ERROR_NOT_SUPPORTED );
+#endif
+}
+
+psa_status_t mbedtls_psa_aead_encrypt_keyed(
+    const mbedtls_psa_aead_operation_t *keyed,
+    psa_algorithm_t alg,
+    const uint8_t *nonce, size_t nonce_length,
+    const uint8_t *additional_data, size_t additional_data_length,
+    const uint8_t *plaintext, size_t plaintext_length,
+    uint8_t *ciphertext, size_t ciphertext_size, size_t *ciphertext_length )
+{
+    psa_status_t status;
+    mbedtls_psa_aead_operation_t operation;
+
+    if( PSA_ALG_AEAD_WITH_DEFAULT_LENGTH_TAG( alg ) != keyed->alg )
+        return( PSA_ERROR_INVALID_ARGUMENT );
+
+    memcpy( &operation, keyed, sizeof( operation ) );
+    operation.tag_length = PSA_ALG_AEAD_GET_TAG_LENGTH( alg );
+
+    status = psa_aead_encrypt_with_operation( &operation,
+                                              nonce, nonce_length,
+                                              additional_data,
+                                              additional_data_length,
+                                              plaintext, plaintext_length,
+                                              ciphertext, ciphertext_size,
+                                              ciphertext_length );
+
+    /* Not mbedtls_psa_aead_abort(): the key schedule belongs to keyed */
+    mbedtls_platform_zeroize( &operation, sizeof( operation ) );
+
+    return( status );
+}
+
+psa_status_t mbedtls_psa_aead_decrypt_keyed(
+    const mbedtls_psa_aead_operation_t *keyed,
+    psa_algorithm_t alg,
+    const uint8_t *nonce, size_t nonce_length,
+    const uint8_t *additional_data, size_t additional_data_length,
+    const uint8_t *ciphertext, size_t ciphertext_length,
+    uint8_t *plaintext, size_t plaintext_size, size_t *plaintext_length )
+{
+    psa_status_t status;
+    mbedtls_psa_aead_operation_t operation;
+
+    if( PSA_ALG_AEAD_WITH_DEFAULT_LENGTH_TAG( alg ) != keyed->alg )
+        return( PSA_ERROR_INVALID_ARGUMENT );
+
+    memcpy( &operation, keyed, sizeof( operation ) );
+    operation.tag_length = PSA_ALG_AEAD_GET_TAG_LENGTH( alg );
+
+    status = psa_aead_decrypt_with_operation( &operation,
+                                              nonce, nonce_length,
+                                              additional_data,
+                                              additional_data_length,
+                                              ciphertext, ciphertext_length,
+                                              plaintext, plaintext_size,
+                                              plaintext_length );
+
+    /* Not mbedtls_psa_aead_abort(): the key schedule belongs to keyed */
+    mbedtls_platform_zeroize( &operation, sizeof( operation ) );
+
     return( status );
 }
 
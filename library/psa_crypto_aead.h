@@ -148,6 +148,70 @@ psa_status_t mbedtls_psa_aead_decrypt(
     const uint8_t *ciphertext, size_t ciphertext_length,
     uint8_t *plaintext, size_t plaintext_size, size_t *plaintext_length );
 
+/**
+ * \brief Prepare a context holding the expanded form of a key, for use with
+ *        mbedtls_psa_aead_encrypt_keyed() and mbedtls_psa_aead_decrypt_keyed().
+ *
+ * \note  This is not a driver entry point. It lets the core keep the result
+ *        of the key setup (block cipher key schedule, GHASH table, ...)
+ *        alongside a key instead of redoing it for every one-shot operation.
+ *
+ * \param[out] keyed             The context to set up. It must be released
+ *                               with mbedtls_psa_aead_abort().
+ * \param[in]  attributes        The attributes of the key.
+ * \param[in]  key_buffer        The buffer containing the key.
+ * \param      key_buffer_size   Size of the \p key_buffer buffer in bytes.
+ * \param      alg               An AEAD algorithm the key is used with. The
+ *                               context serves all tag lengths of it.
+ *
+ * \retval #PSA_SUCCESS Success.
+ * \retval #PSA_ERROR_NOT_SUPPORTED
+ *         \p alg is not supported, or the implementation of its mode does
+ *         not allow sharing the expanded key between operations.
+ * \retval #PSA_ERROR_INSUFFICIENT_MEMORY
+ */
+psa_status_t mbedtls_psa_aead_keyed_setup(
+    mbedtls_psa_aead_operation_t *keyed,
+    const psa_key_attributes_t *attributes,
+    const uint8_t *key_buffer, size_t key_buffer_size,
+    psa_algorithm_t alg );
+
+/**
+ * \brief Same as mbedtls_psa_aead_encrypt(), but with a context prepared by
+ *        mbedtls_psa_aead_keyed_setup() instead of the key.
+ *
+ * \note  \p keyed is only read, so it may be used by several concurrent
+ *        calls.
+ *
+ * \retval #PSA_ERROR_INVALID_ARGUMENT
+ *         \p alg is not a variant of the algorithm \p keyed was set up for.
+ */
+psa_status_t mbedtls_psa_aead_encrypt_keyed(
+    const mbedtls_psa_aead_operation_t *keyed,
+    psa_algorithm_t alg,
+    const uint8_t *nonce, size_t nonce_length,
+    const uint8_t *additional_data, size_t additional_data_length,
+    const uint8_t *plaintext, size_t plaintext_length,
+    uint8_t *ciphertext, size_t ciphertext_size, size_t *ciphertext_length );
+
+/**
+ * \brief Same as mbedtls_psa_aead_decrypt(), but with a context prepared by
+ *        mbedtls_psa_aead_keyed_setup() instead of the key.
+ *
+ * \note  \p keyed is only read, so it may be used by several concurrent
+ *        calls.
+ *
+ * \retval #PSA_ERROR_INVALID_ARGUMENT
+ *         \p alg is not a variant of the algorithm \p keyed was set up for.
+ */
+psa_status_t mbedtls_psa_aead_decrypt_keyed(
+    const mbedtls_psa_aead_operation_t *keyed,
+    psa_algorithm_t alg,
+    const uint8_t *nonce, size_t nonce_length,
+    const uint8_t *additional_data, size_t additional_data_length,
+    const uint8_t *ciphertext, size_t ciphertext_length,
+    uint8_t *plaintext, size_t plaintext_size, size_t *plaintext_length );
+
 /** Set the key for a multipart authenticated encryption operation.
  *
  *  \note The signature of this function is that of a PSA driver
@@ -46,6 +46,26 @@ static inline int mbedtls_psa_safer_memcmp(
     return( diff );
 }
 
+/** The state of a key slot.
+ *
+ * Transitions between states are made with the key store mutex held
+ * (see psa_key_store_lock()).
+ */
+typedef enum
+{
+    /** The slot is free. Its content is all-bits-zero apart from
+     * psa_key_slot_t::slot_idx and psa_key_slot_t::next_slot. */
+    PSA_SLOT_EMPTY = 0,
+    /** The slot has been handed out by psa_get_empty_key_slot() and is being
+     * filled by its owner. It cannot be looked up by key identifier. */
+    PSA_SLOT_FILLING,
+    /** The slot contains a key that can be looked up by key identifier. */
+    PSA_SLOT_FULL,
+    /** The key in the slot is being destroyed. It cannot be looked up by
+     * key identifier anymore. */
+    PSA_SLOT_PENDING_DELETION
+} psa_key_slot_state_t;
+
 /** The data structure representing a key slot, containing key material
  * and metadata for one key.
  */
@@ -53,6 +73,17 @@ typedef struct
 {
     psa_core_key_attributes_t attr;
 
+    psa_key_slot_state_t state;
+
+    /* Index of the slot in the key store. It is set when the slot is
+     * created and never changes afterwards. */
+    size_t slot_idx;
+
+    /* One plus the index of the next slot in the same key identifier hash
+     * bucket when the slot holds a loaded persistent key, or in the list of
+     * free slots when the slot is empty. Zero terminates both lists. */
+    size_t next_slot;
+
     /*
      * Number of locks on the key slot held by the library.
      *
@@ -85,6 +116,13 @@ typedef struct
         uint8_t *data;
         size_t bytes;
     } key;
+
+#if defined(MBEDTLS_PSA_BUILTIN_AEAD)
+    /* Expanded form of the key for one-shot AEAD operations with the
+     * built-in implementation, created on first use. It is not modified
+     * afterwards and is freed together with the key data. */
+    mbedtls_psa_aead_operation_t *aead_keyed;
+#endif
 } psa_key_slot_t;
 
 /* A mask of key attribute flags used only internally.
@@ -185,7 +223,11 @@ static inline psa_key_slot_number_t psa_key_slot_get_slot_number(
 
 /** Completely wipe a slot in memory, including its policy.
  *
- * Persistent storage is not affected.
+ * Persistent storage is not affected. The slot is returned to the pool of
+ * free key slots.
+ *
+ * The caller must hold the key store mutex (see psa_key_store_lock()) and
+ * the only lock on the key slot.
  *
  * \param[in,out] slot  The key slot to wipe.
  *
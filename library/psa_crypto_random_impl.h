@@ -85,6 +85,19 @@ int mbedtls_psa_get_random( void *p_rng,
 
 #include "mbedtls/entropy.h"
 
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+#include <pthread.h>
+#include "mbedtls/threading.h"
+
+/* include/mbedtls/psa_util.h only defines this type when the DRBG state is
+ * visible to applications, which is not the case with one DRBG per thread. */
+#if defined(MBEDTLS_CTR_DRBG_C)
+typedef mbedtls_ctr_drbg_context mbedtls_psa_drbg_context_t;
+#elif defined(MBEDTLS_HMAC_DRBG_C)
+typedef mbedtls_hmac_drbg_context mbedtls_psa_drbg_context_t;
+#endif
+#endif /* MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD */
+
 /** Initialize the PSA DRBG.
  *
  * \param p_rng        Pointer to the Mbed TLS DRBG state.
@@ -111,17 +124,84 @@ static inline void mbedtls_psa_drbg_free( mbedtls_psa_drbg_context_t *p_rng )
 #endif
 }
 
+/** Generate random bytes with the PSA DRBG.
+ *
+ * Unlike mbedtls_psa_get_random(), this function does not lock the mutex of
+ * the DRBG context, so it may only be used on a DRBG context that is not
+ * shared between threads.
+ *
+ * \param p_rng         Pointer to the Mbed TLS DRBG state.
+ * \param output        The buffer to fill.
+ * \param output_size   The number of bytes to write to \p output.
+ *
+ * \return              \c 0 on success.
+ * \return              An Mbed TLS error code (\c MBEDTLS_ERR_xxx) on failure.
+ */
+static inline int mbedtls_psa_drbg_generate( mbedtls_psa_drbg_context_t *p_rng,
+                                             unsigned char *output,
+                                             size_t output_size )
+{
+#if defined(MBEDTLS_CTR_DRBG_C)
+    return( mbedtls_ctr_drbg_random_with_add( p_rng, output, output_size,
+                                              NULL, 0 ) );
+#elif defined(MBEDTLS_HMAC_DRBG_C)
+    return( mbedtls_hmac_drbg_random_with_add( p_rng, output, output_size,
+                                               NULL, 0 ) );
+#endif
+}
+
+/** Reseed the PSA DRBG from its entropy source.
+ *
+ * \param p_rng        Pointer to the Mbed TLS DRBG state.
+ *
+ * \return              \c 0 on success.
+ * \return              An Mbed TLS error code (\c MBEDTLS_ERR_xxx) on failure.
+ */
+static inline int mbedtls_psa_drbg_reseed( mbedtls_psa_drbg_context_t *p_rng )
+{
+#if defined(MBEDTLS_CTR_DRBG_C)
+    return( mbedtls_ctr_drbg_reseed( p_rng, NULL, 0 ) );
+#elif defined(MBEDTLS_HMAC_DRBG_C)
+    return( mbedtls_hmac_drbg_reseed( p_rng, NULL, 0 ) );
+#endif
+}
+
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+/** The DRBG of one thread.
+ */
+typedef struct mbedtls_psa_thread_rng
+{
+    mbedtls_psa_drbg_context_t drbg;
+    /* Fork generation in which the DRBG was last seeded. A child process
+     * created with fork() reseeds its copy of the DRBG before using it. */
+    unsigned fork_generation;
+    struct mbedtls_psa_thread_rng *next;
+} mbedtls_psa_thread_rng_t;
+#endif /* MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD */
+
 /** The type of the PSA random generator context.
  *
  * The random generator context is composed of an entropy context and
- * a DRBG context.
+ * a DRBG context. With #MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD, each thread has
+ * its own DRBG context, seeded from the shared entropy context, instead of
+ * a single DRBG context.
  */
 typedef struct
 {
     void (* entropy_init )( mbedtls_entropy_context *ctx );
     void (* entropy_free )( mbedtls_entropy_context *ctx );
     mbedtls_entropy_context entropy;
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+    /* Thread-specific data key of the DRBG of each thread. */
+    pthread_key_t thread_key;
+    unsigned thread_key_created : 1;
+    /* All thread DRBGs, so that they can be freed by
+     * mbedtls_psa_crypto_free(). Protected by mutex. */
+    mbedtls_psa_thread_rng_t *thread_rngs;
+    mbedtls_threading_mutex_t mutex;
+#else
     mbedtls_psa_drbg_context_t drbg;
+#endif
 } mbedtls_psa_random_context_t;
 
 /* Defined in include/mbedtls/psa_util.h so that it's visible to
@@ -134,7 +214,7 @@ typedef struct
  * Observed with Visual Studio 2013. A known bug apparently:
  * https://stackoverflow.com/questions/8146541/duplicate-external-static-declarations-not-allowed-in-visual-studio
  */
-#if !defined(_MSC_VER)
+#if !defined(_MSC_VER) && !defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
 static mbedtls_f_rng_t *const mbedtls_psa_get_random;
 #endif
 
@@ -147,6 +227,18 @@ static mbedtls_f_rng_t *const mbedtls_psa_get_random;
 #define MBEDTLS_PSA_RANDOM_MAX_REQUEST MBEDTLS_HMAC_DRBG_MAX_REQUEST
 #endif
 
+#if defined(MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD)
+
+/* Generate random bytes with the DRBG of the calling thread. */
+int mbedtls_psa_get_random( void *p_rng,
+                            unsigned char *output,
+                            size_t output_size );
+
+/* The DRBG state is managed internally, per thread. */
+#define MBEDTLS_PSA_RANDOM_STATE NULL
+
+#else /* MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD */
+
 /** A pointer to the PSA DRBG state.
  *
  * This variable is only intended to be used through the macro
@@ -169,8 +261,11 @@ extern mbedtls_psa_drbg_context_t *const mbedtls_psa_random_state;
  */
 #define MBEDTLS_PSA_RANDOM_STATE mbedtls_psa_random_state
 
+#endif /* MBEDTLS_PSA_CRYPTO_RNG_PER_THREAD */
+
 /** Seed the PSA DRBG.
  *
+ * \param p_rng         Pointer to the Mbed TLS DRBG state.
  * \param entropy       An entropy context to read the seed from.
  * \param custom        The personalization string.
  *                      This can be \c NULL, in which case the personalization
@@ -181,18 +276,24 @@ extern mbedtls_psa_drbg_context_t *const mbedtls_psa_random_state;
  * \return              An Mbed TLS error code (\c MBEDTLS_ERR_xxx) on failure.
  */
 static inline int mbedtls_psa_drbg_seed(
+    mbedtls_psa_drbg_context_t *p_rng,
     mbedtls_entropy_context *entropy,
     const unsigned char *custom, size_t len )
 {
 #if defined(MBEDTLS_CTR_DRBG_C)
-    return( mbedtls_ctr_drbg_seed( MBEDTLS_PSA_RANDOM_STATE,
+#if defined(MBEDTLS_CTR_DRBG_BUFFER_SIZE)
+    /* Most PSA and TLS requests are small (nonces, IVs, blinding values):
+     * serve them from a prefetched keystream. */
+    mbedtls_ctr_drbg_set_buffering( p_rng, MBEDTLS_CTR_DRBG_BUFFERING_ON );
+#endif
+    return( mbedtls_ctr_drbg_seed( p_rng,
                                    mbedtls_entropy_func,
                                    entropy,
                                    custom, len ) );
 #elif defined(MBEDTLS_HMAC_DRBG_C)
     const mbedtls_md_info_t *md_info =
         mbedtls_md_info_from_type( MBEDTLS_PSA_HMAC_DRBG_MD_TYPE );
-    return( mbedtls_hmac_drbg_seed( MBEDTLS_PSA_RANDOM_STATE,
+    return( mbedtls_hmac_drbg_seed( p_rng,
                                     md_info,
                                     mbedtls_entropy_func,
                                     entropy,
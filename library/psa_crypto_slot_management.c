@@ -35,12 +35,44 @@
 #include <stdlib.h>
 #include <string.h>
 #include "mbedtls/platform.h"
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
 
 #define ARRAY_LENGTH( array ) ( sizeof( array ) / sizeof( *( array ) ) )
 
+/* Index of the first key slot of a slice of the key store. */
+#define KEY_SLICE_BASE( slice_idx )                                 \
+    ( ( (size_t) MBEDTLS_PSA_KEY_SLOT_COUNT << ( slice_idx ) ) -    \
+      MBEDTLS_PSA_KEY_SLOT_COUNT )
+
+/* Number of key slots in a slice of the key store. */
+#define KEY_SLICE_LENGTH( slice_idx )                               \
+    ( (size_t) MBEDTLS_PSA_KEY_SLOT_COUNT << ( slice_idx ) )
+
+/* Number of buckets of the index of loaded persistent keys. */
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
+#define KEY_INDEX_SIZE ( MBEDTLS_PSA_KEY_SLOT_COUNT * 64 )
+#else
+#define KEY_INDEX_SIZE MBEDTLS_PSA_KEY_SLOT_COUNT
+#endif
+
 typedef struct
 {
+#if !defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
     psa_key_slot_t key_slots[MBEDTLS_PSA_KEY_SLOT_COUNT];
+#endif
+    /* Slice i contains the key slots of index KEY_SLICE_BASE( i ) to
+     * KEY_SLICE_BASE( i + 1 ) - 1. Slices are never moved, so that
+     * pointers to key slots stay valid while the key store grows. */
+    psa_key_slot_t *key_slices[PSA_KEY_SLOT_SLICE_COUNT];
+    size_t slice_count;
+    /* One plus the index of the first free key slot, 0 if there is none. */
+    size_t first_free;
+    /* Hash table of the key slots containing a persistent key. Each entry
+     * is one plus the index of the first key slot of the bucket, 0 if the
+     * bucket is empty. */
+    size_t key_index[KEY_INDEX_SIZE];
     unsigned key_slots_initialized : 1;
 } psa_global_data_t;
 
@@ -62,6 +94,151 @@ int psa_is_valid_key_id( mbedtls_svc_key_id_t key, int vendor_ok )
     return( 0 );
 }
 
+psa_status_t psa_key_store_lock( void )
+{
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &mbedtls_threading_key_slot_mutex ) != 0 )
+        return( PSA_ERROR_GENERIC_ERROR );
+#endif
+    return( PSA_SUCCESS );
+}
+
+psa_status_t psa_key_store_unlock( void )
+{
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &mbedtls_threading_key_slot_mutex ) != 0 )
+        return( PSA_ERROR_GENERIC_ERROR );
+#endif
+    return( PSA_SUCCESS );
+}
+
+/* Number of key slots currently allocated in the key store. */
+static size_t psa_key_slot_count( void )
+{
+    return( KEY_SLICE_BASE( global_data.slice_count ) );
+}
+
+/* Get the key slot of index slot_idx, which must be lower than
+ * psa_key_slot_count(). */
+static psa_key_slot_t *psa_get_key_slot_by_index( size_t slot_idx )
+{
+    size_t slice_idx = 0;
+
+    while( slot_idx >= KEY_SLICE_BASE( slice_idx + 1 ) )
+        slice_idx++;
+
+    return( &global_data.key_slices[slice_idx][slot_idx -
+                                                KEY_SLICE_BASE( slice_idx )] );
+}
+
+static size_t psa_key_index_hash( mbedtls_svc_key_id_t key )
+{
+    uint32_t hash = MBEDTLS_SVC_KEY_ID_GET_KEY_ID( key );
+
+#if defined(MBEDTLS_PSA_CRYPTO_KEY_ID_ENCODES_OWNER)
+    hash ^= (uint32_t) MBEDTLS_SVC_KEY_ID_GET_OWNER_ID( key ) * 0x01000193;
+#endif
+    /* Spread consecutive key identifiers over the buckets. */
+    hash *= 0x9e3779b1;
+
+    return( ( hash >> 8 ) % KEY_INDEX_SIZE );
+}
+
+/* Only loaded persistent keys are indexed: a volatile key identifier
+ * directly gives the index of the key slot. */
+static int psa_key_slot_is_indexed( const psa_key_slot_t *slot )
+{
+    return( ( slot->state == PSA_SLOT_FULL ||
+              slot->state == PSA_SLOT_PENDING_DELETION ) &&
+            ! psa_key_id_is_volatile(
+                MBEDTLS_SVC_KEY_ID_GET_KEY_ID( slot->attr.id ) ) );
+}
+
+static psa_key_slot_t *psa_key_index_find( mbedtls_svc_key_id_t key )
+{
+    size_t next = global_data.key_index[psa_key_index_hash( key )];
+    psa_key_slot_t *slot;
+
+    while( next != 0 )
+    {
+        slot = psa_get_key_slot_by_index( next - 1 );
+        if( mbedtls_svc_key_id_equal( key, slot->attr.id ) )
+            return( slot );
+        next = slot->next_slot;
+    }
+
+    return( NULL );
+}
+
+static void psa_key_index_insert( psa_key_slot_t *slot )
+{
+    size_t *bucket =
+        &global_data.key_index[psa_key_index_hash( slot->attr.id )];
+
+    slot->next_slot = *bucket;
+    *bucket = slot->slot_idx + 1;
+}
+
+static void psa_key_index_remove( psa_key_slot_t *slot )
+{
+    size_t *link =
+        &global_data.key_index[psa_key_index_hash( slot->attr.id )];
+    psa_key_slot_t *cur;
+
+    while( *link != 0 )
+    {
+        cur = psa_get_key_slot_by_index( *link - 1 );
+        if( cur == slot )
+        {
+            *link = slot->next_slot;
+            slot->next_slot = 0;
+            return;
+        }
+        link = &cur->next_slot;
+    }
+}
+
+static void psa_push_free_key_slot( psa_key_slot_t *slot )
+{
+    slot->next_slot = global_data.first_free;
+    global_data.first_free = slot->slot_idx + 1;
+}
+
+/* Add the key slots of a new slice to the list of free key slots, in such
+ * a way that the slot of lowest index is handed out first. */
+static void psa_init_key_slice( size_t slice_idx )
+{
+    psa_key_slot_t *slice = global_data.key_slices[slice_idx];
+    size_t i = KEY_SLICE_LENGTH( slice_idx );
+
+    while( i-- > 0 )
+    {
+        slice[i].slot_idx = KEY_SLICE_BASE( slice_idx ) + i;
+        psa_push_free_key_slot( &slice[i] );
+    }
+}
+
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
+static psa_status_t psa_grow_key_store( void )
+{
+    size_t slice_idx = global_data.slice_count;
+    psa_key_slot_t *slice;
+
+    if( slice_idx == PSA_KEY_SLOT_SLICE_COUNT )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    slice = mbedtls_calloc( KEY_SLICE_LENGTH( slice_idx ), sizeof( *slice ) );
+    if( slice == NULL )
+        return( PSA_ERROR_INSUFFICIENT_MEMORY );
+
+    global_data.key_slices[slice_idx] = slice;
+    global_data.slice_count++;
+    psa_init_key_slice( slice_idx );
+
+    return( PSA_SUCCESS );
+}
+#endif /* MBEDTLS_PSA_KEY_STORE_DYNAMIC */
+
 /** Get the description in memory of a key given its identifier and lock it.
  *
  * The descriptions of volatile keys and loaded persistent keys are
@@ -75,11 +252,14 @@ int psa_is_valid_key_id( mbedtls_svc_key_id_t key, int vendor_ok )
  *
  * For volatile key identifiers, only one key slot is queried as a volatile
  * key with identifier key_id can only be stored in slot of index
- * ( key_id - #PSA_KEY_ID_VOLATILE_MIN ).
+ * ( key_id - #PSA_KEY_ID_VOLATILE_MIN ). Other key identifiers are looked
+ * up in the index of loaded persistent keys.
  *
  * On success, the function locks the key slot. It is the responsibility of
  * the caller to unlock the key slot when it does not access it anymore.
  *
+ * The caller must hold the key store mutex.
+ *
  * \param key           Key identifier to query.
  * \param[out] p_slot   On success, `*p_slot` contains a pointer to the
  *                      key slot containing the description of the key
@@ -89,7 +269,8 @@ int psa_is_valid_key_id( mbedtls_svc_key_id_t key, int vendor_ok )
  *         The pointer to the key slot containing the description of the key
  *         identified by \p key was returned.
  * \retval #PSA_ERROR_INVALID_HANDLE
- *         \p key is not a valid key identifier.
+ *         \p key is not a valid key identifier, or the key is being
+ *         destroyed.
  * \retval #PSA_ERROR_DOES_NOT_EXIST
  *         There is no key with key identifier \p key in the key slots.
  */
@@ -103,17 +284,19 @@ static psa_status_t psa_get_and_lock_key_slot_in_memory(
 
     if( psa_key_id_is_volatile( key_id ) )
     {
-        slot = &global_data.key_slots[ key_id - PSA_KEY_ID_VOLATILE_MIN ];
+        slot_idx = key_id - PSA_KEY_ID_VOLATILE_MIN;
+        if( slot_idx >= psa_key_slot_count( ) )
+            return( PSA_ERROR_DOES_NOT_EXIST );
+
+        slot = psa_get_key_slot_by_index( slot_idx );
 
         /*
-         * Check if both the PSA key identifier key_id and the owner
-         * identifier of key match those of the key slot.
-         *
-         * Note that, if the key slot is not occupied, its PSA key identifier
-         * is equal to zero. This is an invalid value for a PSA key identifier
-         * and thus cannot be equal to the valid PSA key identifier key_id.
+         * Check that the key slot contains a key that is ready for use and
+         * that both the PSA key identifier key_id and the owner identifier
+         * of key match those of the key slot.
          */
-        status = mbedtls_svc_key_id_equal( key, slot->attr.id ) ?
+        status = ( slot->state == PSA_SLOT_FULL &&
+                   mbedtls_svc_key_id_equal( key, slot->attr.id ) ) ?
                  PSA_SUCCESS : PSA_ERROR_DOES_NOT_EXIST;
     }
     else
@@ -121,14 +304,13 @@ static psa_status_t psa_get_and_lock_key_slot_in_memory(
         if ( !psa_is_valid_key_id( key, 1 ) )
             return( PSA_ERROR_INVALID_HANDLE );
 
-        for( slot_idx = 0; slot_idx < MBEDTLS_PSA_KEY_SLOT_COUNT; slot_idx++ )
-        {
-            slot = &global_data.key_slots[ slot_idx ];
-            if( mbedtls_svc_key_id_equal( key, slot->attr.id ) )
-                break;
-        }
-        status = ( slot_idx < MBEDTLS_PSA_KEY_SLOT_COUNT ) ?
-                 PSA_SUCCESS : PSA_ERROR_DOES_NOT_EXIST;
+        slot = psa_key_index_find( key );
+        if( slot == NULL )
+            status = PSA_ERROR_DOES_NOT_EXIST;
+        else if( slot->state != PSA_SLOT_FULL )
+            status = PSA_ERROR_INVALID_HANDLE;
+        else
+            status = PSA_SUCCESS;
     }
 
     if( status == PSA_SUCCESS )
@@ -143,32 +325,90 @@ static psa_status_t psa_get_and_lock_key_slot_in_memory(
 
 psa_status_t psa_initialize_key_slots( void )
 {
-    /* Nothing to do: program startup and psa_wipe_all_key_slots() both
-     * guarantee that the key slots are initialized to all-zero, which
-     * means that all the key slots are in a valid, empty state. */
+    psa_status_t status;
+
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    /* Program startup and psa_wipe_all_key_slots() both guarantee that
+     * the key store is empty. A dynamic key store allocates its first
+     * slice when the first key slot is needed. */
+#if !defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
+    global_data.key_slices[0] = global_data.key_slots;
+    global_data.slice_count = 1;
+    psa_init_key_slice( 0 );
+#endif
     global_data.key_slots_initialized = 1;
-    return( PSA_SUCCESS );
+
+    return( psa_key_store_unlock( ) );
 }
 
 void psa_wipe_all_key_slots( void )
 {
-    size_t slot_idx;
+    size_t slice_idx, slot_idx;
+    psa_key_slot_t *slot;
 
-    for( slot_idx = 0; slot_idx < MBEDTLS_PSA_KEY_SLOT_COUNT; slot_idx++ )
+    (void) psa_key_store_lock( );
+
+    for( slice_idx = 0; slice_idx < global_data.slice_count; slice_idx++ )
     {
-        psa_key_slot_t *slot = &global_data.key_slots[ slot_idx ];
-        slot->lock_count = 1;
-        (void) psa_wipe_key_slot( slot );
+        for( slot_idx = 0; slot_idx < KEY_SLICE_LENGTH( slice_idx );
+             slot_idx++ )
+        {
+            slot = &global_data.key_slices[slice_idx][slot_idx];
+            if( slot->state == PSA_SLOT_EMPTY )
+                continue;
+            slot->lock_count = 1;
+            (void) psa_wipe_key_slot( slot );
+        }
     }
+
+    /* All slots are now empty: release the slices. */
+    for( slice_idx = 0; slice_idx < global_data.slice_count; slice_idx++ )
+    {
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
+        mbedtls_free( global_data.key_slices[slice_idx] );
+#endif
+        global_data.key_slices[slice_idx] = NULL;
+    }
+    global_data.slice_count = 0;
+    global_data.first_free = 0;
+    memset( global_data.key_index, 0, sizeof( global_data.key_index ) );
     global_data.key_slots_initialized = 0;
+
+    (void) psa_key_store_unlock( );
 }
 
-psa_status_t psa_get_empty_key_slot( psa_key_id_t *volatile_key_id,
-                                     psa_key_slot_t **p_slot )
+void psa_free_key_slot( psa_key_slot_t *slot )
+{
+    size_t slot_idx = slot->slot_idx;
+    size_t next_slot = slot->next_slot;
+    int was_empty = ( slot->state == PSA_SLOT_EMPTY );
+
+    if( psa_key_slot_is_indexed( slot ) )
+        psa_key_index_remove( slot );
+
+    /* At this point, key material and other type-specific content has
+     * been wiped. Clear remaining metadata. We can call memset and not
+     * zeroize because the metadata is not particularly sensitive. */
+    memset( slot, 0, sizeof( *slot ) );
+    slot->slot_idx = slot_idx;
+
+    /* A slot that was already empty is already in the free list. */
+    if( was_empty )
+        slot->next_slot = next_slot;
+    else
+        psa_push_free_key_slot( slot );
+}
+
+/* Implementation of psa_get_empty_key_slot() with the key store mutex held. */
+static psa_status_t psa_get_empty_key_slot_locked( psa_key_id_t *volatile_key_id,
+                                                   psa_key_slot_t **p_slot )
 {
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
     size_t slot_idx;
-    psa_key_slot_t *selected_slot, *unlocked_persistent_key_slot;
+    psa_key_slot_t *slot;
 
     if( ! global_data.key_slots_initialized )
     {
@@ -176,50 +416,52 @@ psa_status_t psa_get_empty_key_slot( psa_key_id_t *volatile_key_id,
         goto error;
     }
 
-    selected_slot = unlocked_persistent_key_slot = NULL;
-    for( slot_idx = 0; slot_idx < MBEDTLS_PSA_KEY_SLOT_COUNT; slot_idx++ )
-    {
-        psa_key_slot_t *slot = &global_data.key_slots[ slot_idx ];
-        if( ! psa_is_key_slot_occupied( slot ) )
-        {
-            selected_slot = slot;
-            break;
-        }
-
-        if( ( unlocked_persistent_key_slot == NULL ) &&
-            ( ! PSA_KEY_LIFETIME_IS_VOLATILE( slot->attr.lifetime ) ) &&
-            ( ! psa_is_key_slot_locked( slot ) ) )
-            unlocked_persistent_key_slot = slot;
-    }
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
+    if( global_data.first_free == 0 )
+        (void) psa_grow_key_store( );
+#endif
 
     /*
      * If there is no unused key slot and there is at least one unlocked key
      * slot containing the description of a persistent key, recycle the first
-     * such key slot we encountered. If we later need to operate on the
+     * such key slot we encounter. If we later need to operate on the
      * persistent key we are evicting now, we will reload its description from
      * storage.
      */
-    if( ( selected_slot == NULL ) &&
-        ( unlocked_persistent_key_slot != NULL ) )
+    for( slot_idx = 0;
+         global_data.first_free == 0 && slot_idx < psa_key_slot_count( );
+         slot_idx++ )
     {
-        selected_slot = unlocked_persistent_key_slot;
-        selected_slot->lock_count = 1;
-        psa_wipe_key_slot( selected_slot );
+        slot = psa_get_key_slot_by_index( slot_idx );
+        if( ( slot->state == PSA_SLOT_FULL ) &&
+            ( ! PSA_KEY_LIFETIME_IS_VOLATILE( slot->attr.lifetime ) ) &&
+            ( ! psa_is_key_slot_locked( slot ) ) )
+        {
+            slot->lock_count = 1;
+            psa_wipe_key_slot( slot );
+        }
     }
 
-    if( selected_slot != NULL )
+    if( global_data.first_free == 0 )
     {
-       status = psa_lock_key_slot( selected_slot );
-       if( status != PSA_SUCCESS )
-           goto error;
+        status = PSA_ERROR_INSUFFICIENT_MEMORY;
+        goto error;
+    }
 
-        *volatile_key_id = PSA_KEY_ID_VOLATILE_MIN +
-            ( (psa_key_id_t)( selected_slot - global_data.key_slots ) );
-        *p_slot = selected_slot;
+    slot = psa_get_key_slot_by_index( global_data.first_free - 1 );
+    status = psa_lock_key_slot( slot );
+    if( status != PSA_SUCCESS )
+        goto error;
 
-        return( PSA_SUCCESS );
-    }
-    status = PSA_ERROR_INSUFFICIENT_MEMORY;
+    global_data.first_free = slot->next_slot;
+    slot->next_slot = 0;
+    slot->state = PSA_SLOT_FILLING;
+
+    *volatile_key_id = PSA_KEY_ID_VOLATILE_MIN +
+        (psa_key_id_t) slot->slot_idx;
+    *p_slot = slot;
+
+    return( PSA_SUCCESS );
 
 error:
     *p_slot = NULL;
@@ -228,6 +470,54 @@ error:
     return( status );
 }
 
+psa_status_t psa_get_empty_key_slot( psa_key_id_t *volatile_key_id,
+                                     psa_key_slot_t **p_slot )
+{
+    psa_status_t status, unlock_status;
+
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+    {
+        *p_slot = NULL;
+        *volatile_key_id = 0;
+        return( status );
+    }
+
+    status = psa_get_empty_key_slot_locked( volatile_key_id, p_slot );
+
+    unlock_status = psa_key_store_unlock( );
+    return( ( status != PSA_SUCCESS ) ? status : unlock_status );
+}
+
+/* Implementation of psa_publish_key_slot() with the key store mutex held. */
+static psa_status_t psa_publish_key_slot_locked( psa_key_slot_t *slot )
+{
+    if( ! psa_key_id_is_volatile(
+            MBEDTLS_SVC_KEY_ID_GET_KEY_ID( slot->attr.id ) ) )
+    {
+        if( psa_key_index_find( slot->attr.id ) != NULL )
+            return( PSA_ERROR_ALREADY_EXISTS );
+        psa_key_index_insert( slot );
+    }
+    slot->state = PSA_SLOT_FULL;
+
+    return( PSA_SUCCESS );
+}
+
+psa_status_t psa_publish_key_slot( psa_key_slot_t *slot )
+{
+    psa_status_t status, unlock_status;
+
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    status = psa_publish_key_slot_locked( slot );
+
+    unlock_status = psa_key_store_unlock( );
+    return( ( status != PSA_SUCCESS ) ? status : unlock_status );
+}
+
 #if defined(MBEDTLS_PSA_CRYPTO_STORAGE_C)
 static psa_status_t psa_load_persistent_key_into_slot( psa_key_slot_t *slot )
 {
@@ -344,27 +634,34 @@ psa_status_t psa_get_and_lock_key_slot( mbedtls_svc_key_id_t key,
                                         psa_key_slot_t **p_slot )
 {
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    psa_status_t unlock_status;
 
     *p_slot = NULL;
     if( ! global_data.key_slots_initialized )
         return( PSA_ERROR_BAD_STATE );
 
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+        return( status );
+
     /*
      * On success, the pointer to the slot is passed directly to the caller
      * thus no need to unlock the key slot here.
      */
     status = psa_get_and_lock_key_slot_in_memory( key, p_slot );
     if( status != PSA_ERROR_DOES_NOT_EXIST )
-        return( status );
+        goto exit;
 
     /* Loading keys from storage requires support for such a mechanism */
 #if defined(MBEDTLS_PSA_CRYPTO_STORAGE_C) || \
     defined(MBEDTLS_PSA_CRYPTO_BUILTIN_KEYS)
     psa_key_id_t volatile_key_id;
 
-    status = psa_get_empty_key_slot( &volatile_key_id, p_slot );
+    /* The key store mutex is held while the key is loaded, so that the
+     * same key cannot be loaded twice into two different slots. */
+    status = psa_get_empty_key_slot_locked( &volatile_key_id, p_slot );
     if( status != PSA_SUCCESS )
-        return( status );
+        goto exit;
 
     (*p_slot)->attr.id = key;
     (*p_slot)->attr.lifetime = PSA_KEY_LIFETIME_PERSISTENT;
@@ -380,27 +677,32 @@ psa_status_t psa_get_and_lock_key_slot( mbedtls_svc_key_id_t key,
         status = psa_load_persistent_key_into_slot( *p_slot );
 #endif /* defined(MBEDTLS_PSA_CRYPTO_STORAGE_C) */
 
+    if( status == PSA_SUCCESS )
+    {
+        /* Add implicit usage flags. */
+        psa_extend_key_usage_flags( &(*p_slot)->attr.policy.usage );
+        status = psa_publish_key_slot_locked( *p_slot );
+    }
+
     if( status != PSA_SUCCESS )
     {
         psa_wipe_key_slot( *p_slot );
+        *p_slot = NULL;
         if( status == PSA_ERROR_DOES_NOT_EXIST )
             status = PSA_ERROR_INVALID_HANDLE;
     }
-    else
-        /* Add implicit usage flags. */
-        psa_extend_key_usage_flags( &(*p_slot)->attr.policy.usage );
-
-    return( status );
 #else /* MBEDTLS_PSA_CRYPTO_STORAGE_C || MBEDTLS_PSA_CRYPTO_BUILTIN_KEYS */
-    return( PSA_ERROR_INVALID_HANDLE );
+    status = PSA_ERROR_INVALID_HANDLE;
 #endif /* MBEDTLS_PSA_CRYPTO_STORAGE_C || MBEDTLS_PSA_CRYPTO_BUILTIN_KEYS */
+
+exit:
+    unlock_status = psa_key_store_unlock( );
+    return( ( status != PSA_SUCCESS ) ? status : unlock_status );
 }
 
-psa_status_t psa_unlock_key_slot( psa_key_slot_t *slot )
+/* Implementation of psa_unlock_key_slot() with the key store mutex held. */
+static psa_status_t psa_unlock_key_slot_locked( psa_key_slot_t *slot )
 {
-    if( slot == NULL )
-        return( PSA_SUCCESS );
-
     if( slot->lock_count > 0 )
     {
         slot->lock_count--;
@@ -419,6 +721,23 @@ psa_status_t psa_unlock_key_slot( psa_key_slot_t *slot )
     return( PSA_ERROR_CORRUPTION_DETECTED );
 }
 
+psa_status_t psa_unlock_key_slot( psa_key_slot_t *slot )
+{
+    psa_status_t status, unlock_status;
+
+    if( slot == NULL )
+        return( PSA_SUCCESS );
+
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+        return( status );
+
+    status = psa_unlock_key_slot_locked( slot );
+
+    unlock_status = psa_key_store_unlock( );
+    return( ( status != PSA_SUCCESS ) ? status : unlock_status );
+}
+
 psa_status_t psa_validate_key_location( psa_key_lifetime_t lifetime,
                                         psa_se_drv_table_entry_t **p_drv )
 {
@@ -502,40 +821,53 @@ psa_status_t psa_open_key( mbedtls_svc_key_id_t key, psa_key_handle_t *handle )
 
 psa_status_t psa_close_key( psa_key_handle_t handle )
 {
-    psa_status_t status;
+    psa_status_t status, unlock_status;
     psa_key_slot_t *slot;
 
     if( psa_key_handle_is_null( handle ) )
         return( PSA_SUCCESS );
 
+    status = psa_key_store_lock( );
+    if( status != PSA_SUCCESS )
+        return( status );
+
     status = psa_get_and_lock_key_slot_in_memory( handle, &slot );
     if( status != PSA_SUCCESS )
     {
         if( status == PSA_ERROR_DOES_NOT_EXIST )
             status = PSA_ERROR_INVALID_HANDLE;
-
-        return( status );
     }
-    if( slot->lock_count <= 1 )
-        return( psa_wipe_key_slot( slot ) );
+    else if( slot->lock_count <= 1 )
+        status = psa_wipe_key_slot( slot );
     else
-        return( psa_unlock_key_slot( slot ) );
+        status = psa_unlock_key_slot_locked( slot );
+
+    unlock_status = psa_key_store_unlock( );
+    return( ( status != PSA_SUCCESS ) ? status : unlock_status );
 }
 
 psa_status_t psa_purge_key( mbedtls_svc_key_id_t key )
 {
-    psa_status_t status;
+    psa_status_t status, unlock_status;
     psa_key_slot_t *slot;
 
-    status = psa_get_and_lock_key_slot_in_memory( key, &slot );
+    status = psa_key_store_lock( );
     if( status != PSA_SUCCESS )
         return( status );
 
+    status = psa_get_and_lock_key_slot_in_memory( key, &slot );
+    if( status != PSA_SUCCESS )
+        goto exit;
+
     if( ( ! PSA_KEY_LIFETIME_IS_VOLATILE( slot->attr.lifetime ) ) &&
         ( slot->lock_count <= 1 ) )
-        return( psa_wipe_key_slot( slot ) );
+        status = psa_wipe_key_slot( slot );
     else
-        return( psa_unlock_key_slot( slot ) );
+        status = psa_unlock_key_slot_locked( slot );
+
+exit:
+    unlock_status = psa_key_store_unlock( );
+    return( ( status != PSA_SUCCESS ) ? status : unlock_status );
 }
 
 void mbedtls_psa_get_stats( mbedtls_psa_stats_t *stats )
@@ -544,9 +876,12 @@ void mbedtls_psa_get_stats( mbedtls_psa_stats_t *stats )
 
     memset( stats, 0, sizeof( *stats ) );
 
-    for( slot_idx = 0; slot_idx < MBEDTLS_PSA_KEY_SLOT_COUNT; slot_idx++ )
+    if( psa_key_store_lock( ) != PSA_SUCCESS )
+        return;
+
+    for( slot_idx = 0; slot_idx < psa_key_slot_count( ); slot_idx++ )
     {
-        const psa_key_slot_t *slot = &global_data.key_slots[ slot_idx ];
+        const psa_key_slot_t *slot = psa_get_key_slot_by_index( slot_idx );
         if( psa_is_key_slot_locked( slot ) )
         {
             ++stats->locked_slots;
@@ -574,6 +909,8 @@ void mbedtls_psa_get_stats( mbedtls_psa_stats_t *stats )
                 stats->max_open_external_key_id = id;
         }
     }
+
+    (void) psa_key_store_unlock( );
 }
 
 #endif /* MBEDTLS_PSA_CRYPTO_C */
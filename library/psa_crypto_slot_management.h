@@ -25,22 +25,45 @@
 #include "psa_crypto_core.h"
 #include "psa_crypto_se.h"
 
+/** Number of slices of the key store.
+ *
+ * Slice \c i holds #MBEDTLS_PSA_KEY_SLOT_COUNT * 2^i key slots. A static
+ * key store consists of a single slice.
+ */
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
+#define PSA_KEY_SLOT_SLICE_COUNT 16
+#else
+#define PSA_KEY_SLOT_SLICE_COUNT 1
+#endif
+
+/** The maximum number of key slots in the key store.
+ */
+#define PSA_KEY_SLOT_MAX_COUNT                                               \
+    ( ( (size_t) MBEDTLS_PSA_KEY_SLOT_COUNT << PSA_KEY_SLOT_SLICE_COUNT ) -   \
+      MBEDTLS_PSA_KEY_SLOT_COUNT )
+
 /** Range of volatile key identifiers.
  *
- *  The last #MBEDTLS_PSA_KEY_SLOT_COUNT identifiers of the implementation
+ *  The last #PSA_KEY_SLOT_MAX_COUNT identifiers of the implementation
  *  range of key identifiers are reserved for volatile key identifiers.
+ *  With a dynamic key store, this range ends right before the range of
+ *  built-in keys.
  *  A volatile key identifier is equal to #PSA_KEY_ID_VOLATILE_MIN plus the
  *  index of the key slot containing the volatile key definition.
  */
 
-/** The minimum value for a volatile key identifier.
- */
-#define PSA_KEY_ID_VOLATILE_MIN  ( PSA_KEY_ID_VENDOR_MAX - \
-                                   MBEDTLS_PSA_KEY_SLOT_COUNT + 1 )
-
 /** The maximum value for a volatile key identifier.
  */
+#if defined(MBEDTLS_PSA_KEY_STORE_DYNAMIC)
+#define PSA_KEY_ID_VOLATILE_MAX  ( MBEDTLS_PSA_KEY_ID_BUILTIN_MIN - 1 )
+#else
 #define PSA_KEY_ID_VOLATILE_MAX  PSA_KEY_ID_VENDOR_MAX
+#endif
+
+/** The minimum value for a volatile key identifier.
+ */
+#define PSA_KEY_ID_VOLATILE_MIN  ( PSA_KEY_ID_VOLATILE_MAX - \
+                                   (psa_key_id_t) PSA_KEY_SLOT_MAX_COUNT + 1 )
 
 /** Test whether a key identifier is a volatile key identifier.
  *
@@ -95,10 +118,33 @@ static inline int psa_key_id_is_volatile( psa_key_id_t key_id )
 psa_status_t psa_get_and_lock_key_slot( mbedtls_svc_key_id_t key,
                                         psa_key_slot_t **p_slot );
 
+/** Lock the key store.
+ *
+ * The key store mutex protects the state, the lock counter and the key
+ * identifier of the key slots, as well as the structures used to find
+ * key slots. It is only held for short periods of time: operations on the
+ * key material are done with a lock on the key slot instead.
+ *
+ * This function does nothing unless #MBEDTLS_THREADING_C is enabled.
+ *
+ * \retval #PSA_SUCCESS
+ * \retval #PSA_ERROR_GENERIC_ERROR
+ *         The mutex could not be locked.
+ */
+psa_status_t psa_key_store_lock( void );
+
+/** Unlock the key store.
+ *
+ * \retval #PSA_SUCCESS
+ * \retval #PSA_ERROR_GENERIC_ERROR
+ *         The mutex could not be unlocked.
+ */
+psa_status_t psa_key_store_unlock( void );
+
 /** Initialize the key slot structures.
  *
  * \retval #PSA_SUCCESS
- *         Currently this function always succeeds.
+ * \retval #PSA_ERROR_GENERIC_ERROR
  */
 psa_status_t psa_initialize_key_slots( void );
 
@@ -110,9 +156,13 @@ void psa_wipe_all_key_slots( void );
 /** Find a free key slot.
  *
  * This function returns a key slot that is available for use and is in its
- * ground state (all-bits-zero). On success, the key slot is locked. It is
- * the responsibility of the caller to unlock the key slot when it does not
- * access it anymore.
+ * ground state (all-bits-zero apart from the bookkeeping fields of the key
+ * store) in the #PSA_SLOT_FILLING state. On success, the key slot is locked.
+ * It is the responsibility of the caller to unlock the key slot when it does
+ * not access it anymore.
+ *
+ * Once the key slot is filled, call psa_publish_key_slot() to make the key
+ * available to other users, or psa_wipe_key_slot() to release the slot.
  *
  * \param[out] volatile_key_id   On success, volatile key identifier
  *                               associated to the returned slot.
@@ -125,10 +175,38 @@ void psa_wipe_all_key_slots( void );
 psa_status_t psa_get_empty_key_slot( psa_key_id_t *volatile_key_id,
                                      psa_key_slot_t **p_slot );
 
+/** Make a key slot filled after psa_get_empty_key_slot() accessible by key
+ * identifier.
+ *
+ * \param[in,out] slot  The key slot. It must be in the #PSA_SLOT_FILLING
+ *                      state and its key identifier must be set.
+ *
+ * \retval #PSA_SUCCESS
+ *         The key slot is now in the #PSA_SLOT_FULL state.
+ * \retval #PSA_ERROR_ALREADY_EXISTS
+ *         Another key slot already contains a key with the same identifier.
+ * \retval #PSA_ERROR_GENERIC_ERROR
+ */
+psa_status_t psa_publish_key_slot( psa_key_slot_t *slot );
+
+/** Return a key slot to the pool of free key slots.
+ *
+ * This function is meant to be called by psa_wipe_key_slot() once the key
+ * material has been released. It removes the slot from the index of key
+ * identifiers and resets it to the #PSA_SLOT_EMPTY state.
+ *
+ * The caller must hold the key store mutex.
+ *
+ * \param[in,out] slot  The key slot.
+ */
+void psa_free_key_slot( psa_key_slot_t *slot );
+
 /** Lock a key slot.
  *
  * This function increments the key slot lock counter by one.
  *
+ * The caller must hold the key store mutex.
+ *
  * \param[in] slot  The key slot.
  *
  * \retval #PSA_SUCCESS
@@ -0,0 +1,417 @@
+/*
+ *  Pool of record buffers shared by SSL contexts
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+/*
+ * Free buffers are chained through their first bytes, so the lists need no
+ * memory of their own. Buffers come back zeroized by the SSL layer, hence
+ * only the link has to be cleared when a buffer is handed out again.
+ *
+ * With pthreads, each thread keeps a few free buffers in thread-specific
+ * data and only takes the pool lock when that list is empty or full.
+ */
+
+#include "common.h"
+
+#if defined(MBEDTLS_SSL_BUFFER_POOL_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_buffer_pool.h"
+#include "ssl_misc.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#if defined(MBEDTLS_THREADING_PTHREAD) && MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE > 0
+#define SSL_BUFFER_POOL_PER_THREAD
+#endif
+
+static unsigned char *ssl_buffer_pool_pop( unsigned char **head )
+{
+    unsigned char *buf = *head;
+    unsigned char *next;
+
+    memcpy( &next, buf, sizeof( next ) );
+    mbedtls_platform_zeroize( buf, sizeof( next ) );
+    *head = next;
+
+    return( buf );
+}
+
+static void ssl_buffer_pool_push( unsigned char **head, unsigned char *buf )
+{
+    unsigned char *next = *head;
+
+    memcpy( buf, &next, sizeof( next ) );
+    *head = buf;
+}
+
+/*
+ * Put a buffer on the shared list, or release it if the list is full.
+ * Must be called with the pool lock held.
+ */
+static void ssl_buffer_pool_release( mbedtls_ssl_buffer_pool *pool,
+                                     unsigned char *buf )
+{
+    if( pool->max_free == 0 || pool->nfree < pool->max_free )
+    {
+        ssl_buffer_pool_push( &pool->head, buf );
+        pool->nfree++;
+    }
+    else
+    {
+        mbedtls_free( buf );
+        pool->allocated--;
+    }
+}
+
+#if defined(SSL_BUFFER_POOL_PER_THREAD)
+/*
+ * Thread-specific data destructor: hand the buffers of an exiting thread
+ * over to the shared list.
+ */
+static void ssl_buffer_pool_thread_exit( void *data )
+{
+    mbedtls_ssl_buffer_pool_cache *cache = data;
+    mbedtls_ssl_buffer_pool *pool = cache->pool;
+    mbedtls_ssl_buffer_pool_cache **p;
+
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return;
+
+    while( cache->count > 0 )
+    {
+        ssl_buffer_pool_release( pool, ssl_buffer_pool_pop( &cache->head ) );
+        cache->count--;
+    }
+
+    for( p = &pool->caches; *p != NULL; p = &( *p )->next )
+    {
+        if( *p == cache )
+        {
+            *p = cache->next;
+            break;
+        }
+    }
+
+    (void) mbedtls_mutex_unlock( &pool->mutex );
+
+    mbedtls_free( cache );
+}
+
+/*
+ * Get the list of the calling thread, creating it on first use.
+ * Returns NULL if it cannot be created, in which case the shared list is
+ * used directly.
+ */
+static mbedtls_ssl_buffer_pool_cache *ssl_buffer_pool_thread_cache(
+    mbedtls_ssl_buffer_pool *pool )
+{
+    mbedtls_ssl_buffer_pool_cache *cache;
+
+    cache = pthread_getspecific( pool->thread_key );
+    if( cache != NULL )
+        return( cache );
+
+    cache = mbedtls_calloc( 1, sizeof( mbedtls_ssl_buffer_pool_cache ) );
+    if( cache == NULL )
+        return( NULL );
+    cache->pool = pool;
+
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+    {
+        mbedtls_free( cache );
+        return( NULL );
+    }
+
+    if( pthread_setspecific( pool->thread_key, cache ) != 0 )
+    {
+        (void) mbedtls_mutex_unlock( &pool->mutex );
+        mbedtls_free( cache );
+        return( NULL );
+    }
+    cache->next = pool->caches;
+    pool->caches = cache;
+
+    (void) mbedtls_mutex_unlock( &pool->mutex );
+
+    return( cache );
+}
+#endif /* SSL_BUFFER_POOL_PER_THREAD */
+
+void mbedtls_ssl_buffer_pool_init( mbedtls_ssl_buffer_pool *pool )
+{
+    memset( pool, 0, sizeof( mbedtls_ssl_buffer_pool ) );
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init( &pool->mutex );
+#endif
+}
+
+int mbedtls_ssl_buffer_pool_setup( mbedtls_ssl_buffer_pool *pool,
+                                   size_t buf_len,
+                                   size_t max_free )
+{
+    if( buf_len == 0 )
+    {
+        buf_len = MBEDTLS_SSL_IN_BUFFER_LEN > MBEDTLS_SSL_OUT_BUFFER_LEN ?
+                  MBEDTLS_SSL_IN_BUFFER_LEN : MBEDTLS_SSL_OUT_BUFFER_LEN;
+    }
+
+    if( buf_len < sizeof( unsigned char * ) || pool->buf_len != 0 )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+#if defined(SSL_BUFFER_POOL_PER_THREAD)
+    if( pthread_key_create( &pool->thread_key,
+                            ssl_buffer_pool_thread_exit ) != 0 )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+    pool->thread_key_created = 1;
+#endif
+
+    pool->buf_len = buf_len;
+    pool->max_free = max_free;
+
+    return( 0 );
+}
+
+int mbedtls_ssl_buffer_pool_reserve( mbedtls_ssl_buffer_pool *pool,
+                                     size_t count )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *buf;
+
+    if( pool->buf_len == 0 )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    while( count-- > 0 )
+    {
+        buf = mbedtls_calloc( 1, pool->buf_len );
+        if( buf == NULL )
+            return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+#if defined(MBEDTLS_THREADING_C)
+        if( ( ret = mbedtls_mutex_lock( &pool->mutex ) ) != 0 )
+        {
+            mbedtls_free( buf );
+            return( ret );
+        }
+#endif
+
+        ret = 0;
+        if( pool->max_free != 0 && pool->nfree >= pool->max_free )
+        {
+            count = 0;
+        }
+        else
+        {
+            ssl_buffer_pool_push( &pool->head, buf );
+            pool->nfree++;
+            pool->allocated++;
+            if( pool->allocated > pool->peak )
+                pool->peak = pool->allocated;
+            buf = NULL;
+        }
+
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_unlock( &pool->mutex ) != 0 )
+            ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif
+
+        mbedtls_free( buf );
+        if( ret != 0 )
+            return( ret );
+    }
+
+    return( 0 );
+}
+
+unsigned char *mbedtls_ssl_buffer_pool_get( void *p_pool, size_t len )
+{
+    mbedtls_ssl_buffer_pool *pool = (mbedtls_ssl_buffer_pool *) p_pool;
+    unsigned char *buf = NULL;
+    int oversized = ( len > pool->buf_len );
+#if defined(SSL_BUFFER_POOL_PER_THREAD)
+    mbedtls_ssl_buffer_pool_cache *cache;
+
+    if( ! oversized )
+    {
+        cache = ssl_buffer_pool_thread_cache( pool );
+        if( cache != NULL && cache->count > 0 )
+        {
+            cache->count--;
+            return( ssl_buffer_pool_pop( &cache->head ) );
+        }
+    }
+#endif /* SSL_BUFFER_POOL_PER_THREAD */
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return( NULL );
+#endif
+
+    if( oversized )
+    {
+        pool->oversized++;
+    }
+    else if( pool->nfree > 0 )
+    {
+        buf = ssl_buffer_pool_pop( &pool->head );
+        pool->nfree--;
+    }
+    else
+    {
+        pool->misses++;
+        pool->allocated++;
+        if( pool->allocated > pool->peak )
+            pool->peak = pool->allocated;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock( &pool->mutex );
+#endif
+
+    if( buf != NULL )
+        return( buf );
+
+    if( oversized )
+        return( mbedtls_calloc( 1, len ) );
+
+    buf = mbedtls_calloc( 1, pool->buf_len );
+    if( buf == NULL )
+    {
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+            return( NULL );
+#endif
+        pool->allocated--;
+#if defined(MBEDTLS_THREADING_C)
+        (void) mbedtls_mutex_unlock( &pool->mutex );
+#endif
+    }
+
+    return( buf );
+}
+
+void mbedtls_ssl_buffer_pool_put( void *p_pool, unsigned char *buf, size_t len )
+{
+    mbedtls_ssl_buffer_pool *pool = (mbedtls_ssl_buffer_pool *) p_pool;
+#if defined(SSL_BUFFER_POOL_PER_THREAD)
+    mbedtls_ssl_buffer_pool_cache *cache;
+#endif
+
+    if( buf == NULL )
+        return;
+
+    if( len > pool->buf_len )
+    {
+        mbedtls_free( buf );
+        return;
+    }
+
+#if defined(SSL_BUFFER_POOL_PER_THREAD)
+    cache = ssl_buffer_pool_thread_cache( pool );
+    if( cache != NULL && cache->count < MBEDTLS_SSL_BUFFER_POOL_THREAD_CACHE )
+    {
+        ssl_buffer_pool_push( &cache->head, buf );
+        cache->count++;
+        return;
+    }
+#endif /* SSL_BUFFER_POOL_PER_THREAD */
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+    {
+        mbedtls_free( buf );
+        return;
+    }
+#endif
+
+    ssl_buffer_pool_release( pool, buf );
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock( &pool->mutex );
+#endif
+}
+
+int mbedtls_ssl_buffer_pool_get_stats( mbedtls_ssl_buffer_pool *pool,
+                                       mbedtls_ssl_buffer_pool_stats *stats )
+{
+#if defined(MBEDTLS_THREADING_C)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if( ( ret = mbedtls_mutex_lock( &pool->mutex ) ) != 0 )
+        return( ret );
+#endif
+
+    stats->buf_len = pool->buf_len;
+    stats->allocated = pool->allocated;
+    stats->peak = pool->peak;
+    stats->free = pool->nfree;
+    stats->misses = pool->misses;
+    stats->oversized = pool->oversized;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &pool->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+    return( 0 );
+}
+
+void mbedtls_ssl_buffer_pool_free( mbedtls_ssl_buffer_pool *pool )
+{
+#if defined(SSL_BUFFER_POOL_PER_THREAD)
+    mbedtls_ssl_buffer_pool_cache *cache;
+#endif
+
+    if( pool == NULL )
+        return;
+
+    while( pool->nfree > 0 )
+    {
+        mbedtls_free( ssl_buffer_pool_pop( &pool->head ) );
+        pool->nfree--;
+    }
+
+#if defined(SSL_BUFFER_POOL_PER_THREAD)
+    /* Threads still running lose their list: deleting the key does not
+     * run the destructors. */
+    while( pool->caches != NULL )
+    {
+        cache = pool->caches;
+        pool->caches = cache->next;
+        while( cache->count > 0 )
+        {
+            mbedtls_free( ssl_buffer_pool_pop( &cache->head ) );
+            cache->count--;
+        }
+        mbedtls_free( cache );
+    }
+    if( pool->thread_key_created )
+        (void) pthread_key_delete( pool->thread_key );
+#endif /* SSL_BUFFER_POOL_PER_THREAD */
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free( &pool->mutex );
+#endif
+
+    mbedtls_platform_zeroize( pool, sizeof( mbedtls_ssl_buffer_pool ) );
+}
+
+#endif /* MBEDTLS_SSL_BUFFER_POOL_C */
@@ -19,8 +19,33 @@
 /*
  * These session callbacks use a simple chained list
  * to store and retrieve the session information.
+ *
+ * The shared variant (MBEDTLS_SSL_CACHE_SHARED) uses a fixed array of
+ * slots in a shared memory mapping instead.
  */
 
+/* The shared cache needs robust mutexes and anonymous mappings, which are
+ * not declared when compiling with -std=c99 unless asked for. This must be
+ * done before any system header is included, and build_info.h includes
+ * some, so look at the configuration files alone first. */
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/mbedtls_config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+#if defined(MBEDTLS_USER_CONFIG_FILE)
+#include MBEDTLS_USER_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS */
+#endif
+#endif /* MBEDTLS_SSL_CACHE_SHARED */
+
 #include "common.h"
 
 #if defined(MBEDTLS_SSL_CACHE_C)
@@ -32,6 +57,16 @@
 
 #include <string.h>
 
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif /* MBEDTLS_SSL_CACHE_SHARED */
+
 void mbedtls_ssl_cache_init( mbedtls_ssl_cache_context *cache )
 {
     memset( cache, 0, sizeof( mbedtls_ssl_cache_context ) );
@@ -354,4 +389,435 @@ void mbedtls_ssl_cache_free( mbedtls_ssl_cache_context *cache )
     cache->chain = NULL;
 }
 
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+/*
+ * Layout of the shared mapping:
+ *
+ *   header | bucket 0 | bucket 1 | ... | bucket nb_buckets-1
+ *
+ * where each bucket is a lock followed by MBEDTLS_SSL_CACHE_SHARED_WAYS
+ * slots, and each slot is a slot header followed by max_session_len bytes
+ * of serialized session. Buckets and slots start on cache line boundaries
+ * so that processes working on different buckets do not contend.
+ */
+#define SSL_CACHE_SHM_ALIGN 64
+#define SSL_CACHE_SHM_ROUND( n )                                        \
+    ( ( ( n ) + SSL_CACHE_SHM_ALIGN - 1 ) & ~( (size_t) SSL_CACHE_SHM_ALIGN - 1 ) )
+
+typedef struct
+{
+    size_t nb_buckets;
+    size_t bucket_len;
+    size_t slot_len;
+    size_t max_session_len;
+    int timeout;
+} ssl_cache_shm_header;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    uint64_t clock;                 /* last sequence number handed out */
+} ssl_cache_shm_bucket;
+
+typedef struct
+{
+    uint64_t seq;                   /* insertion order, 0 if the slot is free */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t timestamp;
+#endif
+    unsigned char session_id[32];
+    size_t session_id_len;
+    size_t session_len;
+} ssl_cache_shm_slot;
+
+#define SSL_CACHE_SHM_HEADER_LEN SSL_CACHE_SHM_ROUND( sizeof( ssl_cache_shm_header ) )
+#define SSL_CACHE_SHM_BUCKET_LEN SSL_CACHE_SHM_ROUND( sizeof( ssl_cache_shm_bucket ) )
+#define SSL_CACHE_SHM_SLOT_LEN   SSL_CACHE_SHM_ROUND( sizeof( ssl_cache_shm_slot ) )
+
+static ssl_cache_shm_bucket *ssl_cache_shm_get_bucket( ssl_cache_shm_header *hdr,
+                                                       size_t i )
+{
+    return( (ssl_cache_shm_bucket *)
+            ( (unsigned char *) hdr + SSL_CACHE_SHM_HEADER_LEN +
+              i * hdr->bucket_len ) );
+}
+
+static ssl_cache_shm_slot *ssl_cache_shm_get_slot( ssl_cache_shm_header *hdr,
+                                                   ssl_cache_shm_bucket *bucket,
+                                                   size_t way )
+{
+    return( (ssl_cache_shm_slot *)
+            ( (unsigned char *) bucket + SSL_CACHE_SHM_BUCKET_LEN +
+              way * hdr->slot_len ) );
+}
+
+static unsigned char *ssl_cache_shm_slot_data( ssl_cache_shm_slot *slot )
+{
+    return( (unsigned char *) slot + SSL_CACHE_SHM_SLOT_LEN );
+}
+
+/*
+ * Map a session ID to its bucket (FNV-1a). Session IDs are normally random,
+ * but applications can choose their own, so hash all of it.
+ */
+static ssl_cache_shm_bucket *ssl_cache_shm_find_bucket( ssl_cache_shm_header *hdr,
+                                                        unsigned char const *session_id,
+                                                        size_t session_id_len )
+{
+    uint32_t h = 0x811c9dc5;
+    size_t i;
+
+    for( i = 0; i < session_id_len; i++ )
+        h = ( h ^ session_id[i] ) * 0x01000193;
+
+    return( ssl_cache_shm_get_bucket( hdr, h % hdr->nb_buckets ) );
+}
+
+/*
+ * Lock a bucket. If another process died while holding the lock, the
+ * bucket may be half-written: drop its entries and carry on.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cache_shm_lock( ssl_cache_shm_header *hdr,
+                               ssl_cache_shm_bucket *bucket )
+{
+    size_t way;
+    int ret = pthread_mutex_lock( &bucket->mutex );
+
+    if( ret == EOWNERDEAD )
+    {
+        for( way = 0; way < MBEDTLS_SSL_CACHE_SHARED_WAYS; way++ )
+            ssl_cache_shm_get_slot( hdr, bucket, way )->seq = 0;
+
+        ret = pthread_mutex_consistent( &bucket->mutex );
+        if( ret != 0 )
+            pthread_mutex_unlock( &bucket->mutex );
+    }
+
+    return( ret );
+}
+
+static int ssl_cache_shm_is_expired( const ssl_cache_shm_header *hdr,
+                                     const ssl_cache_shm_slot *slot )
+{
+#if defined(MBEDTLS_HAVE_TIME)
+    return( hdr->timeout != 0 &&
+            (int) ( mbedtls_time( NULL ) - slot->timestamp ) > hdr->timeout );
+#else
+    ((void) hdr);
+    ((void) slot);
+    return( 0 );
+#endif
+}
+
+/* Find a live entry for the given session ID. The bucket must be locked. */
+static ssl_cache_shm_slot *ssl_cache_shm_find_slot( ssl_cache_shm_header *hdr,
+                                                    ssl_cache_shm_bucket *bucket,
+                                                    unsigned char const *session_id,
+                                                    size_t session_id_len )
+{
+    ssl_cache_shm_slot *slot;
+    size_t way;
+
+    for( way = 0; way < MBEDTLS_SSL_CACHE_SHARED_WAYS; way++ )
+    {
+        slot = ssl_cache_shm_get_slot( hdr, bucket, way );
+
+        if( slot->seq == 0 ||
+            slot->session_id_len != session_id_len ||
+            memcmp( slot->session_id, session_id, session_id_len ) != 0 )
+        {
+            continue;
+        }
+
+        if( ssl_cache_shm_is_expired( hdr, slot ) )
+        {
+            slot->seq = 0;
+            return( NULL );
+        }
+
+        return( slot );
+    }
+
+    return( NULL );
+}
+
+void mbedtls_ssl_cache_shared_init( mbedtls_ssl_cache_shared_context *cache )
+{
+    memset( cache, 0, sizeof( mbedtls_ssl_cache_shared_context ) );
+}
+
+int mbedtls_ssl_cache_shared_setup( mbedtls_ssl_cache_shared_context *cache,
+                                    size_t max_entries,
+                                    size_t max_session_len )
+{
+    pthread_mutexattr_t attr;
+    ssl_cache_shm_header *hdr;
+    ssl_cache_shm_bucket *bucket;
+    size_t nb_buckets, slot_len, bucket_len, i;
+    void *shm;
+    int ret = 0;
+
+    if( cache->shm != NULL || max_entries == 0 || max_session_len == 0 ||
+        max_session_len > SIZE_MAX / 2 )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    nb_buckets = ( max_entries + MBEDTLS_SSL_CACHE_SHARED_WAYS - 1 ) /
+                 MBEDTLS_SSL_CACHE_SHARED_WAYS;
+    slot_len = SSL_CACHE_SHM_SLOT_LEN + SSL_CACHE_SHM_ROUND( max_session_len );
+    if( slot_len > ( SIZE_MAX / 2 ) / MBEDTLS_SSL_CACHE_SHARED_WAYS )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    bucket_len = SSL_CACHE_SHM_BUCKET_LEN +
+                 MBEDTLS_SSL_CACHE_SHARED_WAYS * slot_len;
+    if( nb_buckets > ( SIZE_MAX / 2 ) / bucket_len )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    cache->shm_len = SSL_CACHE_SHM_HEADER_LEN + nb_buckets * bucket_len;
+
+    /* Anonymous mappings are zero-filled, so all slots start out free. */
+    shm = mmap( NULL, cache->shm_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+    if( shm == MAP_FAILED )
+    {
+        cache->shm_len = 0;
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+    }
+
+    hdr = (ssl_cache_shm_header *) shm;
+    hdr->nb_buckets = nb_buckets;
+    hdr->bucket_len = bucket_len;
+    hdr->slot_len = slot_len;
+    hdr->max_session_len = max_session_len;
+    hdr->timeout = MBEDTLS_SSL_CACHE_DEFAULT_TIMEOUT;
+
+    if( pthread_mutexattr_init( &attr ) != 0 )
+    {
+        munmap( shm, cache->shm_len );
+        cache->shm_len = 0;
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+    }
+
+    if( pthread_mutexattr_setpshared( &attr, PTHREAD_PROCESS_SHARED ) != 0 ||
+        pthread_mutexattr_setrobust( &attr, PTHREAD_MUTEX_ROBUST ) != 0 )
+    {
+        ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+        goto exit;
+    }
+
+    for( i = 0; i < nb_buckets; i++ )
+    {
+        bucket = ssl_cache_shm_get_bucket( hdr, i );
+        if( pthread_mutex_init( &bucket->mutex, &attr ) != 0 )
+        {
+            while( i-- > 0 )
+                pthread_mutex_destroy( &ssl_cache_shm_get_bucket( hdr, i )->mutex );
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto exit;
+        }
+    }
+
+    cache->shm = shm;
+
+exit:
+    pthread_mutexattr_destroy( &attr );
+    if( ret != 0 )
+    {
+        munmap( shm, cache->shm_len );
+        cache->shm_len = 0;
+    }
+
+    return( ret );
+}
+
+int mbedtls_ssl_cache_shared_get( void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  mbedtls_ssl_session *session )
+{
+    int ret = 1;
+    mbedtls_ssl_cache_shared_context *cache =
+        (mbedtls_ssl_cache_shared_context *) data;
+    ssl_cache_shm_header *hdr = (ssl_cache_shm_header *) cache->shm;
+    ssl_cache_shm_bucket *bucket;
+    ssl_cache_shm_slot *slot;
+    unsigned char *session_serialized = NULL;
+    size_t session_serialized_len = 0;
+
+    if( hdr == NULL || session_id_len == 0 || session_id_len > 32 )
+        return( 1 );
+
+    /* Copy the entry out under the lock and deserialize it after
+     * releasing the lock, so that parsing does not block other workers. */
+    session_serialized = mbedtls_calloc( 1, hdr->max_session_len );
+    if( session_serialized == NULL )
+        return( 1 );
+
+    bucket = ssl_cache_shm_find_bucket( hdr, session_id, session_id_len );
+    if( ssl_cache_shm_lock( hdr, bucket ) != 0 )
+        goto exit;
+
+    slot = ssl_cache_shm_find_slot( hdr, bucket, session_id, session_id_len );
+    if( slot != NULL )
+    {
+        session_serialized_len = slot->session_len;
+        memcpy( session_serialized, ssl_cache_shm_slot_data( slot ),
+                session_serialized_len );
+    }
+
+    if( pthread_mutex_unlock( &bucket->mutex ) != 0 || slot == NULL )
+        goto exit;
+
+    ret = mbedtls_ssl_session_load( session,
+                                    session_serialized,
+                                    session_serialized_len );
+
+exit:
+    mbedtls_platform_zeroize( session_serialized, hdr->max_session_len );
+    mbedtls_free( session_serialized );
+
+    return( ret );
+}
+
+int mbedtls_ssl_cache_shared_set( void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  const mbedtls_ssl_session *session )
+{
+    int ret = 1;
+    mbedtls_ssl_cache_shared_context *cache =
+        (mbedtls_ssl_cache_shared_context *) data;
+    ssl_cache_shm_header *hdr = (ssl_cache_shm_header *) cache->shm;
+    ssl_cache_shm_bucket *bucket;
+    ssl_cache_shm_slot *slot, *cur;
+    unsigned char *session_serialized = NULL;
+    size_t session_serialized_len;
+    size_t way;
+
+    if( hdr == NULL || session_id_len == 0 || session_id_len > 32 )
+        return( 1 );
+
+    /* Serialize outside the lock. Sessions too large for a slot are
+     * simply not cached. */
+    ret = mbedtls_ssl_session_save( session, NULL, 0, &session_serialized_len );
+    if( ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL ||
+        session_serialized_len > hdr->max_session_len )
+        return( 1 );
+
+    session_serialized = mbedtls_calloc( 1, session_serialized_len );
+    if( session_serialized == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    ret = mbedtls_ssl_session_save( session,
+                                    session_serialized,
+                                    session_serialized_len,
+                                    &session_serialized_len );
+    if( ret != 0 )
+        goto exit;
+
+    bucket = ssl_cache_shm_find_bucket( hdr, session_id, session_id_len );
+    if( ( ret = ssl_cache_shm_lock( hdr, bucket ) ) != 0 )
+    {
+        ret = 1;
+        goto exit;
+    }
+
+    /* Reuse the entry for this session ID if there is one, otherwise
+     * a free or expired slot, otherwise evict the oldest entry. */
+    slot = ssl_cache_shm_find_slot( hdr, bucket, session_id, session_id_len );
+    for( way = 0; slot == NULL && way < MBEDTLS_SSL_CACHE_SHARED_WAYS; way++ )
+    {
+        cur = ssl_cache_shm_get_slot( hdr, bucket, way );
+        if( cur->seq == 0 || ssl_cache_shm_is_expired( hdr, cur ) )
+            slot = cur;
+    }
+    if( slot == NULL )
+    {
+        slot = ssl_cache_shm_get_slot( hdr, bucket, 0 );
+        for( way = 1; way < MBEDTLS_SSL_CACHE_SHARED_WAYS; way++ )
+        {
+            cur = ssl_cache_shm_get_slot( hdr, bucket, way );
+            if( cur->seq < slot->seq )
+                slot = cur;
+        }
+    }
+
+    slot->seq = ++bucket->clock;
+#if defined(MBEDTLS_HAVE_TIME)
+    slot->timestamp = mbedtls_time( NULL );
+#endif
+    memcpy( slot->session_id, session_id, session_id_len );
+    slot->session_id_len = session_id_len;
+    memcpy( ssl_cache_shm_slot_data( slot ), session_serialized,
+            session_serialized_len );
+    slot->session_len = session_serialized_len;
+
+    ret = 0;
+    if( pthread_mutex_unlock( &bucket->mutex ) != 0 )
+        ret = 1;
+
+exit:
+    mbedtls_platform_zeroize( session_serialized, session_serialized_len );
+    mbedtls_free( session_serialized );
+
+    return( ret );
+}
+
+int mbedtls_ssl_cache_shared_remove( void *data,
+                                     unsigned char const *session_id,
+                                     size_t session_id_len )
+{
+    int ret = 1;
+    mbedtls_ssl_cache_shared_context *cache =
+        (mbedtls_ssl_cache_shared_context *) data;
+    ssl_cache_shm_header *hdr = (ssl_cache_shm_header *) cache->shm;
+    ssl_cache_shm_bucket *bucket;
+    ssl_cache_shm_slot *slot;
+
+    if( hdr == NULL || session_id_len == 0 || session_id_len > 32 )
+        return( 1 );
+
+    bucket = ssl_cache_shm_find_bucket( hdr, session_id, session_id_len );
+    if( ssl_cache_shm_lock( hdr, bucket ) != 0 )
+        return( 1 );
+
+    slot = ssl_cache_shm_find_slot( hdr, bucket, session_id, session_id_len );
+    if( slot != NULL )
+    {
+        slot->seq = 0;
+        mbedtls_platform_zeroize( ssl_cache_shm_slot_data( slot ),
+                                  slot->session_len );
+        ret = 0;
+    }
+
+    if( pthread_mutex_unlock( &bucket->mutex ) != 0 )
+        ret = 1;
+
+    return( ret );
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+void mbedtls_ssl_cache_shared_set_timeout( mbedtls_ssl_cache_shared_context *cache,
+                                           int timeout )
+{
+    ssl_cache_shm_header *hdr = (ssl_cache_shm_header *) cache->shm;
+
+    if( hdr == NULL )
+        return;
+
+    if( timeout < 0 ) timeout = 0;
+
+    hdr->timeout = timeout;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+void mbedtls_ssl_cache_shared_free( mbedtls_ssl_cache_shared_context *cache )
+{
+    if( cache->shm != NULL )
+        munmap( cache->shm, cache->shm_len );
+
+    cache->shm = NULL;
+    cache->shm_len = 0;
+}
+#endif /* MBEDTLS_SSL_CACHE_SHARED */
+
 #endif /* MBEDTLS_SSL_CACHE_C */
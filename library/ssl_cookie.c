@@ -35,6 +35,7 @@
 
 #include "mbedtls/legacy_or_psa.h"
 
+#include <limits.h>
 #include <string.h>
 
 /*
@@ -57,29 +58,84 @@
 #error "DTLS hello verify needs SHA-1 or SHA-2"
 #endif
 
+#if !defined(MBEDTLS_USE_PSA_CRYPTO)
 /*
- * Cookies are formed of a 4-bytes timestamp (or serial number) and
- * an HMAC of timestamp and client ID.
+ * Without PSA, the HMAC is computed directly with the hash module, starting
+ * from inner and outer states precomputed for each key. A key is never
+ * modified while it is in use, so writes and checks share no mutable state
+ * and need no lock.
  */
-#define COOKIE_LEN      ( 4 + COOKIE_HMAC_LEN )
+#if COOKIE_MD_OUTLEN == 32
+#include "mbedtls/sha256.h"
+typedef mbedtls_sha256_context cookie_hash_context;
+#define COOKIE_HASH_BLOCK_LEN       64
+#define COOKIE_HASH_LEN             28
+#define cookie_hash_init            mbedtls_sha256_init
+#define cookie_hash_free            mbedtls_sha256_free
+#define cookie_hash_clone           mbedtls_sha256_clone
+#define cookie_hash_starts( ctx )   mbedtls_sha256_starts( ctx, 1 )
+#define cookie_hash_update          mbedtls_sha256_update
+#define cookie_hash_finish          mbedtls_sha256_finish
+#elif COOKIE_MD_OUTLEN == 48
+#include "mbedtls/sha512.h"
+typedef mbedtls_sha512_context cookie_hash_context;
+#define COOKIE_HASH_BLOCK_LEN       128
+#define COOKIE_HASH_LEN             48
+#define cookie_hash_init            mbedtls_sha512_init
+#define cookie_hash_free            mbedtls_sha512_free
+#define cookie_hash_clone           mbedtls_sha512_clone
+#define cookie_hash_starts( ctx )   mbedtls_sha512_starts( ctx, 1 )
+#define cookie_hash_update          mbedtls_sha512_update
+#define cookie_hash_finish          mbedtls_sha512_finish
+#else
+#include "mbedtls/sha1.h"
+typedef mbedtls_sha1_context cookie_hash_context;
+#define COOKIE_HASH_BLOCK_LEN       64
+#define COOKIE_HASH_LEN             20
+#define cookie_hash_init            mbedtls_sha1_init
+#define cookie_hash_free            mbedtls_sha1_free
+#define cookie_hash_clone           mbedtls_sha1_clone
+#define cookie_hash_starts( ctx )   mbedtls_sha1_starts( ctx )
+#define cookie_hash_update          mbedtls_sha1_update
+#define cookie_hash_finish          mbedtls_sha1_finish
+#endif
+#endif /* !MBEDTLS_USE_PSA_CRYPTO */
 
-void mbedtls_ssl_cookie_init( mbedtls_ssl_cookie_ctx *ctx )
+/*
+ * Cookies are formed of a 1-byte key generation, a 4-bytes timestamp (or
+ * serial number) and an HMAC of generation, timestamp and client ID.
+ */
+#define COOKIE_HDR_LEN  5
+#define COOKIE_LEN      ( COOKIE_HDR_LEN + COOKIE_HMAC_LEN )
+
+struct mbedtls_ssl_cookie_key
 {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    ctx->psa_hmac_key = MBEDTLS_SVC_KEY_ID_INIT;
+    mbedtls_svc_key_id_t psa_hmac_key;  /*!< key id for the HMAC portion   */
 #else
-    mbedtls_md_init( &ctx->hmac_ctx );
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+    cookie_hash_context inner;          /*!< hash state after key ^ ipad  */
+    cookie_hash_context outer;          /*!< hash state after key ^ opad  */
+#endif
+    unsigned char generation;           /*!< first byte of its cookies    */
+    unsigned char valid;
+};
+
+#define COOKIE_SLOT_NEXT( i )   ( ( ( i ) + 1 ) % MBEDTLS_SSL_COOKIE_KEY_SLOTS )
+#define COOKIE_SLOT_PREV( i )   ( ( ( i ) + MBEDTLS_SSL_COOKIE_KEY_SLOTS - 1 ) % \
+                                  MBEDTLS_SSL_COOKIE_KEY_SLOTS )
+
+void mbedtls_ssl_cookie_init( mbedtls_ssl_cookie_ctx *ctx )
+{
+    ctx->keys = NULL;
+    ctx->current = 0;
 #if !defined(MBEDTLS_HAVE_TIME)
     ctx->serial = 0;
 #endif
     ctx->timeout = MBEDTLS_SSL_COOKIE_TIMEOUT;
 
-#if !defined(MBEDTLS_USE_PSA_CRYPTO)
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_mutex_init( &ctx->mutex );
 #endif
-#endif /* !MBEDTLS_USE_PSA_CRYPTO */
 }
 
 void mbedtls_ssl_cookie_set_timeout( mbedtls_ssl_cookie_ctx *ctx, unsigned long delay )
@@ -87,39 +143,60 @@ void mbedtls_ssl_cookie_set_timeout( mbedtls_ssl_cookie_ctx *ctx, unsigned long
     ctx->timeout = delay;
 }
 
-void mbedtls_ssl_cookie_free( mbedtls_ssl_cookie_ctx *ctx )
+static void ssl_cookie_keys_free( mbedtls_ssl_cookie_ctx *ctx )
 {
+    size_t i;
+
+    if( ctx->keys == NULL )
+        return;
+
+    for( i = 0; i < MBEDTLS_SSL_COOKIE_KEY_SLOTS; i++ )
+    {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_destroy_key( ctx->psa_hmac_key );
+        psa_destroy_key( ctx->keys[i].psa_hmac_key );
 #else
-    mbedtls_md_free( &ctx->hmac_ctx );
+        cookie_hash_free( &ctx->keys[i].inner );
+        cookie_hash_free( &ctx->keys[i].outer );
+#endif
+    }
+
+    mbedtls_platform_zeroize( ctx->keys, MBEDTLS_SSL_COOKIE_KEY_SLOTS *
+                                         sizeof( mbedtls_ssl_cookie_key ) );
+    mbedtls_free( ctx->keys );
+    ctx->keys = NULL;
+}
+
+void mbedtls_ssl_cookie_free( mbedtls_ssl_cookie_ctx *ctx )
+{
+    ssl_cookie_keys_free( ctx );
 
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_mutex_free( &ctx->mutex );
 #endif
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
 
     mbedtls_platform_zeroize( ctx, sizeof( mbedtls_ssl_cookie_ctx ) );
 }
 
-int mbedtls_ssl_cookie_setup( mbedtls_ssl_cookie_ctx *ctx,
-                      int (*f_rng)(void *, unsigned char *, size_t),
-                      void *p_rng )
+/*
+ * Generate a fresh key into a slot that is not in use
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cookie_key_generate( mbedtls_ssl_cookie_ctx *ctx,
+                                    mbedtls_ssl_cookie_key *key,
+                                    unsigned char generation,
+                                    int (*f_rng)(void *, unsigned char *, size_t),
+                                    void *p_rng )
 {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-    psa_algorithm_t alg;
 
     (void)f_rng;
     (void)p_rng;
 
-    alg = mbedtls_hash_info_psa_from_md( COOKIE_MD );
-    if( alg == 0 )
-        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
-
-    ctx->psa_hmac_alg = PSA_ALG_TRUNCATED_MAC( PSA_ALG_HMAC( alg ),
-                                               COOKIE_HMAC_LEN );
+    key->valid = 0;
+    psa_destroy_key( key->psa_hmac_key );
+    key->psa_hmac_key = MBEDTLS_SVC_KEY_ID_INIT;
 
     psa_set_key_usage_flags( &attributes, PSA_KEY_USAGE_VERIFY_MESSAGE |
                                           PSA_KEY_USAGE_SIGN_MESSAGE );
@@ -128,260 +205,391 @@ int mbedtls_ssl_cookie_setup( mbedtls_ssl_cookie_ctx *ctx,
     psa_set_key_bits( &attributes, PSA_BYTES_TO_BITS( COOKIE_MD_OUTLEN ) );
 
     if( ( status = psa_generate_key( &attributes,
-                                     &ctx->psa_hmac_key ) ) != PSA_SUCCESS )
+                                     &key->psa_hmac_key ) ) != PSA_SUCCESS )
     {
         return psa_ssl_status_to_mbedtls( status );
     }
 #else
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    unsigned char key[COOKIE_MD_OUTLEN];
+    unsigned char k[COOKIE_MD_OUTLEN];
+    unsigned char pad[COOKIE_HASH_BLOCK_LEN];
+    size_t i;
 
-    if( ( ret = f_rng( p_rng, key, sizeof( key ) ) ) != 0 )
-        return( ret );
+    (void)ctx;
+    key->valid = 0;
 
-    ret = mbedtls_md_setup( &ctx->hmac_ctx, mbedtls_md_info_from_type( COOKIE_MD ), 1 );
-    if( ret != 0 )
-        return( ret );
+    if( ( ret = f_rng( p_rng, k, sizeof( k ) ) ) != 0 )
+        goto exit;
+
+    memset( pad, 0x36, sizeof( pad ) );
+    for( i = 0; i < sizeof( k ); i++ )
+        pad[i] ^= k[i];
+
+    if( ( ret = cookie_hash_starts( &key->inner ) ) != 0 ||
+        ( ret = cookie_hash_update( &key->inner, pad, sizeof( pad ) ) ) != 0 )
+        goto exit;
+
+    memset( pad, 0x5C, sizeof( pad ) );
+    for( i = 0; i < sizeof( k ); i++ )
+        pad[i] ^= k[i];
 
-    ret = mbedtls_md_hmac_starts( &ctx->hmac_ctx, key, sizeof( key ) );
+    if( ( ret = cookie_hash_starts( &key->outer ) ) != 0 ||
+        ( ret = cookie_hash_update( &key->outer, pad, sizeof( pad ) ) ) != 0 )
+        goto exit;
+
+exit:
+    mbedtls_platform_zeroize( k, sizeof( k ) );
+    mbedtls_platform_zeroize( pad, sizeof( pad ) );
     if( ret != 0 )
         return( ret );
-
-    mbedtls_platform_zeroize( key, sizeof( key ) );
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
+    key->generation = generation;
+    key->valid = 1;
+
     return( 0 );
 }
 
-#if !defined(MBEDTLS_USE_PSA_CRYPTO)
-/*
- * Generate the HMAC part of a cookie
- */
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_cookie_hmac( mbedtls_md_context_t *hmac_ctx,
-                            const unsigned char time[4],
-                            unsigned char **p, unsigned char *end,
-                            const unsigned char *cli_id, size_t cli_id_len )
+int mbedtls_ssl_cookie_setup( mbedtls_ssl_cookie_ctx *ctx,
+                      int (*f_rng)(void *, unsigned char *, size_t),
+                      void *p_rng )
 {
-    unsigned char hmac_out[COOKIE_MD_OUTLEN];
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t i;
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    psa_algorithm_t alg;
 
-    MBEDTLS_SSL_CHK_BUF_PTR( *p, end, COOKIE_HMAC_LEN );
+    alg = mbedtls_hash_info_psa_from_md( COOKIE_MD );
+    if( alg == 0 )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    ctx->psa_hmac_alg = PSA_ALG_TRUNCATED_MAC( PSA_ALG_HMAC( alg ),
+                                               COOKIE_HMAC_LEN );
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    ssl_cookie_keys_free( ctx );
+
+    ctx->keys = mbedtls_calloc( MBEDTLS_SSL_COOKIE_KEY_SLOTS,
+                                sizeof( mbedtls_ssl_cookie_key ) );
+    if( ctx->keys == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
 
-    if( mbedtls_md_hmac_reset(  hmac_ctx ) != 0 ||
-        mbedtls_md_hmac_update( hmac_ctx, time, 4 ) != 0 ||
-        mbedtls_md_hmac_update( hmac_ctx, cli_id, cli_id_len ) != 0 ||
-        mbedtls_md_hmac_finish( hmac_ctx, hmac_out ) != 0 )
+    for( i = 0; i < MBEDTLS_SSL_COOKIE_KEY_SLOTS; i++ )
     {
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+        ctx->keys[i].psa_hmac_key = MBEDTLS_SVC_KEY_ID_INIT;
+#else
+        cookie_hash_init( &ctx->keys[i].inner );
+        cookie_hash_init( &ctx->keys[i].outer );
+#endif
     }
 
-    memcpy( *p, hmac_out, COOKIE_HMAC_LEN );
-    *p += COOKIE_HMAC_LEN;
+    ctx->current = 0;
+    if( ( ret = ssl_cookie_key_generate( ctx, &ctx->keys[0], 0,
+                                         f_rng, p_rng ) ) != 0 )
+    {
+        ssl_cookie_keys_free( ctx );
+        return( ret );
+    }
 
     return( 0 );
 }
-#endif /* !MBEDTLS_USE_PSA_CRYPTO */
 
-/*
- * Generate cookie for DTLS ClientHello verification
- */
-int mbedtls_ssl_cookie_write( void *p_ctx,
-                      unsigned char **p, unsigned char *end,
-                      const unsigned char *cli_id, size_t cli_id_len )
+int mbedtls_ssl_cookie_rotate( mbedtls_ssl_cookie_ctx *ctx,
+                               int (*f_rng)(void *, unsigned char *, size_t),
+                               void *p_rng )
 {
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
-    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-    size_t sign_mac_length = 0;
-#endif
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    mbedtls_ssl_cookie_ctx *ctx = (mbedtls_ssl_cookie_ctx *) p_ctx;
-    unsigned long t;
+    unsigned int cur, next;
 
-    if( ctx == NULL || cli_id == NULL )
+    if( ctx == NULL || ctx->keys == NULL )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
-    MBEDTLS_SSL_CHK_BUF_PTR( *p, end, COOKIE_LEN );
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+        return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_SSL_INTERNAL_ERROR, ret ) );
+#endif
 
-#if defined(MBEDTLS_HAVE_TIME)
-    t = (unsigned long) mbedtls_time( NULL );
-#else
-    t = ctx->serial++;
+    /*
+     * The slot after the current one holds the key before the previous
+     * one, which no longer validates anything: readers only ever use the
+     * current and previous slots. They read ctx->current under the lock,
+     * so they see the new key complete once it is published.
+     */
+    cur = ctx->current;
+    next = COOKIE_SLOT_NEXT( cur );
+    ret = ssl_cookie_key_generate( ctx, &ctx->keys[next],
+                                   (unsigned char)( ctx->keys[cur].generation + 1 ),
+                                   f_rng, p_rng );
+    if( ret == 0 )
+        ctx->current = next;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_SSL_INTERNAL_ERROR,
+                MBEDTLS_ERR_THREADING_MUTEX_ERROR ) );
 #endif
 
-    MBEDTLS_PUT_UINT32_BE(t, *p, 0);
-    *p += 4;
+    return( ret );
+}
 
+/*
+ * Compute the HMAC part of a cookie from its header and the client ID
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cookie_hmac( const mbedtls_ssl_cookie_ctx *ctx,
+                            const mbedtls_ssl_cookie_key *key,
+                            const unsigned char hdr[COOKIE_HDR_LEN],
+                            const unsigned char *cli_id, size_t cli_id_len,
+                            unsigned char out[COOKIE_HMAC_LEN] )
+{
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    status = psa_mac_sign_setup( &operation, ctx->psa_hmac_key,
+    psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    size_t mac_len = 0;
+
+    status = psa_mac_sign_setup( &operation, key->psa_hmac_key,
                                  ctx->psa_hmac_alg );
-    if( status != PSA_SUCCESS )
-    {
-        ret = psa_ssl_status_to_mbedtls( status );
-        goto exit;
-    }
+    if( status == PSA_SUCCESS )
+        status = psa_mac_update( &operation, hdr, COOKIE_HDR_LEN );
+    if( status == PSA_SUCCESS )
+        status = psa_mac_update( &operation, cli_id, cli_id_len );
+    if( status == PSA_SUCCESS )
+        status = psa_mac_sign_finish( &operation, out, COOKIE_HMAC_LEN,
+                                      &mac_len );
 
-    status = psa_mac_update( &operation, *p - 4, 4 );
     if( status != PSA_SUCCESS )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
-        goto exit;
+        psa_mac_abort( &operation );
+        return( psa_ssl_status_to_mbedtls( status ) );
     }
 
-    status = psa_mac_update( &operation, cli_id, cli_id_len );
-    if( status != PSA_SUCCESS )
-    {
-        ret = psa_ssl_status_to_mbedtls( status );
+    return( 0 );
+#else
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    cookie_hash_context hash;
+    unsigned char digest[64];
+
+    (void)ctx;
+
+    cookie_hash_init( &hash );
+    cookie_hash_clone( &hash, &key->inner );
+    if( ( ret = cookie_hash_update( &hash, hdr, COOKIE_HDR_LEN ) ) != 0 ||
+        ( ret = cookie_hash_update( &hash, cli_id, cli_id_len ) ) != 0 ||
+        ( ret = cookie_hash_finish( &hash, digest ) ) != 0 )
         goto exit;
-    }
 
-    status = psa_mac_sign_finish( &operation, *p, COOKIE_MD_OUTLEN,
-                                  &sign_mac_length );
-    if( status != PSA_SUCCESS )
-    {
-        ret = psa_ssl_status_to_mbedtls( status );
+    cookie_hash_clone( &hash, &key->outer );
+    if( ( ret = cookie_hash_update( &hash, digest, COOKIE_HASH_LEN ) ) != 0 ||
+        ( ret = cookie_hash_finish( &hash, digest ) ) != 0 )
         goto exit;
-    }
 
-    *p += COOKIE_HMAC_LEN;
+    memcpy( out, digest, COOKIE_HMAC_LEN );
 
-    ret = 0;
-#else
+exit:
+    cookie_hash_free( &hash );
+    mbedtls_platform_zeroize( digest, sizeof( digest ) );
+    if( ret != 0 )
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+
+    return( 0 );
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+}
+
+/*
+ * Get the current key slot, and the serial number of the next cookie when
+ * there is no clock, under the lock. Taking the lock makes the key generated
+ * by the last rotation visible to the calling thread. The HMAC is computed
+ * afterwards without the lock: the current and previous slots are not
+ * modified until the next-but-one rotation.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cookie_get_current( mbedtls_ssl_cookie_ctx *ctx,
+                                   unsigned int *cur,
+                                   unsigned long *serial,
+                                   int next_serial )
+{
 #if defined(MBEDTLS_THREADING_C)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
     if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_SSL_INTERNAL_ERROR, ret ) );
 #endif
 
-    ret = ssl_cookie_hmac( &ctx->hmac_ctx, *p - 4,
-                           p, end, cli_id, cli_id_len );
+    *cur = ctx->current;
+#if defined(MBEDTLS_HAVE_TIME)
+    (void) next_serial;
+    *serial = 0;
+#else
+    *serial = next_serial ? ctx->serial++ : ctx->serial;
+#endif
 
 #if defined(MBEDTLS_THREADING_C)
     if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_SSL_INTERNAL_ERROR,
                 MBEDTLS_ERR_THREADING_MUTEX_ERROR ) );
 #endif
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-exit:
-    status = psa_mac_abort( &operation );
-    if( status != PSA_SUCCESS )
-        ret = psa_ssl_status_to_mbedtls( status );
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
-    return( ret );
+    return( 0 );
 }
 
 /*
- * Check a cookie
+ * Generate cookie for DTLS ClientHello verification
  */
-int mbedtls_ssl_cookie_check( void *p_ctx,
-                      const unsigned char *cookie, size_t cookie_len,
+int mbedtls_ssl_cookie_write( void *p_ctx,
+                      unsigned char **p, unsigned char *end,
                       const unsigned char *cli_id, size_t cli_id_len )
 {
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
-    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-#else
-    unsigned char ref_hmac[COOKIE_HMAC_LEN];
-    unsigned char *p = ref_hmac;
-#endif
-    int ret = 0;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_ssl_cookie_ctx *ctx = (mbedtls_ssl_cookie_ctx *) p_ctx;
-    unsigned long cur_time, cookie_time;
+    const mbedtls_ssl_cookie_key *key;
+    unsigned int cur;
+    unsigned long t;
 
-    if( ctx == NULL || cli_id == NULL )
+    if( ctx == NULL || ctx->keys == NULL || cli_id == NULL )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
-    if( cookie_len != COOKIE_LEN )
+    MBEDTLS_SSL_CHK_BUF_PTR( *p, end, COOKIE_LEN );
+
+    if( ( ret = ssl_cookie_get_current( ctx, &cur, &t, 1 ) ) != 0 )
+        return( ret );
+    key = &ctx->keys[cur];
+
+#if defined(MBEDTLS_HAVE_TIME)
+    t = (unsigned long) mbedtls_time( NULL );
+#endif
+
+    (*p)[0] = key->generation;
+    MBEDTLS_PUT_UINT32_BE( t, *p, 1 );
+
+    ret = ssl_cookie_hmac( ctx, key, *p, cli_id, cli_id_len,
+                           *p + COOKIE_HDR_LEN );
+    if( ret != 0 )
+        return( ret );
+
+    *p += COOKIE_LEN;
+
+    return( 0 );
+}
+
+/*
+ * Check one cookie against the key slot seen at the start of the call
+ */
+static int ssl_cookie_check_one( const mbedtls_ssl_cookie_ctx *ctx,
+                                 unsigned int cur, unsigned long cur_time,
+                                 const unsigned char *cookie, size_t cookie_len,
+                                 const unsigned char *cli_id, size_t cli_id_len )
+{
+    int ret = 0;
+    const mbedtls_ssl_cookie_key *key = &ctx->keys[cur];
+    unsigned char ref_hmac[COOKIE_HMAC_LEN];
+    unsigned long cookie_time;
+
+    if( cookie_len != COOKIE_LEN || cli_id == NULL )
         return( -1 );
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    status = psa_mac_verify_setup( &operation, ctx->psa_hmac_key,
-                                   ctx->psa_hmac_alg );
-    if( status != PSA_SUCCESS )
+    /* Cookies of the previous key are still accepted after a rotation */
+    if( cookie[0] != key->generation )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
-        goto exit;
+        key = &ctx->keys[COOKIE_SLOT_PREV( cur )];
+        if( ! key->valid || cookie[0] != key->generation )
+            return( -1 );
     }
 
-    status = psa_mac_update( &operation, cookie, 4 );
-    if( status != PSA_SUCCESS )
+    if( ssl_cookie_hmac( ctx, key, cookie, cli_id, cli_id_len,
+                         ref_hmac ) != 0 )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
+        ret = -1;
         goto exit;
     }
 
-    status = psa_mac_update( &operation, cli_id,
-                             cli_id_len );
-    if( status != PSA_SUCCESS )
+    if( mbedtls_ct_memcmp( cookie + COOKIE_HDR_LEN, ref_hmac,
+                           sizeof( ref_hmac ) ) != 0 )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
+        ret = -1;
         goto exit;
     }
 
-    status = psa_mac_verify_finish( &operation, cookie + 4,
-                                    COOKIE_HMAC_LEN );
-    if( status != PSA_SUCCESS )
+    cookie_time = ( (unsigned long) cookie[1] << 24 ) |
+                  ( (unsigned long) cookie[2] << 16 ) |
+                  ( (unsigned long) cookie[3] <<  8 ) |
+                  ( (unsigned long) cookie[4]       );
+
+    if( ctx->timeout != 0 && cur_time - cookie_time > ctx->timeout )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
+        ret = -1;
         goto exit;
     }
 
-    ret = 0;
-#else
-#if defined(MBEDTLS_THREADING_C)
-    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
-        return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_SSL_INTERNAL_ERROR, ret ) );
-#endif
+exit:
+    mbedtls_platform_zeroize( ref_hmac, sizeof( ref_hmac ) );
+    return( ret );
+}
 
-    if( ssl_cookie_hmac( &ctx->hmac_ctx, cookie,
-                         &p, p + sizeof( ref_hmac ),
-                         cli_id, cli_id_len ) != 0 )
-        ret = -1;
+/*
+ * Check a cookie
+ */
+int mbedtls_ssl_cookie_check( void *p_ctx,
+                      const unsigned char *cookie, size_t cookie_len,
+                      const unsigned char *cli_id, size_t cli_id_len )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cookie_ctx *ctx = (mbedtls_ssl_cookie_ctx *) p_ctx;
+    unsigned long cur_time;
+    unsigned int cur;
 
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
-    {
-        ret = MBEDTLS_ERROR_ADD( MBEDTLS_ERR_SSL_INTERNAL_ERROR,
-                                 MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-    }
+    if( ctx == NULL || ctx->keys == NULL || cli_id == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    if( ( ret = ssl_cookie_get_current( ctx, &cur, &cur_time, 0 ) ) != 0 )
+        return( ret );
+
+#if defined(MBEDTLS_HAVE_TIME)
+    cur_time = (unsigned long) mbedtls_time( NULL );
 #endif
 
-    if( ret != 0 )
-        goto exit;
+    return( ssl_cookie_check_one( ctx, cur, cur_time,
+                                  cookie, cookie_len, cli_id, cli_id_len ) );
+}
+
+/*
+ * Check a batch of cookies
+ */
+int mbedtls_ssl_cookie_check_batch( mbedtls_ssl_cookie_ctx *ctx,
+                                    mbedtls_ssl_cookie_query *queries,
+                                    size_t count )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned long cur_time;
+    unsigned int cur;
+    size_t i;
+    int valid = 0;
 
-    if( mbedtls_ct_memcmp( cookie + 4, ref_hmac, sizeof( ref_hmac ) ) != 0 )
+    if( ctx == NULL || ctx->keys == NULL ||
+        ( queries == NULL && count != 0 ) || count > INT_MAX )
     {
-        ret = -1;
-        goto exit;
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
     }
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    if( ( ret = ssl_cookie_get_current( ctx, &cur, &cur_time, 0 ) ) != 0 )
+        return( ret );
 
 #if defined(MBEDTLS_HAVE_TIME)
     cur_time = (unsigned long) mbedtls_time( NULL );
-#else
-    cur_time = ctx->serial;
 #endif
 
-    cookie_time = ( (unsigned long) cookie[0] << 24 ) |
-                  ( (unsigned long) cookie[1] << 16 ) |
-                  ( (unsigned long) cookie[2] <<  8 ) |
-                  ( (unsigned long) cookie[3]       );
-
-    if( ctx->timeout != 0 && cur_time - cookie_time > ctx->timeout )
+    for( i = 0; i < count; i++ )
     {
-        ret = -1;
-        goto exit;
+        queries[i].result = ssl_cookie_check_one( ctx, cur, cur_time,
+                                                  queries[i].cookie,
+                                                  queries[i].cookie_len,
+                                                  queries[i].cli_id,
+                                                  queries[i].cli_id_len );
+        if( queries[i].result == 0 )
+            valid++;
     }
 
-exit:
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    status = psa_mac_abort( &operation );
-    if( status != PSA_SUCCESS )
-        ret = psa_ssl_status_to_mbedtls( status );
-#else
-    mbedtls_platform_zeroize( ref_hmac, sizeof( ref_hmac ) );
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
-    return( ret );
+    return( valid );
 }
 #endif /* MBEDTLS_SSL_COOKIE_C */
@@ -0,0 +1,820 @@
+/*
+ *  DTLS server endpoint: many associations on one datagram socket
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+/*
+ * Associations are found through two hash maps with intrusive chains, one
+ * keyed by peer address and one by the connection ID we gave the peer.
+ * Running retransmission timers are kept on a list so that each call to
+ * mbedtls_ssl_dtls_endpoint_process() only visits associations that are
+ * actually waiting for something.
+ */
+
+#include "common.h"
+
+#if defined(MBEDTLS_SSL_DTLS_ENDPOINT_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_dtls_endpoint.h"
+#include "ssl_misc.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+/* DTLS record header: type, version, epoch, sequence number, [CID,] length */
+#define DTLS_HDR_LEN        13
+#define DTLS_HDR_CID_OFFSET 11
+
+/* Minimum number of buckets of each map */
+#define EP_MIN_BUCKETS      16
+
+/* Attempts at drawing a connection ID that is not already in use */
+#define EP_CID_ATTEMPTS     8
+
+struct mbedtls_ssl_dtls_assoc
+{
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_dtls_endpoint *ep;
+
+    mbedtls_ssl_dtls_assoc *next_addr;      /*!< chain in by_addr, or free list */
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    mbedtls_ssl_dtls_assoc *next_cid;       /*!< chain in by_cid                */
+#endif
+    mbedtls_ssl_dtls_assoc *next_timer;     /*!< running timers                 */
+    mbedtls_ssl_dtls_assoc **pprev_timer;   /*!< NULL if no timer is running    */
+
+    uint32_t timer_start;                   /*!< endpoint clock at set_timer    */
+    uint32_t int_ms;                        /*!< intermediate delay             */
+    uint32_t fin_ms;                        /*!< final delay, 0 if cancelled    */
+
+    unsigned char addr[MBEDTLS_SSL_DGRAM_ADDR_MAX];
+    size_t addr_len;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    unsigned char cid[MBEDTLS_SSL_CID_IN_LEN_MAX];
+    size_t cid_len;
+#endif
+
+    const mbedtls_ssl_dgram *pending;       /*!< datagram for ep_recv()         */
+    int active;                             /*!< in the maps                    */
+    int connected;                          /*!< handshake completed            */
+};
+
+/*
+ * Keyed FNV-1a followed by the MurmurHash3 finalizer, so that peers cannot
+ * choose addresses that all land in the same bucket.
+ */
+static size_t ep_hash( const mbedtls_ssl_dtls_endpoint *ep,
+                       const unsigned char *buf, size_t len )
+{
+    uint32_t h = 2166136261u ^ ep->hash_key;
+    size_t i;
+
+    for( i = 0; i < len; i++ )
+    {
+        h ^= buf[i];
+        h *= 16777619u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return( h & ep->hash_mask );
+}
+
+static mbedtls_ssl_dtls_assoc *ep_find_addr( const mbedtls_ssl_dtls_endpoint *ep,
+                                             const unsigned char *addr,
+                                             size_t addr_len )
+{
+    mbedtls_ssl_dtls_assoc *a = ep->by_addr[ep_hash( ep, addr, addr_len )];
+
+    for( ; a != NULL; a = a->next_addr )
+    {
+        if( a->addr_len == addr_len && memcmp( a->addr, addr, addr_len ) == 0 )
+            return( a );
+    }
+
+    return( NULL );
+}
+
+static void ep_insert_addr( mbedtls_ssl_dtls_endpoint *ep,
+                            mbedtls_ssl_dtls_assoc *a )
+{
+    size_t h = ep_hash( ep, a->addr, a->addr_len );
+
+    a->next_addr = ep->by_addr[h];
+    ep->by_addr[h] = a;
+}
+
+static void ep_remove_addr( mbedtls_ssl_dtls_endpoint *ep,
+                            mbedtls_ssl_dtls_assoc *a )
+{
+    mbedtls_ssl_dtls_assoc **pa = &ep->by_addr[ep_hash( ep, a->addr, a->addr_len )];
+
+    for( ; *pa != NULL; pa = &(*pa)->next_addr )
+    {
+        if( *pa == a )
+        {
+            *pa = a->next_addr;
+            a->next_addr = NULL;
+            return;
+        }
+    }
+}
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+static mbedtls_ssl_dtls_assoc *ep_find_cid( const mbedtls_ssl_dtls_endpoint *ep,
+                                            const unsigned char *cid,
+                                            size_t cid_len )
+{
+    mbedtls_ssl_dtls_assoc *a = ep->by_cid[ep_hash( ep, cid, cid_len )];
+
+    for( ; a != NULL; a = a->next_cid )
+    {
+        if( a->cid_len == cid_len && memcmp( a->cid, cid, cid_len ) == 0 )
+            return( a );
+    }
+
+    return( NULL );
+}
+
+static void ep_insert_cid( mbedtls_ssl_dtls_endpoint *ep,
+                           mbedtls_ssl_dtls_assoc *a )
+{
+    size_t h = ep_hash( ep, a->cid, a->cid_len );
+
+    a->next_cid = ep->by_cid[h];
+    ep->by_cid[h] = a;
+}
+
+static void ep_remove_cid( mbedtls_ssl_dtls_endpoint *ep,
+                           mbedtls_ssl_dtls_assoc *a )
+{
+    mbedtls_ssl_dtls_assoc **pa;
+
+    if( a->cid_len == 0 )
+        return;
+
+    pa = &ep->by_cid[ep_hash( ep, a->cid, a->cid_len )];
+    for( ; *pa != NULL; pa = &(*pa)->next_cid )
+    {
+        if( *pa == a )
+        {
+            *pa = a->next_cid;
+            a->next_cid = NULL;
+            return;
+        }
+    }
+}
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+/*
+ * Timer callbacks: delays are measured on the clock passed to
+ * mbedtls_ssl_dtls_endpoint_process(), with wrap-around arithmetic.
+ */
+static void ep_timer_unlink( mbedtls_ssl_dtls_assoc *a )
+{
+    if( a->pprev_timer == NULL )
+        return;
+
+    *a->pprev_timer = a->next_timer;
+    if( a->next_timer != NULL )
+        a->next_timer->pprev_timer = a->pprev_timer;
+
+    a->next_timer = NULL;
+    a->pprev_timer = NULL;
+}
+
+static void ep_set_timer( void *ctx, uint32_t int_ms, uint32_t fin_ms )
+{
+    mbedtls_ssl_dtls_assoc *a = (mbedtls_ssl_dtls_assoc *) ctx;
+    mbedtls_ssl_dtls_endpoint *ep = a->ep;
+
+    a->timer_start = ep->now;
+    a->int_ms = int_ms;
+    a->fin_ms = fin_ms;
+
+    if( fin_ms == 0 )
+    {
+        ep_timer_unlink( a );
+        return;
+    }
+
+    if( a->pprev_timer != NULL )
+        return;
+
+    a->next_timer = ep->timers;
+    if( ep->timers != NULL )
+        ep->timers->pprev_timer = &a->next_timer;
+    ep->timers = a;
+    a->pprev_timer = &ep->timers;
+}
+
+static int ep_get_timer( void *ctx )
+{
+    mbedtls_ssl_dtls_assoc *a = (mbedtls_ssl_dtls_assoc *) ctx;
+    uint32_t elapsed = a->ep->now - a->timer_start;
+
+    if( a->fin_ms == 0 )
+        return( -1 );
+
+    if( elapsed >= a->fin_ms )
+        return( 2 );
+
+    if( elapsed >= a->int_ms )
+        return( 1 );
+
+    return( 0 );
+}
+
+/*
+ * Send callback: queue the datagram for the next batch, addressed to the
+ * peer of the association. A full queue is flushed first.
+ */
+static int ep_send( void *ctx, const unsigned char *buf, size_t len )
+{
+    mbedtls_ssl_dtls_assoc *a = (mbedtls_ssl_dtls_assoc *) ctx;
+    mbedtls_ssl_dtls_endpoint *ep = a->ep;
+    mbedtls_ssl_dgram *d;
+
+    if( len > ep->mtu )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    if( ep->tx_count == MBEDTLS_SSL_DTLS_ENDPOINT_BATCH )
+        (void) mbedtls_ssl_dtls_endpoint_flush( ep );
+
+    d = &ep->tx[ep->tx_count++];
+    memcpy( d->buf, buf, len );
+    d->len = len;
+    memcpy( d->addr, a->addr, a->addr_len );
+    d->addr_len = a->addr_len;
+
+    return( (int) len );
+}
+
+/*
+ * Receive callback: deliver the datagram being dispatched, once.
+ * Like recvfrom(), truncate it if the buffer is too small.
+ */
+static int ep_recv( void *ctx, unsigned char *buf, size_t len )
+{
+    mbedtls_ssl_dtls_assoc *a = (mbedtls_ssl_dtls_assoc *) ctx;
+    const mbedtls_ssl_dgram *d = a->pending;
+
+    if( d == NULL )
+        return( MBEDTLS_ERR_SSL_WANT_READ );
+
+    a->pending = NULL;
+
+    if( len > d->len )
+        len = d->len;
+    memcpy( buf, d->buf, len );
+
+    return( (int) len );
+}
+
+/*
+ * Take an SSL context from the free list, or allocate a new one.
+ */
+static int ep_assoc_get( mbedtls_ssl_dtls_endpoint *ep,
+                         mbedtls_ssl_dtls_assoc **pa )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_dtls_assoc *a = ep->free_list;
+
+    if( a != NULL )
+    {
+        ep->free_list = a->next_addr;
+        a->next_addr = NULL;
+        *pa = a;
+        return( 0 );
+    }
+
+    a = mbedtls_calloc( 1, sizeof( mbedtls_ssl_dtls_assoc ) );
+    if( a == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    mbedtls_ssl_init( &a->ssl );
+    if( ( ret = mbedtls_ssl_setup( &a->ssl, ep->conf ) ) != 0 )
+    {
+        mbedtls_ssl_free( &a->ssl );
+        mbedtls_free( a );
+        return( ret );
+    }
+
+    a->ep = ep;
+    mbedtls_ssl_set_bio( &a->ssl, a, ep_send, ep_recv, NULL );
+    mbedtls_ssl_set_timer_cb( &a->ssl, a, ep_set_timer, ep_get_timer );
+    mbedtls_ssl_set_mtu( &a->ssl, ep->mtu );
+
+    *pa = a;
+    return( 0 );
+}
+
+/*
+ * Return a context that has not been used since ep_assoc_get().
+ */
+static void ep_assoc_put_unused( mbedtls_ssl_dtls_endpoint *ep,
+                                 mbedtls_ssl_dtls_assoc *a )
+{
+    a->next_addr = ep->free_list;
+    ep->free_list = a;
+}
+
+static int ep_event( mbedtls_ssl_dtls_endpoint *ep,
+                     mbedtls_ssl_dtls_assoc *a, int event )
+{
+    if( ep->f_event == NULL )
+        return( 0 );
+
+    return( ep->f_event( ep->p_event, &a->ssl, event ) );
+}
+
+static void ep_assoc_close( mbedtls_ssl_dtls_endpoint *ep,
+                            mbedtls_ssl_dtls_assoc *a, int notify )
+{
+    if( notify )
+        (void) mbedtls_ssl_close_notify( &a->ssl );
+
+    (void) ep_event( ep, a, MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_CLOSED );
+
+    ep_remove_addr( ep, a );
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    ep_remove_cid( ep, a );
+    a->cid_len = 0;
+#endif
+    ep_timer_unlink( a );
+    a->active = 0;
+    a->connected = 0;
+    a->pending = NULL;
+    ep->count--;
+
+    (void) mbedtls_ssl_session_reset( &a->ssl );
+    mbedtls_ssl_set_user_data_n( &a->ssl, 0 );
+
+    ep_assoc_put_unused( ep, a );
+}
+
+/*
+ * Make progress on an association after it received a datagram or
+ * its timer expired.
+ */
+static void ep_assoc_step( mbedtls_ssl_dtls_endpoint *ep,
+                           mbedtls_ssl_dtls_assoc *a )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if( ! a->connected )
+    {
+        ret = mbedtls_ssl_handshake( &a->ssl );
+        if( ret == MBEDTLS_ERR_SSL_WANT_READ ||
+            ret == MBEDTLS_ERR_SSL_WANT_WRITE )
+        {
+            return;
+        }
+
+        if( ret != 0 )
+        {
+            /* A fatal alert, if any, has already been sent */
+            ep_assoc_close( ep, a, 0 );
+            return;
+        }
+
+        a->connected = 1;
+        if( ep_event( ep, a, MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_CONNECTED ) != 0 )
+        {
+            ep_assoc_close( ep, a, 1 );
+            return;
+        }
+
+        /* Application data may follow the Finished message in the datagram */
+        if( mbedtls_ssl_check_pending( &a->ssl ) == 0 )
+            return;
+    }
+
+    if( ep_event( ep, a, MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_READABLE ) != 0 )
+        ep_assoc_close( ep, a, 1 );
+}
+
+/*
+ * A datagram from an unknown peer: only an initial ClientHello may create
+ * an association, and only after its cookie has been checked, which keeps
+ * no state when it fails.
+ */
+static void ep_new_client( mbedtls_ssl_dtls_endpoint *ep,
+                           const mbedtls_ssl_dgram *d )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_dtls_assoc *a;
+
+    if( ep->count >= ep->max_assocs )
+        return;
+
+    if( d->len <= DTLS_HDR_LEN ||
+        d->buf[0] != MBEDTLS_SSL_MSG_HANDSHAKE ||
+        d->buf[3] != 0 || d->buf[4] != 0 ||
+        d->buf[DTLS_HDR_LEN] != MBEDTLS_SSL_HS_CLIENT_HELLO )
+    {
+        return;
+    }
+
+    if( ep_assoc_get( ep, &a ) != 0 )
+        return;
+
+#if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY)
+    if( ep->conf->f_cookie_write != NULL && ep->conf->f_cookie_check != NULL )
+    {
+        mbedtls_ssl_dgram *out;
+        size_t olen = 0;
+
+        if( ep->tx_count == MBEDTLS_SSL_DTLS_ENDPOINT_BATCH )
+            (void) mbedtls_ssl_dtls_endpoint_flush( ep );
+        out = &ep->tx[ep->tx_count];
+
+        ret = mbedtls_ssl_check_dtls_clihlo_cookie( &a->ssl,
+                                                    d->addr, d->addr_len,
+                                                    d->buf, d->len,
+                                                    out->buf, ep->mtu, &olen );
+        if( ret == MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED )
+        {
+            out->len = olen;
+            memcpy( out->addr, d->addr, d->addr_len );
+            out->addr_len = d->addr_len;
+            ep->tx_count++;
+        }
+
+        if( ret != 0 )
+        {
+            ep_assoc_put_unused( ep, a );
+            return;
+        }
+    }
+#endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY */
+
+    if( mbedtls_ssl_set_client_transport_id( &a->ssl,
+                                             d->addr, d->addr_len ) != 0 )
+    {
+        ep_assoc_put_unused( ep, a );
+        return;
+    }
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    a->cid_len = 0;
+    if( ep->conf->cid_len > 0 )
+    {
+        int i;
+
+        for( i = 0; i < EP_CID_ATTEMPTS; i++ )
+        {
+            if( ep->conf->f_rng( ep->conf->p_rng, a->cid,
+                                 ep->conf->cid_len ) != 0 )
+            {
+                i = EP_CID_ATTEMPTS;
+                break;
+            }
+            if( ep_find_cid( ep, a->cid, ep->conf->cid_len ) == NULL )
+                break;
+        }
+
+        if( i == EP_CID_ATTEMPTS ||
+            mbedtls_ssl_set_cid( &a->ssl, MBEDTLS_SSL_CID_ENABLED,
+                                 a->cid, ep->conf->cid_len ) != 0 )
+        {
+            ep_assoc_put_unused( ep, a );
+            return;
+        }
+
+        a->cid_len = ep->conf->cid_len;
+        ep_insert_cid( ep, a );
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+    memcpy( a->addr, d->addr, d->addr_len );
+    a->addr_len = d->addr_len;
+    ep_insert_addr( ep, a );
+    a->active = 1;
+    ep->count++;
+
+    a->pending = d;
+    ep_assoc_step( ep, a );
+    a->pending = NULL;
+}
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+/*
+ * A record with our connection ID arrived from another address: follow the
+ * peer there, but only if the record is authentic and not a replay.
+ */
+static int ep_assoc_migrate( mbedtls_ssl_dtls_endpoint *ep,
+                             mbedtls_ssl_dtls_assoc *a,
+                             const mbedtls_ssl_dgram *d )
+{
+    if( d->len > MBEDTLS_SSL_IN_BUFFER_LEN ||
+        ep_find_addr( ep, d->addr, d->addr_len ) != NULL )
+    {
+        return( -1 );
+    }
+
+    memcpy( ep->check_buf, d->buf, d->len );
+    if( mbedtls_ssl_check_record( &a->ssl, ep->check_buf, d->len ) != 0 )
+        return( -1 );
+
+    ep_remove_addr( ep, a );
+    memcpy( a->addr, d->addr, d->addr_len );
+    a->addr_len = d->addr_len;
+    ep_insert_addr( ep, a );
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+static void ep_dispatch( mbedtls_ssl_dtls_endpoint *ep,
+                         const mbedtls_ssl_dgram *d )
+{
+    mbedtls_ssl_dtls_assoc *a;
+
+    if( d->addr_len > MBEDTLS_SSL_DGRAM_ADDR_MAX )
+        return;
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    if( ep->conf->cid_len > 0 &&
+        d->len > DTLS_HDR_CID_OFFSET + ep->conf->cid_len &&
+        d->buf[0] == MBEDTLS_SSL_MSG_CID )
+    {
+        a = ep_find_cid( ep, d->buf + DTLS_HDR_CID_OFFSET, ep->conf->cid_len );
+        if( a == NULL )
+            return;
+
+        if( ( a->addr_len != d->addr_len ||
+              memcmp( a->addr, d->addr, d->addr_len ) != 0 ) &&
+            ep_assoc_migrate( ep, a, d ) != 0 )
+        {
+            return;
+        }
+    }
+    else
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    {
+        a = ep_find_addr( ep, d->addr, d->addr_len );
+        if( a == NULL )
+        {
+            ep_new_client( ep, d );
+            return;
+        }
+    }
+
+    a->pending = d;
+    ep_assoc_step( ep, a );
+    a->pending = NULL;
+}
+
+/*
+ * Step the associations whose final timer delay has expired.
+ */
+static void ep_run_timers( mbedtls_ssl_dtls_endpoint *ep )
+{
+    mbedtls_ssl_dtls_assoc *a, *next;
+
+    for( a = ep->timers; a != NULL; a = next )
+    {
+        next = a->next_timer;
+        if( ep_get_timer( a ) == 2 )
+            ep_assoc_step( ep, a );
+    }
+}
+
+void mbedtls_ssl_dtls_endpoint_init( mbedtls_ssl_dtls_endpoint *ep )
+{
+    memset( ep, 0, sizeof( mbedtls_ssl_dtls_endpoint ) );
+}
+
+int mbedtls_ssl_dtls_endpoint_setup( mbedtls_ssl_dtls_endpoint *ep,
+                                     const mbedtls_ssl_config *conf,
+                                     size_t max_assocs, uint16_t mtu )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char key[4];
+    size_t buckets = EP_MIN_BUCKETS;
+    size_t i;
+
+    if( conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        conf->transport != MBEDTLS_SSL_TRANSPORT_DATAGRAM ||
+        conf->f_rng == NULL || max_assocs == 0 || mtu <= DTLS_HDR_LEN ||
+        max_assocs > ( (size_t) -1 ) / 4 )
+    {
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    while( buckets < max_assocs )
+        buckets <<= 1;
+
+    if( ( ret = conf->f_rng( conf->p_rng, key, sizeof( key ) ) ) != 0 )
+        return( ret );
+
+    ep->conf = conf;
+    ep->mtu = mtu;
+    ep->max_assocs = max_assocs;
+    ep->hash_key = MBEDTLS_GET_UINT32_BE( key, 0 );
+    ep->hash_mask = buckets - 1;
+
+    ep->by_addr = mbedtls_calloc( buckets, sizeof( mbedtls_ssl_dtls_assoc * ) );
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    ep->by_cid = mbedtls_calloc( buckets, sizeof( mbedtls_ssl_dtls_assoc * ) );
+    ep->check_buf = mbedtls_calloc( 1, MBEDTLS_SSL_IN_BUFFER_LEN );
+#endif
+    ep->rx = mbedtls_calloc( MBEDTLS_SSL_DTLS_ENDPOINT_BATCH,
+                             sizeof( mbedtls_ssl_dgram ) );
+    ep->tx = mbedtls_calloc( MBEDTLS_SSL_DTLS_ENDPOINT_BATCH,
+                             sizeof( mbedtls_ssl_dgram ) );
+    ep->rx_buf = mbedtls_calloc( MBEDTLS_SSL_DTLS_ENDPOINT_BATCH,
+                                 MBEDTLS_SSL_IN_BUFFER_LEN );
+    ep->tx_buf = mbedtls_calloc( MBEDTLS_SSL_DTLS_ENDPOINT_BATCH, mtu );
+
+    if( ep->by_addr == NULL ||
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        ep->by_cid == NULL || ep->check_buf == NULL ||
+#endif
+        ep->rx == NULL || ep->tx == NULL ||
+        ep->rx_buf == NULL || ep->tx_buf == NULL )
+    {
+        mbedtls_ssl_dtls_endpoint_free( ep );
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+    }
+
+    for( i = 0; i < MBEDTLS_SSL_DTLS_ENDPOINT_BATCH; i++ )
+    {
+        ep->rx[i].buf = ep->rx_buf + i * MBEDTLS_SSL_IN_BUFFER_LEN;
+        ep->tx[i].buf = ep->tx_buf + i * mtu;
+    }
+
+    return( 0 );
+}
+
+void mbedtls_ssl_dtls_endpoint_set_bio( mbedtls_ssl_dtls_endpoint *ep,
+                                        void *p_bio,
+                                        mbedtls_ssl_send_batch_t *f_send,
+                                        mbedtls_ssl_recv_batch_t *f_recv )
+{
+    ep->p_bio = p_bio;
+    ep->f_send = f_send;
+    ep->f_recv = f_recv;
+}
+
+void mbedtls_ssl_dtls_endpoint_set_callback( mbedtls_ssl_dtls_endpoint *ep,
+                                             mbedtls_ssl_dtls_endpoint_cb_t *f_event,
+                                             void *p_event )
+{
+    ep->f_event = f_event;
+    ep->p_event = p_event;
+}
+
+int mbedtls_ssl_dtls_endpoint_process( mbedtls_ssl_dtls_endpoint *ep,
+                                       uint32_t now_ms )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int received = 0;
+    int i;
+
+    if( ep->conf == NULL || ep->f_recv == NULL || ep->f_send == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    ep->now = now_ms;
+
+    for( i = 0; i < MBEDTLS_SSL_DTLS_ENDPOINT_BATCH; i++ )
+    {
+        ep->rx[i].len = MBEDTLS_SSL_IN_BUFFER_LEN;
+        ep->rx[i].addr_len = 0;
+    }
+
+    ret = ep->f_recv( ep->p_bio, ep->rx, MBEDTLS_SSL_DTLS_ENDPOINT_BATCH );
+    if( ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ )
+        return( ret );
+
+    if( ret > 0 )
+        received = ret;
+
+    for( i = 0; i < received; i++ )
+        ep_dispatch( ep, &ep->rx[i] );
+
+    ep_run_timers( ep );
+
+    if( ( ret = mbedtls_ssl_dtls_endpoint_flush( ep ) ) != 0 )
+        return( ret );
+
+    return( received );
+}
+
+int mbedtls_ssl_dtls_endpoint_flush( mbedtls_ssl_dtls_endpoint *ep )
+{
+    int ret = 0;
+    size_t done = 0;
+
+    if( ep->f_send == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    while( done < ep->tx_count )
+    {
+        ret = ep->f_send( ep->p_bio, ep->tx + done, ep->tx_count - done );
+        if( ret <= 0 )
+            break;
+        done += (size_t) ret;
+    }
+
+    /* Whatever could not be sent is lost, as on a congested network */
+    ep->tx_count = 0;
+
+    if( ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret > 0 )
+        ret = 0;
+
+    return( ret );
+}
+
+int mbedtls_ssl_dtls_endpoint_close( mbedtls_ssl_dtls_endpoint *ep,
+                                     mbedtls_ssl_context *ssl )
+{
+    mbedtls_ssl_dtls_assoc *a;
+
+    if( ssl == NULL || ssl->f_send != ep_send )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    a = (mbedtls_ssl_dtls_assoc *) ssl->p_bio;
+    if( a->ep != ep || ! a->active )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    ep_assoc_close( ep, a, 1 );
+
+    return( 0 );
+}
+
+size_t mbedtls_ssl_dtls_endpoint_count( const mbedtls_ssl_dtls_endpoint *ep )
+{
+    return( ep->count );
+}
+
+static void ep_assoc_free( mbedtls_ssl_dtls_assoc *a )
+{
+    mbedtls_ssl_free( &a->ssl );
+    mbedtls_platform_zeroize( a, sizeof( mbedtls_ssl_dtls_assoc ) );
+    mbedtls_free( a );
+}
+
+void mbedtls_ssl_dtls_endpoint_free( mbedtls_ssl_dtls_endpoint *ep )
+{
+    mbedtls_ssl_dtls_assoc *a, *next;
+    size_t i;
+
+    if( ep == NULL )
+        return;
+
+    if( ep->by_addr != NULL )
+    {
+        for( i = 0; i <= ep->hash_mask; i++ )
+        {
+            for( a = ep->by_addr[i]; a != NULL; a = next )
+            {
+                next = a->next_addr;
+                ep_assoc_free( a );
+            }
+        }
+    }
+
+    for( a = ep->free_list; a != NULL; a = next )
+    {
+        next = a->next_addr;
+        ep_assoc_free( a );
+    }
+
+    mbedtls_free( ep->by_addr );
+    mbedtls_free( ep->by_cid );
+    mbedtls_free( ep->rx );
+    mbedtls_free( ep->tx );
+    mbedtls_free( ep->rx_buf );
+    mbedtls_free( ep->tx_buf );
+    if( ep->check_buf != NULL )
+    {
+        mbedtls_platform_zeroize( ep->check_buf, MBEDTLS_SSL_IN_BUFFER_LEN );
+        mbedtls_free( ep->check_buf );
+    }
+
+    mbedtls_platform_zeroize( ep, sizeof( mbedtls_ssl_dtls_endpoint ) );
+}
+
+#endif /* MBEDTLS_SSL_DTLS_ENDPOINT_C */
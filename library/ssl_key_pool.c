@@ -0,0 +1,326 @@
+/*
+ *  Pool of pre-generated ephemeral ECDH key shares
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+/*
+ * Key pairs are generated by mbedtls_ssl_key_pool_fill() outside of the
+ * pool lock and queued in a ring per group; a handshake takes the oldest
+ * one in constant time. Ownership of the PSA key moves with it, so each
+ * key pair serves one handshake only.
+ */
+
+#include "common.h"
+
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_key_pool.h"
+#include "ssl_misc.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/psa_util.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+void mbedtls_ssl_key_pool_init( mbedtls_ssl_key_pool *pool )
+{
+    memset( pool, 0, sizeof( mbedtls_ssl_key_pool ) );
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init( &pool->mutex );
+#endif
+}
+
+/*
+ * Destroy the keys still in the pool and release the rings
+ */
+static void ssl_key_pool_clear( mbedtls_ssl_key_pool *pool )
+{
+    size_t g, i;
+
+    if( pool->groups == NULL )
+        return;
+
+    for( g = 0; g < pool->ngroups; g++ )
+    {
+        mbedtls_ssl_key_pool_group *group = &pool->groups[g];
+
+        if( group->ring == NULL )
+            continue;
+
+        for( i = 0; i < group->count; i++ )
+        {
+            mbedtls_ssl_key_pool_entry *entry =
+                &group->ring[( group->head + i ) % pool->size];
+            (void) psa_destroy_key( entry->key );
+        }
+
+        mbedtls_platform_zeroize( group->ring,
+                                  pool->size * sizeof( mbedtls_ssl_key_pool_entry ) );
+        mbedtls_free( group->ring );
+    }
+
+    mbedtls_free( pool->groups );
+    pool->groups = NULL;
+    pool->ngroups = 0;
+}
+
+int mbedtls_ssl_key_pool_setup( mbedtls_ssl_key_pool *pool,
+                                const uint16_t *groups,
+                                size_t size )
+{
+    size_t ngroups, g;
+
+    if( groups == NULL || groups[0] == 0 || size == 0 )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    for( ngroups = 0; groups[ngroups] != 0; ngroups++ )
+    {
+        size_t bits = 0;
+
+        if( mbedtls_psa_parse_tls_ecc_group( groups[ngroups], &bits ) == 0 )
+            return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    ssl_key_pool_clear( pool );
+
+    pool->groups = mbedtls_calloc( ngroups, sizeof( mbedtls_ssl_key_pool_group ) );
+    if( pool->groups == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+    pool->ngroups = ngroups;
+    pool->size = size;
+    pool->next = 0;
+
+    for( g = 0; g < ngroups; g++ )
+    {
+        mbedtls_ssl_key_pool_group *group = &pool->groups[g];
+
+        group->tls_id = groups[g];
+        group->type = mbedtls_psa_parse_tls_ecc_group( groups[g],
+                                                       &group->bits );
+        group->ring = mbedtls_calloc( size, sizeof( mbedtls_ssl_key_pool_entry ) );
+        if( group->ring == NULL )
+        {
+            ssl_key_pool_clear( pool );
+            return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+        }
+    }
+
+    return( 0 );
+}
+
+/*
+ * Generate one key pair of the given group and export its public key
+ */
+static int ssl_key_pool_generate( const mbedtls_ssl_key_pool_group *group,
+                                  mbedtls_ssl_key_pool_entry *entry )
+{
+    psa_status_t status;
+    psa_key_attributes_t key_attributes = psa_key_attributes_init();
+
+    psa_set_key_usage_flags( &key_attributes, PSA_KEY_USAGE_DERIVE );
+    psa_set_key_algorithm( &key_attributes, PSA_ALG_ECDH );
+    psa_set_key_type( &key_attributes, group->type );
+    psa_set_key_bits( &key_attributes, group->bits );
+
+    status = psa_generate_key( &key_attributes, &entry->key );
+    if( status != PSA_SUCCESS )
+        return( psa_ssl_status_to_mbedtls( status ) );
+
+    status = psa_export_public_key( entry->key, entry->pub,
+                                    sizeof( entry->pub ), &entry->pub_len );
+    if( status != PSA_SUCCESS )
+    {
+        (void) psa_destroy_key( entry->key );
+        return( psa_ssl_status_to_mbedtls( status ) );
+    }
+
+    return( 0 );
+}
+
+int mbedtls_ssl_key_pool_fill( mbedtls_ssl_key_pool *pool, size_t max )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_key_pool_entry entry;
+    size_t generated = 0, full = 0;
+
+    if( pool == NULL || pool->groups == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    while( ( max == 0 || generated < max ) && full < pool->ngroups )
+    {
+        mbedtls_ssl_key_pool_group *group;
+        int queued = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+        if( ( ret = mbedtls_mutex_lock( &pool->mutex ) ) != 0 )
+            return( ret );
+#endif
+
+        group = &pool->groups[pool->next];
+        pool->next = ( pool->next + 1 ) % pool->ngroups;
+        if( group->count == pool->size )
+            full++;
+        else
+            full = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_unlock( &pool->mutex ) != 0 )
+            return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+        if( full > 0 )
+            continue;
+
+        /* The scalar multiplication is done without the lock. */
+        if( ( ret = ssl_key_pool_generate( group, &entry ) ) != 0 )
+            return( ret );
+
+#if defined(MBEDTLS_THREADING_C)
+        if( ( ret = mbedtls_mutex_lock( &pool->mutex ) ) != 0 )
+        {
+            (void) psa_destroy_key( entry.key );
+            mbedtls_platform_zeroize( &entry, sizeof( entry ) );
+            return( ret );
+        }
+#endif
+
+        if( group->count < pool->size )
+        {
+            group->ring[( group->head + group->count ) % pool->size] = entry;
+            group->count++;
+            queued = 1;
+        }
+
+#if defined(MBEDTLS_THREADING_C)
+        if( mbedtls_mutex_unlock( &pool->mutex ) != 0 )
+            return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+        /* Another thread filled the ring in the meantime */
+        if( queued == 0 )
+            (void) psa_destroy_key( entry.key );
+        else
+            generated++;
+
+        mbedtls_platform_zeroize( &entry, sizeof( entry ) );
+    }
+
+    return( (int) generated );
+}
+
+int mbedtls_ssl_key_pool_pop( void *p_pool,
+                              uint16_t named_group,
+                              mbedtls_svc_key_id_t *key,
+                              unsigned char *pub,
+                              size_t pub_size,
+                              size_t *pub_len )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_key_pool *pool = (mbedtls_ssl_key_pool *) p_pool;
+    mbedtls_ssl_key_pool_group *group = NULL;
+    mbedtls_ssl_key_pool_entry *entry;
+    size_t g;
+
+    if( pool == NULL || pool->groups == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    for( g = 0; g < pool->ngroups; g++ )
+    {
+        if( pool->groups[g].tls_id == named_group )
+            group = &pool->groups[g];
+    }
+    if( group == NULL )
+        return( MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &pool->mutex ) ) != 0 )
+        return( ret );
+#endif
+
+    entry = &group->ring[group->head];
+    if( group->count == 0 )
+    {
+        ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+    else if( entry->pub_len > pub_size )
+    {
+        ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+    else
+    {
+        /* Hand the key over and forget it. */
+        *key = entry->key;
+        memcpy( pub, entry->pub, entry->pub_len );
+        *pub_len = entry->pub_len;
+        mbedtls_platform_zeroize( entry, sizeof( mbedtls_ssl_key_pool_entry ) );
+
+        group->head = ( group->head + 1 ) % pool->size;
+        group->count--;
+        ret = 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &pool->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+    return( ret );
+}
+
+size_t mbedtls_ssl_key_pool_available( mbedtls_ssl_key_pool *pool,
+                                       uint16_t named_group )
+{
+    size_t g, count = 0;
+
+    if( pool == NULL || pool->groups == NULL )
+        return( 0 );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_lock( &pool->mutex ) != 0 )
+        return( 0 );
+#endif
+
+    for( g = 0; g < pool->ngroups; g++ )
+    {
+        if( pool->groups[g].tls_id == named_group )
+            count = pool->groups[g].count;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock( &pool->mutex );
+#endif
+
+    return( count );
+}
+
+void mbedtls_ssl_key_pool_free( mbedtls_ssl_key_pool *pool )
+{
+    if( pool == NULL )
+        return;
+
+    ssl_key_pool_clear( pool );
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free( &pool->mutex );
+#endif
+
+    mbedtls_platform_zeroize( pool, sizeof( mbedtls_ssl_key_pool ) );
+}
+
+#endif /* MBEDTLS_SSL_KEY_POOL_C */
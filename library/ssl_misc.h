@@ -69,6 +69,19 @@
 #define MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED
 #endif
 
+/* Restartable ECC in TLS 1.3: certificate chain verification and
+ * CertificateVerify signing/verification, on both endpoints. The (EC)DHE
+ * key exchange goes through PSA and is not restartable. */
+#if defined(MBEDTLS_ECP_RESTARTABLE) && \
+    defined(MBEDTLS_ECDSA_C) && \
+    defined(MBEDTLS_SSL_PROTO_TLS1_3) && \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED)
+#define MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED
+#if !defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
+#define MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED
+#endif
+#endif
+
 #define MBEDTLS_SSL_INITIAL_HANDSHAKE           0
 #define MBEDTLS_SSL_RENEGOTIATION_IN_PROGRESS   1   /* In progress */
 #define MBEDTLS_SSL_RENEGOTIATION_DONE          2   /* Done or aborted */
@@ -103,6 +116,14 @@
 #define MBEDTLS_SSL_EXT_SIG_ALG_CERT                ( 1 << 20 )
 #define MBEDTLS_SSL_EXT_KEY_SHARE                   ( 1 << 21 )
 
+/*
+ * Handling of records that cannot be decrypted by a TLS 1.3 server that
+ * rejected early data, see handshake->early_data_discard.
+ */
+#define MBEDTLS_SSL_EARLY_DATA_NO_DISCARD                 0
+#define MBEDTLS_SSL_EARLY_DATA_DISCARD                    1
+#define MBEDTLS_SSL_EARLY_DATA_DISCARD_TILL_CLIENT_HELLO  2
+
 /*
  * Helper macros for function call with return check.
  */
@@ -224,6 +245,10 @@
 /* The maximum number of buffered handshake messages. */
 #define MBEDTLS_SSL_MAX_BUFFERED_HS 4
 
+/* The maximum number of disjoint byte ranges tracked while reassembling
+ * a fragmented DTLS handshake message. */
+#define MBEDTLS_SSL_MAX_REASSEMBLY_RANGES 8
+
 /* Maximum length we can advertise as our max content length for
    RFC 6066 max_fragment_length extension negotiation purposes
    (the lesser of both sizes, if they are unequal.)
@@ -576,6 +601,10 @@ struct mbedtls_ssl_handshake_params
 
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
     uint8_t async_in_progress; /*!< an asynchronous operation is in progress */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    uint16_t async_sig_alg;    /*!< TLS 1.3 SignatureScheme of the pending
+                                    CertificateVerify signature */
+#endif
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -595,6 +624,7 @@ struct mbedtls_ssl_handshake_params
         ssl_ecrs_ske_start_processing,  /*!< ServerKeyExchange: pk_verify() */
         ssl_ecrs_cke_ecdh_calc_secret,  /*!< ClientKeyExchange: ECDH step 2 */
         ssl_ecrs_crt_vrfy_sign,         /*!< CertificateVerify: pk_sign()   */
+        ssl_ecrs_crt_vrfy_verify,       /*!< CertificateVerify: pk_verify() */
     } ecrs_state;                       /*!< current (or last) operation    */
     mbedtls_x509_crt *ecrs_peer_cert;   /*!< The peer's CRT chain.          */
     size_t ecrs_n;                      /*!< place for saving a length      */
@@ -624,6 +654,21 @@ struct mbedtls_ssl_handshake_params
 #endif
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
     uint16_t new_session_tickets_count;         /*!< number of session tickets */
+    uint8_t new_session_tickets_deferred;       /*!< tickets wait for the first
+                                                     mbedtls_ssl_write() */
+    /** NewSessionTicket messages generated in one batch, sent in as few
+     *  records as possible. */
+    unsigned char *new_session_tickets;
+    size_t new_session_tickets_len;             /*!< length of the batch */
+    size_t new_session_tickets_sent;            /*!< bytes of the batch sent */
+#endif
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    /** Whether records that fail to decrypt are skipped as rejected early
+     *  data, one of the \c MBEDTLS_SSL_EARLY_DATA_xxx_DISCARD values. */
+    uint8_t early_data_discard;
+    uint8_t early_data_replay_ok;   /*!< The 0-RTT ClientHello passed the
+                                         anti-replay check */
+    uint32_t early_data_len;        /*!< Early data received or skipped */
 #endif
 #endif /* MBEDTLS_SSL_SRV_C */
 
@@ -706,8 +751,11 @@ struct mbedtls_ssl_handshake_params
 
     struct
     {
-        size_t total_bytes_buffered; /*!< Cumulative size of heap allocated
-                                      *   buffers used for message buffering. */
+        unsigned char *arena;        /*!< Storage for all buffered messages,
+                                      *   of MBEDTLS_SSL_DTLS_MAX_BUFFERING
+                                      *   bytes, allocated on first use.   */
+        size_t total_bytes_buffered; /*!< Number of bytes of the arena in
+                                      *   use, from its start.             */
 
         uint8_t seen_ccs;               /*!< Indicates if a CCS message has
                                          *   been seen in the current flight. */
@@ -719,6 +767,14 @@ struct mbedtls_ssl_handshake_params
             unsigned is_complete   : 1;
             unsigned char *data;
             size_t data_len;
+            uint8_t range_count;
+            struct
+            {
+                uint32_t start;
+                uint32_t end;
+            } ranges[MBEDTLS_SSL_MAX_REASSEMBLY_RANGES]; /*!< Received bytes
+                                      *   of the message body: sorted,
+                                      *   disjoint and non-adjacent.       */
         } hs[MBEDTLS_SSL_MAX_BUFFERED_HS];
 
         struct
@@ -1116,6 +1172,34 @@ struct mbedtls_ssl_key_cert
 };
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
+/*
+ * Entry of the ciphersuite lookup table built by mbedtls_ssl_conf_precompute()
+ */
+struct mbedtls_ssl_ciphersuite_index_entry
+{
+    uint16_t id;                            /*!< IANA identifier            */
+    uint16_t rank;                          /*!< index in ciphersuite_list  */
+    const mbedtls_ssl_ciphersuite_t *info;  /*!< ciphersuite definition     */
+};
+
+/* Maximum length of a ciphersuite list that can be indexed */
+#define MBEDTLS_SSL_CIPHERSUITE_INDEX_MAX   256
+
+/**
+ * \brief          Look up a ciphersuite in the table built by
+ *                 mbedtls_ssl_conf_precompute().
+ *
+ * \param conf     The SSL configuration. Its ciphersuite table must have
+ *                 been built.
+ * \param suite_id The IANA identifier of the ciphersuite.
+ *
+ * \return         The table entry for \p suite_id, or \c NULL if
+ *                 \p suite_id is not enabled in \p conf.
+ */
+const mbedtls_ssl_ciphersuite_index_entry *mbedtls_ssl_conf_find_ciphersuite(
+                                        const mbedtls_ssl_config *conf,
+                                        int suite_id );
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 /*
  * List of handshake messages kept around for resending
@@ -1565,6 +1649,15 @@ MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_session_copy( mbedtls_ssl_session *dst,
                               const mbedtls_ssl_session *src );
 
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+/*
+ * Parse the peer certificate that mbedtls_ssl_session_load() left in DER
+ * form, if any. Does nothing if the certificate is already parsed.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_session_parse_peer_cert( mbedtls_ssl_session *session );
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
 /* The hash buffer must have at least MBEDTLS_MD_MAX_SIZE bytes of length. */
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -1640,6 +1733,11 @@ void mbedtls_ssl_pend_fatal_alert( mbedtls_ssl_context *ssl,
 
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
 void mbedtls_ssl_dtls_replay_reset( mbedtls_ssl_context *ssl );
+#if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
+uint64_t mbedtls_ssl_dtls_replay_export( const mbedtls_ssl_context *ssl );
+void mbedtls_ssl_dtls_replay_import( mbedtls_ssl_context *ssl,
+                                     uint64_t window_top, uint64_t bits );
+#endif
 #endif
 
 void mbedtls_ssl_handshake_wrapup_free_hs_transform( mbedtls_ssl_context *ssl );
@@ -1747,6 +1845,20 @@ int mbedtls_ssl_tls13_handshake_client_step( mbedtls_ssl_context *ssl );
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_tls13_handshake_server_step( mbedtls_ssl_context *ssl );
 
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+/**
+ * \brief           Resume the server state machine to send the
+ *                  NewSessionTicket messages deferred by
+ *                  #MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED, if any.
+ *
+ * \note            The caller then completes the handshake, which is no
+ *                  longer over if tickets are pending.
+ *
+ * \param ssl       SSL context
+ */
+void mbedtls_ssl_tls13_resume_deferred_tickets( mbedtls_ssl_context *ssl );
+#endif
+
 
 /*
  * Helper functions around key exchange modes.
@@ -2357,6 +2469,30 @@ static inline int psa_ssl_status_to_mbedtls( psa_status_t status )
 }
 #endif /* MBEDTLS_USE_PSA_CRYPTO || MBEDTLS_SSL_PROTO_TLS1_3 */
 
+#if ( defined(MBEDTLS_USE_PSA_CRYPTO) || defined(MBEDTLS_SSL_PROTO_TLS1_3) ) && \
+    defined(MBEDTLS_ECDH_C)
+/**
+ * \brief       Take the ephemeral ECDHE key pair of the handshake from the
+ *              key share pool set with mbedtls_ssl_conf_key_share_pool().
+ *              On success handshake->ecdh_psa_privkey holds the private key.
+ *
+ * \param ssl           SSL context, with handshake->ecdh_psa_type and
+ *                      handshake->ecdh_bits set for \p named_group
+ * \param named_group   IANA NamedGroup of the key pair
+ * \param buf           Buffer receiving the public key
+ * \param buf_len       Size of \p buf in bytes
+ * \param olen          Length of the public key in bytes
+ *
+ * \return      0 if a pooled key pair is used, or a non-zero value if the
+ *              caller must generate the key pair itself.
+ */
+int mbedtls_ssl_pop_key_share( mbedtls_ssl_context *ssl,
+                               uint16_t named_group,
+                               unsigned char *buf,
+                               size_t buf_len,
+                               size_t *olen );
+#endif /* ( MBEDTLS_USE_PSA_CRYPTO || MBEDTLS_SSL_PROTO_TLS1_3 ) && MBEDTLS_ECDH_C */
+
 /**
  * \brief       TLS record protection modes
  */
@@ -2393,6 +2529,12 @@ static inline int mbedtls_ssl_tls13_cipher_suite_is_offered(
 {
     const int *ciphersuite_list = ssl->conf->ciphersuite_list;
 
+    if( ssl->conf->ciphersuite_index != NULL )
+    {
+        return( mbedtls_ssl_conf_find_ciphersuite( ssl->conf,
+                                                   cipher_suite ) != NULL );
+    }
+
     /* Check whether we have offered this ciphersuite */
     for ( size_t i = 0; ciphersuite_list[i] != 0; i++ )
     {
@@ -2446,7 +2588,15 @@ int mbedtls_ssl_write_alpn_ext( mbedtls_ssl_context *ssl,
                                 size_t *out_len );
 #endif /* MBEDTLS_SSL_ALPN */
 
-#if defined(MBEDTLS_TEST_HOOKS)
+#if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY) && defined(MBEDTLS_SSL_SRV_C) && \
+    ( defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) ||                      \
+      defined(MBEDTLS_SSL_DTLS_ENDPOINT_C) )
+/*
+ * Check the cookie of a ClientHello datagram without any per-client state.
+ * Returns 0 if it is valid, or #MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED
+ * after writing a HelloVerifyRequest datagram to obuf.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_check_dtls_clihlo_cookie(
                            mbedtls_ssl_context *ssl,
                            const unsigned char *cli_id, size_t cli_id_len,
@@ -2498,4 +2648,14 @@ int mbedtls_ssl_session_set_hostname( mbedtls_ssl_session *session,
                                       const char *hostname );
 #endif
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && \
+    defined(MBEDTLS_SSL_ALPN) && \
+    defined(MBEDTLS_SSL_SRV_C)
+/* Record the ALPN protocol negotiated when a ticket allowing early data is
+ * issued; \p alpn may be NULL to clear it. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_session_set_ticket_alpn( mbedtls_ssl_session *session,
+                                         const char *alpn );
+#endif
+
 #endif /* ssl_misc.h */
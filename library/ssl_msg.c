@@ -149,6 +149,7 @@ exit:
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 
 /* Forward declarations for functions related to message buffering. */
+static void ssl_buffering_clear( mbedtls_ssl_context *ssl );
 static void ssl_buffering_free_slot( mbedtls_ssl_context *ssl,
                                      uint8_t slot );
 static void ssl_free_buffered_record( mbedtls_ssl_context *ssl );
@@ -2375,7 +2376,7 @@ void mbedtls_ssl_recv_flight_completed( mbedtls_ssl_context *ssl )
     ssl->handshake->buffering.seen_ccs = 0;
 
     /* Clear future message buffering structure. */
-    mbedtls_ssl_buffering_free( ssl );
+    ssl_buffering_clear( ssl );
 
     /* Cancel timer */
     mbedtls_ssl_set_timer( ssl, 0 );
@@ -2825,80 +2826,115 @@ static int ssl_check_hs_header( mbedtls_ssl_context const *ssl )
 }
 
 /*
- * Mark bits in bitmask (used for DTLS HS reassembly)
+ * Record that bytes [start, end) of a handshake message being reassembled
+ * have been received. Ranges that overlap or touch the new one are merged
+ * with it. If it would need a new range and all are in use, nothing is
+ * changed and -1 is returned: the fragment is then ignored, and comes
+ * again when the peer retransmits its flight.
  */
-static void ssl_bitmask_set( unsigned char *mask, size_t offset, size_t len )
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_reassembly_add_range( mbedtls_ssl_hs_buffer *hs_buf,
+                                     uint32_t start, uint32_t end )
 {
-    unsigned int start_bits, end_bits;
-
-    start_bits = 8 - ( offset % 8 );
-    if( start_bits != 8 )
-    {
-        size_t first_byte_idx = offset / 8;
+    unsigned first, last, count = hs_buf->range_count;
 
-        /* Special case */
-        if( len <= start_bits )
-        {
-            for( ; len != 0; len-- )
-                mask[first_byte_idx] |= 1 << ( start_bits - len );
+    /* Ranges first to last - 1 overlap or touch [start, end) */
+    for( first = 0; first < count; first++ )
+        if( hs_buf->ranges[first].end >= start )
+            break;
 
-            /* Avoid potential issues with offset or len becoming invalid */
-            return;
-        }
+    for( last = first; last < count; last++ )
+        if( hs_buf->ranges[last].start > end )
+            break;
 
-        offset += start_bits; /* Now offset % 8 == 0 */
-        len -= start_bits;
+    if( first == last )
+    {
+        if( count == MBEDTLS_SSL_MAX_REASSEMBLY_RANGES )
+            return( -1 );
 
-        for( ; start_bits != 0; start_bits-- )
-            mask[first_byte_idx] |= 1 << ( start_bits - 1 );
+        memmove( &hs_buf->ranges[first + 1], &hs_buf->ranges[first],
+                 ( count - first ) * sizeof( hs_buf->ranges[0] ) );
+        count++;
     }
-
-    end_bits = len % 8;
-    if( end_bits != 0 )
+    else
     {
-        size_t last_byte_idx = ( offset + len ) / 8;
-
-        len -= end_bits; /* Now len % 8 == 0 */
+        if( hs_buf->ranges[first].start < start )
+            start = hs_buf->ranges[first].start;
+        if( hs_buf->ranges[last - 1].end > end )
+            end = hs_buf->ranges[last - 1].end;
 
-        for( ; end_bits != 0; end_bits-- )
-            mask[last_byte_idx] |= 1 << ( 8 - end_bits );
+        memmove( &hs_buf->ranges[first + 1], &hs_buf->ranges[last],
+                 ( count - last ) * sizeof( hs_buf->ranges[0] ) );
+        count -= last - first - 1;
     }
 
-    memset( mask + offset / 8, 0xFF, len / 8 );
+    hs_buf->ranges[first].start = start;
+    hs_buf->ranges[first].end   = end;
+    hs_buf->range_count = (uint8_t) count;
+
+    return( 0 );
 }
 
 /*
- * Check that bitmask is full
+ * DTLS buffering arena
+ *
+ * Buffered handshake messages and the buffered future epoch record all live
+ * in a single block of MBEDTLS_SSL_DTLS_MAX_BUFFERING bytes, allocated the
+ * first time something is buffered and kept until the end of the handshake.
+ * Buffers are taken from the end of the used part. When one is released,
+ * the ones above it are moved down, so that the free space stays in one
+ * piece and total_bytes_buffered is the size of the used part.
  */
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_bitmask_check( unsigned char *mask, size_t len )
+static unsigned char *ssl_buffering_alloc( mbedtls_ssl_context *ssl,
+                                           size_t len )
 {
-    size_t i;
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    unsigned char *buf;
 
-    for( i = 0; i < len / 8; i++ )
-        if( mask[i] != 0xFF )
-            return( -1 );
+    if( len > MBEDTLS_SSL_DTLS_MAX_BUFFERING -
+              hs->buffering.total_bytes_buffered )
+    {
+        return( NULL );
+    }
 
-    for( i = 0; i < len % 8; i++ )
-        if( ( mask[len / 8] & ( 1 << ( 7 - i ) ) ) == 0 )
-            return( -1 );
+    if( hs->buffering.arena == NULL )
+    {
+        hs->buffering.arena = mbedtls_calloc( 1,
+                                              MBEDTLS_SSL_DTLS_MAX_BUFFERING );
+        if( hs->buffering.arena == NULL )
+            return( NULL );
+    }
 
-    return( 0 );
+    buf = hs->buffering.arena + hs->buffering.total_bytes_buffered;
+    hs->buffering.total_bytes_buffered += len;
+
+    return( buf );
 }
 
-/* msg_len does not include the handshake header */
-static size_t ssl_get_reassembly_buffer_size( size_t msg_len,
-                                              unsigned add_bitmap )
+static void ssl_buffering_release( mbedtls_ssl_context *ssl,
+                                   unsigned char *buf, size_t len )
 {
-    size_t alloc_len;
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    unsigned char * const used_end = hs->buffering.arena +
+                                     hs->buffering.total_bytes_buffered;
+    unsigned offset;
 
-    alloc_len  = 12;                                 /* Handshake header */
-    alloc_len += msg_len;                            /* Content buffer   */
+    memmove( buf, buf + len, used_end - ( buf + len ) );
+    mbedtls_platform_zeroize( used_end - len, len );
+    hs->buffering.total_bytes_buffered -= len;
 
-    if( add_bitmap )
-        alloc_len += msg_len / 8 + ( msg_len % 8 != 0 ); /* Bitmap       */
+    for( offset = 0; offset < MBEDTLS_SSL_MAX_BUFFERED_HS; offset++ )
+    {
+        mbedtls_ssl_hs_buffer * const hs_buf = &hs->buffering.hs[offset];
+        if( hs_buf->is_valid == 1 && hs_buf->data > buf )
+            hs_buf->data -= len;
+    }
 
-    return( alloc_len );
+    if( hs->buffering.future_record.data != NULL &&
+        hs->buffering.future_record.data > buf )
+    {
+        hs->buffering.future_record.data -= len;
+    }
 }
 
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
@@ -3044,22 +3080,88 @@ void mbedtls_ssl_update_handshake_status( mbedtls_ssl_context *ssl )
 }
 
 /*
- * DTLS anti-replay: RFC 6347 4.1.2.6
+ * DTLS anti-replay: RFC 6347 4.1.2.6, with the window kept as in RFC 6479
  *
- * in_window is a field of bits numbered from 0 (lsb) to 63 (msb).
- * Bit n is set iff record number in_window_top - n has been seen.
+ * in_window is a ring of 64-bit words: record number n maps to bit n % 64 of
+ * word (n / 64) % SSL_REPLAY_WORDS, and that bit is set iff n has been seen.
+ * When in_window_top moves forward, the words of the blocks it skips over
+ * are cleared, so nothing ever needs to be shifted. One word more than the
+ * maximum window is kept so that the block containing in_window_top never
+ * overlaps with the oldest block still inside the window.
  *
- * Usually, in_window_top is the last record number seen and the lsb of
- * in_window is set. The only exception is the initial state (record number 0
- * not seen yet).
+ * Usually, in_window_top is the last record number seen. The only exception
+ * is the initial state (record number 0 not seen yet).
  */
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
+#define SSL_REPLAY_WORDS    ( MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX / 64 + 1 )
+
+static inline uint64_t *ssl_replay_word( uint64_t *window, uint64_t seqnum )
+{
+    return( &window[( seqnum / 64 ) % SSL_REPLAY_WORDS] );
+}
+
+static inline uint64_t ssl_replay_bit( uint64_t seqnum )
+{
+    return( (uint64_t) 1 << ( seqnum % 64 ) );
+}
+
+static inline int ssl_replay_seen( const uint64_t *window, uint64_t seqnum )
+{
+    return( ( window[( seqnum / 64 ) % SSL_REPLAY_WORDS] &
+              ssl_replay_bit( seqnum ) ) != 0 );
+}
+
 void mbedtls_ssl_dtls_replay_reset( mbedtls_ssl_context *ssl )
 {
     ssl->in_window_top = 0;
-    ssl->in_window = 0;
+    memset( ssl->in_window, 0, sizeof( ssl->in_window ) );
+}
+
+#if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
+/*
+ * The serialized format only has room for the 64 most recent record
+ * numbers: bit n is set iff record number in_window_top - n has been seen.
+ */
+uint64_t mbedtls_ssl_dtls_replay_export( const mbedtls_ssl_context *ssl )
+{
+    uint64_t bits = 0;
+    uint64_t n;
+
+    for( n = 0; n < 64 && n <= ssl->in_window_top; n++ )
+    {
+        if( ssl_replay_seen( ssl->in_window, ssl->in_window_top - n ) )
+            bits |= (uint64_t) 1 << n;
+    }
+
+    return( bits );
 }
 
+void mbedtls_ssl_dtls_replay_import( mbedtls_ssl_context *ssl,
+                                     uint64_t window_top, uint64_t bits )
+{
+    uint64_t *top_word;
+    uint64_t n;
+
+    /* Records older than the serialized part of the window are unknown:
+     * treat them as already seen, which is what a 64-record window does. */
+    memset( ssl->in_window, 0xFF, sizeof( ssl->in_window ) );
+
+    ssl->in_window_top = window_top;
+    top_word = ssl_replay_word( ssl->in_window, window_top );
+    if( window_top % 64 != 63 )
+        *top_word &= ssl_replay_bit( window_top + 1 ) - 1;
+
+    for( n = 0; n < 64 && n <= window_top; n++ )
+    {
+        if( ( bits & ( (uint64_t) 1 << n ) ) == 0 )
+        {
+            *ssl_replay_word( ssl->in_window, window_top - n ) &=
+                ~ssl_replay_bit( window_top - n );
+        }
+    }
+}
+#endif /* MBEDTLS_SSL_CONTEXT_SERIALIZATION */
+
 static inline uint64_t ssl_load_six_bytes( unsigned char *buf )
 {
     return( ( (uint64_t) buf[0] << 40 ) |
@@ -3096,7 +3198,6 @@ static int mbedtls_ssl_dtls_record_replay_check( mbedtls_ssl_context *ssl, uint8
 int mbedtls_ssl_dtls_replay_check( mbedtls_ssl_context const *ssl )
 {
     uint64_t rec_seqnum = ssl_load_six_bytes( ssl->in_ctr + 2 );
-    uint64_t bit;
 
     if( ssl->conf->anti_replay == MBEDTLS_SSL_ANTI_REPLAY_DISABLED )
         return( 0 );
@@ -3104,12 +3205,10 @@ int mbedtls_ssl_dtls_replay_check( mbedtls_ssl_context const *ssl )
     if( rec_seqnum > ssl->in_window_top )
         return( 0 );
 
-    bit = ssl->in_window_top - rec_seqnum;
-
-    if( bit >= 64 )
+    if( ssl->in_window_top - rec_seqnum >= ssl->conf->anti_replay_window )
         return( -1 );
 
-    if( ( ssl->in_window & ( (uint64_t) 1 << bit ) ) != 0 )
+    if( ssl_replay_seen( ssl->in_window, rec_seqnum ) )
         return( -1 );
 
     return( 0 );
@@ -3127,31 +3226,36 @@ void mbedtls_ssl_dtls_replay_update( mbedtls_ssl_context *ssl )
 
     if( rec_seqnum > ssl->in_window_top )
     {
-        /* Update window_top and the contents of the window */
-        uint64_t shift = rec_seqnum - ssl->in_window_top;
+        /* Clear the words of the blocks between the old and the new top,
+         * or the whole ring if we jumped past all of it. */
+        uint64_t block = ssl->in_window_top / 64;
+        uint64_t skip = rec_seqnum / 64 - block;
 
-        if( shift >= 64 )
-            ssl->in_window = 1;
+        if( skip >= SSL_REPLAY_WORDS )
+            memset( ssl->in_window, 0, sizeof( ssl->in_window ) );
         else
         {
-            ssl->in_window <<= shift;
-            ssl->in_window |= 1;
+            while( skip-- > 0 )
+                ssl->in_window[++block % SSL_REPLAY_WORDS] = 0;
         }
 
         ssl->in_window_top = rec_seqnum;
     }
-    else
+    else if( ssl->in_window_top - rec_seqnum >= ssl->conf->anti_replay_window )
     {
-        /* Mark that number as seen in the current window */
-        uint64_t bit = ssl->in_window_top - rec_seqnum;
-
-        if( bit < 64 ) /* Always true, but be extra sure */
-            ssl->in_window |= (uint64_t) 1 << bit;
+        /* Outside the window: replay_check() rejects it, be extra sure */
+        return;
     }
+
+    /* Mark that number as seen in the window */
+    *ssl_replay_word( ssl->in_window, rec_seqnum ) |=
+        ssl_replay_bit( rec_seqnum );
 }
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
 
-#if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) && defined(MBEDTLS_SSL_SRV_C)
+#if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY) && defined(MBEDTLS_SSL_SRV_C) && \
+    ( defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) ||                      \
+      defined(MBEDTLS_SSL_DTLS_ENDPOINT_C) )
 /*
  * Check if a datagram looks like a ClientHello with a valid cookie,
  * and if it doesn't, generate a HelloVerifyRequest message.
@@ -3163,8 +3267,6 @@ void mbedtls_ssl_dtls_replay_update( mbedtls_ssl_context *ssl )
  *   return MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED
  * - otherwise return a specific error code
  */
-MBEDTLS_CHECK_RETURN_CRITICAL
-MBEDTLS_STATIC_TESTABLE
 int mbedtls_ssl_check_dtls_clihlo_cookie(
                            mbedtls_ssl_context *ssl,
                            const unsigned char *cli_id, size_t cli_id_len,
@@ -3303,7 +3405,10 @@ int mbedtls_ssl_check_dtls_clihlo_cookie(
 
     return( MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED );
 }
+#endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY && MBEDTLS_SSL_SRV_C &&
+          ( MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE || MBEDTLS_SSL_DTLS_ENDPOINT_C ) */
 
+#if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) && defined(MBEDTLS_SSL_SRV_C)
 /*
  * Handle possible client reconnect with the same UDP quadruplet
  * (RFC 6347 Section 4.2.8).
@@ -4144,8 +4249,7 @@ static int ssl_buffer_message( mbedtls_ssl_context *ssl )
                     return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
                 }
 
-                reassembly_buf_sz = ssl_get_reassembly_buffer_size( msg_len,
-                                                       hs_buf->is_fragmented );
+                reassembly_buf_sz = msg_len + 12;
 
                 if( reassembly_buf_sz > ( MBEDTLS_SSL_DTLS_MAX_BUFFERING -
                                           hs->buffering.total_bytes_buffered ) )
@@ -4175,12 +4279,10 @@ static int ssl_buffer_message( mbedtls_ssl_context *ssl )
                     if( ssl_buffer_make_space( ssl, reassembly_buf_sz ) != 0 )
                     {
                         MBEDTLS_SSL_DEBUG_MSG( 2, ( "Reassembly of next message of size %" MBEDTLS_PRINTF_SIZET
-                                                    " (%" MBEDTLS_PRINTF_SIZET " with bitmap) would exceed"
-                                                    " the compile-time limit %" MBEDTLS_PRINTF_SIZET
+                                                    " would exceed the compile-time limit %" MBEDTLS_PRINTF_SIZET
                                                     " (already %" MBEDTLS_PRINTF_SIZET
                                                     " bytes buffered) -- fail\n",
                              msg_len,
-                             reassembly_buf_sz,
                              (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
                              hs->buffering.total_bytes_buffered ) );
                         ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
@@ -4191,7 +4293,7 @@ static int ssl_buffer_message( mbedtls_ssl_context *ssl )
                 MBEDTLS_SSL_DEBUG_MSG( 2, ( "initialize reassembly, total length = %" MBEDTLS_PRINTF_SIZET,
                                             msg_len ) );
 
-                hs_buf->data = mbedtls_calloc( 1, reassembly_buf_sz );
+                hs_buf->data = ssl_buffering_alloc( ssl, reassembly_buf_sz );
                 if( hs_buf->data == NULL )
                 {
                     ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
@@ -4206,8 +4308,7 @@ static int ssl_buffer_message( mbedtls_ssl_context *ssl )
                 memcpy( hs_buf->data + 9, hs_buf->data + 1, 3 );
 
                 hs_buf->is_valid = 1;
-
-                hs->buffering.total_bytes_buffered += reassembly_buf_sz;
+                hs_buf->range_count = 0;
             }
             else
             {
@@ -4237,20 +4338,30 @@ static int ssl_buffer_message( mbedtls_ssl_context *ssl )
                 MBEDTLS_SSL_DEBUG_MSG( 2, ( "adding fragment, offset = %" MBEDTLS_PRINTF_SIZET
                                             ", length = %" MBEDTLS_PRINTF_SIZET,
                                             frag_off, frag_len ) );
-                memcpy( msg + frag_off, ssl->in_msg + 12, frag_len );
 
                 if( hs_buf->is_fragmented )
                 {
-                    unsigned char * const bitmask = msg + msg_len;
-                    ssl_bitmask_set( bitmask, frag_off, frag_len );
-                    hs_buf->is_complete = ( ssl_bitmask_check( bitmask,
-                                                               msg_len ) == 0 );
+                    if( frag_len == 0 )
+                        goto exit;
+
+                    if( ssl_reassembly_add_range( hs_buf, (uint32_t) frag_off,
+                                        (uint32_t)( frag_off + frag_len ) ) != 0 )
+                    {
+                        MBEDTLS_SSL_DEBUG_MSG( 2, ( "too many gaps in message, ignore fragment" ) );
+                        goto exit;
+                    }
+
+                    hs_buf->is_complete = ( hs_buf->range_count == 1 &&
+                                            hs_buf->ranges[0].start == 0 &&
+                                            hs_buf->ranges[0].end == msg_len );
                 }
                 else
                 {
                     hs_buf->is_complete = 1;
                 }
 
+                memcpy( msg + frag_off, ssl->in_msg + 12, frag_len );
+
                 MBEDTLS_SSL_DEBUG_MSG( 2, ( "message %scomplete",
                                    hs_buf->is_complete ? "" : "not yet " ) );
             }
@@ -4377,10 +4488,8 @@ static void ssl_free_buffered_record( mbedtls_ssl_context *ssl )
 
     if( hs->buffering.future_record.data != NULL )
     {
-        hs->buffering.total_bytes_buffered -=
-            hs->buffering.future_record.len;
-
-        mbedtls_free( hs->buffering.future_record.data );
+        ssl_buffering_release( ssl, hs->buffering.future_record.data,
+                               hs->buffering.future_record.len );
         hs->buffering.future_record.data = NULL;
     }
 }
@@ -4486,7 +4595,7 @@ static int ssl_buffer_future_record( mbedtls_ssl_context *ssl,
     hs->buffering.future_record.len   = rec->buf_len;
 
     hs->buffering.future_record.data =
-        mbedtls_calloc( 1, hs->buffering.future_record.len );
+        ssl_buffering_alloc( ssl, hs->buffering.future_record.len );
     if( hs->buffering.future_record.data == NULL )
     {
         /* If we run out of RAM trying to buffer a
@@ -4495,13 +4604,78 @@ static int ssl_buffer_future_record( mbedtls_ssl_context *ssl,
     }
 
     memcpy( hs->buffering.future_record.data, rec->buf, rec->buf_len );
-
-    hs->buffering.total_bytes_buffered += rec->buf_len;
     return( 0 );
 }
 
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+/*
+ * RFC 8446 section 4.2.10: a server that rejects early data skips the
+ * client's 0-RTT records, up to max_early_data_size bytes. Those are the
+ * records that fail to decrypt until one succeeds, or, after a
+ * HelloRetryRequest, the application data records until the second
+ * ClientHello.
+ *
+ * Return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING if the record is skipped, 0 if
+ * it must be handled as usual (\p decrypt_ret tells whether decryption
+ * succeeded), or a fatal error.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_skip_rejected_early_data( mbedtls_ssl_context *ssl,
+                                               const mbedtls_record *rec,
+                                               int decrypt_ret )
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+
+    if( ssl->conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        handshake == NULL ||
+        handshake->early_data_discard == MBEDTLS_SSL_EARLY_DATA_NO_DISCARD )
+    {
+        return( 0 );
+    }
+
+    if( handshake->early_data_discard ==
+        MBEDTLS_SSL_EARLY_DATA_DISCARD_TILL_CLIENT_HELLO )
+    {
+        if( rec->type != MBEDTLS_SSL_MSG_APPLICATION_DATA )
+            return( 0 );
+    }
+    else
+    {
+        /* Only a record that went through decryption tells whether the
+         * client has moved on to the handshake keys. */
+        if( ssl->transform_in == NULL ||
+            rec->type == MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC )
+        {
+            return( 0 );
+        }
+
+        if( decrypt_ret != MBEDTLS_ERR_SSL_INVALID_MAC )
+        {
+            if( decrypt_ret == 0 )
+                handshake->early_data_discard = MBEDTLS_SSL_EARLY_DATA_NO_DISCARD;
+            return( 0 );
+        }
+    }
+
+    if( rec->data_len > ssl->conf->max_early_data_size -
+                        handshake->early_data_len )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "too much rejected early data" ) );
+        MBEDTLS_SSL_PEND_FATAL_ALERT( MBEDTLS_SSL_ALERT_MSG_UNEXPECTED_MESSAGE,
+                                      MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE );
+        return( MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE );
+    }
+    handshake->early_data_len += (uint32_t) rec->data_len;
+
+    MBEDTLS_SSL_DEBUG_MSG( 3, ( "skipping rejected early data record, "
+                                "%" MBEDTLS_PRINTF_SIZET " bytes",
+                                rec->data_len ) );
+    return( MBEDTLS_ERR_SSL_CONTINUE_PROCESSING );
+}
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_get_next_record( mbedtls_ssl_context *ssl )
 {
@@ -4624,7 +4798,28 @@ static int ssl_get_next_record( mbedtls_ssl_context *ssl )
      * Decrypt record contents.
      */
 
-    if( ( ret = ssl_prepare_record_content( ssl, &rec ) ) != 0 )
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    if( ssl->transform_in == NULL )
+    {
+        ret = ssl_tls13_skip_rejected_early_data( ssl, &rec, 0 );
+        if( ret != 0 )
+            return( ret );
+    }
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
+    ret = ssl_prepare_record_content( ssl, &rec );
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    if( ssl->transform_in != NULL &&
+        ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM )
+    {
+        int skip_ret = ssl_tls13_skip_rejected_early_data( ssl, &rec, ret );
+        if( skip_ret != 0 )
+            return( skip_ret );
+    }
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
+    if( ret != 0 )
     {
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
         if( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM )
@@ -4861,6 +5056,11 @@ int mbedtls_ssl_send_alert_message( mbedtls_ssl_context *ssl,
     if( ssl == NULL || ssl->conf == NULL )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+    if( ( ret = mbedtls_ssl_unpark( ssl ) ) != 0 )
+        return( ret );
+#endif
+
     if( ssl->out_left != 0 )
         return( mbedtls_ssl_flush_output( ssl ) );
 
@@ -5457,6 +5657,38 @@ static int ssl_handle_hs_message_post_handshake( mbedtls_ssl_context *ssl )
 /*
  * Receive application data decrypted from the SSL layer
  */
+/*
+ * Copy at most len bytes of the application data record at in_offt to buf,
+ * erasing them from the input buffer.
+ */
+static size_t ssl_read_application_data( mbedtls_ssl_context *ssl,
+                                         unsigned char *buf, size_t len )
+{
+    size_t n = ( len < ssl->in_msglen )
+               ? len : ssl->in_msglen;
+
+    memcpy( buf, ssl->in_offt, n );
+    ssl->in_msglen -= n;
+
+    /* Zeroising the plaintext buffer to erase unused application data
+       from the memory. */
+    mbedtls_platform_zeroize( ssl->in_offt, n );
+
+    if( ssl->in_msglen == 0 )
+    {
+        /* all bytes consumed */
+        ssl->in_offt = NULL;
+        ssl->keep_current_message = 0;
+    }
+    else
+    {
+        /* more data available */
+        ssl->in_offt += n;
+    }
+
+    return( n );
+}
+
 int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
@@ -5467,6 +5699,11 @@ int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len )
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> read" ) );
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+    if( ( ret = mbedtls_ssl_unpark( ssl ) ) != 0 )
+        return( ret );
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM )
     {
@@ -5637,32 +5874,28 @@ int mbedtls_ssl_read( mbedtls_ssl_context *ssl, unsigned char *buf, size_t len )
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
     }
 
-    n = ( len < ssl->in_msglen )
-        ? len : ssl->in_msglen;
+    n = ssl_read_application_data( ssl, buf, len );
 
-    memcpy( buf, ssl->in_offt, n );
-    ssl->in_msglen -= n;
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= read" ) );
 
-    /* Zeroising the plaintext buffer to erase unused application data
-       from the memory. */
-    mbedtls_platform_zeroize( ssl->in_offt, n );
+    return( (int) n );
+}
 
-    if( ssl->in_msglen == 0 )
-    {
-        /* all bytes consumed */
-        ssl->in_offt = NULL;
-        ssl->keep_current_message = 0;
-    }
-    else
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+int mbedtls_ssl_read_early_data( mbedtls_ssl_context *ssl,
+                                 unsigned char *buf, size_t len )
+{
+    if( ssl == NULL || ssl->conf == NULL ||
+        ssl->conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        ssl->state != MBEDTLS_SSL_END_OF_EARLY_DATA ||
+        ssl->in_offt == NULL )
     {
-        /* more data available */
-        ssl->in_offt += n;
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
     }
 
-    MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= read" ) );
-
-    return( (int) n );
+    return( (int) ssl_read_application_data( ssl, buf, len ) );
 }
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
 
 /*
  * Send application data to be encrypted by the SSL layer, taking care of max
@@ -5752,6 +5985,11 @@ int mbedtls_ssl_write( mbedtls_ssl_context *ssl, const unsigned char *buf, size_
     if( ssl == NULL || ssl->conf == NULL )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+    if( ( ret = mbedtls_ssl_unpark( ssl ) ) != 0 )
+        return( ret );
+#endif
+
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
     if( ( ret = ssl_check_ctr_renegotiate( ssl ) ) != 0 )
     {
@@ -5760,6 +5998,13 @@ int mbedtls_ssl_write( mbedtls_ssl_context *ssl, const unsigned char *buf, size_
     }
 #endif
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SRV_C) && \
+    defined(MBEDTLS_SSL_SESSION_TICKETS)
+    /* Send the tickets deferred by MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED
+     * ahead of the first application data. */
+    mbedtls_ssl_tls13_resume_deferred_tickets( ssl );
+#endif
+
     if( mbedtls_ssl_is_handshake_over( ssl ) == 0 )
     {
         if( ( ret = mbedtls_ssl_handshake( ssl ) ) != 0 )
@@ -5846,7 +6091,10 @@ void mbedtls_ssl_set_outbound_transform( mbedtls_ssl_context *ssl,
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 
-void mbedtls_ssl_buffering_free( mbedtls_ssl_context *ssl )
+/*
+ * Drop everything that is buffered, but keep the arena for the next flight.
+ */
+static void ssl_buffering_clear( mbedtls_ssl_context *ssl )
 {
     unsigned offset;
     mbedtls_ssl_handshake_params * const hs = ssl->handshake;
@@ -5860,6 +6108,19 @@ void mbedtls_ssl_buffering_free( mbedtls_ssl_context *ssl )
         ssl_buffering_free_slot( ssl, offset );
 }
 
+void mbedtls_ssl_buffering_free( mbedtls_ssl_context *ssl )
+{
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+
+    if( hs == NULL )
+        return;
+
+    ssl_buffering_clear( ssl );
+
+    mbedtls_free( hs->buffering.arena );
+    hs->buffering.arena = NULL;
+}
+
 static void ssl_buffering_free_slot( mbedtls_ssl_context *ssl,
                                      uint8_t slot )
 {
@@ -5871,9 +6132,7 @@ static void ssl_buffering_free_slot( mbedtls_ssl_context *ssl,
 
     if( hs_buf->is_valid == 1 )
     {
-        hs->buffering.total_bytes_buffered -= hs_buf->data_len;
-        mbedtls_platform_zeroize( hs_buf->data, hs_buf->data_len );
-        mbedtls_free( hs_buf->data );
+        ssl_buffering_release( ssl, hs_buf->data, hs_buf->data_len );
         memset( hs_buf, 0, sizeof( mbedtls_ssl_hs_buffer ) );
     }
 }
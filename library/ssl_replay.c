@@ -0,0 +1,188 @@
+/*
+ *  TLS 1.3 0-RTT anti-replay filter
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+/*
+ * This implements the ClientHello recording of RFC 8446 section 8.2 with a
+ * pair of Bloom filters indexed by the PSK binder. The binder is an HMAC
+ * over the ClientHello, so its bytes are used as the hash values directly.
+ */
+
+#include "common.h"
+
+#if defined(MBEDTLS_SSL_REPLAY_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_replay.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+/* Shortest generation: a replayed ClientHello passes the ticket age check
+ * for at most the tolerance plus one second, and the server clock has a
+ * one second granularity. */
+#define SSL_REPLAY_MIN_WINDOW                                               \
+    ( ( MBEDTLS_SSL_TLS1_3_TICKET_AGE_TOLERANCE + 999 ) / 1000 + 2 )
+
+void mbedtls_ssl_replay_init( mbedtls_ssl_replay_context *ctx )
+{
+    memset( ctx, 0, sizeof( mbedtls_ssl_replay_context ) );
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init( &ctx->mutex );
+#endif
+}
+
+int mbedtls_ssl_replay_setup( mbedtls_ssl_replay_context *ctx,
+                              size_t nbits, uint32_t window )
+{
+    if( nbits == 0 )
+        nbits = MBEDTLS_SSL_REPLAY_DEFAULT_BITS;
+    if( window == 0 )
+        window = SSL_REPLAY_MIN_WINDOW;
+
+    if( nbits < 1024 || nbits > ( (size_t) 1 << 31 ) ||
+        ( nbits & ( nbits - 1 ) ) != 0 ||
+        window < SSL_REPLAY_MIN_WINDOW )
+    {
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    mbedtls_free( ctx->bits );
+    ctx->bits = mbedtls_calloc( 2, nbits / 8 );
+    if( ctx->bits == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    ctx->nbits = nbits;
+    ctx->window = window;
+    ctx->current = 0;
+    ctx->start = mbedtls_time( NULL );
+
+    return( 0 );
+}
+
+/*
+ * Start new generations as time passes: the current generation becomes the
+ * previous one, the previous one is cleared and becomes the current one.
+ */
+static void ssl_replay_rotate( mbedtls_ssl_replay_context *ctx,
+                               mbedtls_time_t now )
+{
+    const size_t len = ctx->nbits / 8;
+
+    if( now < ctx->start )
+    {
+        /* The clock went backwards: keep the current generation, which
+         * then lasts longer. */
+        return;
+    }
+
+    if( now - ctx->start < (mbedtls_time_t) ctx->window )
+        return;
+
+    if( now - ctx->start < 2 * (mbedtls_time_t) ctx->window )
+    {
+        ctx->current ^= 1;
+        memset( ctx->bits + ctx->current * len, 0, len );
+        ctx->start += ctx->window;
+    }
+    else
+    {
+        memset( ctx->bits, 0, 2 * len );
+        ctx->start = now;
+    }
+}
+
+int mbedtls_ssl_replay_check( void *p_replay,
+                              const unsigned char *identity,
+                              size_t identity_len,
+                              const unsigned char *binder,
+                              size_t binder_len )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_replay_context *ctx = (mbedtls_ssl_replay_context *) p_replay;
+    unsigned char *current, *previous;
+    size_t len;
+    int seen_current = 1, seen_previous = 1;
+    uint32_t idx[MBEDTLS_SSL_REPLAY_HASHES];
+    unsigned i;
+
+    ((void) identity);
+    ((void) identity_len);
+
+    if( ctx == NULL || ctx->bits == NULL ||
+        binder_len < 4 * MBEDTLS_SSL_REPLAY_HASHES )
+    {
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    for( i = 0; i < MBEDTLS_SSL_REPLAY_HASHES; i++ )
+    {
+        idx[i] = MBEDTLS_GET_UINT32_BE( binder, 4 * i ) &
+                 (uint32_t)( ctx->nbits - 1 );
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+        return( ret );
+#endif
+
+    ssl_replay_rotate( ctx, mbedtls_time( NULL ) );
+
+    len = ctx->nbits / 8;
+    current = ctx->bits + ctx->current * len;
+    previous = ctx->bits + ( ctx->current ^ 1 ) * len;
+
+    for( i = 0; i < MBEDTLS_SSL_REPLAY_HASHES; i++ )
+    {
+        const unsigned char mask = (unsigned char)( 1u << ( idx[i] & 7 ) );
+
+        if( ( current[idx[i] >> 3] & mask ) == 0 )
+            seen_current = 0;
+        if( ( previous[idx[i] >> 3] & mask ) == 0 )
+            seen_previous = 0;
+
+        current[idx[i] >> 3] |= mask;
+    }
+
+    ret = ( seen_current || seen_previous ) ? MBEDTLS_ERR_SSL_BAD_INPUT_DATA : 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+    return( ret );
+}
+
+void mbedtls_ssl_replay_free( mbedtls_ssl_replay_context *ctx )
+{
+    if( ctx == NULL )
+        return;
+
+    mbedtls_free( ctx->bits );
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free( &ctx->mutex );
+#endif
+
+    mbedtls_platform_zeroize( ctx, sizeof( mbedtls_ssl_replay_context ) );
+}
+
+#endif /* MBEDTLS_SSL_REPLAY_C */
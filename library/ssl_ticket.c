@@ -58,31 +58,82 @@ void mbedtls_ssl_ticket_init( mbedtls_ssl_ticket_context *ctx )
                               TICKET_CRYPT_LEN_BYTES )
 
 /*
- * Generate/update a key
+ * Release a reference to a key, and destroy the key with the last one.
+ * Must be called with ctx->mutex held.
+ */
+static void ssl_ticket_key_put( mbedtls_ssl_ticket_key *key )
+{
+    if( --key->refs != 0 )
+        return;
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    psa_destroy_key( key->key );
+#else
+    mbedtls_cipher_free( &key->ctx );
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free( &key->mutex );
+#endif
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    mbedtls_platform_zeroize( key, sizeof( mbedtls_ssl_ticket_key ) );
+    mbedtls_free( key );
+}
+
+/*
+ * Release a key obtained from ssl_ticket_get_active_key() or
+ * ssl_ticket_get_key_by_name().
+ */
+static void ssl_ticket_release_key( mbedtls_ssl_ticket_context *ctx,
+                                    mbedtls_ssl_ticket_key *key )
+{
+#if defined(MBEDTLS_THREADING_C)
+    /* Nothing sensible can be done if this fails: leaking the key is
+     * better than freeing it while it may still be used. */
+    if( mbedtls_mutex_lock( &ctx->mutex ) != 0 )
+        return;
+#endif
+
+    ssl_ticket_key_put( key );
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock( &ctx->mutex );
+#else
+    ((void) ctx);
+#endif
+}
+
+/*
+ * Create a key object with the given name and key material, with a single
+ * reference that belongs to the caller.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_ticket_gen_key( mbedtls_ssl_ticket_context *ctx,
-                               unsigned char index )
+static int ssl_ticket_key_create( mbedtls_ssl_ticket_context *ctx,
+                                  const unsigned char *name,
+                                  const unsigned char *k,
+                                  mbedtls_ssl_ticket_key **out )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    unsigned char buf[MAX_KEY_BYTES] = {0};
-    mbedtls_ssl_ticket_key *key = ctx->keys + index;
+    mbedtls_ssl_ticket_key *key;
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
 #endif
 
+    key = mbedtls_calloc( 1, sizeof( mbedtls_ssl_ticket_key ) );
+    if( key == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+    key->refs = 1;
+
+    memcpy( key->name, name, TICKET_KEY_NAME_BYTES );
 #if defined(MBEDTLS_HAVE_TIME)
     key->generation_time = mbedtls_time( NULL );
 #endif
 
-    if( ( ret = ctx->f_rng( ctx->p_rng, key->name, sizeof( key->name ) ) ) != 0 )
-        return( ret );
-
-    if( ( ret = ctx->f_rng( ctx->p_rng, buf, sizeof( buf ) ) ) != 0 )
-        return( ret );
-
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
+    key->alg = ctx->alg;
+    key->key_type = ctx->key_type;
+    key->key_bits = ctx->key_bits;
+
     psa_set_key_usage_flags( &attributes,
                              PSA_KEY_USAGE_ENCRYPT | PSA_KEY_USAGE_DECRYPT );
     psa_set_key_algorithm( &attributes, key->alg );
@@ -90,38 +141,179 @@ static int ssl_ticket_gen_key( mbedtls_ssl_ticket_context *ctx,
     psa_set_key_bits( &attributes, key->key_bits );
 
     ret = psa_ssl_status_to_mbedtls(
-            psa_import_key( &attributes, buf,
+            psa_import_key( &attributes, k,
                             PSA_BITS_TO_BYTES( key->key_bits ),
                             &key->key ) );
 #else
-    /* With GCM and CCM, same context can encrypt & decrypt */
-    ret = mbedtls_cipher_setkey( &key->ctx, buf,
-                                 mbedtls_cipher_get_key_bitlen( &key->ctx ),
-                                 MBEDTLS_ENCRYPT );
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init( &key->mutex );
+#endif
+    mbedtls_cipher_init( &key->ctx );
+
+    if( ( ret = mbedtls_cipher_setup( &key->ctx, ctx->cipher_info ) ) == 0 )
+    {
+        /* With GCM and CCM, same context can encrypt & decrypt */
+        ret = mbedtls_cipher_setkey( &key->ctx, k, (int) ctx->key_bits,
+                                     MBEDTLS_ENCRYPT );
+    }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
+    if( ret != 0 )
+    {
+        ssl_ticket_key_put( key );
+        return( ret );
+    }
+
+    *out = key;
+    return( 0 );
+}
+
+/*
+ * Hash a key name into the index. Names are normally random, so their
+ * first bytes are as good a hash as any.
+ */
+static size_t ssl_ticket_name_hash( const unsigned char *name )
+{
+    return( MBEDTLS_GET_UINT32_BE( name, 0 ) %
+            MBEDTLS_SSL_TICKET_KEY_INDEX_SIZE );
+}
+
+/*
+ * Rebuild the name index after the key set has changed.
+ * Must be called with ctx->mutex held.
+ */
+static void ssl_ticket_rebuild_index( mbedtls_ssl_ticket_context *ctx )
+{
+    size_t h;
+    unsigned char i;
+
+    memset( ctx->index, 0, sizeof( ctx->index ) );
+
+    for( i = 0; i < ctx->key_count; i++ )
+    {
+        h = ssl_ticket_name_hash( ctx->keys[i]->name );
+        while( ctx->index[h] != 0 )
+            h = ( h + 1 ) % MBEDTLS_SSL_TICKET_KEY_INDEX_SIZE;
+        ctx->index[h] = i + 1;
+    }
+}
+
+/*
+ * Find a key by name in O(1) expected time.
+ * Must be called with ctx->mutex held.
+ */
+static int ssl_ticket_find_key( const mbedtls_ssl_ticket_context *ctx,
+                                const unsigned char *name )
+{
+    size_t h = ssl_ticket_name_hash( name );
+    unsigned char i;
+
+    /* The table is never more than half full, so this terminates. */
+    while( ( i = ctx->index[h] ) != 0 )
+    {
+        if( memcmp( name, ctx->keys[i - 1]->name, TICKET_KEY_NAME_BYTES ) == 0 )
+            return( i - 1 );
+        h = ( h + 1 ) % MBEDTLS_SSL_TICKET_KEY_INDEX_SIZE;
+    }
+
+    return( -1 );
+}
+
+/*
+ * Remove the key at the given position from the key set.
+ * Must be called with ctx->mutex held.
+ */
+static void ssl_ticket_remove_key( mbedtls_ssl_ticket_context *ctx,
+                                   unsigned char idx )
+{
+    ssl_ticket_key_put( ctx->keys[idx] );
+
+    memmove( ctx->keys + idx, ctx->keys + idx + 1,
+             ( ctx->key_count - idx - 1 ) * sizeof( *ctx->keys ) );
+    ctx->key_count--;
+    ctx->keys[ctx->key_count] = NULL;
+
+    if( ctx->active > idx )
+        ctx->active--;
+}
+
+/*
+ * Add a key to the key set, taking over the caller's reference.
+ * A key with the same name is replaced, and if the set is full the oldest
+ * key other than the active one is evicted.
+ * Must be called with ctx->mutex held.
+ */
+static void ssl_ticket_insert_key( mbedtls_ssl_ticket_context *ctx,
+                                   mbedtls_ssl_ticket_key *key,
+                                   int make_active )
+{
+    int idx = ssl_ticket_find_key( ctx, key->name );
+    int was_active = 0;
+
+    if( idx >= 0 )
+    {
+        was_active = ( idx == ctx->active );
+        ssl_ticket_remove_key( ctx, (unsigned char) idx );
+    }
+    else if( ctx->key_count == MBEDTLS_SSL_TICKET_MAX_KEYS )
+    {
+        ssl_ticket_remove_key( ctx, ctx->active == 0 ? 1 : 0 );
+    }
+
+    ctx->keys[ctx->key_count] = key;
+    if( make_active || was_active || ctx->key_count == 0 )
+        ctx->active = ctx->key_count;
+    ctx->key_count++;
+
+    ssl_ticket_rebuild_index( ctx );
+}
+
+/*
+ * Generate a random key and make it the active one.
+ * Must be called with ctx->mutex held.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_gen_key( mbedtls_ssl_ticket_context *ctx )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char name[TICKET_KEY_NAME_BYTES];
+    unsigned char buf[MAX_KEY_BYTES] = {0};
+    mbedtls_ssl_ticket_key *key;
+
+    do
+    {
+        if( ( ret = ctx->f_rng( ctx->p_rng, name, sizeof( name ) ) ) != 0 )
+            return( ret );
+    }
+    while( ssl_ticket_find_key( ctx, name ) >= 0 );
+
+    if( ( ret = ctx->f_rng( ctx->p_rng, buf, sizeof( buf ) ) ) != 0 )
+        return( ret );
+
+    ret = ssl_ticket_key_create( ctx, name, buf, &key );
     mbedtls_platform_zeroize( buf, sizeof( buf ) );
+    if( ret != 0 )
+        return( ret );
 
-    return( ret );
+    ssl_ticket_insert_key( ctx, key, 1 );
+    return( 0 );
 }
 
 /*
  * Rotate/generate keys if necessary
+ * Must be called with ctx->mutex held.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_ticket_update_keys( mbedtls_ssl_ticket_context *ctx )
 {
-#if !defined(MBEDTLS_HAVE_TIME)
-    ((void) ctx);
-#else
+    if( ctx->key_count == 0 )
+        return( ssl_ticket_gen_key( ctx ) );
+
+#if defined(MBEDTLS_HAVE_TIME)
     if( ctx->ticket_lifetime != 0 )
     {
         mbedtls_time_t current_time = mbedtls_time( NULL );
-        mbedtls_time_t key_time = ctx->keys[ctx->active].generation_time;
-
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-        psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-#endif
+        mbedtls_time_t key_time = ctx->keys[ctx->active]->generation_time;
 
         if( current_time >= key_time &&
             (uint64_t) ( current_time - key_time ) < ctx->ticket_lifetime )
@@ -129,78 +321,161 @@ static int ssl_ticket_update_keys( mbedtls_ssl_ticket_context *ctx )
             return( 0 );
         }
 
-        ctx->active = 1 - ctx->active;
+        return( ssl_ticket_gen_key( ctx ) );
+    }
+#endif /* MBEDTLS_HAVE_TIME */
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-        if( ( status = psa_destroy_key( ctx->keys[ctx->active].key ) ) != PSA_SUCCESS )
-        {
-            return psa_ssl_status_to_mbedtls( status );
-        }
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+    return( 0 );
+}
 
-        return( ssl_ticket_gen_key( ctx, ctx->active ) );
+/*
+ * Take a reference to the active key, rotating keys first if needed.
+ * The mutex is only held for the bookkeeping: the cryptographic work is
+ * done by the caller on its own reference, concurrently with other
+ * threads, and the key set may be rotated meanwhile.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_get_active_key( mbedtls_ssl_ticket_context *ctx,
+                                      mbedtls_ssl_ticket_key **key,
+                                      uint32_t *lifetime )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+        return( ret );
+#endif
+
+    if( ( ret = ssl_ticket_update_keys( ctx ) ) == 0 )
+    {
+        *key = ctx->keys[ctx->active];
+        (*key)->refs++;
+        *lifetime = ctx->ticket_lifetime;
     }
-    else
-#endif /* MBEDTLS_HAVE_TIME */
-        return( 0 );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+    return( ret );
 }
 
 /*
- * Rotate active session ticket encryption key
+ * Take a reference to the key with the given name, if any.
+ * See ssl_ticket_get_active_key().
  */
-int mbedtls_ssl_ticket_rotate( mbedtls_ssl_ticket_context *ctx,
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_get_key_by_name( mbedtls_ssl_ticket_context *ctx,
+                                       const unsigned char *name,
+                                       mbedtls_ssl_ticket_key **key,
+                                       uint32_t *lifetime )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int idx;
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
+        return( ret );
+#endif
+
+    if( ( ret = ssl_ticket_update_keys( ctx ) ) != 0 )
+        goto cleanup;
+
+    if( ( idx = ssl_ticket_find_key( ctx, name ) ) < 0 )
+    {
+        /* We can't know for sure but this is a likely option unless we're
+         * under attack - this is only informative anyway */
+        ret = MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED;
+        goto cleanup;
+    }
+
+    *key = ctx->keys[idx];
+    (*key)->refs++;
+    *lifetime = ctx->ticket_lifetime;
+
+cleanup:
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+    return( ret );
+}
+
+/*
+ * Install an externally provided key
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_install_key( mbedtls_ssl_ticket_context *ctx,
     const unsigned char *name, size_t nlength,
     const unsigned char *k, size_t klength,
-    uint32_t lifetime )
+    int make_active, uint32_t lifetime )
 {
-    const unsigned char idx = 1 - ctx->active;
-    mbedtls_ssl_ticket_key * const key = ctx->keys + idx;
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_ticket_key *key;
+    int idx;
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
-    const size_t bitlen = key->key_bits;
-#else
-    const int bitlen = mbedtls_cipher_get_key_bitlen( &key->ctx );
-#endif
+    if( ctx->f_rng == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
-    if( nlength < TICKET_KEY_NAME_BYTES || klength * 8 < (size_t)bitlen )
+    if( nlength < TICKET_KEY_NAME_BYTES || klength * 8 < ctx->key_bits )
         return( MBEDTLS_ERR_CIPHER_BAD_INPUT_DATA );
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    if( ( status = psa_destroy_key( key->key ) ) != PSA_SUCCESS )
+    if( ( ret = ssl_ticket_key_create( ctx, name, k, &key ) ) != 0 )
+        return( ret );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
+        ssl_ticket_key_put( key );
         return( ret );
     }
+#endif
 
-    psa_set_key_usage_flags( &attributes,
-                             PSA_KEY_USAGE_ENCRYPT | PSA_KEY_USAGE_DECRYPT );
-    psa_set_key_algorithm( &attributes, key->alg );
-    psa_set_key_type( &attributes, key->key_type );
-    psa_set_key_bits( &attributes, key->key_bits );
-
-    if( ( status = psa_import_key( &attributes, k,
-                                   PSA_BITS_TO_BYTES( key->key_bits ),
-                                   &key->key ) ) != PSA_SUCCESS )
+    idx = ssl_ticket_find_key( ctx, name );
+    if( ! make_active && idx >= 0 && idx == ctx->active )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
-        return( ret );
+        ssl_ticket_key_put( key );
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    else
+    {
+        ssl_ticket_insert_key( ctx, key, make_active );
+        if( make_active )
+            ctx->ticket_lifetime = lifetime;
+        ret = 0;
     }
-#else
-    ret = mbedtls_cipher_setkey( &key->ctx, k, bitlen, MBEDTLS_ENCRYPT );
-    if( ret != 0 )
-        return( ret );
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-    ctx->active = idx;
-    ctx->ticket_lifetime = lifetime;
-    memcpy( key->name, name, TICKET_KEY_NAME_BYTES );
-#if defined(MBEDTLS_HAVE_TIME)
-    key->generation_time = mbedtls_time( NULL );
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
 #endif
-    return 0;
+
+    return( ret );
+}
+
+/*
+ * Rotate active session ticket encryption key
+ */
+int mbedtls_ssl_ticket_rotate( mbedtls_ssl_ticket_context *ctx,
+    const unsigned char *name, size_t nlength,
+    const unsigned char *k, size_t klength,
+    uint32_t lifetime )
+{
+    return( ssl_ticket_install_key( ctx, name, nlength, k, klength,
+                                    1, lifetime ) );
+}
+
+/*
+ * Add a session ticket decryption key
+ */
+int mbedtls_ssl_ticket_add_key( mbedtls_ssl_ticket_context *ctx,
+    const unsigned char *name, size_t nlength,
+    const unsigned char *k, size_t klength )
+{
+    return( ssl_ticket_install_key( ctx, name, nlength, k, klength,
+                                    0, 0 ) );
 }
 
 /*
@@ -250,28 +525,26 @@ int mbedtls_ssl_ticket_setup( mbedtls_ssl_ticket_context *ctx,
     ctx->ticket_lifetime = lifetime;
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    ctx->keys[0].alg = alg;
-    ctx->keys[0].key_type = key_type;
-    ctx->keys[0].key_bits = key_bits;
-
-    ctx->keys[1].alg = alg;
-    ctx->keys[1].key_type = key_type;
-    ctx->keys[1].key_bits = key_bits;
+    ctx->alg = alg;
+    ctx->key_type = key_type;
 #else
-    if( ( ret = mbedtls_cipher_setup( &ctx->keys[0].ctx, cipher_info ) ) != 0 )
-        return( ret );
-
-    if( ( ret = mbedtls_cipher_setup( &ctx->keys[1].ctx, cipher_info ) ) != 0 )
-        return( ret );
+    ctx->cipher_info = cipher_info;
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
+    ctx->key_bits = key_bits;
 
-    if( ( ret = ssl_ticket_gen_key( ctx, 0 ) ) != 0 ||
-        ( ret = ssl_ticket_gen_key( ctx, 1 ) ) != 0 )
-    {
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
         return( ret );
-    }
+#endif
 
-    return( 0 );
+    ret = ssl_ticket_gen_key( ctx );
+
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
+        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+#endif
+
+    return( ret );
 }
 
 /*
@@ -286,18 +559,19 @@ int mbedtls_ssl_ticket_setup( mbedtls_ssl_ticket_context *ctx,
  *
  * The key_name, iv, and length of encrypted_state are the additional
  * authenticated data.
+ *
+ * This writes one ticket with the given key and IV.
+ * Without PSA, must be called with key->mutex held.
  */
-
-int mbedtls_ssl_ticket_write( void *p_ticket,
-                              const mbedtls_ssl_session *session,
-                              unsigned char *start,
-                              const unsigned char *end,
-                              size_t *tlen,
-                              uint32_t *ticket_lifetime )
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_seal( mbedtls_ssl_ticket_key *key,
+                            const unsigned char *iv_src,
+                            const mbedtls_ssl_session *session,
+                            unsigned char *start,
+                            const unsigned char *end,
+                            size_t *tlen )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    mbedtls_ssl_ticket_context *ctx = p_ticket;
-    mbedtls_ssl_ticket_key *key;
     unsigned char *key_name = start;
     unsigned char *iv = start + TICKET_KEY_NAME_BYTES;
     unsigned char *state_len_bytes = iv + TICKET_IV_BYTES;
@@ -308,40 +582,24 @@ int mbedtls_ssl_ticket_write( void *p_ticket,
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
 #endif
 
-    *tlen = 0;
-
-    if( ctx == NULL || ctx->f_rng == NULL )
-        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
-
     /* We need at least 4 bytes for key_name, 12 for IV, 2 for len 16 for tag,
      * in addition to session itself, that will be checked when writing it. */
     MBEDTLS_SSL_CHK_BUF_PTR( start, end, TICKET_MIN_LEN );
 
-#if defined(MBEDTLS_THREADING_C)
-    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
-        return( ret );
-#endif
-
-    if( ( ret = ssl_ticket_update_keys( ctx ) ) != 0 )
-        goto cleanup;
-
-    key = &ctx->keys[ctx->active];
-
-    *ticket_lifetime = ctx->ticket_lifetime;
-
     memcpy( key_name, key->name, TICKET_KEY_NAME_BYTES );
-
-    if( ( ret = ctx->f_rng( ctx->p_rng, iv, TICKET_IV_BYTES ) ) != 0 )
-        goto cleanup;
+    memcpy( iv, iv_src, TICKET_IV_BYTES );
 
     /* Dump session state */
     if( ( ret = mbedtls_ssl_session_save( session,
                                           state, end - state,
-                                          &clear_len ) ) != 0 ||
-        (unsigned long) clear_len > 65535 )
+                                          &clear_len ) ) != 0 )
     {
-         goto cleanup;
+        return( ret );
     }
+    if( (unsigned long) clear_len > 65535 )
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+    if( (size_t)( end - state ) < clear_len + TICKET_AUTH_TAG_BYTES )
+        return( MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL );
     MBEDTLS_PUT_UINT16_BE( clear_len, state_len_bytes, 0 );
 
     /* Encrypt and authenticate */
@@ -352,53 +610,148 @@ int mbedtls_ssl_ticket_write( void *p_ticket,
                                      state, end - state,
                                      &ciph_len ) ) != PSA_SUCCESS )
     {
-        ret = psa_ssl_status_to_mbedtls( status );
-        goto cleanup;
+        return( psa_ssl_status_to_mbedtls( status ) );
     }
 #else
-    if( ( ret = mbedtls_cipher_auth_encrypt_ext( &key->ctx,
+    ret = mbedtls_cipher_auth_encrypt_ext( &key->ctx,
                     iv, TICKET_IV_BYTES,
                     /* Additional data: key name, IV and length */
                     key_name, TICKET_ADD_DATA_LEN,
                     state, clear_len,
                     state, end - state, &ciph_len,
-                    TICKET_AUTH_TAG_BYTES ) ) != 0 )
-    {
-        goto cleanup;
-    }
+                    TICKET_AUTH_TAG_BYTES );
+    if( ret != 0 )
+        return( ret );
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
     if( ciph_len != clear_len + TICKET_AUTH_TAG_BYTES )
-    {
-        ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-        goto cleanup;
-    }
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
 
     *tlen = TICKET_MIN_LEN + ciph_len - TICKET_AUTH_TAG_BYTES;
 
-cleanup:
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
+    return( 0 );
+}
+
+/*
+ * Create session ticket (see ssl_ticket_seal for structure)
+ */
+int mbedtls_ssl_ticket_write( void *p_ticket,
+                              const mbedtls_ssl_session *session,
+                              unsigned char *start,
+                              const unsigned char *end,
+                              size_t *tlen,
+                              uint32_t *ticket_lifetime )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_ticket_context *ctx = p_ticket;
+    mbedtls_ssl_ticket_key *key;
+    unsigned char iv[TICKET_IV_BYTES];
+
+    *tlen = 0;
+
+    if( ctx == NULL || ctx->f_rng == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    MBEDTLS_SSL_CHK_BUF_PTR( start, end, TICKET_MIN_LEN );
+
+    if( ( ret = ssl_ticket_get_active_key( ctx, &key,
+                                           ticket_lifetime ) ) != 0 )
+        return( ret );
+
+    if( ( ret = ctx->f_rng( ctx->p_rng, iv, TICKET_IV_BYTES ) ) != 0 )
+        goto cleanup;
+
+#if !defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &key->mutex ) ) != 0 )
+        goto cleanup;
+#endif
+
+    ret = ssl_ticket_seal( key, iv, session, start, end, tlen );
+
+#if !defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &key->mutex ) != 0 && ret == 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
 #endif
 
+cleanup:
+    ssl_ticket_release_key( ctx, key );
+
     return( ret );
 }
 
 /*
- * Select key based on name
+ * Create several session tickets with the same key: the key reference, the
+ * key lock and the random generator are taken once for the whole batch
+ * rather than once per ticket.
  */
-static mbedtls_ssl_ticket_key *ssl_ticket_select_key(
-        mbedtls_ssl_ticket_context *ctx,
-        const unsigned char name[4] )
+int mbedtls_ssl_ticket_write_batch( void *p_ticket,
+                                    const mbedtls_ssl_session *sessions,
+                                    size_t count,
+                                    unsigned char *start,
+                                    const unsigned char *end,
+                                    size_t *tlens,
+                                    uint32_t *ticket_lifetime )
 {
-    unsigned char i;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_ticket_context *ctx = p_ticket;
+    mbedtls_ssl_ticket_key *key;
+    unsigned char *ivs = NULL;
+    unsigned char *p = start;
+    size_t i;
 
-    for( i = 0; i < sizeof( ctx->keys ) / sizeof( *ctx->keys ); i++ )
-        if( memcmp( name, ctx->keys[i].name, 4 ) == 0 )
-            return( &ctx->keys[i] );
+    if( ctx == NULL || ctx->f_rng == NULL || count == 0 )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    MBEDTLS_SSL_CHK_BUF_PTR( start, end, TICKET_MIN_LEN );
+
+    /* At most this many tickets fit in the buffer */
+    if( count > (size_t)( end - start ) / TICKET_MIN_LEN )
+        count = (size_t)( end - start ) / TICKET_MIN_LEN;
+
+    ivs = mbedtls_calloc( count, TICKET_IV_BYTES );
+    if( ivs == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    if( ( ret = ssl_ticket_get_active_key( ctx, &key,
+                                           ticket_lifetime ) ) != 0 )
+    {
+        mbedtls_free( ivs );
+        return( ret );
+    }
 
-    return( NULL );
+    if( ( ret = ctx->f_rng( ctx->p_rng, ivs, count * TICKET_IV_BYTES ) ) != 0 )
+        goto cleanup;
+
+#if !defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &key->mutex ) ) != 0 )
+        goto cleanup;
+#endif
+
+    for( i = 0; i < count; i++ )
+    {
+        ret = ssl_ticket_seal( key, ivs + i * TICKET_IV_BYTES, &sessions[i],
+                               p, end, &tlens[i] );
+        if( ret != 0 )
+            break;
+        p += tlens[i];
+    }
+
+    /* Stop at the first ticket that does not fit */
+    if( ret == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL && i > 0 )
+        ret = 0;
+    if( ret == 0 )
+        ret = (int) i;
+
+#if !defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &key->mutex ) != 0 && ret >= 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif
+
+cleanup:
+    ssl_ticket_release_key( ctx, key );
+    mbedtls_free( ivs );
+
+    return( ret );
 }
 
 /*
@@ -411,12 +764,13 @@ int mbedtls_ssl_ticket_parse( void *p_ticket,
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_ssl_ticket_context *ctx = p_ticket;
-    mbedtls_ssl_ticket_key *key;
+    mbedtls_ssl_ticket_key *key = NULL;
     unsigned char *key_name = buf;
     unsigned char *iv = buf + TICKET_KEY_NAME_BYTES;
     unsigned char *enc_len_p = iv + TICKET_IV_BYTES;
     unsigned char *ticket = enc_len_p + TICKET_CRYPT_LEN_BYTES;
     size_t enc_len, clear_len;
+    uint32_t lifetime;
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
@@ -428,30 +782,15 @@ int mbedtls_ssl_ticket_parse( void *p_ticket,
     if( len < TICKET_MIN_LEN )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
-#if defined(MBEDTLS_THREADING_C)
-    if( ( ret = mbedtls_mutex_lock( &ctx->mutex ) ) != 0 )
-        return( ret );
-#endif
-
-    if( ( ret = ssl_ticket_update_keys( ctx ) ) != 0 )
-        goto cleanup;
-
     enc_len = ( enc_len_p[0] << 8 ) | enc_len_p[1];
 
     if( len != TICKET_MIN_LEN + enc_len )
-    {
-        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-        goto cleanup;
-    }
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
     /* Select key */
-    if( ( key = ssl_ticket_select_key( ctx, key_name ) ) == NULL )
-    {
-        /* We can't know for sure but this is a likely option unless we're
-         * under attack - this is only informative anyway */
-        ret = MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED;
-        goto cleanup;
-    }
+    if( ( ret = ssl_ticket_get_key_by_name( ctx, key_name,
+                                            &key, &lifetime ) ) != 0 )
+        return( ret );
 
     /* Decrypt and authenticate */
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -464,13 +803,22 @@ int mbedtls_ssl_ticket_parse( void *p_ticket,
         goto cleanup;
     }
 #else
-    if( ( ret = mbedtls_cipher_auth_decrypt_ext( &key->ctx,
+#if defined(MBEDTLS_THREADING_C)
+    if( ( ret = mbedtls_mutex_lock( &key->mutex ) ) != 0 )
+        goto cleanup;
+#endif
+    ret = mbedtls_cipher_auth_decrypt_ext( &key->ctx,
                     iv, TICKET_IV_BYTES,
                     /* Additional data: key name, IV and length */
                     key_name, TICKET_ADD_DATA_LEN,
                     ticket, enc_len + TICKET_AUTH_TAG_BYTES,
                     ticket, enc_len, &clear_len,
-                    TICKET_AUTH_TAG_BYTES ) ) != 0 )
+                    TICKET_AUTH_TAG_BYTES );
+#if defined(MBEDTLS_THREADING_C)
+    if( mbedtls_mutex_unlock( &key->mutex ) != 0 && ret == 0 )
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+#endif
+    if( ret != 0 )
     {
         if( ret == MBEDTLS_ERR_CIPHER_AUTH_FAILED )
             ret = MBEDTLS_ERR_SSL_INVALID_MAC;
@@ -485,6 +833,10 @@ int mbedtls_ssl_ticket_parse( void *p_ticket,
         goto cleanup;
     }
 
+    /* The session is decrypted: the key is no longer needed. */
+    ssl_ticket_release_key( ctx, key );
+    key = NULL;
+
     /* Actually load session */
     if( ( ret = mbedtls_ssl_session_load( session, ticket, clear_len ) ) != 0 )
         goto cleanup;
@@ -495,19 +847,19 @@ int mbedtls_ssl_ticket_parse( void *p_ticket,
         mbedtls_time_t current_time = mbedtls_time( NULL );
 
         if( current_time < session->start ||
-            (uint32_t)( current_time - session->start ) > ctx->ticket_lifetime )
+            (uint32_t)( current_time - session->start ) > lifetime )
         {
             ret = MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED;
             goto cleanup;
         }
     }
+#else
+    ((void) lifetime);
 #endif
 
 cleanup:
-#if defined(MBEDTLS_THREADING_C)
-    if( mbedtls_mutex_unlock( &ctx->mutex ) != 0 )
-        return( MBEDTLS_ERR_THREADING_MUTEX_ERROR );
-#endif
+    if( key != NULL )
+        ssl_ticket_release_key( ctx, key );
 
     return( ret );
 }
@@ -517,13 +869,12 @@ cleanup:
  */
 void mbedtls_ssl_ticket_free( mbedtls_ssl_ticket_context *ctx )
 {
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_destroy_key( ctx->keys[0].key );
-    psa_destroy_key( ctx->keys[1].key );
-#else
-    mbedtls_cipher_free( &ctx->keys[0].ctx );
-    mbedtls_cipher_free( &ctx->keys[1].ctx );
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+    unsigned char i;
+
+    /* No ticket may be in flight any more, so these are the last
+     * references. */
+    for( i = 0; i < ctx->key_count; i++ )
+        ssl_ticket_key_put( ctx->keys[i] );
 
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_mutex_free( &ctx->mutex );
@@ -40,6 +40,7 @@
 #include "mbedtls/version.h"
 #include "mbedtls/constant_time.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -242,10 +243,17 @@ int mbedtls_ssl_session_copy( mbedtls_ssl_session *dst,
     dst->hostname = NULL;
 #endif
 #endif /* MBEDTLS_SSL_SESSION_TICKETS && MBEDTLS_SSL_CLI_C */
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN) && \
+    defined(MBEDTLS_SSL_SRV_C)
+    dst->ticket_alpn = NULL;
+#endif
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    dst->peer_cert_der = NULL;
+#endif
     if( src->peer_cert != NULL )
     {
         int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
@@ -264,6 +272,17 @@ int mbedtls_ssl_session_copy( mbedtls_ssl_session *dst,
             return( ret );
         }
     }
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    if( src->peer_cert_der != NULL )
+    {
+        dst->peer_cert_der = mbedtls_calloc( 1, src->peer_cert_der_len );
+        if( dst->peer_cert_der == NULL )
+            return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+        memcpy( dst->peer_cert_der, src->peer_cert_der,
+                src->peer_cert_der_len );
+    }
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
 #else /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
     if( src->peer_cert_digest != NULL )
     {
@@ -304,14 +323,53 @@ int mbedtls_ssl_session_copy( mbedtls_ssl_session *dst,
           MBEDTLS_SSL_SERVER_NAME_INDICATION */
 #endif /* MBEDTLS_SSL_SESSION_TICKETS && MBEDTLS_SSL_CLI_C */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN) && \
+    defined(MBEDTLS_SSL_SRV_C)
+    if( src->ticket_alpn != NULL )
+    {
+        int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+        ret = mbedtls_ssl_session_set_ticket_alpn( dst, src->ticket_alpn );
+        if( ret != 0 )
+            return( ret );
+    }
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_ALPN && MBEDTLS_SSL_SRV_C */
+
     return( 0 );
 }
 
+/*
+ * Record buffers come from the buffer pool of the configuration if it has
+ * one, and from the heap otherwise.
+ */
+static unsigned char *ssl_buffer_alloc( const mbedtls_ssl_config *conf,
+                                        size_t len )
+{
+    if( conf->f_buf_get != NULL )
+        return( conf->f_buf_get( conf->p_buf_pool, len ) );
+
+    return( mbedtls_calloc( 1, len ) );
+}
+
+static void ssl_buffer_free( const mbedtls_ssl_config *conf,
+                             unsigned char *buf, size_t len )
+{
+    if( buf == NULL )
+        return;
+
+    mbedtls_platform_zeroize( buf, len );
+
+    if( conf->f_buf_put != NULL )
+        conf->f_buf_put( conf->p_buf_pool, buf, len );
+    else
+        mbedtls_free( buf );
+}
+
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int resize_buffer( unsigned char **buffer, size_t len_new, size_t *len_old )
+static int resize_buffer( const mbedtls_ssl_config *conf,
+                          unsigned char **buffer, size_t len_new, size_t *len_old )
 {
-    unsigned char* resized_buffer = mbedtls_calloc( 1, len_new );
+    unsigned char* resized_buffer = ssl_buffer_alloc( conf, len_new );
     if( resized_buffer == NULL )
         return -1;
 
@@ -321,8 +379,7 @@ static int resize_buffer( unsigned char **buffer, size_t len_new, size_t *len_ol
      * lost, are done outside of this function. */
     memcpy( resized_buffer, *buffer,
             ( len_new < *len_old ) ? len_new : *len_old );
-    mbedtls_platform_zeroize( *buffer, *len_old );
-    mbedtls_free( *buffer );
+    ssl_buffer_free( conf, *buffer, *len_old );
 
     *buffer = resized_buffer;
     *len_old = len_new;
@@ -346,7 +403,8 @@ static void handle_buffer_resizing( mbedtls_ssl_context *ssl, int downsizing,
             ssl->in_buf_len > in_buf_new_len && ssl->in_left < in_buf_new_len :
             ssl->in_buf_len < in_buf_new_len )
         {
-            if( resize_buffer( &ssl->in_buf, in_buf_new_len, &ssl->in_buf_len ) != 0 )
+            if( resize_buffer( ssl->conf, &ssl->in_buf, in_buf_new_len,
+                               &ssl->in_buf_len ) != 0 )
             {
                 MBEDTLS_SSL_DEBUG_MSG( 1, ( "input buffer resizing failed - out of memory" ) );
             }
@@ -368,7 +426,8 @@ static void handle_buffer_resizing( mbedtls_ssl_context *ssl, int downsizing,
             ssl->out_buf_len > out_buf_new_len && ssl->out_left < out_buf_new_len :
             ssl->out_buf_len < out_buf_new_len )
         {
-            if( resize_buffer( &ssl->out_buf, out_buf_new_len, &ssl->out_buf_len ) != 0 )
+            if( resize_buffer( ssl->conf, &ssl->out_buf, out_buf_new_len,
+                               &ssl->out_buf_len ) != 0 )
             {
                 MBEDTLS_SSL_DEBUG_MSG( 1, ( "output buffer resizing failed - out of memory" ) );
             }
@@ -508,6 +567,12 @@ static void ssl_clear_peer_cert( mbedtls_ssl_session *session )
         mbedtls_free( session->peer_cert );
         session->peer_cert = NULL;
     }
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    /* Zeroization is not necessary. */
+    mbedtls_free( session->peer_cert_der );
+    session->peer_cert_der = NULL;
+    session->peer_cert_der_len = 0;
+#endif
 #else /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
     if( session->peer_cert_digest != NULL )
     {
@@ -519,6 +584,38 @@ static void ssl_clear_peer_cert( mbedtls_ssl_session *session )
     }
 #endif /* !MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
 }
+
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+int mbedtls_ssl_session_parse_peer_cert( mbedtls_ssl_session *session )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crt *crt;
+
+    if( session->peer_cert != NULL || session->peer_cert_der == NULL )
+        return( 0 );
+
+    crt = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) );
+    if( crt == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    mbedtls_x509_crt_init( crt );
+
+    if( ( ret = mbedtls_x509_crt_parse_der( crt, session->peer_cert_der,
+                                            session->peer_cert_der_len ) ) != 0 )
+    {
+        mbedtls_x509_crt_free( crt );
+        mbedtls_free( crt );
+        return( ret );
+    }
+
+    mbedtls_free( session->peer_cert_der );
+    session->peer_cert_der = NULL;
+    session->peer_cert_der_len = 0;
+    session->peer_cert = crt;
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 void mbedtls_ssl_optimize_checksum( mbedtls_ssl_context *ssl,
@@ -1067,7 +1164,7 @@ int mbedtls_ssl_setup( mbedtls_ssl_context *ssl,
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     ssl->in_buf_len = in_buf_len;
 #endif
-    ssl->in_buf = mbedtls_calloc( 1, in_buf_len );
+    ssl->in_buf = ssl_buffer_alloc( conf, in_buf_len );
     if( ssl->in_buf == NULL )
     {
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed", in_buf_len ) );
@@ -1078,7 +1175,7 @@ int mbedtls_ssl_setup( mbedtls_ssl_context *ssl,
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     ssl->out_buf_len = out_buf_len;
 #endif
-    ssl->out_buf = mbedtls_calloc( 1, out_buf_len );
+    ssl->out_buf = ssl_buffer_alloc( conf, out_buf_len );
     if( ssl->out_buf == NULL )
     {
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed", out_buf_len ) );
@@ -1098,8 +1195,8 @@ int mbedtls_ssl_setup( mbedtls_ssl_context *ssl,
     return( 0 );
 
 error:
-    mbedtls_free( ssl->in_buf );
-    mbedtls_free( ssl->out_buf );
+    ssl_buffer_free( conf, ssl->in_buf, in_buf_len );
+    ssl_buffer_free( conf, ssl->out_buf, out_buf_len );
 
     ssl->conf = NULL;
 
@@ -1219,6 +1316,11 @@ int mbedtls_ssl_session_reset_int( mbedtls_ssl_context *ssl, int partial )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+    if( ( ret = mbedtls_ssl_unpark( ssl ) ) != 0 )
+        return( ret );
+#endif
+
     ssl->state = MBEDTLS_SSL_HELLO_REQUEST;
 
     mbedtls_ssl_session_reset_msg_layer( ssl, partial );
@@ -1247,6 +1349,10 @@ int mbedtls_ssl_session_reset_int( mbedtls_ssl_context *ssl, int partial )
     ssl->alpn_chosen = NULL;
 #endif
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    ssl->early_data_status = MBEDTLS_SSL_EARLY_DATA_STATUS_NOT_SENT;
+#endif
+
 #if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY) && defined(MBEDTLS_SSL_SRV_C)
     int free_cli_id = 1;
 #if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE)
@@ -1275,6 +1381,153 @@ int mbedtls_ssl_session_reset( mbedtls_ssl_context *ssl )
     return( mbedtls_ssl_session_reset_int( ssl, 0 ) );
 }
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+/*
+ * Release the record buffers of an idle connection
+ */
+int mbedtls_ssl_park( mbedtls_ssl_context *ssl )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    size_t in_buf_len;
+    size_t out_buf_len;
+#else
+    size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
+    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+#endif
+
+    if( ssl == NULL || ssl->conf == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    if( ssl->parked != 0 )
+        return( 0 );
+
+    /* The DTLS handshake structure outlives the handshake until the peer
+     * has seen our last flight, and a renegotiation needs the buffers. */
+    if( mbedtls_ssl_is_handshake_over( ssl ) == 0 || ssl->handshake != NULL )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "Handshake isn't completed" ) );
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    /* A partial record, an unread application data record or the rest of a
+     * datagram are kept in the input buffer. */
+    if( mbedtls_ssl_check_pending( ssl ) != 0 ||
+        ( ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+          ssl->in_left != 0 ) )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "There is pending incoming data" ) );
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    if( ( ret = mbedtls_ssl_flush_output( ssl ) ) != 0 )
+        return( ret );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> park" ) );
+
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    in_buf_len = ssl->in_buf_len;
+    out_buf_len = ssl->out_buf_len;
+#endif
+
+    /* With TLS, the incoming record counter is only kept in the 8 bytes
+     * in front of the record header. Move it into the context so that it
+     * survives the buffer, and so that in_ctr stays valid meanwhile. */
+    memcpy( ssl->parked_in_ctr, ssl->in_ctr, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN );
+
+    ssl_buffer_free( ssl->conf, ssl->in_buf, in_buf_len );
+    ssl_buffer_free( ssl->conf, ssl->out_buf, out_buf_len );
+
+    ssl->in_buf = NULL;
+    ssl->in_ctr = ssl->parked_in_ctr;
+    ssl->in_hdr = NULL;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    ssl->in_cid = NULL;
+#endif
+    ssl->in_len = NULL;
+    ssl->in_iv = NULL;
+    ssl->in_msg = NULL;
+    ssl->in_left = 0;
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    ssl->next_record_offset = 0;
+#endif
+
+    ssl->out_buf = NULL;
+    ssl->out_ctr = NULL;
+    ssl->out_hdr = NULL;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    ssl->out_cid = NULL;
+#endif
+    ssl->out_len = NULL;
+    ssl->out_iv = NULL;
+    ssl->out_msg = NULL;
+
+    ssl->parked = 1;
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= park" ) );
+
+    return( 0 );
+}
+
+/*
+ * Allocate the record buffers of a parked connection again
+ */
+int mbedtls_ssl_unpark( mbedtls_ssl_context *ssl )
+{
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    size_t in_buf_len;
+    size_t out_buf_len;
+#else
+    size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
+    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+#endif
+    unsigned char *in_buf, *out_buf;
+
+    if( ssl == NULL || ssl->conf == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    if( ssl->parked == 0 )
+        return( 0 );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> unpark" ) );
+
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    in_buf_len = ssl->in_buf_len;
+    out_buf_len = ssl->out_buf_len;
+#endif
+
+    in_buf = ssl_buffer_alloc( ssl->conf, in_buf_len );
+    out_buf = ssl_buffer_alloc( ssl->conf, out_buf_len );
+    if( in_buf == NULL || out_buf == NULL )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed",
+                                    in_buf_len + out_buf_len ) );
+        ssl_buffer_free( ssl->conf, in_buf, in_buf_len );
+        ssl_buffer_free( ssl->conf, out_buf, out_buf_len );
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+    }
+
+    ssl->in_buf = in_buf;
+    ssl->out_buf = out_buf;
+
+    /* Same as after mbedtls_ssl_context_load(): the incoming pointers are
+     * set up again for each record, the outgoing ones follow the current
+     * transform. */
+    mbedtls_ssl_reset_in_out_pointers( ssl );
+    mbedtls_ssl_update_out_pointers( ssl, ssl->transform_out );
+
+    memcpy( ssl->in_ctr, ssl->parked_in_ctr, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN );
+    mbedtls_platform_zeroize( ssl->parked_in_ctr,
+                              sizeof( ssl->parked_in_ctr ) );
+
+    ssl->parked = 0;
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= unpark" ) );
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_CONTEXT_PARKING */
+
 /*
  * SSL set accessors
  */
@@ -1293,6 +1546,16 @@ void mbedtls_ssl_conf_dtls_anti_replay( mbedtls_ssl_config *conf, char mode )
 {
     conf->anti_replay = mode;
 }
+
+int mbedtls_ssl_conf_dtls_anti_replay_window( mbedtls_ssl_config *conf,
+                                              size_t window )
+{
+    if( window == 0 || window > MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    conf->anti_replay_window = (uint16_t) window;
+    return( 0 );
+}
 #endif
 
 void mbedtls_ssl_conf_dtls_badmac_limit( mbedtls_ssl_config *conf, unsigned limit )
@@ -1439,12 +1702,101 @@ int mbedtls_ssl_set_session( mbedtls_ssl_context *ssl, const mbedtls_ssl_session
 }
 #endif /* MBEDTLS_SSL_CLI_C */
 
+static void ssl_conf_free_ciphersuite_index( mbedtls_ssl_config *conf )
+{
+    mbedtls_free( conf->ciphersuite_index );
+    conf->ciphersuite_index = NULL;
+    conf->ciphersuite_index_len = 0;
+}
+
 void mbedtls_ssl_conf_ciphersuites( mbedtls_ssl_config *conf,
                                     const int *ciphersuites )
 {
+    ssl_conf_free_ciphersuite_index( conf );
     conf->ciphersuite_list = ciphersuites;
 }
 
+/*
+ * Sort ciphersuite table entries by identifier, then by preference.
+ */
+static int ssl_ciphersuite_index_cmp( const void *a, const void *b )
+{
+    const mbedtls_ssl_ciphersuite_index_entry *ea = a;
+    const mbedtls_ssl_ciphersuite_index_entry *eb = b;
+
+    if( ea->id != eb->id )
+        return( ea->id < eb->id ? -1 : 1 );
+
+    return( ea->rank < eb->rank ? -1 : ea->rank > eb->rank );
+}
+
+int mbedtls_ssl_conf_precompute( mbedtls_ssl_config *conf )
+{
+    mbedtls_ssl_ciphersuite_index_entry *index;
+    const mbedtls_ssl_ciphersuite_t *info;
+    size_t list_len, i, n;
+
+    ssl_conf_free_ciphersuite_index( conf );
+
+    for( list_len = 0; conf->ciphersuite_list[list_len] != 0; list_len++ )
+    {
+        if( list_len == MBEDTLS_SSL_CIPHERSUITE_INDEX_MAX )
+            return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    index = mbedtls_calloc( list_len + 1, sizeof( *index ) );
+    if( index == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    for( i = 0, n = 0; i < list_len; i++ )
+    {
+        info = mbedtls_ssl_ciphersuite_from_id( conf->ciphersuite_list[i] );
+        if( info == NULL )
+            continue;
+
+        index[n].id = (uint16_t) info->id;
+        index[n].rank = (uint16_t) i;
+        index[n].info = info;
+        n++;
+    }
+
+    qsort( index, n, sizeof( *index ), ssl_ciphersuite_index_cmp );
+
+    /* Keep only the first occurrence of repeated identifiers */
+    for( i = 0, list_len = n, n = 0; i < list_len; i++ )
+    {
+        if( n == 0 || index[i].id != index[n - 1].id )
+            index[n++] = index[i];
+    }
+
+    conf->ciphersuite_index = index;
+    conf->ciphersuite_index_len = n;
+
+    return( 0 );
+}
+
+const mbedtls_ssl_ciphersuite_index_entry *mbedtls_ssl_conf_find_ciphersuite(
+                                        const mbedtls_ssl_config *conf,
+                                        int suite_id )
+{
+    size_t lo = 0, hi = conf->ciphersuite_index_len;
+
+    while( lo < hi )
+    {
+        size_t mid = lo + ( hi - lo ) / 2;
+
+        if( conf->ciphersuite_index[mid].id == suite_id )
+            return( &conf->ciphersuite_index[mid] );
+
+        if( conf->ciphersuite_index[mid].id < suite_id )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return( NULL );
+}
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
 void mbedtls_ssl_conf_tls13_key_exchange_modes( mbedtls_ssl_config *conf,
                                                 const int kex_modes )
@@ -1458,6 +1810,22 @@ void mbedtls_ssl_tls13_conf_early_data( mbedtls_ssl_config *conf,
 {
     conf->early_data_enabled = early_data_enabled;
 }
+
+#if defined(MBEDTLS_SSL_SRV_C)
+void mbedtls_ssl_tls13_conf_max_early_data_size( mbedtls_ssl_config *conf,
+                                                 uint32_t max_early_data_size )
+{
+    conf->max_early_data_size = max_early_data_size;
+}
+
+void mbedtls_ssl_tls13_conf_early_data_replay( mbedtls_ssl_config *conf,
+                                               mbedtls_ssl_early_data_replay_t *f_replay,
+                                               void *p_replay )
+{
+    conf->f_early_data_replay = f_replay;
+    conf->p_early_data_replay = p_replay;
+}
+#endif /* MBEDTLS_SSL_SRV_C */
 #endif /* MBEDTLS_SSL_EARLY_DATA */
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
@@ -2003,6 +2371,8 @@ mbedtls_ssl_mode_t mbedtls_ssl_get_mode_from_ciphersuite(
  *            case client: ClientOnlyData;
  *            case server: uint64 start_time;
  *        };
+ *       uint32 max_early_data_size;      // if MBEDTLS_SSL_EARLY_DATA
+ *       opaque ticket_alpn<0..255>;      // if MBEDTLS_SSL_EARLY_DATA
  *     } serialized_session_tls13;
  *
  */
@@ -2018,6 +2388,13 @@ static int ssl_tls13_session_save( const mbedtls_ssl_session *session,
     defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
     size_t hostname_len = ( session->hostname == NULL ) ?
                             0 : strlen( session->hostname ) + 1;
+#endif
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN) && \
+    defined(MBEDTLS_SSL_SRV_C)
+    size_t ticket_alpn_len = ( session->ticket_alpn == NULL ) ?
+                               0 : strlen( session->ticket_alpn );
+#elif defined(MBEDTLS_SSL_EARLY_DATA)
+    size_t ticket_alpn_len = 0;
 #endif
     size_t needed =   1                             /* endpoint */
                     + 2                             /* ciphersuite */
@@ -2053,6 +2430,15 @@ static int ssl_tls13_session_save( const mbedtls_ssl_session *session,
     }
 #endif /* MBEDTLS_SSL_CLI_C */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    if( ticket_alpn_len > 255 )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    needed +=   4                           /* max_early_data_size */
+              + 1                           /* ticket_alpn length */
+              + ticket_alpn_len;            /* ticket_alpn */
+#endif
+
     *olen = needed;
     if( needed > buf_len )
         return( MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL );
@@ -2107,6 +2493,19 @@ static int ssl_tls13_session_save( const mbedtls_ssl_session *session,
         }
     }
 #endif /* MBEDTLS_SSL_CLI_C */
+
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    MBEDTLS_PUT_UINT32_BE( session->max_early_data_size, p, 0 );
+    p[4] = (unsigned char) ticket_alpn_len;
+    p += 5;
+#if defined(MBEDTLS_SSL_ALPN) && defined(MBEDTLS_SSL_SRV_C)
+    if( ticket_alpn_len > 0 )
+    {
+        memcpy( p, session->ticket_alpn, ticket_alpn_len );
+        p += ticket_alpn_len;
+    }
+#endif
+#endif /* MBEDTLS_SSL_EARLY_DATA */
     return( 0 );
 }
 
@@ -2201,6 +2600,31 @@ static int ssl_tls13_session_load( mbedtls_ssl_session *session,
     }
 #endif /* MBEDTLS_SSL_CLI_C */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    {
+        size_t ticket_alpn_len;
+
+        if( end - p < 5 )
+            return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+        session->max_early_data_size = MBEDTLS_GET_UINT32_BE( p, 0 );
+        ticket_alpn_len = p[4];
+        p += 5;
+
+        if( end - p < ( long int )ticket_alpn_len )
+            return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+#if defined(MBEDTLS_SSL_ALPN) && defined(MBEDTLS_SSL_SRV_C)
+        if( ticket_alpn_len > 0 )
+        {
+            session->ticket_alpn = mbedtls_calloc( 1, ticket_alpn_len + 1 );
+            if( session->ticket_alpn == NULL )
+                return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+            memcpy( session->ticket_alpn, p, ticket_alpn_len );
+        }
+#endif
+        p += ticket_alpn_len;
+    }
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
     return( 0 );
 
 }
@@ -2483,6 +2907,59 @@ void mbedtls_ssl_conf_groups( mbedtls_ssl_config *conf,
     conf->group_list = group_list;
 }
 
+void mbedtls_ssl_conf_buffer_pool( mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_buffer_get_t *f_get,
+                                   mbedtls_ssl_buffer_put_t *f_put,
+                                   void *p_pool )
+{
+    conf->f_buf_get = f_get;
+    conf->f_buf_put = f_put;
+    conf->p_buf_pool = p_pool;
+}
+
+#if ( defined(MBEDTLS_USE_PSA_CRYPTO) || defined(MBEDTLS_SSL_PROTO_TLS1_3) ) && \
+    defined(MBEDTLS_ECDH_C)
+void mbedtls_ssl_conf_key_share_pool( mbedtls_ssl_config *conf,
+                                      mbedtls_ssl_key_share_pop_t *f_pop,
+                                      void *p_pool )
+{
+    conf->f_key_share_pop = f_pop;
+    conf->p_key_share = p_pool;
+}
+
+/*
+ * Take the ephemeral key pair of the handshake from the key share pool.
+ * handshake->ecdh_psa_type and ecdh_bits must be set.
+ */
+int mbedtls_ssl_pop_key_share( mbedtls_ssl_context *ssl,
+                               uint16_t named_group,
+                               unsigned char *buf,
+                               size_t buf_len,
+                               size_t *olen )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_svc_key_id_t key = MBEDTLS_SVC_KEY_ID_INIT;
+
+    if( ssl->conf->f_key_share_pop == NULL )
+        return( MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE );
+
+    ret = ssl->conf->f_key_share_pop( ssl->conf->p_key_share, named_group,
+                                      &key, buf, buf_len, olen );
+    if( ret != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 3, "f_key_share_pop", ret );
+        return( ret );
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG( 3, ( "using pre-generated key share, group %04x",
+                                (unsigned) named_group ) );
+    ssl->handshake->ecdh_psa_privkey = key;
+    ssl->handshake->ecdh_psa_privkey_is_external = 0;
+
+    return( 0 );
+}
+#endif /* ( MBEDTLS_USE_PSA_CRYPTO || MBEDTLS_SSL_PROTO_TLS1_3 ) && MBEDTLS_ECDH_C */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 int mbedtls_ssl_set_hostname( mbedtls_ssl_context *ssl, const char *hostname )
 {
@@ -2574,6 +3051,13 @@ const char *mbedtls_ssl_get_alpn_protocol( const mbedtls_ssl_context *ssl )
 }
 #endif /* MBEDTLS_SSL_ALPN */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+int mbedtls_ssl_get_early_data_status( const mbedtls_ssl_context *ssl )
+{
+    return( ssl->early_data_status );
+}
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
 #if defined(MBEDTLS_SSL_DTLS_SRTP)
 void mbedtls_ssl_conf_srtp_mki_value_supported( mbedtls_ssl_config *conf,
                                                 int support_mki_value )
@@ -2742,6 +3226,12 @@ void mbedtls_ssl_conf_new_session_tickets( mbedtls_ssl_config *conf,
 {
     conf->new_session_tickets_count = num_tickets;
 }
+
+void mbedtls_ssl_conf_new_session_tickets_mode( mbedtls_ssl_config *conf,
+                                                int mode )
+{
+    conf->new_session_tickets_mode = mode;
+}
 #endif
 
 void mbedtls_ssl_conf_session_tickets_cb( mbedtls_ssl_config *conf,
@@ -2753,6 +3243,12 @@ void mbedtls_ssl_conf_session_tickets_cb( mbedtls_ssl_config *conf,
     conf->f_ticket_parse = f_ticket_parse;
     conf->p_ticket       = p_ticket;
 }
+
+void mbedtls_ssl_conf_session_tickets_batch_cb( mbedtls_ssl_config *conf,
+        mbedtls_ssl_ticket_write_batch_t *f_ticket_write_batch )
+{
+    conf->f_ticket_write_batch = f_ticket_write_batch;
+}
 #endif
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
 
@@ -2799,6 +3295,17 @@ void mbedtls_ssl_set_async_operation_data( mbedtls_ssl_context *ssl,
     if( ssl->handshake != NULL )
         ssl->handshake->user_async_ctx = ctx;
 }
+
+uint16_t mbedtls_ssl_get_async_sig_alg( const mbedtls_ssl_context *ssl )
+{
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if( ssl->handshake != NULL )
+        return( ssl->handshake->async_sig_alg );
+#else
+    ((void) ssl);
+#endif
+    return( MBEDTLS_TLS1_3_SIG_NONE );
+}
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
 /*
@@ -3015,6 +3522,16 @@ const mbedtls_x509_crt *mbedtls_ssl_get_peer_cert( const mbedtls_ssl_context *ss
     return( NULL );
 #endif /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
 }
+
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+int mbedtls_ssl_load_peer_cert( mbedtls_ssl_context *ssl )
+{
+    if( ssl == NULL || ssl->session == NULL )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    return( mbedtls_ssl_session_parse_peer_cert( ssl->session ) );
+}
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_CLI_C)
@@ -3101,12 +3618,19 @@ int mbedtls_ssl_get_session( const mbedtls_ssl_context *ssl,
 #define SSL_SERIALIZED_SESSION_CONFIG_TICKET 0
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_EARLY_DATA)
+#define SSL_SERIALIZED_SESSION_CONFIG_EARLY_DATA 1
+#else
+#define SSL_SERIALIZED_SESSION_CONFIG_EARLY_DATA 0
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_EARLY_DATA */
+
 #define SSL_SERIALIZED_SESSION_CONFIG_TIME_BIT          0
 #define SSL_SERIALIZED_SESSION_CONFIG_CRT_BIT           1
 #define SSL_SERIALIZED_SESSION_CONFIG_CLIENT_TICKET_BIT 2
 #define SSL_SERIALIZED_SESSION_CONFIG_MFL_BIT           3
 #define SSL_SERIALIZED_SESSION_CONFIG_ETM_BIT           4
 #define SSL_SERIALIZED_SESSION_CONFIG_TICKET_BIT        5
+#define SSL_SERIALIZED_SESSION_CONFIG_EARLY_DATA_BIT    6
 
 #define SSL_SERIALIZED_SESSION_CONFIG_BITFLAG                           \
     ( (uint16_t) (                                                      \
@@ -3115,7 +3639,8 @@ int mbedtls_ssl_get_session( const mbedtls_ssl_context *ssl,
         ( SSL_SERIALIZED_SESSION_CONFIG_CLIENT_TICKET << SSL_SERIALIZED_SESSION_CONFIG_CLIENT_TICKET_BIT ) | \
         ( SSL_SERIALIZED_SESSION_CONFIG_MFL           << SSL_SERIALIZED_SESSION_CONFIG_MFL_BIT           ) | \
         ( SSL_SERIALIZED_SESSION_CONFIG_ETM           << SSL_SERIALIZED_SESSION_CONFIG_ETM_BIT           ) | \
-        ( SSL_SERIALIZED_SESSION_CONFIG_TICKET        << SSL_SERIALIZED_SESSION_CONFIG_TICKET_BIT        ) ) )
+        ( SSL_SERIALIZED_SESSION_CONFIG_TICKET        << SSL_SERIALIZED_SESSION_CONFIG_TICKET_BIT        ) | \
+        ( SSL_SERIALIZED_SESSION_CONFIG_EARLY_DATA    << SSL_SERIALIZED_SESSION_CONFIG_EARLY_DATA_BIT    ) ) )
 
 static unsigned char ssl_serialized_session_header[] = {
     MBEDTLS_VERSION_MAJOR,
@@ -3559,6 +4084,11 @@ int mbedtls_ssl_renegotiate( mbedtls_ssl_context *ssl )
     if( ssl == NULL || ssl->conf == NULL )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
+#if defined(MBEDTLS_SSL_CONTEXT_PARKING)
+    if( mbedtls_ssl_unpark( ssl ) != 0 )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+#endif
+
 #if defined(MBEDTLS_SSL_SRV_C)
     /* On server, just send the request */
     if( ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER )
@@ -3635,6 +4165,12 @@ void mbedtls_ssl_handshake_free( mbedtls_ssl_context *ssl )
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 #endif /* MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SRV_C) && \
+    defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_free( handshake->new_session_tickets );
+    handshake->new_session_tickets = NULL;
+#endif
+
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
     if( ssl->conf->f_async_cancel != NULL && handshake->async_in_progress != 0 )
     {
@@ -3780,6 +4316,11 @@ void mbedtls_ssl_session_free( mbedtls_ssl_session *session )
     mbedtls_free( session->ticket );
 #endif
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN) && \
+    defined(MBEDTLS_SSL_SRV_C)
+    mbedtls_free( session->ticket_alpn );
+#endif
+
     mbedtls_platform_zeroize( session, sizeof( mbedtls_ssl_session ) );
 }
 
@@ -3853,6 +4394,7 @@ static unsigned char ssl_serialized_context_header[] = {
  *  uint32 badmac_seen;         // DTLS: number of records with failing MAC
  *  uint64 in_window_top;       // DTLS: last validated record seq_num
  *  uint64 in_window;           // DTLS: bitmask for replay protection
+ *                              // (64 most recent records only)
  *  uint8 disable_datagram_packing; // DTLS: only one record per datagram
  *  uint64 cur_out_ctr;         // Record layer: outgoing sequence number
  *  uint16 mtu;                 // DTLS: path mtu (max outgoing fragment size)
@@ -4015,7 +4557,7 @@ int mbedtls_ssl_context_save( mbedtls_ssl_context *ssl,
         MBEDTLS_PUT_UINT64_BE( ssl->in_window_top, p, 0 );
         p += 8;
 
-        MBEDTLS_PUT_UINT64_BE( ssl->in_window, p, 0 );
+        MBEDTLS_PUT_UINT64_BE( mbedtls_ssl_dtls_replay_export( ssl ), p, 0 );
         p += 8;
     }
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
@@ -4243,25 +4785,9 @@ static int ssl_context_load( mbedtls_ssl_context *ssl,
     if( (size_t)( end - p ) < 16 )
         return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
-    ssl->in_window_top = ( (uint64_t) p[0] << 56 ) |
-                         ( (uint64_t) p[1] << 48 ) |
-                         ( (uint64_t) p[2] << 40 ) |
-                         ( (uint64_t) p[3] << 32 ) |
-                         ( (uint64_t) p[4] << 24 ) |
-                         ( (uint64_t) p[5] << 16 ) |
-                         ( (uint64_t) p[6] <<  8 ) |
-                         ( (uint64_t) p[7]       );
-    p += 8;
-
-    ssl->in_window = ( (uint64_t) p[0] << 56 ) |
-                     ( (uint64_t) p[1] << 48 ) |
-                     ( (uint64_t) p[2] << 40 ) |
-                     ( (uint64_t) p[3] << 32 ) |
-                     ( (uint64_t) p[4] << 24 ) |
-                     ( (uint64_t) p[5] << 16 ) |
-                     ( (uint64_t) p[6] <<  8 ) |
-                     ( (uint64_t) p[7]       );
-    p += 8;
+    mbedtls_ssl_dtls_replay_import( ssl, MBEDTLS_GET_UINT64_BE( p, 0 ),
+                                    MBEDTLS_GET_UINT64_BE( p, 8 ) );
+    p += 16;
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -4387,8 +4913,7 @@ void mbedtls_ssl_free( mbedtls_ssl_context *ssl )
         size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
 #endif
 
-        mbedtls_platform_zeroize( ssl->out_buf, out_buf_len );
-        mbedtls_free( ssl->out_buf );
+        ssl_buffer_free( ssl->conf, ssl->out_buf, out_buf_len );
         ssl->out_buf = NULL;
     }
 
@@ -4400,8 +4925,7 @@ void mbedtls_ssl_free( mbedtls_ssl_context *ssl )
         size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
 #endif
 
-        mbedtls_platform_zeroize( ssl->in_buf, in_buf_len );
-        mbedtls_free( ssl->in_buf );
+        ssl_buffer_free( ssl->conf, ssl->in_buf, in_buf_len );
         ssl->in_buf = NULL;
     }
 
@@ -4753,6 +5277,7 @@ int mbedtls_ssl_config_defaults( mbedtls_ssl_config *conf,
 
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
     conf->anti_replay = MBEDTLS_SSL_ANTI_REPLAY_ENABLED;
+    conf->anti_replay_window = 64;
 #endif
 
 #if defined(MBEDTLS_SSL_SRV_C)
@@ -4792,6 +5317,12 @@ int mbedtls_ssl_config_defaults( mbedtls_ssl_config *conf,
 #if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
     mbedtls_ssl_conf_new_session_tickets(
         conf, MBEDTLS_SSL_TLS1_3_DEFAULT_NEW_SESSION_TICKETS );
+    mbedtls_ssl_conf_new_session_tickets_mode(
+        conf, MBEDTLS_SSL_NEW_SESSION_TICKETS_IMMEDIATE );
+#endif
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    mbedtls_ssl_tls13_conf_max_early_data_size(
+        conf, MBEDTLS_SSL_MAX_EARLY_DATA_SIZE );
 #endif
     /*
      * Allow all TLS 1.3 key exchange modes by default.
@@ -4843,7 +5374,8 @@ int mbedtls_ssl_config_defaults( mbedtls_ssl_config *conf,
          */
         case MBEDTLS_SSL_PRESET_SUITEB:
 
-            conf->ciphersuite_list = ssl_preset_suiteb_ciphersuites;
+            mbedtls_ssl_conf_ciphersuites( conf,
+                                           ssl_preset_suiteb_ciphersuites );
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
             conf->cert_profile = &mbedtls_x509_crt_profile_suiteb;
@@ -4869,7 +5401,8 @@ int mbedtls_ssl_config_defaults( mbedtls_ssl_config *conf,
          */
         default:
 
-            conf->ciphersuite_list = mbedtls_ssl_list_ciphersuites();
+            mbedtls_ssl_conf_ciphersuites( conf,
+                                           mbedtls_ssl_list_ciphersuites() );
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
             conf->cert_profile = &mbedtls_x509_crt_profile_default;
@@ -4935,6 +5468,8 @@ void mbedtls_ssl_config_free( mbedtls_ssl_config *conf )
     ssl_key_cert_free( conf->key_cert );
 #endif
 
+    ssl_conf_free_ciphersuite_index( conf );
+
     mbedtls_platform_zeroize( conf, sizeof( mbedtls_ssl_config ) );
 }
 
@@ -6400,6 +6935,17 @@ static int ssl_check_peer_crt_unchanged( mbedtls_ssl_context *ssl,
 {
     mbedtls_x509_crt const * const peer_crt = ssl->session->peer_cert;
 
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    /* No need to parse a resumed certificate just to compare it. */
+    if( ssl->session->peer_cert_der != NULL )
+    {
+        if( ssl->session->peer_cert_der_len != crt_buf_len )
+            return( -1 );
+
+        return( memcmp( ssl->session->peer_cert_der, crt_buf, crt_buf_len ) );
+    }
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
+
     if( peer_crt == NULL )
         return( -1 );
 
@@ -8266,7 +8812,8 @@ static size_t ssl_tls12_session_save( const mbedtls_ssl_session *session,
 #endif
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
-    size_t cert_len;
+    const unsigned char *cert = NULL;
+    size_t cert_len = 0;
 #endif /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
@@ -8315,10 +8862,18 @@ static size_t ssl_tls12_session_save( const mbedtls_ssl_session *session,
      */
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
-    if( session->peer_cert == NULL )
-        cert_len = 0;
-    else
+    if( session->peer_cert != NULL )
+    {
+        cert = session->peer_cert->raw.p;
         cert_len = session->peer_cert->raw.len;
+    }
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    else if( session->peer_cert_der != NULL )
+    {
+        cert = session->peer_cert_der;
+        cert_len = session->peer_cert_der_len;
+    }
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
 
     used += 3 + cert_len;
 
@@ -8328,9 +8883,9 @@ static size_t ssl_tls12_session_save( const mbedtls_ssl_session *session,
         *p++ = MBEDTLS_BYTE_1( cert_len );
         *p++ = MBEDTLS_BYTE_0( cert_len );
 
-        if( session->peer_cert != NULL )
+        if( cert != NULL )
         {
-            memcpy( p, session->peer_cert->raw.p, cert_len );
+            memcpy( p, cert, cert_len );
             p += cert_len;
         }
     }
@@ -8466,6 +9021,10 @@ static int ssl_tls12_session_load( mbedtls_ssl_session *session,
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
     session->peer_cert = NULL;
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    session->peer_cert_der = NULL;
+    session->peer_cert_der_len = 0;
+#endif
 #else
     session->peer_cert_digest = NULL;
 #endif /* !MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
@@ -8488,11 +9047,22 @@ static int ssl_tls12_session_load( mbedtls_ssl_session *session,
 
     if( cert_len != 0 )
     {
+#if !defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
         int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+#endif
 
         if( cert_len > (size_t)( end - p ) )
             return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
 
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+        /* Parsed on first use, see mbedtls_ssl_session_parse_peer_cert(). */
+        session->peer_cert_der = mbedtls_calloc( 1, cert_len );
+        if( session->peer_cert_der == NULL )
+            return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+        memcpy( session->peer_cert_der, p, cert_len );
+        session->peer_cert_der_len = cert_len;
+#else
         session->peer_cert = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) );
 
         if( session->peer_cert == NULL )
@@ -8508,6 +9078,7 @@ static int ssl_tls12_session_load( mbedtls_ssl_session *session,
             session->peer_cert = NULL;
             return( ret );
         }
+#endif /* MBEDTLS_SSL_SESSION_LAZY_PEER_CERT */
 
         p += cert_len;
     }
@@ -8993,4 +9564,39 @@ int mbedtls_ssl_session_set_hostname( mbedtls_ssl_session *session,
           MBEDTLS_SSL_SERVER_NAME_INDICATION &&
           MBEDTLS_SSL_CLI_C */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA) && \
+    defined(MBEDTLS_SSL_ALPN) && \
+    defined(MBEDTLS_SSL_SRV_C)
+int mbedtls_ssl_session_set_ticket_alpn( mbedtls_ssl_session *session,
+                                         const char *alpn )
+{
+    size_t alpn_len = 0;
+
+    if( alpn != NULL )
+    {
+        alpn_len = strlen( alpn );
+
+        /* The ALPN protocol name is serialized with a one-byte length. */
+        if( alpn_len > 255 )
+            return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+    }
+
+    mbedtls_free( session->ticket_alpn );
+    session->ticket_alpn = NULL;
+
+    if( alpn != NULL )
+    {
+        session->ticket_alpn = mbedtls_calloc( 1, alpn_len + 1 );
+        if( session->ticket_alpn == NULL )
+            return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+        memcpy( session->ticket_alpn, alpn, alpn_len );
+    }
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_EARLY_DATA &&
+          MBEDTLS_SSL_ALPN &&
+          MBEDTLS_SSL_SRV_C */
+
 #endif /* MBEDTLS_SSL_TLS_C */
@@ -1414,11 +1414,12 @@ static int ssl_parse_server_hello( mbedtls_ssl_context *ssl )
 
     /*
      * Perform cipher suite validation in same way as in ssl_write_client_hello.
+     * The list only needs to be walked if there is no lookup table.
      */
-    i = 0;
-    while( 1 )
+    if( ssl->conf->ciphersuite_index != NULL )
     {
-        if( ssl->conf->ciphersuite_list[i] == 0 )
+        if( mbedtls_ssl_conf_find_ciphersuite( ssl->conf,
+                    ssl->session_negotiate->ciphersuite ) == NULL )
         {
             MBEDTLS_SSL_DEBUG_MSG( 1, ( "bad server hello message" ) );
             mbedtls_ssl_send_alert_message(
@@ -1427,11 +1428,27 @@ static int ssl_parse_server_hello( mbedtls_ssl_context *ssl )
                 MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER );
             return( MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER );
         }
-
-        if( ssl->conf->ciphersuite_list[i++] ==
-            ssl->session_negotiate->ciphersuite )
+    }
+    else
+    {
+        i = 0;
+        while( 1 )
         {
-            break;
+            if( ssl->conf->ciphersuite_list[i] == 0 )
+            {
+                MBEDTLS_SSL_DEBUG_MSG( 1, ( "bad server hello message" ) );
+                mbedtls_ssl_send_alert_message(
+                    ssl,
+                    MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                    MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER );
+                return( MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER );
+            }
+
+            if( ssl->conf->ciphersuite_list[i++] ==
+                ssl->session_negotiate->ciphersuite )
+            {
+                break;
+            }
         }
     }
 
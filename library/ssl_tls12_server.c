@@ -798,24 +798,16 @@ static int ssl_pick_cert( mbedtls_ssl_context *ssl,
  * Sets ciphersuite_info only if the suite matches.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_ciphersuite_match( mbedtls_ssl_context *ssl, int suite_id,
-                                  const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
+static int ssl_ciphersuite_info_match( mbedtls_ssl_context *ssl,
+                                       const mbedtls_ssl_ciphersuite_t *suite_info,
+                                       const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
 {
-    const mbedtls_ssl_ciphersuite_t *suite_info;
-
 #if defined(MBEDTLS_KEY_EXCHANGE_WITH_CERT_ENABLED)
     mbedtls_pk_type_t sig_type;
 #endif
 
-    suite_info = mbedtls_ssl_ciphersuite_from_id( suite_id );
-    if( suite_info == NULL )
-    {
-        MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
-    }
-
     MBEDTLS_SSL_DEBUG_MSG( 3, ( "trying ciphersuite: %#04x (%s)",
-                                (unsigned int) suite_id, suite_info->name ) );
+                                (unsigned int) suite_info->id, suite_info->name ) );
 
     if( suite_info->min_tls_version > ssl->tls_version ||
         suite_info->max_tls_version < ssl->tls_version )
@@ -892,6 +884,83 @@ static int ssl_ciphersuite_match( mbedtls_ssl_context *ssl, int suite_id,
     return( 0 );
 }
 
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ciphersuite_match( mbedtls_ssl_context *ssl, int suite_id,
+                                  const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
+{
+    const mbedtls_ssl_ciphersuite_t *suite_info;
+
+    suite_info = mbedtls_ssl_ciphersuite_from_id( suite_id );
+    if( suite_info == NULL )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+    }
+
+    return( ssl_ciphersuite_info_match( ssl, suite_info, ciphersuite_info ) );
+}
+
+/*
+ * Select a ciphersuite with the lookup table built by
+ * mbedtls_ssl_conf_precompute(): each offered ciphersuite is looked up once,
+ * then the candidates are tried in the configured preference order.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ciphersuite_select_indexed( mbedtls_ssl_context *ssl,
+                                           const unsigned char *offered,
+                                           size_t offered_len,
+                                           int *got_common_suite,
+                                           const mbedtls_ssl_ciphersuite_t **ciphersuite_info )
+{
+    int ret;
+    size_t i, j;
+    const mbedtls_ssl_ciphersuite_index_entry *entry;
+    unsigned char ranks[MBEDTLS_SSL_CIPHERSUITE_INDEX_MAX / 8];
+
+    memset( ranks, 0, sizeof( ranks ) );
+
+    for( j = 0; j < offered_len; j += 2 )
+    {
+        entry = mbedtls_ssl_conf_find_ciphersuite( ssl->conf,
+                                        MBEDTLS_GET_UINT16_BE( offered, j ) );
+        if( entry == NULL )
+            continue;
+
+        *got_common_suite = 1;
+
+        if( ssl->conf->respect_cli_pref == MBEDTLS_SSL_SRV_CIPHERSUITE_ORDER_CLIENT )
+        {
+            if( ( ret = ssl_ciphersuite_info_match( ssl, entry->info,
+                                                    ciphersuite_info ) ) != 0 )
+                return( ret );
+
+            if( *ciphersuite_info != NULL )
+                return( 0 );
+        }
+        else
+            ranks[entry->rank / 8] |= (unsigned char) ( 1u << ( entry->rank % 8 ) );
+    }
+
+    /* Server preference: try the common ciphersuites in our order */
+    for( i = 0; i < MBEDTLS_SSL_CIPHERSUITE_INDEX_MAX; i++ )
+    {
+        if( ( ranks[i / 8] & ( 1u << ( i % 8 ) ) ) == 0 )
+            continue;
+
+        entry = mbedtls_ssl_conf_find_ciphersuite( ssl->conf,
+                                                   ssl->conf->ciphersuite_list[i] );
+
+        if( ( ret = ssl_ciphersuite_info_match( ssl, entry->info,
+                                                ciphersuite_info ) ) != 0 )
+            return( ret );
+
+        if( *ciphersuite_info != NULL )
+            return( 0 );
+    }
+
+    return( 0 );
+}
+
 /* This function doesn't alert on errors that happen early during
    ClientHello parsing because they might indicate that the client is
    not talking SSL/TLS at all and would not understand our alert. */
@@ -1638,7 +1707,19 @@ read_record_header:
     ciphersuites = ssl->conf->ciphersuite_list;
     ciphersuite_info = NULL;
 
-    if (ssl->conf->respect_cli_pref == MBEDTLS_SSL_SRV_CIPHERSUITE_ORDER_CLIENT)
+    if( ssl->conf->ciphersuite_index != NULL )
+    {
+        if( ( ret = ssl_ciphersuite_select_indexed( ssl,
+                                                    buf + ciph_offset + 2,
+                                                    ciph_len,
+                                                    &got_common_suite,
+                                                    &ciphersuite_info ) ) != 0 )
+            return( ret );
+
+        if( ciphersuite_info != NULL )
+            goto have_ciphersuite;
+    }
+    else if (ssl->conf->respect_cli_pref == MBEDTLS_SSL_SRV_CIPHERSUITE_ORDER_CLIENT)
     {
         for( j = 0, p = buf + ciph_offset + 2; j < ciph_len; j += 2, p += 2 )
             for( i = 0; ciphersuites[i] != 0; i++ )
@@ -1692,7 +1773,7 @@ read_record_header:
 have_ciphersuite:
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "selected ciphersuite: %s", ciphersuite_info->name ) );
 
-    ssl->session_negotiate->ciphersuite = ciphersuites[i];
+    ssl->session_negotiate->ciphersuite = ciphersuite_info->id;
     ssl->handshake->ciphersuite_info = ciphersuite_info;
 
     ssl->state++;
@@ -2974,16 +3055,6 @@ curve_matching_done:
         MBEDTLS_PUT_UINT16_BE( (*curve)->tls_id, p, 0 );
         p += 2;
 
-        /* Generate ECDH private key. */
-        status = psa_generate_key( &key_attributes,
-                                   &handshake->ecdh_psa_privkey );
-        if( status != PSA_SUCCESS )
-        {
-            ret = psa_ssl_status_to_mbedtls( status );
-            MBEDTLS_SSL_DEBUG_RET( 1, "psa_generate_key", ret );
-            return( ret );
-        }
-
         /*
          * ECPoint  public
          *
@@ -2999,9 +3070,28 @@ curve_matching_done:
         size_t own_pubkey_max_len = (size_t)( MBEDTLS_SSL_OUT_CONTENT_LEN
                                     - ( own_pubkey - ssl->out_msg ) );
 
-        status = psa_export_public_key( handshake->ecdh_psa_privkey,
-                                        own_pubkey, own_pubkey_max_len,
-                                        &len );
+        /* Use a pre-generated key pair if there is one, or generate the
+         * ECDH private key and export its public part. */
+        if( mbedtls_ssl_pop_key_share( ssl, (*curve)->tls_id, own_pubkey,
+                                       own_pubkey_max_len, &len ) == 0 )
+        {
+            status = PSA_SUCCESS;
+        }
+        else
+        {
+            status = psa_generate_key( &key_attributes,
+                                       &handshake->ecdh_psa_privkey );
+            if( status != PSA_SUCCESS )
+            {
+                ret = psa_ssl_status_to_mbedtls( status );
+                MBEDTLS_SSL_DEBUG_RET( 1, "psa_generate_key", ret );
+                return( ret );
+            }
+
+            status = psa_export_public_key( handshake->ecdh_psa_privkey,
+                                            own_pubkey, own_pubkey_max_len,
+                                            &len );
+        }
         if( status != PSA_SUCCESS )
         {
             ret = psa_ssl_status_to_mbedtls( status );
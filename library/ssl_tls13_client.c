@@ -1778,6 +1778,13 @@ static int ssl_tls13_postprocess_server_hello( mbedtls_ssl_context *ssl )
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_ssl_handshake_params *handshake = ssl->handshake;
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    /* Only take the restartable paths when an operation budget was set
+     * with mbedtls_ecp_set_max_ops(), as in TLS 1.2. */
+    if( mbedtls_ecp_restart_is_enabled() )
+        handshake->ecrs_enabled = 1;
+#endif
+
     /* Determine the key exchange mode:
      * 1) If both the pre_shared_key and key_share extensions were received
      *    then the key exchange mode is PSK with EPHEMERAL.
@@ -2472,6 +2479,10 @@ static int ssl_tls13_parse_new_session_ticket_exts( mbedtls_ssl_context *ssl,
 
     ((void) ssl);
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    ssl->session->max_early_data_size = 0;
+#endif
+
     while( p < end )
     {
         unsigned int extension_type;
@@ -2488,6 +2499,18 @@ static int ssl_tls13_parse_new_session_ticket_exts( mbedtls_ssl_context *ssl,
         {
             case MBEDTLS_TLS_EXT_EARLY_DATA:
                 MBEDTLS_SSL_DEBUG_MSG( 4, ( "early_data extension received" ) );
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+                /* struct { uint32 max_early_data_size; } EarlyDataIndication; */
+                if( extension_data_len != 4 )
+                {
+                    MBEDTLS_SSL_PEND_FATAL_ALERT(
+                        MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                        MBEDTLS_ERR_SSL_DECODE_ERROR );
+                    return( MBEDTLS_ERR_SSL_DECODE_ERROR );
+                }
+                ssl->session->max_early_data_size =
+                    MBEDTLS_GET_UINT32_BE( p, 0 );
+#endif /* MBEDTLS_SSL_EARLY_DATA */
                 break;
 
             default:
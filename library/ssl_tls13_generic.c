@@ -265,6 +265,22 @@ static int ssl_tls13_parse_certificate_verify( mbedtls_ssl_context *ssl,
     }
 #endif /* MBEDTLS_X509_RSASSA_PSS_SUPPORT */
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled && sig_alg == MBEDTLS_PK_ECDSA )
+    {
+        ret = mbedtls_pk_verify_restartable(
+                  &ssl->session_negotiate->peer_cert->pk,
+                  md_alg, verify_hash, verify_hash_len,
+                  p, signature_len, &ssl->handshake->ecrs_ctx.pk );
+        if( ret == 0 )
+            return( 0 );
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_pk_verify_restartable", ret );
+        if( ret == MBEDTLS_ERR_ECP_IN_PROGRESS )
+            return( MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS );
+        goto error;
+    }
+#endif /* MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED */
+
     if( ( ret = mbedtls_pk_verify_ext( sig_alg, options,
                                        &ssl->session_negotiate->peer_cert->pk,
                                        md_alg, verify_hash, verify_hash_len,
@@ -301,9 +317,26 @@ int mbedtls_ssl_tls13_process_certificate_verify( mbedtls_ssl_context *ssl )
 
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> parse certificate verify" ) );
 
-    MBEDTLS_SSL_PROC_CHK(
-        mbedtls_ssl_tls13_fetch_handshake_msg( ssl,
-                MBEDTLS_SSL_HS_CERTIFICATE_VERIFY, &buf, &buf_len ) );
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled &&
+        ssl->handshake->ecrs_state == ssl_ecrs_crt_vrfy_verify )
+    {
+        /* The message is still in the input buffer. */
+        buf = ssl->in_msg + 4;
+        buf_len = ssl->in_hslen - 4;
+    }
+    else
+#endif /* MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED */
+    {
+        MBEDTLS_SSL_PROC_CHK(
+            mbedtls_ssl_tls13_fetch_handshake_msg( ssl,
+                    MBEDTLS_SSL_HS_CERTIFICATE_VERIFY, &buf, &buf_len ) );
+    }
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled )
+        ssl->handshake->ecrs_state = ssl_ecrs_crt_vrfy_verify;
+#endif
 
     /* Need to calculate the hash of the transcript first
      * before reading the message since otherwise it gets
@@ -336,6 +369,11 @@ int mbedtls_ssl_tls13_process_certificate_verify( mbedtls_ssl_context *ssl )
     MBEDTLS_SSL_PROC_CHK( ssl_tls13_parse_certificate_verify( ssl, buf,
                             buf + buf_len, verify_buffer, verify_buffer_len ) );
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled )
+        ssl->handshake->ecrs_state = ssl_ecrs_none;
+#endif
+
     mbedtls_ssl_add_hs_msg_to_checksum( ssl, MBEDTLS_SSL_HS_CERTIFICATE_VERIFY,
                                         buf, buf_len );
 
@@ -549,6 +587,12 @@ static int ssl_tls13_validate_certificate( mbedtls_ssl_context *ssl )
     const char *ext_oid;
     size_t ext_len;
     uint32_t verify_result = 0;
+    mbedtls_x509_crt_restart_ctx *rs_ctx = NULL;
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled )
+        rs_ctx = &ssl->handshake->ecrs_ctx;
+#endif
 
     /* If SNI was used, overwrite authentication mode
      * from the configuration. */
@@ -620,19 +664,24 @@ static int ssl_tls13_validate_certificate( mbedtls_ssl_context *ssl )
     /*
      * Main check: verify certificate
      */
-    ret = mbedtls_x509_crt_verify_with_profile(
+    ret = mbedtls_x509_crt_verify_restartable(
         ssl->session_negotiate->peer_cert,
         ca_chain, ca_crl,
         ssl->conf->cert_profile,
         ssl->hostname,
         &verify_result,
-        ssl->conf->f_vrfy, ssl->conf->p_vrfy );
+        ssl->conf->f_vrfy, ssl->conf->p_vrfy, rs_ctx );
 
     if( ret != 0 )
     {
         MBEDTLS_SSL_DEBUG_RET( 1, "x509_verify_cert", ret );
     }
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ret == MBEDTLS_ERR_ECP_IN_PROGRESS )
+        return( MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS );
+#endif
+
     /*
      * Secondary checks: always done, but change 'ret' only if it was 0
      */
@@ -738,16 +787,40 @@ int mbedtls_ssl_tls13_process_certificate( mbedtls_ssl_context *ssl )
     unsigned char *buf;
     size_t buf_len;
 
-    MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_tls13_fetch_handshake_msg(
-                          ssl, MBEDTLS_SSL_HS_CERTIFICATE,
-                          &buf, &buf_len ) );
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled &&
+        ssl->handshake->ecrs_state == ssl_ecrs_crt_verify )
+    {
+        /* The chain is already parsed and the message is still in the
+         * input buffer: only resume the verification. */
+        buf = ssl->in_msg + 4;
+        buf_len = ssl->in_hslen - 4;
+    }
+    else
+#endif /* MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED */
+    {
+        MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_tls13_fetch_handshake_msg(
+                              ssl, MBEDTLS_SSL_HS_CERTIFICATE,
+                              &buf, &buf_len ) );
+
+        /* Parse the certificate chain sent by the peer. */
+        MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_tls13_parse_certificate( ssl, buf,
+                                                                   buf + buf_len ) );
+    }
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled )
+        ssl->handshake->ecrs_state = ssl_ecrs_crt_verify;
+#endif
 
-    /* Parse the certificate chain sent by the peer. */
-    MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_tls13_parse_certificate( ssl, buf,
-                                                               buf + buf_len ) );
     /* Validate the certificate chain and set the verification results. */
     MBEDTLS_SSL_PROC_CHK( ssl_tls13_validate_certificate( ssl ) );
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if( ssl->handshake->ecrs_enabled )
+        ssl->handshake->ecrs_state = ssl_ecrs_none;
+#endif
+
     mbedtls_ssl_add_hs_msg_to_checksum( ssl, MBEDTLS_SSL_HS_CERTIFICATE,
                                         buf, buf_len );
 
@@ -923,6 +996,45 @@ int mbedtls_ssl_tls13_check_sig_alg_cert_key_match( uint16_t sig_alg,
     return( 0 );
 }
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+/*
+ * Complete a CertificateVerify signature started with f_async_sign_start,
+ * writing the algorithm, the signature length and the signature at \p buf.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_resume_certificate_verify( mbedtls_ssl_context *ssl,
+                                                unsigned char *buf,
+                                                unsigned char *end,
+                                                size_t *out_len )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t signature_len = 0;
+
+    MBEDTLS_SSL_CHK_BUF_PTR( buf, end, 4 );
+
+    ret = ssl->conf->f_async_resume( ssl, buf + 4, &signature_len,
+                                     (size_t)( end - ( buf + 4 ) ) );
+    if( ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS )
+    {
+        ssl->handshake->async_in_progress = 0;
+        mbedtls_ssl_set_async_operation_data( ssl, NULL );
+    }
+    MBEDTLS_SSL_DEBUG_RET( 2, "ssl_tls13_resume_certificate_verify", ret );
+    if( ret != 0 )
+        return( ret );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "CertificateVerify signature with %s",
+                    mbedtls_ssl_sig_alg_to_str( ssl->handshake->async_sig_alg ) ) );
+
+    MBEDTLS_PUT_UINT16_BE( ssl->handshake->async_sig_alg, buf, 0 );
+    MBEDTLS_PUT_UINT16_BE( signature_len, buf, 2 );
+
+    *out_len = 4 + signature_len;
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_write_certificate_verify_body( mbedtls_ssl_context *ssl,
                                                     unsigned char *buf,
@@ -943,7 +1055,26 @@ static int ssl_tls13_write_certificate_verify_body( mbedtls_ssl_context *ssl,
 
     *out_len = 0;
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    /* If there is an ongoing signature operation, the transcript and the
+     * algorithm are already fixed: just wait for the result. */
+    if( ssl->handshake->async_in_progress != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "resuming signature operation" ) );
+        return( ssl_tls13_resume_certificate_verify( ssl, buf, end, out_len ) );
+    }
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
     own_key = mbedtls_ssl_own_key( ssl );
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    /* If the private key is external, the certificate's public key is
+     * enough to choose the signature algorithm. */
+    if( own_key == NULL && ssl->conf->f_async_sign_start != NULL &&
+        mbedtls_ssl_own_cert( ssl ) != NULL )
+    {
+        own_key = &mbedtls_ssl_own_cert( ssl )->pk;
+    }
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
     if( own_key == NULL )
     {
         MBEDTLS_SSL_DEBUG_MSG( 1, ( "should never happen" ) );
@@ -995,6 +1126,17 @@ static int ssl_tls13_write_certificate_verify_body( mbedtls_ssl_context *ssl,
         if( !mbedtls_ssl_tls13_check_sig_alg_cert_key_match( *sig_alg, own_key ) )
             continue;
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+        /* When resuming, stick to the algorithm the signature was started
+         * with. */
+        if( ssl->handshake->ecrs_enabled &&
+            ssl->handshake->ecrs_state == ssl_ecrs_crt_vrfy_sign &&
+            *sig_alg != ssl->handshake->ecrs_n )
+        {
+            continue;
+        }
+#endif
+
         if( mbedtls_ssl_get_pk_type_and_md_alg_from_sig_alg(
                                         *sig_alg, &pk_type, &md_alg ) != 0 )
         {
@@ -1013,10 +1155,69 @@ static int ssl_tls13_write_certificate_verify_body( mbedtls_ssl_context *ssl,
 
         MBEDTLS_SSL_DEBUG_BUF( 3, "verify hash", verify_hash, verify_hash_len );
 
-        if( ( ret = mbedtls_pk_sign_ext( pk_type, own_key,
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+        if( ssl->conf->f_async_sign_start != NULL )
+        {
+            /* Let the callback know which scheme it is signing for, see
+             * mbedtls_ssl_get_async_sig_alg(). */
+            ssl->handshake->async_sig_alg = *sig_alg;
+            ret = ssl->conf->f_async_sign_start( ssl,
+                                                 mbedtls_ssl_own_cert( ssl ),
+                                                 md_alg, verify_hash,
+                                                 verify_hash_len );
+            switch( ret )
+            {
+            case MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH:
+                /* act as if f_async_sign was null */
+                ssl->handshake->async_sig_alg = MBEDTLS_TLS1_3_SIG_NONE;
+                if( mbedtls_ssl_own_key( ssl ) == NULL )
+                {
+                    MBEDTLS_SSL_DEBUG_MSG( 1, ( "got no private key" ) );
+                    return( MBEDTLS_ERR_SSL_PRIVATE_KEY_REQUIRED );
+                }
+                break;
+            case 0:
+                ssl->handshake->async_in_progress = 1;
+                return( ssl_tls13_resume_certificate_verify( ssl, buf, end,
+                                                             out_len ) );
+            case MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS:
+                ssl->handshake->async_in_progress = 1;
+                return( MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS );
+            default:
+                ssl->handshake->async_sig_alg = MBEDTLS_TLS1_3_SIG_NONE;
+                MBEDTLS_SSL_DEBUG_RET( 1, "f_async_sign_start", ret );
+                return( ret );
+            }
+        }
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+        if( ssl->handshake->ecrs_enabled && pk_type == MBEDTLS_PK_ECDSA )
+        {
+            ssl->handshake->ecrs_state = ssl_ecrs_crt_vrfy_sign;
+            ssl->handshake->ecrs_n = *sig_alg;
+            ret = mbedtls_pk_sign_restartable( own_key,
                         md_alg, verify_hash, verify_hash_len,
                         p + 4, (size_t)( end - ( p + 4 ) ), &signature_len,
-                        ssl->conf->f_rng, ssl->conf->p_rng ) ) != 0 )
+                        ssl->conf->f_rng, ssl->conf->p_rng,
+                        &ssl->handshake->ecrs_ctx.pk );
+            if( ret == MBEDTLS_ERR_ECP_IN_PROGRESS )
+            {
+                MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_pk_sign_restartable", ret );
+                return( MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS );
+            }
+            ssl->handshake->ecrs_state = ssl_ecrs_none;
+        }
+        else
+#endif /* MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED */
+        {
+            ret = mbedtls_pk_sign_ext( pk_type, own_key,
+                        md_alg, verify_hash, verify_hash_len,
+                        p + 4, (size_t)( end - ( p + 4 ) ), &signature_len,
+                        ssl->conf->f_rng, ssl->conf->p_rng );
+        }
+
+        if( ret != 0 )
         {
              MBEDTLS_SSL_DEBUG_MSG( 2, ( "CertificateVerify signature failed with %s",
                                     mbedtls_ssl_sig_alg_to_str( *sig_alg ) ) );
@@ -1063,8 +1264,17 @@ int mbedtls_ssl_tls13_write_certificate_verify( mbedtls_ssl_context *ssl )
     MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_start_handshake_msg( ssl,
                 MBEDTLS_SSL_HS_CERTIFICATE_VERIFY, &buf, &buf_len ) );
 
-    MBEDTLS_SSL_PROC_CHK( ssl_tls13_write_certificate_verify_body(
-                                ssl, buf, buf + buf_len, &msg_len ) );
+    ret = ssl_tls13_write_certificate_verify_body( ssl, buf, buf + buf_len,
+                                                   &msg_len );
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    if( ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= write certificate verify (pending)" ) );
+        return( ret );
+    }
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+    if( ret != 0 )
+        goto cleanup;
 
     mbedtls_ssl_add_hs_msg_to_checksum( ssl, MBEDTLS_SSL_HS_CERTIFICATE_VERIFY,
                                         buf, msg_len );
@@ -1450,6 +1660,13 @@ int mbedtls_ssl_tls13_generate_and_write_ecdh_key_exchange(
 
     ssl->handshake->ecdh_bits = ecdh_bits;
 
+    /* Use a pre-generated key pair if there is one. */
+    if( mbedtls_ssl_pop_key_share( ssl, named_group, buf, (size_t)( end - buf ),
+                                   out_len ) == 0 )
+    {
+        return( 0 );
+    }
+
     key_attributes = psa_key_attributes_init();
     psa_set_key_usage_flags( &key_attributes, PSA_KEY_USAGE_DERIVE );
     psa_set_key_algorithm( &key_attributes, PSA_ALG_ECDH );
@@ -667,6 +667,24 @@ int mbedtls_ssl_tls13_calculate_verify_data( mbedtls_ssl_context *ssl,
                                              size_t *actual_len,
                                              int which );
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+/**
+ * \brief Compute TLS 1.3 early data transform
+ *
+ * \param ssl  The SSL context to operate on. The early secret must have been
+ *             computed and the handshake transcript must contain the
+ *             ClientHello only.
+ *
+ * \note       Only the client write keys are derived, the transform is
+ *             used to protect the client's 0-RTT data.
+ *
+ * \returns    \c 0 on success.
+ * \returns    A negative error code on failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_compute_early_transform( mbedtls_ssl_context *ssl );
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
 /**
  * \brief Compute TLS 1.3 handshake transform
  *
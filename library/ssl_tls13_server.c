@@ -452,6 +452,13 @@ static int ssl_tls13_session_copy_ticket( mbedtls_ssl_session *dst,
         return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
     memcpy( dst->resumption_key, src->resumption_key, src->resumption_key_len );
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    dst->max_early_data_size = src->max_early_data_size;
+#if defined(MBEDTLS_SSL_ALPN)
+    return( mbedtls_ssl_session_set_ticket_alpn( dst, src->ticket_alpn ) );
+#endif
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
     return( 0 );
 }
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
@@ -623,6 +630,27 @@ static int ssl_tls13_parse_pre_shared_key_ext( mbedtls_ssl_context *ssl,
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
         if( psk_type == MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION )
         {
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+            /* RFC 8446 section 4.2.10: early data is only accepted with the
+             * first PSK identity. Record the 0-RTT ClientHello with the
+             * anti-replay callback now, while the binder is at hand. */
+            if( identity_id == 0 &&
+                ssl->handshake->hello_retry_request_count == 0 &&
+                ( ssl->handshake->extensions_present &
+                  MBEDTLS_SSL_EXT_EARLY_DATA ) &&
+                ssl->conf->early_data_enabled == MBEDTLS_SSL_EARLY_DATA_ENABLED &&
+                session.max_early_data_size > 0 )
+            {
+                ssl->handshake->early_data_replay_ok =
+                    ( ssl->conf->f_early_data_replay == NULL ||
+                      ssl->conf->f_early_data_replay(
+                          ssl->conf->p_early_data_replay,
+                          identity, identity_len,
+                          binder, binder_len ) == 0 );
+                if( ! ssl->handshake->early_data_replay_ok )
+                    MBEDTLS_SSL_DEBUG_MSG( 2, ( "0-RTT ClientHello replayed" ) );
+            }
+#endif /* MBEDTLS_SSL_EARLY_DATA */
             ret = ssl_tls13_session_copy_ticket( ssl->session_negotiate,
                                                  &session );
             mbedtls_ssl_session_free( &session );
@@ -973,6 +1001,13 @@ static void ssl_tls13_debug_print_client_hello_exts( mbedtls_ssl_context *ssl )
                 & MBEDTLS_SSL_EXT_ALPN ) > 0 ) ?
                 "TRUE" : "FALSE" ) );
 #endif /* MBEDTLS_SSL_ALPN */
+#if defined ( MBEDTLS_SSL_EARLY_DATA )
+    MBEDTLS_SSL_DEBUG_MSG( 3,
+            ( "- EARLY_DATA_EXTENSION ( %s )",
+            ( ( ssl->handshake->extensions_present
+                & MBEDTLS_SSL_EXT_EARLY_DATA ) > 0 ) ?
+                "TRUE" : "FALSE" ) );
+#endif /* MBEDTLS_SSL_EARLY_DATA */
 }
 #endif /* MBEDTLS_DEBUG_C */
 
@@ -1621,6 +1656,22 @@ static int ssl_tls13_parse_client_hello( mbedtls_ssl_context *ssl,
                 ssl->handshake->extensions_present |= MBEDTLS_SSL_EXT_PRE_SHARED_KEY;
                 break;
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+            case MBEDTLS_TLS_EXT_EARLY_DATA:
+                MBEDTLS_SSL_DEBUG_MSG( 3, ( "found early_data extension" ) );
+
+                /* The extension data is empty in the ClientHello. */
+                if( extension_data_len != 0 )
+                {
+                    MBEDTLS_SSL_PEND_FATAL_ALERT(
+                        MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                        MBEDTLS_ERR_SSL_DECODE_ERROR );
+                    return( MBEDTLS_ERR_SSL_DECODE_ERROR );
+                }
+                ssl->handshake->extensions_present |= MBEDTLS_SSL_EXT_EARLY_DATA;
+                break;
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
 #if defined(MBEDTLS_SSL_ALPN)
             case MBEDTLS_TLS_EXT_ALPN:
                 MBEDTLS_SSL_DEBUG_MSG( 3, ( "found alpn extension" ) );
@@ -1721,6 +1772,12 @@ static int ssl_tls13_postprocess_client_hello( mbedtls_ssl_context* ssl )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    /* See ssl_tls13_postprocess_server_hello() */
+    if( mbedtls_ecp_restart_is_enabled() )
+        ssl->handshake->ecrs_enabled = 1;
+#endif
+
     /*
      * Server certificate selection
      */
@@ -1746,6 +1803,95 @@ static int ssl_tls13_postprocess_client_hello( mbedtls_ssl_context* ssl )
 
 }
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+/*
+ * RFC 8446 section 4.2.10: accept the early data offered in the ClientHello
+ * if it resumes, with its first PSK identity, a ticket that allows early
+ * data and was issued with the same ALPN protocol, and if no
+ * HelloRetryRequest is needed. Otherwise, set up the record layer to skip
+ * the early data.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_select_early_data( mbedtls_ssl_context *ssl,
+                                        int hrr_required )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+
+    handshake->early_data_discard = MBEDTLS_SSL_EARLY_DATA_NO_DISCARD;
+
+    if( ( handshake->extensions_present & MBEDTLS_SSL_EXT_EARLY_DATA ) == 0 )
+    {
+        /* After a HelloRetryRequest, keep the status of the first
+         * ClientHello. */
+        if( handshake->hello_retry_request_count == 0 )
+            ssl->early_data_status = MBEDTLS_SSL_EARLY_DATA_STATUS_NOT_SENT;
+        return( 0 );
+    }
+
+    ssl->early_data_status = MBEDTLS_SSL_EARLY_DATA_STATUS_REJECTED;
+
+    if( hrr_required )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "EarlyData: rejected, HelloRetryRequest" ) );
+        handshake->early_data_discard =
+            MBEDTLS_SSL_EARLY_DATA_DISCARD_TILL_CLIENT_HELLO;
+        return( 0 );
+    }
+
+    /* A second ClientHello must not offer early data. */
+    if( handshake->hello_retry_request_count > 0 )
+        return( 0 );
+
+    handshake->early_data_discard = MBEDTLS_SSL_EARLY_DATA_DISCARD;
+
+    if( ssl->conf->early_data_enabled != MBEDTLS_SSL_EARLY_DATA_ENABLED ||
+        ( handshake->extensions_present & MBEDTLS_SSL_EXT_PRE_SHARED_KEY ) == 0 ||
+        handshake->resume == 0 ||
+        handshake->selected_identity != 0 ||
+        ssl->session_negotiate->max_early_data_size == 0 )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "EarlyData: rejected, not a 0-RTT "
+                                    "resumption" ) );
+        return( 0 );
+    }
+
+    if( ! handshake->early_data_replay_ok )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "EarlyData: rejected, replay check" ) );
+        return( 0 );
+    }
+
+#if defined(MBEDTLS_SSL_ALPN)
+    {
+        const char *ticket_alpn = ssl->session_negotiate->ticket_alpn;
+
+        if( ( ticket_alpn == NULL ) != ( ssl->alpn_chosen == NULL ) ||
+            ( ticket_alpn != NULL &&
+              strcmp( ticket_alpn, ssl->alpn_chosen ) != 0 ) )
+        {
+            MBEDTLS_SSL_DEBUG_MSG( 2, ( "EarlyData: rejected, ALPN mismatch" ) );
+            return( 0 );
+        }
+    }
+#endif /* MBEDTLS_SSL_ALPN */
+
+    ret = mbedtls_ssl_tls13_compute_early_transform( ssl );
+    if( ret != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_tls13_compute_early_transform",
+                               ret );
+        return( ret );
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "EarlyData: accepted" ) );
+    ssl->early_data_status = MBEDTLS_SSL_EARLY_DATA_STATUS_ACCEPTED;
+    handshake->early_data_discard = MBEDTLS_SSL_EARLY_DATA_NO_DISCARD;
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
 /*
  * Main entry point from the state machine; orchestrates the otherfunctions.
  */
@@ -1775,6 +1921,11 @@ static int ssl_tls13_process_client_hello( mbedtls_ssl_context *ssl )
 
     MBEDTLS_SSL_PROC_CHK( ssl_tls13_postprocess_client_hello( ssl ) );
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    MBEDTLS_SSL_PROC_CHK( ssl_tls13_select_early_data( ssl,
+                parse_client_hello_ret == SSL_CLIENT_HELLO_HRR_REQUIRED ) );
+#endif
+
     if( parse_client_hello_ret == SSL_CLIENT_HELLO_OK )
         mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_SERVER_HELLO );
     else
@@ -2356,6 +2507,17 @@ static int ssl_tls13_write_encrypted_extensions_body( mbedtls_ssl_context *ssl,
     p += output_len;
 #endif /* MBEDTLS_SSL_ALPN */
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    /* The early_data extension is empty in EncryptedExtensions. */
+    if( ssl->early_data_status == MBEDTLS_SSL_EARLY_DATA_STATUS_ACCEPTED )
+    {
+        MBEDTLS_SSL_CHK_BUF_PTR( p, end, 4 );
+        MBEDTLS_PUT_UINT16_BE( MBEDTLS_TLS_EXT_EARLY_DATA, p, 0 );
+        MBEDTLS_PUT_UINT16_BE( 0, p, 2 );
+        p += 4;
+    }
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
     extensions_len = ( p - p_extensions_len ) - 2;
     MBEDTLS_PUT_UINT16_BE( extensions_len, p_extensions_len, 0 );
 
@@ -2601,6 +2763,16 @@ static int ssl_tls13_write_server_finished( mbedtls_ssl_context *ssl )
         return( ret );
     }
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    if( ssl->early_data_status == MBEDTLS_SSL_EARLY_DATA_STATUS_ACCEPTED )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "Switch to early data keys for inbound traffic" ) );
+        mbedtls_ssl_set_inbound_transform( ssl, ssl->handshake->transform_earlydata );
+        mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_END_OF_EARLY_DATA );
+        return( 0 );
+    }
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
     MBEDTLS_SSL_DEBUG_MSG( 1, ( "Switch to handshake keys for inbound traffic" ) );
     mbedtls_ssl_set_inbound_transform( ssl, ssl->handshake->transform_handshake );
 
@@ -2616,6 +2788,98 @@ static int ssl_tls13_write_server_finished( mbedtls_ssl_context *ssl )
     return( 0 );
 }
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+/*
+ * Handler for MBEDTLS_SSL_END_OF_EARLY_DATA
+ *
+ * Hand each early data record to the application, then process the
+ * EndOfEarlyData message:
+ *
+ * struct {} EndOfEarlyData;
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_process_end_of_early_data( mbedtls_ssl_context *ssl )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    /* The application has not read the current early data record yet. */
+    if( ssl->in_offt != NULL )
+        return( MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA );
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> parse end of early data" ) );
+
+    if( ( ret = mbedtls_ssl_read_record( ssl, 0 ) ) != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "mbedtls_ssl_read_record", ret );
+        goto cleanup;
+    }
+
+    if( ssl->in_msgtype == MBEDTLS_SSL_MSG_APPLICATION_DATA )
+    {
+        if( ssl->in_msglen > ssl->session_negotiate->max_early_data_size -
+                             ssl->handshake->early_data_len )
+        {
+            MBEDTLS_SSL_DEBUG_MSG( 1, ( "too much early data" ) );
+            MBEDTLS_SSL_PEND_FATAL_ALERT(
+                MBEDTLS_SSL_ALERT_MSG_UNEXPECTED_MESSAGE,
+                MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE );
+            ret = MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+            goto cleanup;
+        }
+        ssl->handshake->early_data_len += (uint32_t) ssl->in_msglen;
+
+        /* Skip empty records, OpenSSL sends them to randomize the IV. */
+        if( ssl->in_msglen == 0 )
+        {
+            ret = 0;
+            goto cleanup;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG( 3, ( "received %" MBEDTLS_PRINTF_SIZET
+                                    " bytes of early data",
+                                    ssl->in_msglen ) );
+        ssl->in_offt = ssl->in_msg;
+        ret = MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA;
+        goto cleanup;
+    }
+
+    if( ssl->in_msgtype != MBEDTLS_SSL_MSG_HANDSHAKE ||
+        ssl->in_msg[0] != MBEDTLS_SSL_HS_END_OF_EARLY_DATA )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "unexpected message during early data" ) );
+        MBEDTLS_SSL_PEND_FATAL_ALERT( MBEDTLS_SSL_ALERT_MSG_UNEXPECTED_MESSAGE,
+                                      MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE );
+        ret = MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+        goto cleanup;
+    }
+
+    if( ssl->in_hslen != mbedtls_ssl_hs_hdr_len( ssl ) )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "bad end of early data message" ) );
+        MBEDTLS_SSL_PEND_FATAL_ALERT( MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                      MBEDTLS_ERR_SSL_DECODE_ERROR );
+        ret = MBEDTLS_ERR_SSL_DECODE_ERROR;
+        goto cleanup;
+    }
+
+    mbedtls_ssl_add_hs_msg_to_checksum(
+        ssl, MBEDTLS_SSL_HS_END_OF_EARLY_DATA, ssl->in_msg + 4, 0 );
+
+    MBEDTLS_SSL_DEBUG_MSG( 1, ( "Switch to handshake keys for inbound traffic" ) );
+    mbedtls_ssl_set_inbound_transform( ssl, ssl->handshake->transform_handshake );
+
+    if( ssl->handshake->certificate_request_sent )
+        mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_CLIENT_CERTIFICATE );
+    else
+        mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_CLIENT_FINISHED );
+
+cleanup:
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "<= parse end of early data" ) );
+    return( ret );
+}
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
 /*
  * Handler for MBEDTLS_SSL_CLIENT_FINISHED
  */
@@ -2639,6 +2903,22 @@ static int ssl_tls13_process_client_finished( mbedtls_ssl_context *ssl )
     return( 0 );
 }
 
+/*
+ * Free the handshake parameters once the handshake and the NewSessionTicket
+ * messages are over, as the TLS 1.2 handshake does, so that an idle
+ * connection only keeps its session and application transform.
+ */
+static void ssl_tls13_handshake_over( mbedtls_ssl_context *ssl )
+{
+    mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_HANDSHAKE_OVER );
+
+    MBEDTLS_SSL_DEBUG_MSG( 3, ( "=> handshake wrapup: final free" ) );
+    mbedtls_ssl_handshake_free( ssl );
+    mbedtls_free( ssl->handshake );
+    ssl->handshake = NULL;
+    MBEDTLS_SSL_DEBUG_MSG( 3, ( "<= handshake wrapup: final free" ) );
+}
+
 /*
  * Handler for MBEDTLS_SSL_HANDSHAKE_WRAPUP
  */
@@ -2650,9 +2930,18 @@ static int ssl_tls13_handshake_wrapup( mbedtls_ssl_context *ssl )
     mbedtls_ssl_tls13_handshake_wrapup( ssl );
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
-    mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_NEW_SESSION_TICKET );
+    if( ssl->conf->new_session_tickets_mode ==
+        MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 2, ( "NewSessionTicket: deferred to the "
+                                    "first write" ) );
+        ssl->handshake->new_session_tickets_deferred = 1;
+        mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_HANDSHAKE_OVER );
+    }
+    else
+        mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_NEW_SESSION_TICKET );
 #else
-    mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_HANDSHAKE_OVER );
+    ssl_tls13_handshake_over( ssl );
 #endif
     return( 0 );
 }
@@ -2690,91 +2979,6 @@ static int ssl_tls13_write_new_session_ticket_coordinate( mbedtls_ssl_context *s
 }
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_tls13_prepare_new_session_ticket( mbedtls_ssl_context *ssl,
-                                                 unsigned char *ticket_nonce,
-                                                 size_t ticket_nonce_size )
-{
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    mbedtls_ssl_session *session = ssl->session;
-    mbedtls_ssl_ciphersuite_t *ciphersuite_info;
-    psa_algorithm_t psa_hash_alg;
-    int hash_length;
-
-    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> prepare NewSessionTicket msg" ) );
-
-#if defined(MBEDTLS_HAVE_TIME)
-    session->start = mbedtls_time( NULL );
-#endif
-
-    /* Generate ticket_age_add */
-    if( ( ret = ssl->conf->f_rng( ssl->conf->p_rng,
-                                  (unsigned char *) &session->ticket_age_add,
-                                  sizeof( session->ticket_age_add ) ) != 0 ) )
-    {
-        MBEDTLS_SSL_DEBUG_RET( 1, "generate_ticket_age_add", ret );
-        return( ret );
-    }
-    MBEDTLS_SSL_DEBUG_MSG( 3, ( "ticket_age_add: %u",
-                                (unsigned int)session->ticket_age_add ) );
-
-    /* Generate ticket_nonce */
-    ret = ssl->conf->f_rng( ssl->conf->p_rng, ticket_nonce, ticket_nonce_size );
-    if( ret != 0 )
-    {
-        MBEDTLS_SSL_DEBUG_RET( 1, "generate_ticket_nonce", ret );
-        return( ret );
-    }
-    MBEDTLS_SSL_DEBUG_BUF( 3, "ticket_nonce:",
-                           ticket_nonce, ticket_nonce_size );
-
-    ciphersuite_info =
-                (mbedtls_ssl_ciphersuite_t *) ssl->handshake->ciphersuite_info;
-    psa_hash_alg = mbedtls_psa_translate_md( ciphersuite_info->mac );
-    hash_length = PSA_HASH_LENGTH( psa_hash_alg );
-    if( hash_length == -1 ||
-        (size_t)hash_length > sizeof( session->resumption_key ) )
-    {
-        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
-    }
-
-    /* In this code the psk key length equals the length of the hash */
-    session->resumption_key_len = hash_length;
-    session->ciphersuite = ciphersuite_info->id;
-
-    /* Compute resumption key
-     *
-     *  HKDF-Expand-Label( resumption_master_secret,
-     *                    "resumption", ticket_nonce, Hash.length )
-     */
-    ret = mbedtls_ssl_tls13_hkdf_expand_label(
-               psa_hash_alg,
-               session->app_secrets.resumption_master_secret,
-               hash_length,
-               MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN( resumption ),
-               ticket_nonce,
-               ticket_nonce_size,
-               session->resumption_key,
-               hash_length );
-
-    if( ret != 0 )
-    {
-        MBEDTLS_SSL_DEBUG_RET( 2,
-                               "Creating the ticket-resumed PSK failed",
-                               ret );
-        return ( ret );
-    }
-    MBEDTLS_SSL_DEBUG_BUF( 3, "Ticket-resumed PSK",
-                           session->resumption_key,
-                           session->resumption_key_len );
-
-    MBEDTLS_SSL_DEBUG_BUF( 3, "resumption_master_secret",
-                           session->app_secrets.resumption_master_secret,
-                           hash_length );
-
-    return( 0 );
-}
-
 /* This function creates a NewSessionTicket message in the following format:
  *
  * struct {
@@ -2798,44 +3002,38 @@ static int ssl_tls13_prepare_new_session_ticket( mbedtls_ssl_context *ssl,
  *  - key (key)
  *  - key length (key_len)
  *  - ciphersuite (ciphersuite)
+ *
+ * The message is written with its handshake header.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_tls13_write_new_session_ticket_body( mbedtls_ssl_context *ssl,
-                                                    unsigned char *buf,
-                                                    unsigned char *end,
-                                                    size_t *out_len,
-                                                    unsigned char *ticket_nonce,
-                                                    size_t ticket_nonce_size )
+static int ssl_tls13_write_new_session_ticket_msg( mbedtls_ssl_context *ssl,
+                                                   const mbedtls_ssl_session *session,
+                                                   const unsigned char *ticket,
+                                                   size_t ticket_len,
+                                                   uint32_t ticket_lifetime,
+                                                   const unsigned char *ticket_nonce,
+                                                   size_t ticket_nonce_size,
+                                                   unsigned char *buf,
+                                                   unsigned char *end,
+                                                   size_t *out_len )
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    unsigned char *p = buf;
-    mbedtls_ssl_session *session = ssl->session;
-    size_t ticket_len;
-    uint32_t ticket_lifetime;
+    unsigned char *p = buf + 4;
+
+    ((void) ssl);
 
     *out_len = 0;
     MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> write NewSessionTicket msg" ) );
 
     /*
+     *    handshake header  4 bytes
      *    ticket_lifetime   4 bytes
      *    ticket_age_add    4 bytes
      *    ticket_nonce      1 + ticket_nonce_size bytes
-     *    ticket            >=2 bytes
+     *    ticket            2 + ticket_len bytes
      */
-    MBEDTLS_SSL_CHK_BUF_PTR( p, end, 4 + 4 + 1 + ticket_nonce_size + 2 );
-
-    /* Generate ticket and ticket_lifetime */
-    ret = ssl->conf->f_ticket_write( ssl->conf->p_ticket,
-                                     session,
-                                     p + 9 + ticket_nonce_size + 2,
-                                     end,
-                                     &ticket_len,
-                                     &ticket_lifetime);
-    if( ret != 0 )
-    {
-        MBEDTLS_SSL_DEBUG_RET( 1, "write_ticket", ret );
-        return( ret );
-    }
+    MBEDTLS_SSL_CHK_BUF_PTR( buf, end,
+                             4 + 4 + 4 + 1 + ticket_nonce_size + 2 + ticket_len );
+
     /* RFC 8446 4.6.1
      *  ticket_lifetime:  Indicates the lifetime in seconds as a 32-bit
      *      unsigned integer in network byte order from the time of ticket
@@ -2869,17 +3067,38 @@ static int ssl_tls13_write_new_session_ticket_body( mbedtls_ssl_context *ssl,
     /* Write ticket */
     MBEDTLS_PUT_UINT16_BE( ticket_len, p, 0 );
     p += 2;
+    memcpy( p, ticket, ticket_len );
     MBEDTLS_SSL_DEBUG_BUF( 4, "ticket", p, ticket_len);
     p += ticket_len;
 
     /* Ticket Extensions
      *
-     * Note: We currently don't have any extensions.
-     * Set length to zero.
+     * struct {
+     *     uint32 max_early_data_size;
+     * } EarlyDataIndication;
      */
-    MBEDTLS_SSL_CHK_BUF_PTR( p, end, 2 );
-    MBEDTLS_PUT_UINT16_BE( 0, p, 0 );
-    p += 2;
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    if( session->max_early_data_size > 0 )
+    {
+        MBEDTLS_SSL_CHK_BUF_PTR( p, end, 2 + 8 );
+        MBEDTLS_PUT_UINT16_BE( 8, p, 0 );
+        MBEDTLS_PUT_UINT16_BE( MBEDTLS_TLS_EXT_EARLY_DATA, p, 2 );
+        MBEDTLS_PUT_UINT16_BE( 4, p, 4 );
+        MBEDTLS_PUT_UINT32_BE( session->max_early_data_size, p, 6 );
+        MBEDTLS_SSL_DEBUG_MSG( 3, ( "max_early_data_size: %u",
+                                    (unsigned) session->max_early_data_size ) );
+        p += 2 + 8;
+    }
+    else
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+    {
+        MBEDTLS_SSL_CHK_BUF_PTR( p, end, 2 );
+        MBEDTLS_PUT_UINT16_BE( 0, p, 0 );
+        p += 2;
+    }
+
+    buf[0] = MBEDTLS_SSL_HS_NEW_SESSION_TICKET;
+    MBEDTLS_PUT_UINT24_BE( p - buf - 4, buf, 1 );
 
     *out_len = p - buf;
     MBEDTLS_SSL_DEBUG_BUF( 4, "ticket", buf, *out_len );
@@ -2889,54 +3108,322 @@ static int ssl_tls13_write_new_session_ticket_body( mbedtls_ssl_context *ssl,
 }
 
 /*
- * Handler for MBEDTLS_SSL_NEW_SESSION_TICKET
+ * Generate all the NewSessionTicket messages of the connection at once.
+ *
+ * The tickets only differ by their ticket_age_add, nonce and resumption
+ * key: the rest of the session is prepared once, the random values are
+ * drawn in one call and the tickets are written with the batch callback
+ * if there is one. The messages are stored in handshake->new_session_tickets.
  */
-static int ssl_tls13_write_new_session_ticket( mbedtls_ssl_context *ssl )
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_prepare_new_session_tickets( mbedtls_ssl_context *ssl )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+    mbedtls_ssl_session *session = ssl->session;
+    mbedtls_ssl_session *sessions = NULL;
+    const size_t nonce_len = MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH;
+    const size_t count = handshake->new_session_tickets_count;
+    unsigned char *random = NULL;
+    size_t *tlens = NULL;
+    mbedtls_ssl_ciphersuite_t *ciphersuite_info;
+    psa_algorithm_t psa_hash_alg;
+    int hash_length;
+    uint32_t ticket_lifetime = 0;
+    size_t done, i;
 
-    MBEDTLS_SSL_PROC_CHK_NEG( ssl_tls13_write_new_session_ticket_coordinate( ssl ) );
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "=> prepare NewSessionTicket msg" ) );
 
-    if( ret == SSL_NEW_SESSION_TICKET_WRITE )
+#if defined(MBEDTLS_HAVE_TIME)
+    session->start = mbedtls_time( NULL );
+#endif
+
+    ciphersuite_info =
+                (mbedtls_ssl_ciphersuite_t *) handshake->ciphersuite_info;
+    psa_hash_alg = mbedtls_psa_translate_md( ciphersuite_info->mac );
+    hash_length = PSA_HASH_LENGTH( psa_hash_alg );
+    if( hash_length == -1 ||
+        (size_t)hash_length > sizeof( session->resumption_key ) )
     {
-        unsigned char ticket_nonce[MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH];
-        unsigned char *buf;
-        size_t buf_len, msg_len;
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+    }
 
-        MBEDTLS_SSL_PROC_CHK( ssl_tls13_prepare_new_session_ticket(
-                                  ssl, ticket_nonce, sizeof( ticket_nonce ) ) );
+    /* In this code the psk key length equals the length of the hash */
+    session->resumption_key_len = hash_length;
+    session->ciphersuite = ciphersuite_info->id;
 
-        MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_start_handshake_msg( ssl,
-                MBEDTLS_SSL_HS_NEW_SESSION_TICKET, &buf, &buf_len ) );
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    session->max_early_data_size = 0;
+    if( ssl->conf->early_data_enabled == MBEDTLS_SSL_EARLY_DATA_ENABLED )
+        session->max_early_data_size = ssl->conf->max_early_data_size;
+#if defined(MBEDTLS_SSL_ALPN)
+    ret = mbedtls_ssl_session_set_ticket_alpn( session, ssl->alpn_chosen );
+    if( ret != 0 )
+        return( ret );
+#endif
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
+    MBEDTLS_SSL_DEBUG_BUF( 3, "resumption_master_secret",
+                           session->app_secrets.resumption_master_secret,
+                           hash_length );
 
-        MBEDTLS_SSL_PROC_CHK( ssl_tls13_write_new_session_ticket_body(
-                                  ssl, buf, buf + buf_len, &msg_len,
-                                  ticket_nonce, sizeof( ticket_nonce ) ) );
+    sessions = mbedtls_calloc( count, sizeof( mbedtls_ssl_session ) );
+    tlens = mbedtls_calloc( count, sizeof( size_t ) );
+    random = mbedtls_calloc( count, 4 + nonce_len );
+    if( sessions == NULL || tlens == NULL || random == NULL )
+    {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto cleanup;
+    }
 
-        MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_finish_handshake_msg(
-                                  ssl, buf_len, msg_len ) );
+    /* Generate ticket_age_add and ticket_nonce of all tickets */
+    ret = ssl->conf->f_rng( ssl->conf->p_rng, random, count * ( 4 + nonce_len ) );
+    if( ret != 0 )
+    {
+        MBEDTLS_SSL_DEBUG_RET( 1, "generate ticket_age_add and ticket_nonce",
+                               ret );
+        goto cleanup;
+    }
 
-        /* Limit session tickets count to one when resumption connection.
+    for( i = 0; i < count; i++ )
+    {
+        const unsigned char *nonce = random + i * ( 4 + nonce_len ) + 4;
+
+        /* Shallow copies: they share the pointers of ssl->session and are
+         * only read by the ticket callbacks, never freed. */
+        memcpy( &sessions[i], session, sizeof( mbedtls_ssl_session ) );
+        sessions[i].ticket_age_add =
+            MBEDTLS_GET_UINT32_BE( random, i * ( 4 + nonce_len ) );
+        MBEDTLS_SSL_DEBUG_MSG( 3, ( "ticket_age_add: %u",
+                                    (unsigned int) sessions[i].ticket_age_add ) );
+        MBEDTLS_SSL_DEBUG_BUF( 3, "ticket_nonce:", nonce, nonce_len );
+
+        /* Compute resumption key
          *
-         * See document of mbedtls_ssl_conf_new_session_tickets.
+         *  HKDF-Expand-Label( resumption_master_secret,
+         *                    "resumption", ticket_nonce, Hash.length )
          */
-        if( ssl->handshake->resume == 1 )
-            ssl->handshake->new_session_tickets_count = 0;
+        ret = mbedtls_ssl_tls13_hkdf_expand_label(
+                   psa_hash_alg,
+                   session->app_secrets.resumption_master_secret,
+                   hash_length,
+                   MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN( resumption ),
+                   nonce, nonce_len,
+                   sessions[i].resumption_key,
+                   hash_length );
+        if( ret != 0 )
+        {
+            MBEDTLS_SSL_DEBUG_RET( 2,
+                                   "Creating the ticket-resumed PSK failed",
+                                   ret );
+            goto cleanup;
+        }
+        MBEDTLS_SSL_DEBUG_BUF( 3, "Ticket-resumed PSK",
+                               sessions[i].resumption_key,
+                               sessions[i].resumption_key_len );
+    }
+
+    /* Write the tickets in the output buffer, which is free at this point,
+     * then append the messages carrying them to the batch. */
+    for( done = 0; done < count; )
+    {
+        unsigned char *tickets = ssl->out_msg;
+        const unsigned char *tickets_end = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN;
+        unsigned char *batch, *p;
+        size_t n, batch_len;
+
+        if( ssl->conf->f_ticket_write_batch != NULL )
+        {
+            ret = ssl->conf->f_ticket_write_batch( ssl->conf->p_ticket,
+                                                   sessions + done,
+                                                   count - done,
+                                                   tickets, tickets_end,
+                                                   tlens + done,
+                                                   &ticket_lifetime );
+            if( ret < 0 )
+            {
+                MBEDTLS_SSL_DEBUG_RET( 1, "write_ticket_batch", ret );
+                goto cleanup;
+            }
+            n = (size_t) ret;
+        }
         else
-            ssl->handshake->new_session_tickets_count--;
+        {
+            ret = ssl->conf->f_ticket_write( ssl->conf->p_ticket,
+                                             sessions + done,
+                                             tickets, tickets_end,
+                                             tlens + done,
+                                             &ticket_lifetime );
+            if( ret != 0 )
+            {
+                MBEDTLS_SSL_DEBUG_RET( 1, "write_ticket", ret );
+                goto cleanup;
+            }
+            n = 1;
+        }
+
+        if( n == 0 || n > count - done )
+        {
+            ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+            goto cleanup;
+        }
+
+        /* handshake header, lifetime, age_add, nonce, ticket, extensions */
+        batch_len = handshake->new_session_tickets_len;
+        for( i = done; i < done + n; i++ )
+            batch_len += 4 + 4 + 4 + 1 + nonce_len + 2 + tlens[i] + 2 + 8;
+
+        batch = mbedtls_calloc( 1, batch_len );
+        if( batch == NULL )
+        {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto cleanup;
+        }
+        if( handshake->new_session_tickets != NULL )
+        {
+            memcpy( batch, handshake->new_session_tickets,
+                    handshake->new_session_tickets_len );
+            mbedtls_free( handshake->new_session_tickets );
+        }
+        handshake->new_session_tickets = batch;
+        p = batch + handshake->new_session_tickets_len;
+
+        for( i = done; i < done + n; i++ )
+        {
+            size_t msg_len;
+
+            ret = ssl_tls13_write_new_session_ticket_msg(
+                      ssl, &sessions[i], tickets, tlens[i], ticket_lifetime,
+                      random + i * ( 4 + nonce_len ) + 4, nonce_len,
+                      p, batch + batch_len, &msg_len );
+            if( ret != 0 )
+                goto cleanup;
 
-        mbedtls_ssl_handshake_set_state( ssl,
-                                         MBEDTLS_SSL_NEW_SESSION_TICKET_FLUSH );
+            tickets += tlens[i];
+            p += msg_len;
+        }
+        handshake->new_session_tickets_len = p - batch;
+        done += n;
     }
-    else
+
+    ret = 0;
+
+cleanup:
+    if( sessions != NULL )
     {
-        mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_HANDSHAKE_OVER );
+        mbedtls_platform_zeroize( sessions,
+                                  count * sizeof( mbedtls_ssl_session ) );
+        mbedtls_free( sessions );
+    }
+    mbedtls_free( tlens );
+    mbedtls_free( random );
+
+    return( ret );
+}
+
+/*
+ * Send as many of the pending NewSessionTicket messages as fit in one
+ * record. TLS 1.3 lets a record carry several handshake messages.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_new_session_ticket_record( mbedtls_ssl_context *ssl )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+    const unsigned char *p = handshake->new_session_tickets +
+                             handshake->new_session_tickets_sent;
+    const unsigned char *end = handshake->new_session_tickets +
+                               handshake->new_session_tickets_len;
+    size_t len = 0, msg_len;
+    int max_len;
+
+    max_len = mbedtls_ssl_get_max_out_record_payload( ssl );
+    if( max_len < 0 )
+        return( max_len );
+
+    while( end - p >= 4 && handshake->new_session_tickets_count > 0 )
+    {
+        msg_len = 4 + MBEDTLS_GET_UINT24_BE( p, 1 );
+        if( msg_len > (size_t)( end - p ) ||
+            len + msg_len > (size_t) max_len )
+        {
+            break;
+        }
+
+        p += msg_len;
+        len += msg_len;
+        handshake->new_session_tickets_count--;
+    }
+
+    if( len == 0 )
+    {
+        MBEDTLS_SSL_DEBUG_MSG( 1, ( "NewSessionTicket does not fit in a record" ) );
+        return( MBEDTLS_ERR_SSL_INTERNAL_ERROR );
+    }
+
+    memcpy( ssl->out_msg, handshake->new_session_tickets +
+                          handshake->new_session_tickets_sent, len );
+    ssl->out_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
+    ssl->out_msglen = len;
+    handshake->new_session_tickets_sent += len;
+
+    MBEDTLS_SSL_PROC_CHK( mbedtls_ssl_write_record( ssl, 0 ) );
+
+cleanup:
+    return( ret );
+}
+
+/*
+ * Handler for MBEDTLS_SSL_NEW_SESSION_TICKET
+ */
+static int ssl_tls13_write_new_session_ticket( mbedtls_ssl_context *ssl )
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if( ssl->handshake->new_session_tickets == NULL )
+    {
+        MBEDTLS_SSL_PROC_CHK_NEG(
+            ssl_tls13_write_new_session_ticket_coordinate( ssl ) );
+
+        if( ret == SSL_NEW_SESSION_TICKET_SKIP )
+        {
+            ssl_tls13_handshake_over( ssl );
+            return( 0 );
+        }
+
+        /* Limit session tickets count to one when resumption connection.
+         *
+         * See document of mbedtls_ssl_conf_new_session_tickets.
+         */
+        if( ssl->handshake->resume == 1 )
+            ssl->handshake->new_session_tickets_count = 1;
+
+        MBEDTLS_SSL_PROC_CHK( ssl_tls13_prepare_new_session_tickets( ssl ) );
     }
 
+    MBEDTLS_SSL_PROC_CHK( ssl_tls13_write_new_session_ticket_record( ssl ) );
+
+    mbedtls_ssl_handshake_set_state( ssl,
+                                     MBEDTLS_SSL_NEW_SESSION_TICKET_FLUSH );
+
 cleanup:
 
     return( ret );
 }
+
+void mbedtls_ssl_tls13_resume_deferred_tickets( mbedtls_ssl_context *ssl )
+{
+    if( ssl->conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        ssl->handshake == NULL ||
+        ssl->handshake->new_session_tickets_deferred == 0 )
+    {
+        return;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG( 2, ( "NewSessionTicket: sending deferred tickets" ) );
+    ssl->handshake->new_session_tickets_deferred = 0;
+    mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_NEW_SESSION_TICKET );
+}
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
 
 /*
@@ -3024,6 +3511,12 @@ int mbedtls_ssl_tls13_handshake_server_step( mbedtls_ssl_context *ssl )
             ret = ssl_tls13_write_server_finished( ssl );
             break;
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+        case MBEDTLS_SSL_END_OF_EARLY_DATA:
+            ret = ssl_tls13_process_end_of_early_data( ssl );
+            break;
+#endif /* MBEDTLS_SSL_EARLY_DATA */
+
         case MBEDTLS_SSL_CLIENT_FINISHED:
             ret = ssl_tls13_process_client_finished( ssl );
             break;
@@ -3079,7 +3572,7 @@ int mbedtls_ssl_tls13_handshake_server_step( mbedtls_ssl_context *ssl )
             ret = 0;
 
             if( ssl->handshake->new_session_tickets_count == 0 )
-                mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_HANDSHAKE_OVER );
+                ssl_tls13_handshake_over( ssl );
             else
                 mbedtls_ssl_handshake_set_state( ssl, MBEDTLS_SSL_NEW_SESSION_TICKET );
             break;
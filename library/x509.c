@@ -32,6 +32,7 @@
 #if defined(MBEDTLS_X509_USE_C)
 
 #include "mbedtls/x509.h"
+#include "x509_internal.h"
 #include "mbedtls/asn1.h"
 #include "mbedtls/error.h"
 #include "mbedtls/oid.h"
@@ -467,6 +468,17 @@ static int x509_get_attr_type_value( unsigned char **p,
  */
 int mbedtls_x509_get_name( unsigned char **p, const unsigned char *end,
                    mbedtls_x509_name *cur )
+{
+    return( mbedtls_x509_get_name_arena( p, end, cur, NULL ) );
+}
+
+/*
+ * Same as mbedtls_x509_get_name(), but take the list elements from arena
+ * when it is not NULL. They are then owned by the arena, also on error.
+ */
+int mbedtls_x509_get_name_arena( unsigned char **p, const unsigned char *end,
+                                 mbedtls_x509_name *cur,
+                                 mbedtls_x509_arena *arena )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     size_t set_len;
@@ -500,7 +512,8 @@ int mbedtls_x509_get_name( unsigned char **p, const unsigned char *end,
             /* Mark this item as being no the only one in a set */
             cur->next_merged = 1;
 
-            cur->next = mbedtls_calloc( 1, sizeof( mbedtls_x509_name ) );
+            cur->next = mbedtls_x509_arena_calloc( arena,
+                                                   sizeof( mbedtls_x509_name ) );
 
             if( cur->next == NULL )
             {
@@ -517,7 +530,8 @@ int mbedtls_x509_get_name( unsigned char **p, const unsigned char *end,
         if( *p == end )
             return( 0 );
 
-        cur->next = mbedtls_calloc( 1, sizeof( mbedtls_x509_name ) );
+        cur->next = mbedtls_x509_arena_calloc( arena,
+                                               sizeof( mbedtls_x509_name ) );
 
         if( cur->next == NULL )
         {
@@ -532,7 +546,7 @@ error:
     /* Skip the first element as we did not allocate it */
     allocated = head->next;
 
-    while( allocated != NULL )
+    while( arena == NULL && allocated != NULL )
     {
         prev = allocated;
         allocated = allocated->next;
@@ -546,6 +560,163 @@ error:
     return( ret );
 }
 
+/*
+ * Arena blocks are carved into structures holding pointers and size_t
+ * fields, so keep every allocation aligned to the widest of those.
+ */
+#define X509_ARENA_ALIGN        8
+#define X509_ARENA_ROUND( n )   \
+    ( ( ( n ) + X509_ARENA_ALIGN - 1 ) & ~( (size_t) X509_ARENA_ALIGN - 1 ) )
+
+/* Default minimum block size, enough for a typical certificate's fields */
+#define X509_ARENA_DEFAULT_BLOCK_SIZE   1024
+
+typedef struct x509_arena_block
+{
+    struct x509_arena_block *prev;  /* Block allocated before this one   */
+    size_t base;                    /* Arena offset of the first byte    */
+    size_t size;                    /* Usable bytes after the header     */
+    size_t used;                    /* Bytes handed out from this block  */
+}
+x509_arena_block;
+
+#define X509_ARENA_BLOCK_HDR    X509_ARENA_ROUND( sizeof( x509_arena_block ) )
+
+/*
+ * Memory is handed out in increasing offset order from the newest block.
+ * Bytes that are not handed out are always zero, which gives calloc()
+ * semantics without clearing on each allocation.
+ */
+struct mbedtls_x509_arena
+{
+    x509_arena_block *head;         /* Newest block, or NULL             */
+    size_t block_size;              /* Minimum size of a new block       */
+};
+
+mbedtls_x509_arena *mbedtls_x509_arena_new( size_t block_size )
+{
+    mbedtls_x509_arena *arena;
+
+    arena = mbedtls_calloc( 1, sizeof( mbedtls_x509_arena ) );
+    if( arena == NULL )
+        return( NULL );
+
+    arena->block_size = block_size != 0 ? block_size :
+                                          X509_ARENA_DEFAULT_BLOCK_SIZE;
+    return( arena );
+}
+
+static void x509_arena_block_free( x509_arena_block *block )
+{
+    mbedtls_platform_zeroize( (unsigned char *) block + X509_ARENA_BLOCK_HDR,
+                              block->used );
+    mbedtls_platform_zeroize( block, sizeof( x509_arena_block ) );
+    mbedtls_free( block );
+}
+
+void mbedtls_x509_arena_free( mbedtls_x509_arena *arena )
+{
+    x509_arena_block *block;
+
+    if( arena == NULL )
+        return;
+
+    while( ( block = arena->head ) != NULL )
+    {
+        arena->head = block->prev;
+        x509_arena_block_free( block );
+    }
+
+    mbedtls_platform_zeroize( arena, sizeof( mbedtls_x509_arena ) );
+    mbedtls_free( arena );
+}
+
+/*
+ * Make sure the next len bytes can be served without another allocation.
+ */
+int mbedtls_x509_arena_reserve( mbedtls_x509_arena *arena, size_t len )
+{
+    x509_arena_block *block = arena->head;
+    size_t size;
+
+    if( block != NULL && block->size - block->used >= len )
+        return( 0 );
+
+    size = len > arena->block_size ? len : arena->block_size;
+    if( size > (size_t) -1 - X509_ARENA_BLOCK_HDR - X509_ARENA_ALIGN )
+        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+    size = X509_ARENA_ROUND( size );
+
+    block = mbedtls_calloc( 1, X509_ARENA_BLOCK_HDR + size );
+    if( block == NULL )
+        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+
+    block->prev = arena->head;
+    block->base = mbedtls_x509_arena_offset( arena );
+    block->size = size;
+    arena->head = block;
+
+    return( 0 );
+}
+
+/*
+ * Return len zeroed bytes, or fall back to the heap when arena is NULL so
+ * that parsing code can use a single call for both cases.
+ */
+void *mbedtls_x509_arena_calloc( mbedtls_x509_arena *arena, size_t len )
+{
+    x509_arena_block *block;
+    void *ptr;
+
+    if( arena == NULL )
+        return( mbedtls_calloc( 1, len ) );
+
+    if( len == 0 || len > (size_t) -1 - X509_ARENA_ALIGN )
+        return( NULL );
+    len = X509_ARENA_ROUND( len );
+
+    if( mbedtls_x509_arena_reserve( arena, len ) != 0 )
+        return( NULL );
+
+    block = arena->head;
+    ptr = (unsigned char *) block + X509_ARENA_BLOCK_HDR + block->used;
+    block->used += len;
+
+    return( ptr );
+}
+
+/*
+ * Offsets grow monotonically with each allocation and can be used to
+ * release everything allocated after a given point.
+ */
+size_t mbedtls_x509_arena_offset( const mbedtls_x509_arena *arena )
+{
+    if( arena->head == NULL )
+        return( 0 );
+
+    return( arena->head->base + arena->head->used );
+}
+
+void mbedtls_x509_arena_rewind( mbedtls_x509_arena *arena, size_t offset )
+{
+    x509_arena_block *block;
+    size_t keep;
+
+    while( ( block = arena->head ) != NULL && block->base > offset )
+    {
+        arena->head = block->prev;
+        x509_arena_block_free( block );
+    }
+
+    if( block == NULL || block->base + block->used <= offset )
+        return;
+
+    keep = offset - block->base;
+    mbedtls_platform_zeroize( (unsigned char *) block + X509_ARENA_BLOCK_HDR +
+                              keep, block->used - keep );
+    block->used = keep;
+}
+
 static int x509_parse_int( unsigned char **p, size_t n, int *res )
 {
     *res = 0;
@@ -36,6 +36,7 @@
 #include "mbedtls/oid.h"
 #include "mbedtls/platform_util.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #if defined(MBEDTLS_PEM_PARSE_C)
@@ -217,16 +218,44 @@ static int x509_get_crl_entry_ext( unsigned char **p,
     return( 0 );
 }
 
+/*
+ * Order CRL entries by serial number: shorter serials first, then
+ * lexicographically. Any total order works, as long as lookups use the
+ * same one.
+ */
+static int x509_crl_serial_cmp( const mbedtls_x509_buf *a,
+                                const mbedtls_x509_buf *b )
+{
+    if( a->len != b->len )
+        return( a->len < b->len ? -1 : 1 );
+
+    return( memcmp( a->p, b->p, a->len ) );
+}
+
+static int x509_crl_entry_cmp( const void *a, const void *b )
+{
+    const mbedtls_x509_crl_entry *ea = *(const mbedtls_x509_crl_entry **) a;
+    const mbedtls_x509_crl_entry *eb = *(const mbedtls_x509_crl_entry **) b;
+
+    return( x509_crl_serial_cmp( &ea->serial, &eb->serial ) );
+}
+
 /*
  * X.509 CRL Entries
+ *
+ * The first entry is stored in crl->entry, the following ones in a single
+ * array crl->entries, linked together so that the list can still be walked
+ * through the next pointers.
  */
 static int x509_get_entries( unsigned char **p,
                              const unsigned char *end,
-                             mbedtls_x509_crl_entry *entry )
+                             mbedtls_x509_crl *crl )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     size_t entry_len;
-    mbedtls_x509_crl_entry *cur_entry = entry;
+    size_t count, i;
+    unsigned char *q;
+    mbedtls_x509_crl_entry *cur_entry = &crl->entry;
 
     if( *p == end )
         return( 0 );
@@ -242,11 +271,43 @@ static int x509_get_entries( unsigned char **p,
 
     end = *p + entry_len;
 
-    while( *p < end )
+    /*
+     * Count the entries first so that they can be allocated at once.
+     */
+    for( count = 0, q = *p; q < end; count++ )
+    {
+        size_t len2;
+
+        if( ( ret = mbedtls_asn1_get_tag( &q, end, &len2,
+                MBEDTLS_ASN1_SEQUENCE | MBEDTLS_ASN1_CONSTRUCTED ) ) != 0 )
+        {
+            return( ret );
+        }
+
+        q += len2;
+    }
+
+    if( count > 1 )
+    {
+        crl->entries = mbedtls_calloc( count - 1,
+                                       sizeof( mbedtls_x509_crl_entry ) );
+        if( crl->entries == NULL )
+            return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+    }
+
+    crl->entry_count = count;
+
+    for( i = 0; i < count; i++ )
     {
         size_t len2;
         const unsigned char *end2;
 
+        if( i > 0 )
+        {
+            cur_entry->next = &crl->entries[i - 1];
+            cur_entry = cur_entry->next;
+        }
+
         cur_entry->raw.tag = **p;
         if( ( ret = mbedtls_asn1_get_tag( p, end, &len2,
                 MBEDTLS_ASN1_SEQUENCE | MBEDTLS_ASN1_CONSTRUCTED ) ) != 0 )
@@ -268,16 +329,24 @@ static int x509_get_entries( unsigned char **p,
         if( ( ret = x509_get_crl_entry_ext( p, end2,
                                             &cur_entry->entry_ext ) ) != 0 )
             return( ret );
+    }
 
-        if( *p < end )
-        {
-            cur_entry->next = mbedtls_calloc( 1, sizeof( mbedtls_x509_crl_entry ) );
+    /*
+     * Build the index of serial numbers for mbedtls_x509_crl_find_entry().
+     */
+    if( count > 0 )
+    {
+        crl->serial_index = mbedtls_calloc( count,
+                                    sizeof( const mbedtls_x509_crl_entry * ) );
+        if( crl->serial_index == NULL )
+            return( MBEDTLS_ERR_X509_ALLOC_FAILED );
 
-            if( cur_entry->next == NULL )
-                return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+        crl->serial_index[0] = &crl->entry;
+        for( i = 1; i < count; i++ )
+            crl->serial_index[i] = &crl->entries[i - 1];
 
-            cur_entry = cur_entry->next;
-        }
+        qsort( crl->serial_index, count,
+               sizeof( const mbedtls_x509_crl_entry * ), x509_crl_entry_cmp );
     }
 
     return( 0 );
@@ -456,7 +525,7 @@ int mbedtls_x509_crl_parse_der( mbedtls_x509_crl *chain,
      *                                   -- if present, MUST be v2
      *                        } OPTIONAL
      */
-    if( ( ret = x509_get_entries( &p, end, &crl->entry ) ) != 0 )
+    if( ( ret = x509_get_entries( &p, end, crl ) ) != 0 )
     {
         mbedtls_x509_crl_free( crl );
         return( ret );
@@ -608,6 +677,36 @@ int mbedtls_x509_crl_parse_file( mbedtls_x509_crl *chain, const char *path )
 }
 #endif /* MBEDTLS_FS_IO */
 
+/*
+ * Look up a serial number in the index of a CRL
+ */
+const mbedtls_x509_crl_entry *mbedtls_x509_crl_find_entry(
+                                        const mbedtls_x509_crl *crl,
+                                        const mbedtls_x509_buf *serial )
+{
+    size_t lo = 0, hi = crl->entry_count;
+
+    if( crl->serial_index == NULL )
+        return( NULL );
+
+    while( lo < hi )
+    {
+        size_t mid = lo + ( hi - lo ) / 2;
+        int cmp = x509_crl_serial_cmp( serial,
+                                       &crl->serial_index[mid]->serial );
+
+        if( cmp == 0 )
+            return( crl->serial_index[mid] );
+
+        if( cmp < 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+    return( NULL );
+}
+
 #if !defined(MBEDTLS_X509_REMOVE_INFO)
 /*
  * Return an informational string about the certificate.
@@ -707,8 +806,6 @@ void mbedtls_x509_crl_free( mbedtls_x509_crl *crl )
     mbedtls_x509_crl *crl_prv;
     mbedtls_x509_name *name_cur;
     mbedtls_x509_name *name_prv;
-    mbedtls_x509_crl_entry *entry_cur;
-    mbedtls_x509_crl_entry *entry_prv;
 
     if( crl == NULL )
         return;
@@ -728,16 +825,16 @@ void mbedtls_x509_crl_free( mbedtls_x509_crl *crl )
             mbedtls_free( name_prv );
         }
 
-        entry_cur = crl_cur->entry.next;
-        while( entry_cur != NULL )
+        if( crl_cur->entries != NULL )
         {
-            entry_prv = entry_cur;
-            entry_cur = entry_cur->next;
-            mbedtls_platform_zeroize( entry_prv,
+            mbedtls_platform_zeroize( crl_cur->entries,
+                                      ( crl_cur->entry_count - 1 ) *
                                       sizeof( mbedtls_x509_crl_entry ) );
-            mbedtls_free( entry_prv );
+            mbedtls_free( crl_cur->entries );
         }
 
+        mbedtls_free( crl_cur->serial_index );
+
         if( crl_cur->raw.p != NULL )
         {
             mbedtls_platform_zeroize( crl_cur->raw.p, crl_cur->raw.len );
@@ -34,6 +34,7 @@
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 
 #include "mbedtls/x509_crt.h"
+#include "x509_internal.h"
 #include "mbedtls/error.h"
 #include "mbedtls/oid.h"
 #include "mbedtls/platform_util.h"
@@ -590,6 +591,43 @@ static int x509_get_key_usage( unsigned char **p,
     return( 0 );
 }
 
+typedef struct
+{
+    mbedtls_x509_sequence *cur;
+    mbedtls_x509_arena *arena;
+} x509_get_sequence_of_ctx;
+
+/*
+ * Equivalent of the mbedtls_asn1_get_sequence_of() callback, taking list
+ * elements from the certificate's arena when it has one.
+ */
+static int x509_get_sequence_of_cb( void *ctx,
+                                    int tag,
+                                    unsigned char *start,
+                                    size_t len )
+{
+    x509_get_sequence_of_ctx *seq_ctx = (x509_get_sequence_of_ctx *) ctx;
+    mbedtls_x509_sequence *cur = seq_ctx->cur;
+
+    if( cur->buf.p != NULL )
+    {
+        cur->next = mbedtls_x509_arena_calloc( seq_ctx->arena,
+                                               sizeof( mbedtls_x509_sequence ) );
+
+        if( cur->next == NULL )
+            return( MBEDTLS_ERR_ASN1_ALLOC_FAILED );
+
+        cur = cur->next;
+    }
+
+    cur->buf.p = start;
+    cur->buf.len = len;
+    cur->buf.tag = tag;
+
+    seq_ctx->cur = cur;
+    return( 0 );
+}
+
 /*
  * ExtKeyUsageSyntax ::= SEQUENCE SIZE (1..MAX) OF KeyPurposeId
  *
@@ -597,11 +635,16 @@ static int x509_get_key_usage( unsigned char **p,
  */
 static int x509_get_ext_key_usage( unsigned char **p,
                                const unsigned char *end,
-                               mbedtls_x509_sequence *ext_key_usage)
+                               mbedtls_x509_sequence *ext_key_usage,
+                               mbedtls_x509_arena *arena )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    x509_get_sequence_of_ctx seq_ctx = { ext_key_usage, arena };
 
-    if( ( ret = mbedtls_asn1_get_sequence_of( p, end, ext_key_usage, MBEDTLS_ASN1_OID ) ) != 0 )
+    memset( ext_key_usage, 0, sizeof( mbedtls_x509_sequence ) );
+    if( ( ret = mbedtls_asn1_traverse_sequence_of( p, end, 0xFF,
+                    MBEDTLS_ASN1_OID, 0, 0,
+                    x509_get_sequence_of_cb, &seq_ctx ) ) != 0 )
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_EXTENSIONS, ret ) );
 
     /* Sequence length must be >= 1 */
@@ -641,7 +684,8 @@ static int x509_get_ext_key_usage( unsigned char **p,
  */
 static int x509_get_subject_alt_name( unsigned char **p,
                                       const unsigned char *end,
-                                      mbedtls_x509_sequence *subject_alt_name )
+                                      mbedtls_x509_sequence *subject_alt_name,
+                                      mbedtls_x509_arena *arena )
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     size_t len, tag_len;
@@ -687,7 +731,7 @@ static int x509_get_subject_alt_name( unsigned char **p,
         {
             mbedtls_x509_sequence *seq_cur = subject_alt_name->next;
             mbedtls_x509_sequence *seq_prv;
-            while( seq_cur != NULL )
+            while( arena == NULL && seq_cur != NULL )
             {
                 seq_prv = seq_cur;
                 seq_cur = seq_cur->next;
@@ -705,7 +749,8 @@ static int x509_get_subject_alt_name( unsigned char **p,
             if( cur->next != NULL )
                 return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS );
 
-            cur->next = mbedtls_calloc( 1, sizeof( mbedtls_asn1_sequence ) );
+            cur->next = mbedtls_x509_arena_calloc( arena,
+                                            sizeof( mbedtls_asn1_sequence ) );
 
             if( cur->next == NULL )
                 return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_EXTENSIONS,
@@ -782,7 +827,8 @@ static int x509_get_subject_alt_name( unsigned char **p,
  */
 static int x509_get_certificate_policies( unsigned char **p,
                                           const unsigned char *end,
-                                          mbedtls_x509_sequence *certificate_policies )
+                                          mbedtls_x509_sequence *certificate_policies,
+                                          mbedtls_x509_arena *arena )
 {
     int ret, parse_ret = 0;
     size_t len;
@@ -846,7 +892,8 @@ static int x509_get_certificate_policies( unsigned char **p,
             if( cur->next != NULL )
                 return( MBEDTLS_ERR_X509_INVALID_EXTENSIONS );
 
-            cur->next = mbedtls_calloc( 1, sizeof( mbedtls_asn1_sequence ) );
+            cur->next = mbedtls_x509_arena_calloc( arena,
+                                            sizeof( mbedtls_asn1_sequence ) );
 
             if( cur->next == NULL )
                 return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_EXTENSIONS,
@@ -1011,14 +1058,14 @@ static int x509_get_crt_ext( unsigned char **p,
         case MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE:
             /* Parse extended key usage */
             if( ( ret = x509_get_ext_key_usage( p, end_ext_octet,
-                    &crt->ext_key_usage ) ) != 0 )
+                    &crt->ext_key_usage, crt->arena ) ) != 0 )
                 return( ret );
             break;
 
         case MBEDTLS_X509_EXT_SUBJECT_ALT_NAME:
             /* Parse subject alt name */
             if( ( ret = x509_get_subject_alt_name( p, end_ext_octet,
-                    &crt->subject_alt_names ) ) != 0 )
+                    &crt->subject_alt_names, crt->arena ) ) != 0 )
                 return( ret );
             break;
 
@@ -1032,7 +1079,7 @@ static int x509_get_crt_ext( unsigned char **p,
         case MBEDTLS_OID_X509_EXT_CERTIFICATE_POLICIES:
             /* Parse certificate policies type */
             if( ( ret = x509_get_certificate_policies( p, end_ext_octet,
-                    &crt->certificate_policies ) ) != 0 )
+                    &crt->certificate_policies, crt->arena ) ) != 0 )
             {
                 /* Give the callback (if any) a chance to handle the extension
                  * if it contains unsupported policies */
@@ -1075,6 +1122,32 @@ static int x509_get_crt_ext( unsigned char **p,
     return( 0 );
 }
 
+/* Room left after the certificate itself for its names and sequences */
+#define X509_CRT_ARENA_HEADROOM     1024
+
+/*
+ * Undo a failed x509_crt_parse_der_core() on the last certificate of a chain.
+ * Memory taken from an arena is left for the caller to rewind, and the
+ * certificate stays attached to its arena.
+ */
+static void x509_crt_parse_cleanup( mbedtls_x509_crt *crt )
+{
+    mbedtls_x509_arena *arena = crt->arena;
+
+    if( arena == NULL )
+    {
+        mbedtls_x509_crt_free( crt );
+        return;
+    }
+
+    mbedtls_pk_free( &crt->pk );
+#if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
+    mbedtls_free( crt->sig_opts );
+#endif
+    mbedtls_platform_zeroize( crt, sizeof( mbedtls_x509_crt ) );
+    crt->arena = arena;
+}
+
 /*
  * Parse and fill a single X.509 certificate in DER format
  */
@@ -1114,7 +1187,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
     if( ( ret = mbedtls_asn1_get_tag( &p, end, &len,
             MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERR_X509_INVALID_FORMAT );
     }
 
@@ -1123,7 +1196,8 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
     if( make_copy != 0 )
     {
         /* Create and populate a new buffer for the raw field. */
-        crt->raw.p = p = mbedtls_calloc( 1, crt->raw.len );
+        crt->raw.p = p = mbedtls_x509_arena_calloc( crt->arena,
+                                                    crt->raw.len );
         if( crt->raw.p == NULL )
             return( MBEDTLS_ERR_X509_ALLOC_FAILED );
 
@@ -1147,7 +1221,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
     if( ( ret = mbedtls_asn1_get_tag( &p, end, &len,
             MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_FORMAT, ret ) );
     }
 
@@ -1166,13 +1240,13 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
         ( ret = mbedtls_x509_get_alg(      &p, end, &crt->sig_oid,
                                             &sig_params1 ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
 
     if( crt->version < 0 || crt->version > 2 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERR_X509_UNKNOWN_VERSION );
     }
 
@@ -1182,7 +1256,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
                                   &crt->sig_md, &crt->sig_pk,
                                   &crt->sig_opts ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
 
@@ -1194,13 +1268,14 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
     if( ( ret = mbedtls_asn1_get_tag( &p, end, &len,
             MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_FORMAT, ret ) );
     }
 
-    if( ( ret = mbedtls_x509_get_name( &p, p + len, &crt->issuer ) ) != 0 )
+    if( ( ret = mbedtls_x509_get_name_arena( &p, p + len, &crt->issuer,
+                                             crt->arena ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
 
@@ -1215,7 +1290,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
     if( ( ret = x509_get_dates( &p, end, &crt->valid_from,
                                          &crt->valid_to ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
 
@@ -1227,13 +1302,14 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
     if( ( ret = mbedtls_asn1_get_tag( &p, end, &len,
             MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_FORMAT, ret ) );
     }
 
-    if( len && ( ret = mbedtls_x509_get_name( &p, p + len, &crt->subject ) ) != 0 )
+    if( len && ( ret = mbedtls_x509_get_name_arena( &p, p + len,
+                                                    &crt->subject, crt->arena ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
 
@@ -1245,7 +1321,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
     crt->pk_raw.p = p;
     if( ( ret = mbedtls_pk_parse_subpubkey( &p, end, &crt->pk ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
     crt->pk_raw.len = p - crt->pk_raw.p;
@@ -1263,7 +1339,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
         ret = x509_get_uid( &p, end, &crt->issuer_id,  1 );
         if( ret != 0 )
         {
-            mbedtls_x509_crt_free( crt );
+            x509_crt_parse_cleanup( crt );
             return( ret );
         }
     }
@@ -1273,7 +1349,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
         ret = x509_get_uid( &p, end, &crt->subject_id,  2 );
         if( ret != 0 )
         {
-            mbedtls_x509_crt_free( crt );
+            x509_crt_parse_cleanup( crt );
             return( ret );
         }
     }
@@ -1283,14 +1359,14 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
         ret = x509_get_crt_ext( &p, end, crt, cb, p_ctx );
         if( ret != 0 )
         {
-            mbedtls_x509_crt_free( crt );
+            x509_crt_parse_cleanup( crt );
             return( ret );
         }
     }
 
     if( p != end )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_FORMAT,
                 MBEDTLS_ERR_ASN1_LENGTH_MISMATCH ) );
     }
@@ -1306,7 +1382,7 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
      */
     if( ( ret = mbedtls_x509_get_alg( &p, end, &sig_oid2, &sig_params2 ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
 
@@ -1317,19 +1393,19 @@ static int x509_crt_parse_der_core( mbedtls_x509_crt *crt,
         ( sig_params1.len != 0 &&
           memcmp( sig_params1.p, sig_params2.p, sig_params1.len ) != 0 ) )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERR_X509_SIG_MISMATCH );
     }
 
     if( ( ret = mbedtls_x509_get_sig( &p, end, &crt->sig ) ) != 0 )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( ret );
     }
 
     if( p != end )
     {
-        mbedtls_x509_crt_free( crt );
+        x509_crt_parse_cleanup( crt );
         return( MBEDTLS_ERROR_ADD( MBEDTLS_ERR_X509_INVALID_FORMAT,
                 MBEDTLS_ERR_ASN1_LENGTH_MISMATCH ) );
     }
@@ -1350,6 +1426,8 @@ static int mbedtls_x509_crt_parse_der_internal( mbedtls_x509_crt *chain,
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_x509_crt *crt = chain, *prev = NULL;
+    mbedtls_x509_arena *arena;
+    size_t arena_offset = 0;
 
     /*
      * Check for valid input
@@ -1357,6 +1435,26 @@ static int mbedtls_x509_crt_parse_der_internal( mbedtls_x509_crt *chain,
     if( crt == NULL || buf == NULL )
         return( MBEDTLS_ERR_X509_BAD_INPUT_DATA );
 
+    arena = chain->arena;
+    if( arena != NULL )
+    {
+        /* Get the whole certificate into one block when possible, so that
+         * parsing it usually costs at most one allocation. */
+        unsigned char *p = (unsigned char *) buf;
+        size_t len, need = sizeof( mbedtls_x509_crt );
+
+        if( make_copy != 0 &&
+            mbedtls_asn1_get_tag( &p, buf + buflen, &len,
+                    MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE ) == 0 )
+            need += ( p - buf ) + len;
+
+        if( ( ret = mbedtls_x509_arena_reserve( arena, need +
+                                                X509_CRT_ARENA_HEADROOM ) ) != 0 )
+            return( ret );
+
+        arena_offset = mbedtls_x509_arena_offset( arena );
+    }
+
     while( crt->version != 0 && crt->next != NULL )
     {
         prev = crt;
@@ -1368,7 +1466,8 @@ static int mbedtls_x509_crt_parse_der_internal( mbedtls_x509_crt *chain,
      */
     if( crt->version != 0 && crt->next == NULL )
     {
-        crt->next = mbedtls_calloc( 1, sizeof( mbedtls_x509_crt ) );
+        crt->next = mbedtls_x509_arena_calloc( arena,
+                                               sizeof( mbedtls_x509_crt ) );
 
         if( crt->next == NULL )
             return( MBEDTLS_ERR_X509_ALLOC_FAILED );
@@ -1376,6 +1475,7 @@ static int mbedtls_x509_crt_parse_der_internal( mbedtls_x509_crt *chain,
         prev = crt;
         mbedtls_x509_crt_init( crt->next );
         crt = crt->next;
+        crt->arena = arena;
     }
 
     ret = x509_crt_parse_der_core( crt, buf, buflen, make_copy, cb, p_ctx );
@@ -1384,7 +1484,9 @@ static int mbedtls_x509_crt_parse_der_internal( mbedtls_x509_crt *chain,
         if( prev )
             prev->next = NULL;
 
-        if( crt != chain )
+        if( arena != NULL )
+            mbedtls_x509_arena_rewind( arena, arena_offset );
+        else if( crt != chain )
             mbedtls_free( crt );
 
         return( ret );
@@ -1393,6 +1495,18 @@ static int mbedtls_x509_crt_parse_der_internal( mbedtls_x509_crt *chain,
     return( 0 );
 }
 
+int mbedtls_x509_crt_use_arena( mbedtls_x509_crt *chain, size_t block_size )
+{
+    if( chain == NULL || chain->version != 0 || chain->arena != NULL )
+        return( MBEDTLS_ERR_X509_BAD_INPUT_DATA );
+
+    chain->arena = mbedtls_x509_arena_new( block_size );
+    if( chain->arena == NULL )
+        return( MBEDTLS_ERR_X509_ALLOC_FAILED );
+
+    return( 0 );
+}
+
 int mbedtls_x509_crt_parse_der_nocopy( mbedtls_x509_crt *chain,
                                        const unsigned char *buf,
                                        size_t buflen )
@@ -2321,20 +2435,7 @@ int mbedtls_x509_crt_check_extended_key_usage( const mbedtls_x509_crt *crt,
  */
 int mbedtls_x509_crt_is_revoked( const mbedtls_x509_crt *crt, const mbedtls_x509_crl *crl )
 {
-    const mbedtls_x509_crl_entry *cur = &crl->entry;
-
-    while( cur != NULL && cur->serial.len != 0 )
-    {
-        if( crt->serial.len == cur->serial.len &&
-            memcmp( crt->serial.p, cur->serial.p, crt->serial.len ) == 0 )
-        {
-            return( 1 );
-        }
-
-        cur = cur->next;
-    }
-
-    return( 0 );
+    return( mbedtls_x509_crl_find_entry( crl, &crt->serial ) != NULL );
 }
 
 /*
@@ -3304,6 +3405,7 @@ void mbedtls_x509_crt_free( mbedtls_x509_crt *crt )
     mbedtls_x509_name *name_prv;
     mbedtls_x509_sequence *seq_cur;
     mbedtls_x509_sequence *seq_prv;
+    mbedtls_x509_arena *arena;
 
     if( crt == NULL )
         return;
@@ -3316,6 +3418,13 @@ void mbedtls_x509_crt_free( mbedtls_x509_crt *crt )
         mbedtls_free( cert_cur->sig_opts );
 #endif
 
+        /* Everything else is released with the arena below */
+        if( cert_cur->arena != NULL )
+        {
+            cert_cur = cert_cur->next;
+            continue;
+        }
+
         name_cur = cert_cur->issuer.next;
         while( name_cur != NULL )
         {
@@ -3374,6 +3483,15 @@ void mbedtls_x509_crt_free( mbedtls_x509_crt *crt )
     }
     while( cert_cur != NULL );
 
+    /* The arena holds all other certificates of the chain */
+    if( crt->arena != NULL )
+    {
+        arena = crt->arena;
+        mbedtls_platform_zeroize( crt, sizeof( mbedtls_x509_crt ) );
+        mbedtls_x509_arena_free( arena );
+        return;
+    }
+
     cert_cur = crt;
     do
     {
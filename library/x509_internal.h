@@ -0,0 +1,111 @@
+/**
+ * \file x509_internal.h
+ *
+ * \brief X.509 functions for use inside the library only
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef MBEDTLS_X509_INTERNAL_H
+#define MBEDTLS_X509_INTERNAL_H
+
+#include "common.h"
+
+#include "mbedtls/x509.h"
+
+/**
+ * \brief           Variant of mbedtls_x509_get_name() that takes the
+ *                  elements of the list from an arena.
+ *
+ * \param p         On entry, the start of the name. On exit, the end of
+ *                  the parsed data.
+ * \param end       The end of the input.
+ * \param cur       The first element of the list, provided by the caller.
+ * \param arena     The arena the other elements are allocated from, or
+ *                  \c NULL to allocate them on the heap. When not \c NULL,
+ *                  the elements are owned by \p arena, also on error.
+ *
+ * \return          \c 0 on success, or an \c MBEDTLS_ERR_X509_XXX or
+ *                  \c MBEDTLS_ERR_ASN1_XXX error code.
+ */
+int mbedtls_x509_get_name_arena( unsigned char **p, const unsigned char *end,
+                                 mbedtls_x509_name *cur,
+                                 mbedtls_x509_arena *arena );
+
+/**
+ * \brief           Create an arena.
+ *
+ * \param block_size The minimum size of the blocks the arena allocates
+ *                  from the heap, or \c 0 for a default size.
+ *
+ * \return          The new arena, or \c NULL if the allocation failed.
+ */
+mbedtls_x509_arena *mbedtls_x509_arena_new( size_t block_size );
+
+/**
+ * \brief           Free an arena and everything allocated from it.
+ *
+ * \param arena     The arena to free. This may be \c NULL.
+ */
+void mbedtls_x509_arena_free( mbedtls_x509_arena *arena );
+
+/**
+ * \brief           Make sure the next \p len bytes can be allocated from
+ *                  \p arena without allocating another block.
+ *
+ * \param arena     The arena.
+ * \param len       The number of bytes to reserve.
+ *
+ * \return          \c 0 on success, or #MBEDTLS_ERR_X509_ALLOC_FAILED.
+ */
+int mbedtls_x509_arena_reserve( mbedtls_x509_arena *arena, size_t len );
+
+/**
+ * \brief           Allocate zeroed memory from an arena.
+ *
+ * \note            The memory is released by mbedtls_x509_arena_free() or
+ *                  mbedtls_x509_arena_rewind(), never individually.
+ *
+ * \param arena     The arena, or \c NULL to allocate with mbedtls_calloc().
+ * \param len       The number of bytes to allocate.
+ *
+ * \return          The allocated memory, suitably aligned for any X.509
+ *                  structure, or \c NULL on failure.
+ */
+void *mbedtls_x509_arena_calloc( mbedtls_x509_arena *arena, size_t len );
+
+/**
+ * \brief           Get the current position of an arena.
+ *
+ * \param arena     The arena.
+ *
+ * \return          A value to pass to mbedtls_x509_arena_rewind() later.
+ *                  It grows with each allocation.
+ */
+size_t mbedtls_x509_arena_offset( const mbedtls_x509_arena *arena );
+
+/**
+ * \brief           Release everything allocated from an arena after a
+ *                  given position.
+ *
+ * \param arena     The arena.
+ * \param offset    A value returned by mbedtls_x509_arena_offset().
+ *                  The released memory is zeroized.
+ */
+void mbedtls_x509_arena_rewind( mbedtls_x509_arena *arena, size_t offset );
+
+#endif /* MBEDTLS_X509_INTERNAL_H */
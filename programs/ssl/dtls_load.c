@@ -0,0 +1,585 @@
+/*
+ *  DTLS load test: a server built on the DTLS endpoint, and a client that
+ *  runs many concurrent handshakes against any DTLS server
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License"); you may
+ *  not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ *  WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_SSL_DTLS_ENDPOINT_C) || !defined(MBEDTLS_SSL_CLI_C) || \
+    !defined(MBEDTLS_SSL_COOKIE_C) || !defined(MBEDTLS_NET_C) ||          \
+    !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_CTR_DRBG_C) ||        \
+    !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(MBEDTLS_RSA_C) ||      \
+    !defined(MBEDTLS_PEM_PARSE_C) || !defined(MBEDTLS_TIMING_C)
+
+int main( void )
+{
+    mbedtls_printf( "MBEDTLS_SSL_DTLS_ENDPOINT_C and/or MBEDTLS_SSL_CLI_C and/or "
+                    "MBEDTLS_SSL_COOKIE_C and/or MBEDTLS_NET_C and/or "
+                    "MBEDTLS_ENTROPY_C and/or MBEDTLS_CTR_DRBG_C and/or "
+                    "MBEDTLS_X509_CRT_PARSE_C and/or MBEDTLS_RSA_C and/or "
+                    "MBEDTLS_PEM_PARSE_C and/or MBEDTLS_TIMING_C not defined.\n" );
+    mbedtls_exit( 0 );
+}
+#else
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cookie.h"
+#include "mbedtls/ssl_dtls_endpoint.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/error.h"
+#include "mbedtls/debug.h"
+#include "mbedtls/timing.h"
+
+#include "test/certs.h"
+
+#define DFL_ROLE                "server"
+#define DFL_SERVER_ADDR         NULL
+#define DFL_SERVER_PORT         "4433"
+#define DFL_MAX_ASSOCS          1000
+#define DFL_CID_LEN             0
+#define DFL_CLIENTS             100
+#define DFL_TIMEOUT             30
+#define DFL_DEBUG_LEVEL         0
+
+#define MTU                     1400
+#define POLL_MS                 10
+
+#define GET_REQUEST "GET / HTTP/1.0\r\n\r\n"
+
+#define HTTP_RESPONSE \
+    "HTTP/1.0 200 OK\r\nContent-Type: text/html\r\n\r\n" \
+    "<h2>Mbed TLS Test Server</h2>\r\n" \
+    "<p>Successful connection using: %s</p>\r\n"
+
+#define USAGE \
+    "\n usage: dtls_load param=<>...\n"                                 \
+    "\n acceptable parameters:\n"                                       \
+    "    role=%%s             \"server\" or \"client\"\n"               \
+    "                        default: " DFL_ROLE "\n"                   \
+    "    server_addr=%%s      default: all interfaces (server),\n"     \
+    "                        localhost (client)\n"                     \
+    "    server_port=%%s      default: " DFL_SERVER_PORT "\n"           \
+    "    debug_level=%%d      default: 0 (disabled)\n"                  \
+    "\n server role:\n"                                                 \
+    "    max_assocs=%%d       maximum concurrent associations\n"        \
+    "                        default: 1000\n"                           \
+    "    cid_len=%%d          length of the connection IDs given to\n"  \
+    "                        clients, 0 to disable. default: 0\n"       \
+    "\n client role:\n"                                                 \
+    "    clients=%%d          number of concurrent handshakes\n"        \
+    "                        default: 100\n"                            \
+    "    timeout=%%d          give up after this many seconds\n"        \
+    "                        default: 30\n"                             \
+    "\n"
+
+static struct options
+{
+    const char *role;
+    const char *server_addr;
+    const char *server_port;
+    int debug_level;
+    int max_assocs;
+    int cid_len;
+    int clients;
+    int timeout;
+} opt;
+
+static void my_debug( void *ctx, int level,
+                      const char *file, int line,
+                      const char *str )
+{
+    ((void) level);
+
+    mbedtls_fprintf( (FILE *) ctx, "%s:%04d: %s", file, line, str );
+    fflush( (FILE *) ctx );
+}
+
+/*
+ * Server role: one socket, one endpoint, any number of clients
+ */
+static int server_event( void *p_ctx, mbedtls_ssl_context *ssl, int event )
+{
+    unsigned long *stats = (unsigned long *) p_ctx;
+    unsigned char buf[1024];
+    int ret, len;
+
+    switch( event )
+    {
+        case MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_CONNECTED:
+            stats[0]++;
+            mbedtls_printf( "  . association %lu established (%s)\n",
+                            stats[0], mbedtls_ssl_get_ciphersuite( ssl ) );
+            return( 0 );
+
+        case MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_READABLE:
+            while( ( ret = mbedtls_ssl_read( ssl, buf, sizeof( buf ) ) ) > 0 )
+            {
+                len = mbedtls_snprintf( (char *) buf, sizeof( buf ),
+                                        HTTP_RESPONSE,
+                                        mbedtls_ssl_get_ciphersuite( ssl ) );
+                ret = mbedtls_ssl_write( ssl, buf, len );
+                if( ret < 0 )
+                    return( ret );
+            }
+            if( ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                ret == MBEDTLS_ERR_SSL_WANT_WRITE )
+            {
+                return( 0 );
+            }
+            return( ret == 0 ? -1 : ret );
+
+        case MBEDTLS_SSL_DTLS_ENDPOINT_EVENT_CLOSED:
+            stats[1]++;
+            return( 0 );
+    }
+
+    return( 0 );
+}
+
+static int run_server( mbedtls_ssl_config *conf, mbedtls_net_context *fd )
+{
+    int ret;
+    mbedtls_ssl_dtls_endpoint ep;
+    struct mbedtls_timing_hr_time clock;
+    unsigned long stats[2] = { 0, 0 };
+
+    mbedtls_ssl_dtls_endpoint_init( &ep );
+
+    mbedtls_printf( "  . Bind on udp/%s/%s ...",
+                    opt.server_addr == NULL ? "*" : opt.server_addr,
+                    opt.server_port );
+    fflush( stdout );
+
+    if( ( ret = mbedtls_net_bind( fd, opt.server_addr, opt.server_port,
+                                  MBEDTLS_NET_PROTO_UDP ) ) != 0 ||
+        ( ret = mbedtls_net_set_nonblock( fd ) ) != 0 )
+    {
+        mbedtls_printf( " failed\n  ! mbedtls_net_bind returned -0x%x\n\n",
+                        (unsigned int) -ret );
+        goto exit;
+    }
+
+    if( ( ret = mbedtls_ssl_dtls_endpoint_setup( &ep, conf,
+                                                 opt.max_assocs,
+                                                 MTU ) ) != 0 )
+    {
+        mbedtls_printf( " failed\n  ! mbedtls_ssl_dtls_endpoint_setup "
+                        "returned -0x%x\n\n", (unsigned int) -ret );
+        goto exit;
+    }
+
+    mbedtls_ssl_dtls_endpoint_set_bio( &ep, fd, mbedtls_net_send_batch,
+                                       mbedtls_net_recv_batch );
+    mbedtls_ssl_dtls_endpoint_set_callback( &ep, server_event, stats );
+
+    mbedtls_printf( " ok\n  . Serving up to %d associations\n",
+                    opt.max_assocs );
+    fflush( stdout );
+
+    (void) mbedtls_timing_get_timer( &clock, 1 );
+
+    for( ;; )
+    {
+        ret = mbedtls_ssl_dtls_endpoint_process( &ep,
+                    (uint32_t) mbedtls_timing_get_timer( &clock, 0 ) );
+        if( ret < 0 )
+        {
+            mbedtls_printf( "  ! mbedtls_ssl_dtls_endpoint_process "
+                            "returned -0x%x\n", (unsigned int) -ret );
+            goto exit;
+        }
+
+        if( ret == 0 )
+        {
+            fflush( stdout );
+            (void) mbedtls_net_poll( fd, MBEDTLS_NET_POLL_READ, POLL_MS );
+        }
+    }
+
+exit:
+    mbedtls_ssl_dtls_endpoint_free( &ep );
+    return( ret );
+}
+
+/*
+ * Client role: many concurrent associations, each on its own socket
+ */
+typedef struct
+{
+    mbedtls_net_context fd;
+    mbedtls_ssl_context ssl;
+    mbedtls_timing_delay_context timer;
+    int state;                          /* 0 handshake, 1 reading, 2 done */
+} load_client;
+
+static int client_step( load_client *c )
+{
+    unsigned char buf[1024];
+    int ret;
+
+    if( c->state == 0 )
+    {
+        ret = mbedtls_ssl_handshake( &c->ssl );
+        if( ret != 0 )
+            return( ret );
+
+        ret = mbedtls_ssl_write( &c->ssl, (const unsigned char *) GET_REQUEST,
+                                 sizeof( GET_REQUEST ) - 1 );
+        if( ret < 0 )
+            return( ret );
+
+        c->state = 1;
+    }
+
+    ret = mbedtls_ssl_read( &c->ssl, buf, sizeof( buf ) );
+    if( ret <= 0 )
+        return( ret == 0 ? MBEDTLS_ERR_SSL_CONN_EOF : ret );
+
+    (void) mbedtls_ssl_close_notify( &c->ssl );
+    c->state = 2;
+    return( 0 );
+}
+
+static int run_client( mbedtls_ssl_config *conf )
+{
+    int ret = 0, i;
+    int done = 0, failed = 0;
+    load_client *cl;
+    struct mbedtls_timing_hr_time clock;
+    unsigned long elapsed;
+
+    if( opt.server_addr == NULL )
+        opt.server_addr = "localhost";
+
+    cl = mbedtls_calloc( opt.clients, sizeof( load_client ) );
+    if( cl == NULL )
+        return( MBEDTLS_ERR_SSL_ALLOC_FAILED );
+
+    mbedtls_printf( "  . Starting %d handshakes with %s:%s ...",
+                    opt.clients, opt.server_addr, opt.server_port );
+    fflush( stdout );
+
+    (void) mbedtls_timing_get_timer( &clock, 1 );
+
+    for( i = 0; i < opt.clients; i++ )
+    {
+        load_client *c = &cl[i];
+
+        mbedtls_net_init( &c->fd );
+        mbedtls_ssl_init( &c->ssl );
+
+        if( ( ret = mbedtls_net_connect( &c->fd, opt.server_addr,
+                                         opt.server_port,
+                                         MBEDTLS_NET_PROTO_UDP ) ) != 0 ||
+            ( ret = mbedtls_net_set_nonblock( &c->fd ) ) != 0 ||
+            ( ret = mbedtls_ssl_setup( &c->ssl, conf ) ) != 0 ||
+            ( ret = mbedtls_ssl_set_hostname( &c->ssl, "localhost" ) ) != 0 )
+        {
+            mbedtls_printf( " failed\n  ! client %d setup returned -0x%x\n",
+                            i, (unsigned int) -ret );
+            goto exit;
+        }
+
+        mbedtls_ssl_set_bio( &c->ssl, &c->fd,
+                             mbedtls_net_send, mbedtls_net_recv, NULL );
+        mbedtls_ssl_set_timer_cb( &c->ssl, &c->timer, mbedtls_timing_set_delay,
+                                  mbedtls_timing_get_delay );
+        mbedtls_ssl_set_mtu( &c->ssl, MTU );
+    }
+
+    mbedtls_printf( " ok\n" );
+    fflush( stdout );
+
+    while( done + failed < opt.clients )
+    {
+        if( mbedtls_timing_get_timer( &clock, 0 ) >
+            (unsigned long) opt.timeout * 1000 )
+        {
+            mbedtls_printf( "  ! timeout with %d handshakes pending\n",
+                            opt.clients - done - failed );
+            failed = opt.clients - done;
+            break;
+        }
+
+        for( i = 0; i < opt.clients; i++ )
+        {
+            if( cl[i].state == 2 )
+                continue;
+
+            ret = client_step( &cl[i] );
+            if( ret == 0 )
+                done++;
+            else if( ret != MBEDTLS_ERR_SSL_WANT_READ &&
+                     ret != MBEDTLS_ERR_SSL_WANT_WRITE )
+            {
+                mbedtls_printf( "  ! client %d failed: -0x%x\n",
+                                i, (unsigned int) -ret );
+                cl[i].state = 2;
+                failed++;
+            }
+        }
+
+        mbedtls_net_usleep( 1000 );
+    }
+
+    elapsed = mbedtls_timing_get_timer( &clock, 0 );
+    mbedtls_printf( "  . %d/%d handshakes completed in %lu ms",
+                    done, opt.clients, elapsed );
+    if( elapsed > 0 )
+        mbedtls_printf( " (%lu handshakes/s)",
+                        (unsigned long) done * 1000 / elapsed );
+    mbedtls_printf( "\n" );
+
+    ret = ( failed == 0 ) ? 0 : 1;
+
+exit:
+    for( i = 0; i < opt.clients; i++ )
+    {
+        mbedtls_ssl_free( &cl[i].ssl );
+        mbedtls_net_free( &cl[i].fd );
+    }
+    mbedtls_free( cl );
+    return( ret );
+}
+
+int main( int argc, char *argv[] )
+{
+    int ret = 1, i, is_server;
+    char *p, *q;
+    const char *pers = "dtls_load";
+    mbedtls_net_context listen_fd;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt crt;
+    mbedtls_pk_context pkey;
+    mbedtls_ssl_cookie_ctx cookie_ctx;
+
+    mbedtls_net_init( &listen_fd );
+    mbedtls_ssl_config_init( &conf );
+    mbedtls_ssl_cookie_init( &cookie_ctx );
+    mbedtls_x509_crt_init( &crt );
+    mbedtls_pk_init( &pkey );
+    mbedtls_entropy_init( &entropy );
+    mbedtls_ctr_drbg_init( &ctr_drbg );
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    if( psa_crypto_init() != PSA_SUCCESS )
+    {
+        mbedtls_fprintf( stderr, "Failed to initialize PSA Crypto\n" );
+        goto exit;
+    }
+#endif
+
+    opt.role        = DFL_ROLE;
+    opt.server_addr = DFL_SERVER_ADDR;
+    opt.server_port = DFL_SERVER_PORT;
+    opt.debug_level = DFL_DEBUG_LEVEL;
+    opt.max_assocs  = DFL_MAX_ASSOCS;
+    opt.cid_len     = DFL_CID_LEN;
+    opt.clients     = DFL_CLIENTS;
+    opt.timeout     = DFL_TIMEOUT;
+
+    for( i = 1; i < argc; i++ )
+    {
+        p = argv[i];
+        if( ( q = strchr( p, '=' ) ) == NULL )
+            goto usage;
+        *q++ = '\0';
+
+        if( strcmp( p, "role" ) == 0 )
+        {
+            if( strcmp( q, "server" ) != 0 && strcmp( q, "client" ) != 0 )
+                goto usage;
+            opt.role = q;
+        }
+        else if( strcmp( p, "server_addr" ) == 0 )
+            opt.server_addr = q;
+        else if( strcmp( p, "server_port" ) == 0 )
+            opt.server_port = q;
+        else if( strcmp( p, "debug_level" ) == 0 )
+        {
+            opt.debug_level = atoi( q );
+            if( opt.debug_level < 0 || opt.debug_level > 65535 )
+                goto usage;
+        }
+        else if( strcmp( p, "max_assocs" ) == 0 )
+        {
+            opt.max_assocs = atoi( q );
+            if( opt.max_assocs < 1 )
+                goto usage;
+        }
+        else if( strcmp( p, "cid_len" ) == 0 )
+        {
+            opt.cid_len = atoi( q );
+            if( opt.cid_len < 0 || opt.cid_len > MBEDTLS_SSL_CID_IN_LEN_MAX )
+                goto usage;
+        }
+        else if( strcmp( p, "clients" ) == 0 )
+        {
+            opt.clients = atoi( q );
+            if( opt.clients < 1 )
+                goto usage;
+        }
+        else if( strcmp( p, "timeout" ) == 0 )
+        {
+            opt.timeout = atoi( q );
+            if( opt.timeout < 1 )
+                goto usage;
+        }
+        else
+            goto usage;
+    }
+
+    is_server = ( strcmp( opt.role, "server" ) == 0 );
+
+#if defined(MBEDTLS_DEBUG_C)
+    mbedtls_debug_set_threshold( opt.debug_level );
+#endif
+
+    mbedtls_printf( "  . Seeding the random number generator..." );
+    fflush( stdout );
+
+    if( ( ret = mbedtls_ctr_drbg_seed( &ctr_drbg, mbedtls_entropy_func,
+                                       &entropy, (const unsigned char *) pers,
+                                       strlen( pers ) ) ) != 0 )
+    {
+        mbedtls_printf( " failed\n  ! mbedtls_ctr_drbg_seed returned %d\n",
+                        ret );
+        goto exit;
+    }
+
+    mbedtls_printf( " ok\n  . Setting up the DTLS configuration..." );
+    fflush( stdout );
+
+    if( ( ret = mbedtls_ssl_config_defaults( &conf,
+                    is_server ? MBEDTLS_SSL_IS_SERVER : MBEDTLS_SSL_IS_CLIENT,
+                    MBEDTLS_SSL_TRANSPORT_DATAGRAM,
+                    MBEDTLS_SSL_PRESET_DEFAULT ) ) != 0 )
+    {
+        mbedtls_printf( " failed\n  ! mbedtls_ssl_config_defaults "
+                        "returned %d\n", ret );
+        goto exit;
+    }
+
+    mbedtls_ssl_conf_rng( &conf, mbedtls_ctr_drbg_random, &ctr_drbg );
+    mbedtls_ssl_conf_dbg( &conf, my_debug, stdout );
+
+    if( is_server )
+    {
+        /*
+         * This program uses embedded test certificates.
+         */
+        if( ( ret = mbedtls_x509_crt_parse( &crt,
+                        (const unsigned char *) mbedtls_test_srv_crt,
+                        mbedtls_test_srv_crt_len ) ) != 0 ||
+            ( ret = mbedtls_pk_parse_key( &pkey,
+                        (const unsigned char *) mbedtls_test_srv_key,
+                        mbedtls_test_srv_key_len, NULL, 0,
+                        mbedtls_ctr_drbg_random, &ctr_drbg ) ) != 0 ||
+            ( ret = mbedtls_ssl_conf_own_cert( &conf, &crt, &pkey ) ) != 0 )
+        {
+            mbedtls_printf( " failed\n  ! loading the server certificate "
+                            "returned -0x%x\n", (unsigned int) -ret );
+            goto exit;
+        }
+
+        if( ( ret = mbedtls_ssl_cookie_setup( &cookie_ctx,
+                        mbedtls_ctr_drbg_random, &ctr_drbg ) ) != 0 )
+        {
+            mbedtls_printf( " failed\n  ! mbedtls_ssl_cookie_setup "
+                            "returned %d\n", ret );
+            goto exit;
+        }
+
+        mbedtls_ssl_conf_dtls_cookies( &conf, mbedtls_ssl_cookie_write,
+                                       mbedtls_ssl_cookie_check, &cookie_ctx );
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        if( ( ret = mbedtls_ssl_conf_cid( &conf, opt.cid_len,
+                        MBEDTLS_SSL_UNEXPECTED_CID_IGNORE ) ) != 0 )
+        {
+            mbedtls_printf( " failed\n  ! mbedtls_ssl_conf_cid "
+                            "returned %d\n", ret );
+            goto exit;
+        }
+#else
+        if( opt.cid_len != 0 )
+        {
+            mbedtls_printf( " failed\n  ! cid_len requires "
+                            "MBEDTLS_SSL_DTLS_CONNECTION_ID\n" );
+            ret = 1;
+            goto exit;
+        }
+#endif
+    }
+    else
+    {
+        /* Only the handshake rate is measured: skip authentication */
+        mbedtls_ssl_conf_authmode( &conf, MBEDTLS_SSL_VERIFY_NONE );
+    }
+
+    mbedtls_printf( " ok\n" );
+
+    ret = is_server ? run_server( &conf, &listen_fd ) : run_client( &conf );
+    goto exit;
+
+usage:
+    mbedtls_printf( USAGE );
+    ret = 1;
+
+exit:
+
+#ifdef MBEDTLS_ERROR_C
+    if( ret < 0 )
+    {
+        char error_buf[100];
+        mbedtls_strerror( ret, error_buf, 100 );
+        mbedtls_printf( "Last error was: %d - %s\n\n", ret, error_buf );
+    }
+#endif
+
+    mbedtls_net_free( &listen_fd );
+    mbedtls_x509_crt_free( &crt );
+    mbedtls_pk_free( &pkey );
+    mbedtls_ssl_config_free( &conf );
+    mbedtls_ssl_cookie_free( &cookie_ctx );
+    mbedtls_ctr_drbg_free( &ctr_drbg );
+    mbedtls_entropy_free( &entropy );
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    mbedtls_psa_crypto_free( );
+#endif
+
+    /* Shell can not handle large exit numbers -> 1 for errors */
+    if( ret < 0 )
+        ret = 1;
+
+    mbedtls_exit( ret );
+}
+#endif /* MBEDTLS_SSL_DTLS_ENDPOINT_C && MBEDTLS_SSL_CLI_C &&
+          MBEDTLS_SSL_COOKIE_C && MBEDTLS_NET_C && MBEDTLS_ENTROPY_C &&
+          MBEDTLS_CTR_DRBG_C && MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_RSA_C
+          && MBEDTLS_PEM_PARSE_C && MBEDTLS_TIMING_C */
@@ -1,5 +1,6 @@
 /*
- *  Simple DTLS server demonstration program
+ *  Simple DTLS server demonstration program, serving many clients on one
+ *  socket with batched datagram I/O
  *
  *  Copyright The Mbed TLS Contributors
  *  SPDX-License-Identifier: Apache-2.0
@@ -74,6 +75,54 @@ int main( void )
 #define READ_TIMEOUT_MS 10000   /* 10 seconds */
 #define DEBUG_LEVEL 0
 
+#define MAX_CLIENTS     16      /* concurrent DTLS associations */
+#define BATCH_SIZE      16      /* datagrams per recv/send system call */
+#define DGRAM_MAX_LEN   4096    /* largest datagram we receive */
+#define DGRAM_MTU       1400    /* largest datagram we send */
+#define POLL_MS         100     /* granularity of retransmission timers */
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+/* Our connection IDs are the slot number and a generation counter, so
+ * that a record carrying a CID is routed without looking at its source
+ * address, and a stale CID from a previous occupant of a slot is dropped. */
+#define CID_LEN         4
+#define DTLS_HDR_CID    11      /* offset of the CID in a record header */
+#endif
+
+/*
+ * One DTLS association, identified by the peer's transport address
+ * (and by our connection ID, if negotiated).
+ */
+typedef struct
+{
+    int active;
+    int handshake_done;
+    mbedtls_ssl_context ssl;
+    mbedtls_timing_delay_context timer;
+    unsigned char addr[MBEDTLS_SSL_DGRAM_ADDR_MAX];
+    size_t addr_len;
+    const mbedtls_ssl_dgram *pending;   /* datagram for the next f_recv */
+    const mbedtls_ssl_dgram *from;      /* datagram being processed */
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    uint16_t generation;
+#endif
+} client_slot;
+
+/*
+ * Datagrams queued by all associations, sent with a single system call
+ */
+typedef struct
+{
+    mbedtls_net_context *sock;
+    mbedtls_ssl_dgram dgrams[BATCH_SIZE];
+    unsigned char bufs[BATCH_SIZE][DGRAM_MTU];
+    size_t count;
+} dgram_queue;
+
+static client_slot clients[MAX_CLIENTS];
+static dgram_queue tx_queue;
+static mbedtls_ssl_dgram rx_dgrams[BATCH_SIZE];
+static unsigned char rx_bufs[BATCH_SIZE][DGRAM_MAX_LEN];
 
 static void my_debug( void *ctx, int level,
                       const char *file, int line,
@@ -85,30 +134,306 @@ static void my_debug( void *ctx, int level,
     fflush(  (FILE *) ctx  );
 }
 
-int main( void )
+/*
+ * Send all queued datagrams
+ */
+static int flush_tx( dgram_queue *q )
+{
+    int ret;
+    size_t sent = 0;
+
+    while( sent < q->count )
+    {
+        ret = mbedtls_net_send_batch( q->sock, q->dgrams + sent,
+                                      q->count - sent );
+        if( ret < 0 )
+        {
+            /* Drop the batch: DTLS retransmission will recover */
+            printf( "  ! mbedtls_net_send_batch returned -0x%x\n",
+                    (unsigned int) -ret );
+            break;
+        }
+        sent += ret;
+    }
+
+    q->count = 0;
+    return( 0 );
+}
+
+/*
+ * Send callback of each association: queue the datagram for the next batch
+ */
+static int slot_send( void *ctx, const unsigned char *buf, size_t len )
+{
+    client_slot *slot = (client_slot *) ctx;
+    mbedtls_ssl_dgram *d;
+
+    if( len > DGRAM_MTU )
+        return( MBEDTLS_ERR_SSL_BAD_INPUT_DATA );
+
+    if( tx_queue.count == BATCH_SIZE )
+        flush_tx( &tx_queue );
+
+    d = &tx_queue.dgrams[tx_queue.count++];
+    d->buf = tx_queue.bufs[tx_queue.count - 1];
+    memcpy( d->buf, buf, len );
+    d->len = len;
+    memcpy( d->addr, slot->addr, slot->addr_len );
+    d->addr_len = slot->addr_len;
+
+    return( (int) len );
+}
+
+/*
+ * Receive callback of each association: deliver the datagram that the
+ * demultiplexer routed to it, if any
+ */
+static int slot_recv( void *ctx, unsigned char *buf, size_t len )
+{
+    client_slot *slot = (client_slot *) ctx;
+    const mbedtls_ssl_dgram *d = slot->pending;
+
+    if( d == NULL )
+        return( MBEDTLS_ERR_SSL_WANT_READ );
+
+    slot->pending = NULL;
+
+    if( d->len > len )
+        return( MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL );
+
+    memcpy( buf, d->buf, d->len );
+    return( (int) d->len );
+}
+
+static void slot_free( client_slot *slot )
+{
+    mbedtls_ssl_session_reset( &slot->ssl );
+    slot->active = 0;
+    slot->handshake_done = 0;
+    slot->pending = NULL;
+    slot->from = NULL;
+    slot->addr_len = 0;
+}
+
+/*
+ * Find the association a datagram belongs to: by connection ID if the
+ * first record carries one, by source address otherwise
+ */
+static client_slot *demux( const mbedtls_ssl_dgram *d )
+{
+    size_t i;
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    if( d->len >= DTLS_HDR_CID + CID_LEN &&
+        d->buf[0] == MBEDTLS_SSL_MSG_CID )
+    {
+        const unsigned char *cid = d->buf + DTLS_HDR_CID;
+        size_t idx = ( (size_t) cid[0] << 8 ) | cid[1];
+        uint16_t gen = (uint16_t) ( ( cid[2] << 8 ) | cid[3] );
+
+        if( idx < MAX_CLIENTS && clients[idx].active &&
+            clients[idx].generation == gen )
+            return( &clients[idx] );
+
+        return( NULL );
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+    for( i = 0; i < MAX_CLIENTS; i++ )
+    {
+        if( clients[i].active &&
+            clients[i].addr_len == d->addr_len &&
+            memcmp( clients[i].addr, d->addr, d->addr_len ) == 0 )
+            return( &clients[i] );
+    }
+
+    return( NULL );
+}
+
+/*
+ * Start a new association for a datagram from an unknown address
+ */
+static client_slot *slot_new( const mbedtls_ssl_dgram *d )
+{
+    int ret;
+    size_t i;
+    client_slot *slot = NULL;
+
+    /* Only a ClientHello can start an association */
+    if( d->len < 1 || d->buf[0] != MBEDTLS_SSL_MSG_HANDSHAKE )
+        return( NULL );
+
+    for( i = 0; i < MAX_CLIENTS && slot == NULL; i++ )
+    {
+        if( ! clients[i].active )
+            slot = &clients[i];
+    }
+
+    if( slot == NULL )
+        return( NULL );
+
+    memcpy( slot->addr, d->addr, d->addr_len );
+    slot->addr_len = d->addr_len;
+
+    /* For HelloVerifyRequest cookies */
+    if( ( ret = mbedtls_ssl_set_client_transport_id( &slot->ssl,
+                    slot->addr, slot->addr_len ) ) != 0 )
+    {
+        printf( "  ! mbedtls_ssl_set_client_transport_id() returned -0x%x\n",
+                (unsigned int) -ret );
+        return( NULL );
+    }
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    {
+        unsigned char cid[CID_LEN];
+        size_t idx = (size_t) ( slot - clients );
+
+        slot->generation++;
+        cid[0] = (unsigned char) ( idx >> 8 );
+        cid[1] = (unsigned char) ( idx );
+        cid[2] = (unsigned char) ( slot->generation >> 8 );
+        cid[3] = (unsigned char) ( slot->generation );
+
+        if( ( ret = mbedtls_ssl_set_cid( &slot->ssl, MBEDTLS_SSL_CID_ENABLED,
+                                         cid, sizeof( cid ) ) ) != 0 )
+        {
+            printf( "  ! mbedtls_ssl_set_cid() returned -0x%x\n",
+                    (unsigned int) -ret );
+            return( NULL );
+        }
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+    slot->active = 1;
+    return( slot );
+}
+
+/*
+ * Make progress on an association: handshake, then read one request,
+ * echo it and close the connection
+ */
+static void slot_step( client_slot *slot )
 {
     int ret, len;
-    mbedtls_net_context listen_fd, client_fd;
     unsigned char buf[1024];
+    int id = (int) ( slot - clients );
+
+    if( ! slot->handshake_done )
+    {
+        ret = mbedtls_ssl_handshake( &slot->ssl );
+
+        if( ret == MBEDTLS_ERR_SSL_WANT_READ ||
+            ret == MBEDTLS_ERR_SSL_WANT_WRITE )
+            return;
+
+        if( ret == MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED )
+        {
+            /* Keep no state until the client has proven its address */
+            slot_free( slot );
+            return;
+        }
+
+        if( ret != 0 )
+        {
+            printf( "  ! [%d] mbedtls_ssl_handshake returned -0x%x\n",
+                    id, (unsigned int) -ret );
+            slot_free( slot );
+            return;
+        }
+
+        printf( "  . [%d] DTLS handshake ok\n", id );
+        slot->handshake_done = 1;
+
+        /* Use the timer to detect idle clients from now on */
+        mbedtls_timing_set_delay( &slot->timer, READ_TIMEOUT_MS,
+                                  READ_TIMEOUT_MS );
+    }
+
+    /*
+     * Read the echo Request
+     */
+    len = sizeof( buf ) - 1;
+    memset( buf, 0, sizeof( buf ) );
+
+    ret = mbedtls_ssl_read( &slot->ssl, buf, len );
+
+    if( ret == MBEDTLS_ERR_SSL_WANT_READ ||
+        ret == MBEDTLS_ERR_SSL_WANT_WRITE )
+        return;
+
+    if( ret <= 0 )
+    {
+        switch( ret )
+        {
+            case MBEDTLS_ERR_SSL_TIMEOUT:
+                printf( "  < [%d] timeout\n", id );
+                slot_free( slot );
+                return;
+
+            case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
+                printf( "  < [%d] connection was closed gracefully\n", id );
+                goto close_notify;
+
+            default:
+                printf( "  < [%d] mbedtls_ssl_read returned -0x%x\n",
+                        id, (unsigned int) -ret );
+                slot_free( slot );
+                return;
+        }
+    }
+
+    len = ret;
+    printf( "  < [%d] %d bytes read\n\n%s\n\n", id, len, buf );
+
+    /* The record was authenticated, so if it was routed by connection ID
+     * from a new address, the client has moved: answer there */
+    if( slot->from != NULL )
+    {
+        memcpy( slot->addr, slot->from->addr, slot->from->addr_len );
+        slot->addr_len = slot->from->addr_len;
+    }
+
+    /*
+     * Write the echo Response: the record is queued, never blocks
+     */
+    ret = mbedtls_ssl_write( &slot->ssl, buf, len );
+    if( ret < 0 )
+    {
+        printf( "  > [%d] mbedtls_ssl_write returned %d\n", id, ret );
+        slot_free( slot );
+        return;
+    }
+
+    printf( "  > [%d] %d bytes written\n", id, ret );
+
+close_notify:
+    /* No error checking, the connection might be closed already */
+    (void) mbedtls_ssl_close_notify( &slot->ssl );
+    printf( "  . [%d] connection closed\n", id );
+    slot_free( slot );
+}
+
+int main( void )
+{
+    int ret, n;
+    size_t i;
+    mbedtls_net_context listen_fd;
     const char *pers = "dtls_server";
-    unsigned char client_ip[16] = { 0 };
-    size_t cliip_len;
     mbedtls_ssl_cookie_ctx cookie_ctx;
 
     mbedtls_entropy_context entropy;
     mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_ssl_context ssl;
     mbedtls_ssl_config conf;
     mbedtls_x509_crt srvcert;
     mbedtls_pk_context pkey;
-    mbedtls_timing_delay_context timer;
 #if defined(MBEDTLS_SSL_CACHE_C)
     mbedtls_ssl_cache_context cache;
 #endif
 
     mbedtls_net_init( &listen_fd );
-    mbedtls_net_init( &client_fd );
-    mbedtls_ssl_init( &ssl );
+    for( i = 0; i < MAX_CLIENTS; i++ )
+        mbedtls_ssl_init( &clients[i].ssl );
     mbedtls_ssl_config_init( &conf );
     mbedtls_ssl_cookie_init( &cookie_ctx );
 #if defined(MBEDTLS_SSL_CACHE_C)
@@ -177,7 +502,7 @@ int main( void )
     printf( " ok\n" );
 
     /*
-     * 3. Setup the "listening" UDP socket
+     * 3. Setup the "listening" UDP socket, shared by all clients
      */
     printf( "  . Bind on udp/*/4433 ..." );
     fflush( stdout );
@@ -188,6 +513,8 @@ int main( void )
         goto exit;
     }
 
+    tx_queue.sock = &listen_fd;
+
     printf( " ok\n" );
 
     /*
@@ -207,7 +534,6 @@ int main( void )
 
     mbedtls_ssl_conf_rng( &conf, mbedtls_ctr_drbg_random, &ctr_drbg );
     mbedtls_ssl_conf_dbg( &conf, my_debug, stdout );
-    mbedtls_ssl_conf_read_timeout( &conf, READ_TIMEOUT_MS );
 
 #if defined(MBEDTLS_SSL_CACHE_C)
     mbedtls_ssl_conf_session_cache( &conf, &cache,
@@ -232,151 +558,93 @@ int main( void )
     mbedtls_ssl_conf_dtls_cookies( &conf, mbedtls_ssl_cookie_write, mbedtls_ssl_cookie_check,
                                &cookie_ctx );
 
-    if( ( ret = mbedtls_ssl_setup( &ssl, &conf ) ) != 0 )
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    if( ( ret = mbedtls_ssl_conf_cid( &conf, CID_LEN,
+                                MBEDTLS_SSL_UNEXPECTED_CID_IGNORE ) ) != 0 )
     {
-        printf( " failed\n  ! mbedtls_ssl_setup returned %d\n\n", ret );
+        printf( " failed\n  ! mbedtls_ssl_conf_cid returned %d\n\n", ret );
         goto exit;
     }
-
-    mbedtls_ssl_set_timer_cb( &ssl, &timer, mbedtls_timing_set_delay,
-                                            mbedtls_timing_get_delay );
-
-    printf( " ok\n" );
-
-reset:
-#ifdef MBEDTLS_ERROR_C
-    if( ret != 0 )
-    {
-        char error_buf[100];
-        mbedtls_strerror( ret, error_buf, 100 );
-        printf("Last error was: %d - %s\n\n", ret, error_buf );
-    }
 #endif
 
-    mbedtls_net_free( &client_fd );
-
-    mbedtls_ssl_session_reset( &ssl );
-
-    /*
-     * 3. Wait until a client connects
-     */
-    printf( "  . Waiting for a remote connection ..." );
-    fflush( stdout );
-
-    if( ( ret = mbedtls_net_accept( &listen_fd, &client_fd,
-                    client_ip, sizeof( client_ip ), &cliip_len ) ) != 0 )
+    /* Each association reads the datagrams routed to it by demux() and
+     * queues what it writes, so that all I/O is batched */
+    for( i = 0; i < MAX_CLIENTS; i++ )
     {
-        printf( " failed\n  ! mbedtls_net_accept returned %d\n\n", ret );
-        goto exit;
-    }
+        if( ( ret = mbedtls_ssl_setup( &clients[i].ssl, &conf ) ) != 0 )
+        {
+            printf( " failed\n  ! mbedtls_ssl_setup returned %d\n\n", ret );
+            goto exit;
+        }
 
-    /* For HelloVerifyRequest cookies */
-    if( ( ret = mbedtls_ssl_set_client_transport_id( &ssl,
-                    client_ip, cliip_len ) ) != 0 )
-    {
-        printf( " failed\n  ! "
-                "mbedtls_ssl_set_client_transport_id() returned -0x%x\n\n", (unsigned int) -ret );
-        goto exit;
+        mbedtls_ssl_set_bio( &clients[i].ssl, &clients[i],
+                             slot_send, slot_recv, NULL );
+        mbedtls_ssl_set_mtu( &clients[i].ssl, DGRAM_MTU );
+        mbedtls_ssl_set_timer_cb( &clients[i].ssl, &clients[i].timer,
+                                  mbedtls_timing_set_delay,
+                                  mbedtls_timing_get_delay );
     }
 
-    mbedtls_ssl_set_bio( &ssl, &client_fd,
-                         mbedtls_net_send, mbedtls_net_recv, mbedtls_net_recv_timeout );
-
-    printf( " ok\n" );
-
-    /*
-     * 5. Handshake
-     */
-    printf( "  . Performing the DTLS handshake..." );
-    fflush( stdout );
-
-    do ret = mbedtls_ssl_handshake( &ssl );
-    while( ret == MBEDTLS_ERR_SSL_WANT_READ ||
-           ret == MBEDTLS_ERR_SSL_WANT_WRITE );
-
-    if( ret == MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED )
-    {
-        printf( " hello verification requested\n" );
-        ret = 0;
-        goto reset;
-    }
-    else if( ret != 0 )
-    {
-        printf( " failed\n  ! mbedtls_ssl_handshake returned -0x%x\n\n", (unsigned int) -ret );
-        goto reset;
-    }
+    for( i = 0; i < BATCH_SIZE; i++ )
+        rx_dgrams[i].buf = rx_bufs[i];
 
     printf( " ok\n" );
 
     /*
-     * 6. Read the echo Request
+     * 5. Serve all clients: receive a batch of datagrams, hand each one to
+     *    its association, and send everything they wrote in one batch
      */
-    printf( "  < Read from client:" );
+    printf( "  . Waiting for clients ...\n" );
     fflush( stdout );
 
-    len = sizeof( buf ) - 1;
-    memset( buf, 0, sizeof( buf ) );
-
-    do ret = mbedtls_ssl_read( &ssl, buf, len );
-    while( ret == MBEDTLS_ERR_SSL_WANT_READ ||
-           ret == MBEDTLS_ERR_SSL_WANT_WRITE );
-
-    if( ret <= 0 )
+    while( 1 )
     {
-        switch( ret )
+        ret = mbedtls_net_poll( &listen_fd, MBEDTLS_NET_POLL_READ, POLL_MS );
+        if( ret < 0 )
         {
-            case MBEDTLS_ERR_SSL_TIMEOUT:
-                printf( " timeout\n\n" );
-                goto reset;
-
-            case MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY:
-                printf( " connection was closed gracefully\n" );
-                ret = 0;
-                goto close_notify;
-
-            default:
-                printf( " mbedtls_ssl_read returned -0x%x\n\n", (unsigned int) -ret );
-                goto reset;
+            printf( "  ! mbedtls_net_poll returned -0x%x\n\n", (unsigned int) -ret );
+            goto exit;
         }
-    }
 
-    len = ret;
-    printf( " %d bytes read\n\n%s\n\n", len, buf );
-
-    /*
-     * 7. Write the 200 Response
-     */
-    printf( "  > Write to client:" );
-    fflush( stdout );
+        if( ret & MBEDTLS_NET_POLL_READ )
+        {
+            for( i = 0; i < BATCH_SIZE; i++ )
+                rx_dgrams[i].len = DGRAM_MAX_LEN;
+
+            n = mbedtls_net_recv_batch( &listen_fd, rx_dgrams, BATCH_SIZE );
+            if( n < 0 && n != MBEDTLS_ERR_SSL_WANT_READ )
+            {
+                printf( "  ! mbedtls_net_recv_batch returned -0x%x\n\n",
+                        (unsigned int) -n );
+                goto exit;
+            }
+
+            for( i = 0; n > 0 && i < (size_t) n; i++ )
+            {
+                client_slot *slot = demux( &rx_dgrams[i] );
+
+                if( slot == NULL )
+                    slot = slot_new( &rx_dgrams[i] );
+                if( slot == NULL )
+                    continue;
+
+                slot->pending = slot->from = &rx_dgrams[i];
+                slot_step( slot );
+                slot->pending = slot->from = NULL;
+            }
+        }
 
-    do ret = mbedtls_ssl_write( &ssl, buf, len );
-    while( ret == MBEDTLS_ERR_SSL_WANT_READ ||
-           ret == MBEDTLS_ERR_SSL_WANT_WRITE );
+        /* Retransmissions and idle timeouts */
+        for( i = 0; i < MAX_CLIENTS; i++ )
+        {
+            if( clients[i].active &&
+                mbedtls_timing_get_delay( &clients[i].timer ) == 2 )
+                slot_step( &clients[i] );
+        }
 
-    if( ret < 0 )
-    {
-        printf( " failed\n  ! mbedtls_ssl_write returned %d\n\n", ret );
-        goto exit;
+        flush_tx( &tx_queue );
     }
 
-    len = ret;
-    printf( " %d bytes written\n\n%s\n\n", len, buf );
-
-    /*
-     * 8. Done, cleanly close the connection
-     */
-close_notify:
-    printf( "  . Closing the connection..." );
-
-    /* No error checking, the connection might be closed already */
-    do ret = mbedtls_ssl_close_notify( &ssl );
-    while( ret == MBEDTLS_ERR_SSL_WANT_WRITE );
-    ret = 0;
-
-    printf( " done\n" );
-
-    goto reset;
-
     /*
      * Final clean-ups and exit
      */
@@ -391,12 +659,12 @@ exit:
     }
 #endif
 
-    mbedtls_net_free( &client_fd );
     mbedtls_net_free( &listen_fd );
 
     mbedtls_x509_crt_free( &srvcert );
     mbedtls_pk_free( &pkey );
-    mbedtls_ssl_free( &ssl );
+    for( i = 0; i < MAX_CLIENTS; i++ )
+        mbedtls_ssl_free( &clients[i].ssl );
     mbedtls_ssl_config_free( &conf );
     mbedtls_ssl_cookie_free( &cookie_ctx );
 #if defined(MBEDTLS_SSL_CACHE_C)
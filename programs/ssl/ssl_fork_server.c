@@ -56,6 +56,10 @@ int main( void )
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/timing.h"
 
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+#include "mbedtls/ssl_cache.h"
+#endif
+
 #include <string.h>
 #include <signal.h>
 
@@ -95,6 +99,9 @@ int main( void )
     mbedtls_ssl_config conf;
     mbedtls_x509_crt srvcert;
     mbedtls_pk_context pkey;
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+    mbedtls_ssl_cache_shared_context cache;
+#endif
 
     mbedtls_net_init( &listen_fd );
     mbedtls_net_init( &client_fd );
@@ -104,6 +111,9 @@ int main( void )
     mbedtls_pk_init( &pkey );
     mbedtls_x509_crt_init( &srvcert );
     mbedtls_ctr_drbg_init( &ctr_drbg );
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+    mbedtls_ssl_cache_shared_init( &cache );
+#endif
 
     signal( SIGCHLD, SIG_IGN );
 
@@ -186,6 +196,19 @@ int main( void )
         goto exit;
     }
 
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+    /* Set up before forking so that all children share the cache. */
+    if( ( ret = mbedtls_ssl_cache_shared_setup( &cache, 1024, 4096 ) ) != 0 )
+    {
+        mbedtls_printf( " failed!  mbedtls_ssl_cache_shared_setup returned %d\n\n", ret );
+        goto exit;
+    }
+
+    mbedtls_ssl_conf_session_cache( &conf, &cache,
+                                    mbedtls_ssl_cache_shared_get,
+                                    mbedtls_ssl_cache_shared_set );
+#endif
+
     mbedtls_printf( " ok\n" );
 
     /*
@@ -393,6 +416,9 @@ exit:
     mbedtls_pk_free( &pkey );
     mbedtls_ssl_free( &ssl );
     mbedtls_ssl_config_free( &conf );
+#if defined(MBEDTLS_SSL_CACHE_SHARED)
+    mbedtls_ssl_cache_shared_free( &cache );
+#endif
     mbedtls_ctr_drbg_free( &ctr_drbg );
     mbedtls_entropy_free( &entropy );
 
@@ -57,6 +57,14 @@ int main( void )
 #include "mbedtls/ssl_cookie.h"
 #endif
 
+#if defined(MBEDTLS_SSL_REPLAY_C)
+#include "mbedtls/ssl_replay.h"
+#endif
+
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+#include "mbedtls/ssl_key_pool.h"
+#endif
+
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION) && defined(MBEDTLS_FS_IO)
 #define SNI_OPTION
 #endif
@@ -98,6 +106,7 @@ int main( void )
 #define DFL_PSK_LIST_OPAQUE     0
 #define DFL_PSK_IDENTITY        "Client_identity"
 #define DFL_ECJPAKE_PW          NULL
+#define DFL_EC_MAX_OPS          -1
 #define DFL_PSK_LIST            NULL
 #define DFL_FORCE_CIPHER        0
 #define DFL_TLS1_3_KEX_MODES    MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_ALL
@@ -124,6 +133,12 @@ int main( void )
 #define DFL_TICKET_ROTATE       0
 #define DFL_TICKET_TIMEOUT      86400
 #define DFL_TICKET_AEAD         MBEDTLS_CIPHER_AES_256_GCM
+#define DFL_TICKET_BATCH        0
+#define DFL_TICKETS_DEFERRED    0
+#define DFL_EARLY_DATA          -1
+#define DFL_MAX_EARLY_DATA_SIZE -1
+#define DFL_EARLY_DATA_REPLAY   1
+#define DFL_KEY_POOL            0
 #define DFL_CACHE_MAX           -1
 #define DFL_CACHE_TIMEOUT       -1
 #define DFL_SNI                 NULL
@@ -134,6 +149,7 @@ int main( void )
 #define DFL_TRANSPORT           MBEDTLS_SSL_TRANSPORT_STREAM
 #define DFL_COOKIES             1
 #define DFL_ANTI_REPLAY         -1
+#define DFL_ANTI_REPLAY_WINDOW  0
 #define DFL_HS_TO_MIN           0
 #define DFL_HS_TO_MAX           0
 #define DFL_DTLS_MTU            -1
@@ -289,11 +305,32 @@ int main( void )
     "    tickets=%%d          default: 1 (enabled)\n"       \
     "    ticket_rotate=%%d    default: 0 (disabled)\n"      \
     "    ticket_timeout=%%d   default: 86400 (one day)\n"   \
-    "    ticket_aead=%%s      default: \"AES-256-GCM\"\n"
+    "    ticket_aead=%%s      default: \"AES-256-GCM\"\n"   \
+    "    ticket_batch=%%d     default: 0 (one ticket at a time)\n" \
+    "    tickets_deferred=%%d default: 0 (send tickets after the handshake)\n" \
+    "                        1: send them before the first application data\n"
 #else
 #define USAGE_TICKETS ""
 #endif /* MBEDTLS_SSL_SESSION_TICKETS && MBEDTLS_SSL_TICKET_C */
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_EARLY_DATA)
+#define USAGE_EARLY_DATA                                    \
+    "    early_data=%%d       default: library default (0, disabled)\n" \
+    "    max_early_data_size=%%d default: library default\n" \
+    "    early_data_replay=%%d default: 1 (reject replayed early data)\n"
+#else
+#define USAGE_EARLY_DATA ""
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_EARLY_DATA */
+
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+#define USAGE_KEY_POOL                                      \
+    "    key_pool=%%d         default: 0 (disabled)\n"     \
+    "                        Number of x25519 and secp256r1 key pairs to\n" \
+    "                        pre-generate while waiting for a connection\n"
+#else
+#define USAGE_KEY_POOL ""
+#endif /* MBEDTLS_SSL_KEY_POOL_C */
+
 #define USAGE_EAP_TLS                                       \
     "    eap_tls=%%d          default: 0 (disabled)\n"
 #define USAGE_NSS_KEYLOG                                    \
@@ -369,7 +406,8 @@ int main( void )
 
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
 #define USAGE_ANTI_REPLAY \
-    "    anti_replay=0/1     default: (library default: enabled)\n"
+    "    anti_replay=0/1     default: (library default: enabled)\n" \
+    "    anti_replay_window=%%d default: (library default)\n"
 #else
 #define USAGE_ANTI_REPLAY ""
 #endif
@@ -424,6 +462,13 @@ int main( void )
 #define USAGE_ECJPAKE ""
 #endif
 
+#if defined(MBEDTLS_ECP_RESTARTABLE)
+#define USAGE_ECRESTART \
+    "    ec_max_ops=%%s       default: library default (restart disabled)\n"
+#else
+#define USAGE_ECRESTART ""
+#endif
+
 #if defined(MBEDTLS_ECP_C)
 #define USAGE_CURVES \
     "    curves=a,b,c,d      default: \"default\" (library default)\n"  \
@@ -517,6 +562,7 @@ int main( void )
     USAGE_PSK                                               \
     USAGE_CA_CALLBACK                                       \
     USAGE_ECJPAKE                                           \
+    USAGE_ECRESTART                                         \
     "\n"
 #define USAGE3 \
     "    allow_legacy=%%d     default: (library default: no)\n"      \
@@ -524,6 +570,8 @@ int main( void )
     "    exchanges=%%d        default: 1\n"                 \
     "\n"                                                    \
     USAGE_TICKETS                                           \
+    USAGE_EARLY_DATA                                        \
+    USAGE_KEY_POOL                                          \
     USAGE_EAP_TLS                                           \
     USAGE_REPRODUCIBLE                                      \
     USAGE_NSS_KEYLOG                                        \
@@ -619,6 +667,7 @@ struct options
     const char *psk_identity;   /* the pre-shared key identity              */
     char *psk_list;             /* list of PSK id/key pairs for callback    */
     const char *ecjpake_pw;     /* the EC J-PAKE password                   */
+    int ec_max_ops;             /* EC consecutive operations limit          */
     int force_ciphersuite[2];   /* protocol/ciphersuite to use, or all      */
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     int tls13_kex_modes;        /* supported TLS 1.3 key exchange modes     */
@@ -642,6 +691,12 @@ struct options
     int ticket_rotate;          /* session ticket rotate (code coverage)    */
     int ticket_timeout;         /* session ticket lifetime                  */
     int ticket_aead;            /* session ticket protection                */
+    int ticket_batch;           /* generate the TLS 1.3 tickets in one go   */
+    int tickets_deferred;       /* send the TLS 1.3 tickets on first write  */
+    int early_data;             /* accept 0-RTT data?                       */
+    int max_early_data_size;    /* maximum amount of 0-RTT data             */
+    int early_data_replay;      /* check 0-RTT ClientHellos for replay      */
+    int key_pool;               /* pre-generated key pairs per group        */
     int cache_max;              /* max number of session cache entries      */
 #if defined(MBEDTLS_HAVE_TIME)
     int cache_timeout;          /* expiration delay of session cache entries*/
@@ -656,6 +711,7 @@ struct options
     int transport;              /* TLS or DTLS?                             */
     int cookies;                /* Use cookies for DTLS? -1 to break them   */
     int anti_replay;            /* Use anti-replay for DTLS? -1 for default */
+    int anti_replay_window;     /* DTLS anti-replay window, 0 for default   */
     uint32_t hs_to_min;         /* Initial value of DTLS handshake timer    */
     uint32_t hs_to_max;         /* Max value of DTLS handshake timer        */
     int dtls_mtu;               /* UDP Maximum transport unit for DTLS       */
@@ -1050,7 +1106,8 @@ static int mbedtls_status_is_ssl_in_progress( int ret )
 {
     return( ret == MBEDTLS_ERR_SSL_WANT_READ ||
             ret == MBEDTLS_ERR_SSL_WANT_WRITE ||
-            ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS );
+            ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS ||
+            ret == MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS );
 }
 
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
@@ -1108,6 +1165,7 @@ typedef struct
     unsigned slot;
     ssl_async_operation_type_t operation_type;
     mbedtls_md_type_t md_alg;
+    int rsa_pss; /* ASYNC_OP_SIGN with RSA-PSS rather than PKCS#1 v1.5 */
     unsigned char input[SSL_ASYNC_INPUT_MAX_SIZE];
     size_t input_len;
     unsigned remaining_delay;
@@ -1179,6 +1237,19 @@ static int ssl_async_start( mbedtls_ssl_context *ssl,
     ctx->slot = slot;
     ctx->operation_type = op_type;
     ctx->md_alg = md_alg;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if( op_type == ASYNC_OP_SIGN )
+    {
+        uint16_t sig_alg = mbedtls_ssl_get_async_sig_alg( ssl );
+        if( sig_alg != MBEDTLS_TLS1_3_SIG_NONE )
+            mbedtls_printf( "Async sign callback: TLS 1.3 signature algorithm 0x%04x\n",
+                            (unsigned) sig_alg );
+        /* TLS 1.3 only allows RSA-PSS for RSA keys. */
+        ctx->rsa_pss = sig_alg == MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA256 ||
+                       sig_alg == MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA384 ||
+                       sig_alg == MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA512;
+    }
+#endif
     memcpy( ctx->input, input, input_len );
     ctx->input_len = input_len;
     ctx->remaining_delay = config_data->slots[slot].delay;
@@ -1240,6 +1311,18 @@ static int ssl_async_resume( mbedtls_ssl_context *ssl,
                                       config_data->f_rng, config_data->p_rng );
             break;
         case ASYNC_OP_SIGN:
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+            if( ctx->rsa_pss )
+            {
+                ret = mbedtls_pk_sign_ext( MBEDTLS_PK_RSASSA_PSS, key_slot->pk,
+                                           ctx->md_alg,
+                                           ctx->input, ctx->input_len,
+                                           output, output_size, output_len,
+                                           config_data->f_rng,
+                                           config_data->p_rng );
+                break;
+            }
+#endif
             ret = mbedtls_pk_sign( key_slot->pk,
                                    ctx->md_alg,
                                    ctx->input, ctx->input_len,
@@ -1481,6 +1564,13 @@ int main( int argc, char *argv[] )
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
     mbedtls_ssl_ticket_context ticket_ctx;
 #endif /* MBEDTLS_SSL_SESSION_TICKETS && MBEDTLS_SSL_TICKET_C */
+#if defined(MBEDTLS_SSL_REPLAY_C)
+    mbedtls_ssl_replay_context replay_ctx;
+#endif
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+    mbedtls_ssl_key_pool key_pool;
+    uint16_t key_pool_groups[3];
+#endif
 #if defined(SNI_OPTION)
     sni_entry *sni_info = NULL;
 #endif
@@ -1571,6 +1661,12 @@ int main( int argc, char *argv[] )
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
     mbedtls_ssl_ticket_init( &ticket_ctx );
 #endif
+#if defined(MBEDTLS_SSL_REPLAY_C)
+    mbedtls_ssl_replay_init( &replay_ctx );
+#endif
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+    mbedtls_ssl_key_pool_init( &key_pool );
+#endif
 #if defined(MBEDTLS_SSL_ALPN)
     memset( (void *) alpn_list, 0, sizeof( alpn_list ) );
 #endif
@@ -1659,6 +1755,7 @@ int main( int argc, char *argv[] )
     opt.psk_identity        = DFL_PSK_IDENTITY;
     opt.psk_list            = DFL_PSK_LIST;
     opt.ecjpake_pw          = DFL_ECJPAKE_PW;
+    opt.ec_max_ops          = DFL_EC_MAX_OPS;
     opt.force_ciphersuite[0]= DFL_FORCE_CIPHER;
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     opt.tls13_kex_modes     = DFL_TLS1_3_KEX_MODES;
@@ -1682,6 +1779,12 @@ int main( int argc, char *argv[] )
     opt.ticket_rotate       = DFL_TICKET_ROTATE;
     opt.ticket_timeout      = DFL_TICKET_TIMEOUT;
     opt.ticket_aead         = DFL_TICKET_AEAD;
+    opt.ticket_batch        = DFL_TICKET_BATCH;
+    opt.tickets_deferred    = DFL_TICKETS_DEFERRED;
+    opt.early_data          = DFL_EARLY_DATA;
+    opt.max_early_data_size = DFL_MAX_EARLY_DATA_SIZE;
+    opt.early_data_replay   = DFL_EARLY_DATA_REPLAY;
+    opt.key_pool            = DFL_KEY_POOL;
     opt.cache_max           = DFL_CACHE_MAX;
 #if defined(MBEDTLS_HAVE_TIME)
     opt.cache_timeout       = DFL_CACHE_TIMEOUT;
@@ -1694,6 +1797,7 @@ int main( int argc, char *argv[] )
     opt.transport           = DFL_TRANSPORT;
     opt.cookies             = DFL_COOKIES;
     opt.anti_replay         = DFL_ANTI_REPLAY;
+    opt.anti_replay_window  = DFL_ANTI_REPLAY_WINDOW;
     opt.hs_to_min           = DFL_HS_TO_MIN;
     opt.hs_to_max           = DFL_HS_TO_MAX;
     opt.dtls_mtu            = DFL_DTLS_MTU;
@@ -1852,6 +1956,8 @@ int main( int argc, char *argv[] )
             opt.psk_list = q;
         else if( strcmp( p, "ecjpake_pw" ) == 0 )
             opt.ecjpake_pw = q;
+        else if( strcmp( p, "ec_max_ops" ) == 0 )
+            opt.ec_max_ops = atoi( q );
         else if( strcmp( p, "force_ciphersuite" ) == 0 )
         {
             opt.force_ciphersuite[0] = mbedtls_ssl_get_ciphersuite_id( q );
@@ -2085,6 +2191,45 @@ int main( int argc, char *argv[] )
             if( opt.ticket_rotate < 0 || opt.ticket_rotate > 1 )
                 goto usage;
         }
+        else if( strcmp( p, "ticket_batch" ) == 0 )
+        {
+            opt.ticket_batch = atoi( q );
+            if( opt.ticket_batch < 0 || opt.ticket_batch > 1 )
+                goto usage;
+        }
+        else if( strcmp( p, "tickets_deferred" ) == 0 )
+        {
+            opt.tickets_deferred = atoi( q );
+            if( opt.tickets_deferred < 0 || opt.tickets_deferred > 1 )
+                goto usage;
+        }
+        else if( strcmp( p, "early_data" ) == 0 )
+        {
+            switch( atoi( q ) )
+            {
+                case 0: opt.early_data = MBEDTLS_SSL_EARLY_DATA_DISABLED; break;
+                case 1: opt.early_data = MBEDTLS_SSL_EARLY_DATA_ENABLED; break;
+                default: goto usage;
+            }
+        }
+        else if( strcmp( p, "max_early_data_size" ) == 0 )
+        {
+            opt.max_early_data_size = atoi( q );
+            if( opt.max_early_data_size < 0 )
+                goto usage;
+        }
+        else if( strcmp( p, "early_data_replay" ) == 0 )
+        {
+            opt.early_data_replay = atoi( q );
+            if( opt.early_data_replay < 0 || opt.early_data_replay > 1 )
+                goto usage;
+        }
+        else if( strcmp( p, "key_pool" ) == 0 )
+        {
+            opt.key_pool = atoi( q );
+            if( opt.key_pool < 0 || opt.key_pool > 8 )
+                goto usage;
+        }
         else if( strcmp( p, "ticket_timeout" ) == 0 )
         {
             opt.ticket_timeout = atoi( q );
@@ -2125,6 +2270,12 @@ int main( int argc, char *argv[] )
             if( opt.anti_replay < 0 || opt.anti_replay > 1)
                 goto usage;
         }
+        else if( strcmp( p, "anti_replay_window" ) == 0 )
+        {
+            opt.anti_replay_window = atoi( q );
+            if( opt.anti_replay_window < 1 )
+                goto usage;
+        }
         else if( strcmp( p, "badmac_limit" ) == 0 )
         {
             opt.badmac_limit = atoi( q );
@@ -2976,6 +3127,11 @@ int main( int argc, char *argv[] )
     mbedtls_ssl_conf_rng( &conf, rng_get, &rng );
     mbedtls_ssl_conf_dbg( &conf, my_debug, stdout );
 
+#if defined(MBEDTLS_ECP_RESTARTABLE)
+    if( opt.ec_max_ops != DFL_EC_MAX_OPS )
+        mbedtls_ecp_set_max_ops( opt.ec_max_ops );
+#endif
+
 #if defined(MBEDTLS_SSL_CACHE_C)
     if( opt.cache_max != -1 )
         mbedtls_ssl_cache_set_max_entries( &cache, opt.cache_max );
@@ -3019,10 +3175,17 @@ int main( int argc, char *argv[] )
                     mbedtls_ssl_ticket_write,
                     mbedtls_ssl_ticket_parse,
                     &ticket_ctx );
+
+            if( opt.ticket_batch )
+                mbedtls_ssl_conf_session_tickets_batch_cb( &conf,
+                        mbedtls_ssl_ticket_write_batch );
         }
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
         mbedtls_ssl_conf_new_session_tickets( &conf, opt.tickets );
+        if( opt.tickets_deferred )
+            mbedtls_ssl_conf_new_session_tickets_mode( &conf,
+                    MBEDTLS_SSL_NEW_SESSION_TICKETS_DEFERRED );
 #endif
         /* exercise manual ticket rotation (not required for typical use)
          * (used for external synchronization of session ticket encryption keys)
@@ -3043,6 +3206,52 @@ int main( int argc, char *argv[] )
     }
 #endif
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_EARLY_DATA)
+    if( opt.early_data != DFL_EARLY_DATA )
+        mbedtls_ssl_tls13_conf_early_data( &conf, opt.early_data );
+    if( opt.max_early_data_size != DFL_MAX_EARLY_DATA_SIZE )
+        mbedtls_ssl_tls13_conf_max_early_data_size( &conf,
+                                    (uint32_t) opt.max_early_data_size );
+#if defined(MBEDTLS_SSL_REPLAY_C)
+    if( opt.early_data_replay == 1 )
+    {
+        if( ( ret = mbedtls_ssl_replay_setup( &replay_ctx, 0, 0 ) ) != 0 )
+        {
+            mbedtls_printf( " failed\n  ! mbedtls_ssl_replay_setup returned %d\n\n", ret );
+            goto exit;
+        }
+
+        mbedtls_ssl_tls13_conf_early_data_replay( &conf,
+                                                  mbedtls_ssl_replay_check,
+                                                  &replay_ctx );
+    }
+#endif /* MBEDTLS_SSL_REPLAY_C */
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_EARLY_DATA */
+
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+    if( opt.key_pool > 0 )
+    {
+        i = 0;
+        if( mbedtls_ecp_curve_info_from_tls_id(
+                MBEDTLS_SSL_IANA_TLS_GROUP_X25519 ) != NULL )
+            key_pool_groups[i++] = MBEDTLS_SSL_IANA_TLS_GROUP_X25519;
+        if( mbedtls_ecp_curve_info_from_tls_id(
+                MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1 ) != NULL )
+            key_pool_groups[i++] = MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1;
+        key_pool_groups[i] = 0;
+
+        if( ( ret = mbedtls_ssl_key_pool_setup( &key_pool, key_pool_groups,
+                                                opt.key_pool ) ) != 0 )
+        {
+            mbedtls_printf( " failed\n  ! mbedtls_ssl_key_pool_setup returned %d\n\n", ret );
+            goto exit;
+        }
+
+        mbedtls_ssl_conf_key_share_pool( &conf, mbedtls_ssl_key_pool_pop,
+                                         &key_pool );
+    }
+#endif /* MBEDTLS_SSL_KEY_POOL_C */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if( opt.transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM )
     {
@@ -3075,6 +3284,15 @@ int main( int argc, char *argv[] )
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
         if( opt.anti_replay != DFL_ANTI_REPLAY )
             mbedtls_ssl_conf_dtls_anti_replay( &conf, opt.anti_replay );
+
+        if( opt.anti_replay_window != DFL_ANTI_REPLAY_WINDOW &&
+            ( ret = mbedtls_ssl_conf_dtls_anti_replay_window( &conf,
+                                        opt.anti_replay_window ) ) != 0 )
+        {
+            mbedtls_printf( " failed\n  ! mbedtls_ssl_conf_dtls_anti_replay_window returned -0x%x\n\n",
+                            (unsigned int) -ret );
+            goto exit;
+        }
 #endif
 
         if( opt.badmac_limit != DFL_BADMAC_LIMIT )
@@ -3424,6 +3642,16 @@ reset:
 
     mbedtls_ssl_session_reset( &ssl );
 
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+    /* Refill the key share pool while no client is connected. */
+    if( opt.key_pool > 0 &&
+        ( ret = mbedtls_ssl_key_pool_fill( &key_pool, 0 ) ) < 0 )
+    {
+        mbedtls_printf( " failed\n  ! mbedtls_ssl_key_pool_fill returned %d\n\n", ret );
+        goto exit;
+    }
+#endif
+
     /*
      * 3. Wait until a client connects
      */
@@ -3518,9 +3746,29 @@ handshake:
         }
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_EARLY_DATA)
+        if( ret == MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA )
+        {
+            len = opt.buffer_size - 1;
+            memset( buf, 0, opt.buffer_size );
+            ret = mbedtls_ssl_read_early_data( &ssl, buf, len );
+            if( ret < 0 )
+                break;
+
+            mbedtls_printf( " %d bytes of early data read\n\n%s\n",
+                            ret, (char *) buf );
+            continue;
+        }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_EARLY_DATA */
+
         if( ! mbedtls_status_is_ssl_in_progress( ret ) )
             break;
 
+#if defined(MBEDTLS_ECP_RESTARTABLE)
+        if( ret == MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS )
+            continue;
+#endif
+
         /* For event-driven IO, wait for socket to become available */
         if( opt.event == 1 /* level triggered IO */ )
         {
@@ -3578,6 +3826,20 @@ handshake:
             mbedtls_ssl_ciphersuite_get_cipher_key_bitlen( ciphersuite_info ) );
     }
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_EARLY_DATA)
+    switch( mbedtls_ssl_get_early_data_status( &ssl ) )
+    {
+        case MBEDTLS_SSL_EARLY_DATA_STATUS_ACCEPTED:
+            mbedtls_printf( "    [ Early data accepted ]\n" );
+            break;
+        case MBEDTLS_SSL_EARLY_DATA_STATUS_REJECTED:
+            mbedtls_printf( "    [ Early data rejected ]\n" );
+            break;
+        default:
+            break;
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_EARLY_DATA */
+
     if( ( ret = mbedtls_ssl_get_record_expansion( &ssl ) ) >= 0 )
         mbedtls_printf( "    [ Record expansion is %d ]\n", ret );
     else
@@ -3618,6 +3880,11 @@ handshake:
         mbedtls_printf( " ok\n" );
 
 #if !defined(MBEDTLS_X509_REMOVE_INFO)
+#if defined(MBEDTLS_SSL_SESSION_LAZY_PEER_CERT)
+    if( ( ret = mbedtls_ssl_load_peer_cert( &ssl ) ) != 0 )
+        mbedtls_printf( "  ! mbedtls_ssl_load_peer_cert returned -0x%x\n\n",
+                        (unsigned int) -ret );
+#endif
     if( mbedtls_ssl_get_peer_cert( &ssl ) != NULL )
     {
         char crt_buf[512];
@@ -4302,6 +4569,12 @@ exit:
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
     mbedtls_ssl_ticket_free( &ticket_ctx );
 #endif
+#if defined(MBEDTLS_SSL_REPLAY_C)
+    mbedtls_ssl_replay_free( &replay_ctx );
+#endif
+#if defined(MBEDTLS_SSL_KEY_POOL_C)
+    mbedtls_ssl_key_pool_free( &key_pool );
+#endif
 #if defined(MBEDTLS_SSL_COOKIE_C)
     mbedtls_ssl_cookie_free( &cookie_ctx );
 #endif
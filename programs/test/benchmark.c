@@ -59,8 +59,14 @@ int main( void )
 #include "mbedtls/ecdsa.h"
 #include "mbedtls/ecdh.h"
 
+#include "mbedtls/x509_crt.h"
+
+#include "mbedtls/ssl_cookie.h"
+
 #include "mbedtls/error.h"
 
+#include "test/certs.h"
+
 #ifndef asm
 #define asm __asm
 #endif
@@ -118,7 +124,7 @@ static void mbedtls_set_alarm( int seconds );
     "aes_cbc, aes_gcm, aes_ccm, aes_xts, chachapoly,\n"                 \
     "aes_cmac, des3_cmac, poly1305\n"                                   \
     "ctr_drbg, hmac_drbg\n"                                     \
-    "rsa, dhm, ecdsa, ecdh.\n"
+    "rsa, dhm, ecdsa, ecdh, x509, dtls_cookie.\n"
 
 #if defined(MBEDTLS_ERROR_C)
 #define PRINT_ERROR                                                     \
@@ -517,9 +523,101 @@ typedef struct {
          aria, camellia, chacha20,
          poly1305,
          ctr_drbg, hmac_drbg,
-         rsa, dhm, ecdsa, ecdh;
+         rsa, dhm, ecdsa, ecdh,
+         x509, dtls_cookie;
 } todo_list;
 
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+/*
+ * Parse the test CA list into a fresh chain, optionally backed by an arena,
+ * and free it again.
+ */
+static int x509_parse_test_cas( int use_arena )
+{
+    mbedtls_x509_crt chain;
+    int ret = 0;
+    size_t i;
+
+    mbedtls_x509_crt_init( &chain );
+
+    if( use_arena )
+        ret = mbedtls_x509_crt_use_arena( &chain, 0 );
+
+    for( i = 0; ret == 0 && mbedtls_test_cas_der[i] != NULL; i++ )
+        ret = mbedtls_x509_crt_parse_der( &chain, mbedtls_test_cas_der[i],
+                                          mbedtls_test_cas_der_len[i] );
+
+    mbedtls_x509_crt_free( &chain );
+    return( ret );
+}
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) &&          \
+    !defined(MBEDTLS_PLATFORM_CALLOC_MACRO) &&   \
+    !defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
+#define X509_COUNT_ALLOCS
+
+static unsigned long x509_alloc_count;
+
+static void *x509_counting_calloc( size_t n, size_t size )
+{
+    x509_alloc_count++;
+    return( MBEDTLS_PLATFORM_STD_CALLOC( n, size ) );
+}
+
+/*
+ * Print how many allocations parsing and freeing the test CA list takes.
+ */
+static void x509_print_alloc_count( const char *title, int use_arena )
+{
+    x509_alloc_count = 0;
+    mbedtls_platform_set_calloc_free( x509_counting_calloc,
+                                      MBEDTLS_PLATFORM_STD_FREE );
+    (void) x509_parse_test_cas( use_arena );
+    mbedtls_platform_set_calloc_free( MBEDTLS_PLATFORM_STD_CALLOC,
+                                      MBEDTLS_PLATFORM_STD_FREE );
+
+    mbedtls_printf( HEADER_FORMAT "%6lu allocs/chain\n", title,
+                    x509_alloc_count );
+}
+#endif /* MBEDTLS_PLATFORM_MEMORY && !MBEDTLS_PLATFORM_CALLOC_MACRO &&
+          !MBEDTLS_MEMORY_BUFFER_ALLOC_C */
+#endif /* MBEDTLS_X509_CRT_PARSE_C */
+
+#if defined(MBEDTLS_SSL_COOKIE_C)
+#define COOKIE_BATCH        64
+#define COOKIE_MAX_LEN      64
+
+/*
+ * Issue one cookie per client in a batch, as a server under a ClientHello
+ * flood would, with client IDs made up of a 16-byte address and port.
+ */
+static int dtls_cookie_write_batch( mbedtls_ssl_cookie_ctx *ctx,
+                                    mbedtls_ssl_cookie_query *queries,
+                                    unsigned char *cookies,
+                                    unsigned char *ids )
+{
+    int ret;
+    size_t i;
+    unsigned char *p;
+
+    for( i = 0; i < COOKIE_BATCH; i++ )
+    {
+        p = cookies + i * COOKIE_MAX_LEN;
+        ret = mbedtls_ssl_cookie_write( ctx, &p, p + COOKIE_MAX_LEN,
+                                        ids + i * 18, 18 );
+        if( ret != 0 )
+            return( ret );
+
+        queries[i].cookie = cookies + i * COOKIE_MAX_LEN;
+        queries[i].cookie_len = p - queries[i].cookie;
+        queries[i].cli_id = ids + i * 18;
+        queries[i].cli_id_len = 18;
+    }
+
+    return( 0 );
+}
+#endif /* MBEDTLS_SSL_COOKIE_C */
+
 
 int main( int argc, char *argv[] )
 {
@@ -600,6 +698,10 @@ int main( int argc, char *argv[] )
                 todo.ecdsa = 1;
             else if( strcmp( argv[i], "ecdh" ) == 0 )
                 todo.ecdh = 1;
+            else if( strcmp( argv[i], "x509" ) == 0 )
+                todo.x509 = 1;
+            else if( strcmp( argv[i], "dtls_cookie" ) == 0 )
+                todo.dtls_cookie = 1;
 #if defined(MBEDTLS_ECP_C)
             else if( set_ecp_curve( argv[i], single_curve ) )
                 curve_list = single_curve;
@@ -1268,6 +1370,72 @@ int main( int argc, char *argv[] )
     }
 #endif
 
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    if( todo.x509 )
+    {
+        TIME_PUBLIC( "X509 parse", "chain",
+                     ret = x509_parse_test_cas( 0 ) );
+        TIME_PUBLIC( "X509 parse arena", "chain",
+                     ret = x509_parse_test_cas( 1 ) );
+#if defined(X509_COUNT_ALLOCS)
+        x509_print_alloc_count( "X509 parse", 0 );
+        x509_print_alloc_count( "X509 parse arena", 1 );
+#endif
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_COOKIE_C)
+    if( todo.dtls_cookie )
+    {
+        mbedtls_ssl_cookie_ctx cookie;
+        mbedtls_ssl_cookie_query queries[COOKIE_BATCH];
+        unsigned char cookies[COOKIE_BATCH * COOKIE_MAX_LEN];
+        unsigned char ids[COOKIE_BATCH * 18];
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+        if( psa_crypto_init( ) != PSA_SUCCESS )
+            mbedtls_exit( 1 );
+#endif
+        mbedtls_ssl_cookie_init( &cookie );
+        if( mbedtls_ssl_cookie_setup( &cookie, myrand, NULL ) != 0 ||
+            myrand( NULL, ids, sizeof( ids ) ) != 0 ||
+            dtls_cookie_write_batch( &cookie, queries, cookies, ids ) != 0 )
+        {
+            mbedtls_exit( 1 );
+        }
+
+        /* All figures are for a single thread: writing and checking take
+         * no lock, so they scale with the number of cores. */
+        TIME_PUBLIC( "DTLS cookie write", "cookie",
+                     unsigned char *p = cookies;
+                     ret = mbedtls_ssl_cookie_write( &cookie, &p,
+                                                     p + COOKIE_MAX_LEN,
+                                                     ids, 18 ) );
+        TIME_PUBLIC( "DTLS cookie check", "cookie",
+                     ret = mbedtls_ssl_cookie_check( &cookie,
+                                                     queries[0].cookie,
+                                                     queries[0].cookie_len,
+                                                     ids, 18 ) );
+        TIME_PUBLIC( "DTLS cookie check x64", "batch",
+                     ret = mbedtls_ssl_cookie_check_batch( &cookie, queries,
+                                                           COOKIE_BATCH );
+                     ret = ( ret == COOKIE_BATCH ) ? 0 : -1 );
+        TIME_PUBLIC( "DTLS cookie flood x64", "batch",
+                     ret = dtls_cookie_write_batch( &cookie, queries,
+                                                    cookies, ids );
+                     if( ret == 0 )
+                         ret = mbedtls_ssl_cookie_check_batch( &cookie,
+                                                               queries,
+                                                               COOKIE_BATCH );
+                     ret = ( ret == COOKIE_BATCH ) ? 0 : -1 );
+
+        mbedtls_ssl_cookie_free( &cookie );
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+        mbedtls_psa_crypto_free( );
+#endif
+    }
+#endif
+
     mbedtls_printf( "\n" );
 
 #if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
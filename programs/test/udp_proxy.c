@@ -136,6 +136,10 @@ int main( void )
     "    protect_hvr=0/1     default: 0 (don't protect HelloVerifyRequest)\n" \
     "    protect_len=%%d      default: (don't protect packets of this size)\n" \
     "    inject_clihlo=0/1   default: 0 (don't inject fake ClientHello)\n"  \
+    "    reorder=%%d          default: 0 (don't reorder ApplicationData)\n" \
+    "                        hold the first ApplicationData packet from\n"  \
+    "                        the client until N later packets from the\n"  \
+    "                        client have been forwarded.\n"                 \
     "\n"                                                                    \
     "    seed=%%d             default: (use current time)\n"                \
     USAGE_PACK                                                              \
@@ -170,6 +174,7 @@ static struct options
     int protect_hvr;            /* never drop or delay HelloVerifyRequest   */
     int protect_len;            /* never drop/delay packet of the given size*/
     int inject_clihlo;          /* inject fake ClientHello after handshake  */
+    int reorder;                /* forward 1st client ApplicationData late  */
     unsigned pack;              /* merge packets into single datagram for
                                  * at most \c merge milliseconds if > 0     */
     unsigned int seed;          /* seed for "random" events                 */
@@ -324,6 +329,12 @@ static void get_options( int argc, char *argv[] )
             if( opt.inject_clihlo < 0 || opt.inject_clihlo > 1 )
                 exit_usage( p, q );
         }
+        else if( strcmp( p, "reorder" ) == 0 )
+        {
+            opt.reorder = atoi( q );
+            if( opt.reorder < 0 || opt.reorder > 65536 )
+                exit_usage( p, q );
+        }
         else if( strcmp( p, "seed" ) == 0 )
         {
             opt.seed = atoi( q );
@@ -656,6 +667,21 @@ int send_packet( const packet *p, const char *why )
 static size_t prev_len;
 static packet prev[MAX_DELAYED_MSG];
 
+/*
+ * For the reorder option: the first ApplicationData packet from the client
+ * is held back, and sent only after opt.reorder later packets from the
+ * client, so that it arrives that many records late.
+ */
+typedef enum {
+    REORDER_INIT,   /* haven't seen the first ApplicationData yet */
+    REORDER_HELD,   /* holding it, counting later packets */
+    REORDER_DONE,   /* already sent, done */
+} reorder_state_t;
+
+static reorder_state_t reorder_state;
+static packet reordered;
+static int reorder_count;
+
 void clear_pending( void )
 {
     memset( &prev, 0, sizeof( prev ) );
@@ -740,6 +766,20 @@ int handle_message( const char *way,
         delay_list_len = opt.delay_srv_cnt;
     }
 
+    if( opt.reorder != 0 && strcmp( way, "S <- C" ) == 0 )
+    {
+        if( reorder_state == REORDER_INIT &&
+            strcmp( cur.type, "ApplicationData" ) == 0 )
+        {
+            memcpy( &reordered, &cur, sizeof( packet ) );
+            reorder_state = REORDER_HELD;
+            return( 0 );
+        }
+
+        if( reorder_state == REORDER_HELD )
+            reorder_count++;
+    }
+
     /* Check if message type is in the list of messages
      * that should be delayed */
     for( delay_idx = 0; delay_idx < delay_list_len; delay_idx++ )
@@ -800,6 +840,13 @@ int handle_message( const char *way,
             return( ret );
     }
 
+    if( reorder_state == REORDER_HELD && reorder_count >= opt.reorder )
+    {
+        reorder_state = REORDER_DONE;
+        if( ( ret = send_packet( &reordered, "reordered" ) ) != 0 )
+            return( ret );
+    }
+
     return( 0 );
 }
 
@@ -900,6 +947,8 @@ accept:
      * 3. Forward packets forever (kill the process to terminate it)
      */
     clear_pending();
+    reorder_state = REORDER_INIT;
+    reorder_count = 0;
     memset( held, 0, sizeof( held ) );
 
     nb_fds = client_fd.fd;
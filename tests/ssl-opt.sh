@@ -45,6 +45,7 @@ fi
 : ${P_SRV:=../programs/ssl/ssl_server2}
 : ${P_CLI:=../programs/ssl/ssl_client2}
 : ${P_PXY:=../programs/test/udp_proxy}
+: ${P_DTLS_LOAD:=../programs/ssl/dtls_load}
 : ${P_QUERY:=../programs/test/query_compile_time_config}
 : ${OPENSSL_CMD:=openssl} # OPENSSL would conflict with the build system
 : ${GNUTLS_CLI:=gnutls-cli}
@@ -1004,7 +1005,7 @@ wait_client_done() {
 # check if the given command uses dtls and sets global variable DTLS
 detect_dtls() {
     case "$1" in
-        *dtls=1*|*-dtls*|*-u*) DTLS=1;;
+        *dtls=1*|*-dtls*|*-u*|*dtls_load*) DTLS=1;;
         *) DTLS=0;;
     esac
 }
@@ -1094,7 +1095,12 @@ skip_handshake_stage_check() {
 analyze_test_commands() {
     # if the test uses DTLS but no custom proxy, add a simple proxy
     # as it provides timing info that's useful to debug failures
-    if [ -z "$PXY_CMD" ] && [ "$DTLS" -eq 1 ]; then
+    # (not for the load generator: the proxy only serves one client)
+    case "$CLI_CMD" in
+        *dtls_load*) NO_DEFAULT_PXY=1;;
+        *) NO_DEFAULT_PXY=0;;
+    esac
+    if [ -z "$PXY_CMD" ] && [ "$DTLS" -eq 1 ] && [ "$NO_DEFAULT_PXY" -eq 0 ]; then
         PXY_CMD="$P_PXY"
         case " $SRV_CMD " in
             *' server_addr=::1 '*)
@@ -8457,6 +8463,65 @@ run_test    "EC restart: TLS, max_ops=1000, ECDHE-PSK" \
             -C "mbedtls_ecdh_make_public.*4b00" \
             -C "mbedtls_pk_sign.*4b00"
 
+requires_config_enabled MBEDTLS_ECP_RESTARTABLE
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "EC restart: TLS 1.3, client max_ops=65535" \
+            "$P_SRV force_version=tls13 auth_mode=required \
+             crt_file=data_files/server5.crt key_file=data_files/server5.key" \
+            "$P_CLI force_version=tls13 \
+             key_file=data_files/server5.key crt_file=data_files/server5.crt  \
+             debug_level=1 ec_max_ops=65535" \
+            0 \
+            -C "x509_verify_cert.*4b00" \
+            -C "mbedtls_pk_verify.*4b00" \
+            -C "mbedtls_pk_sign.*4b00"
+
+requires_config_enabled MBEDTLS_ECP_RESTARTABLE
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "EC restart: TLS 1.3, client max_ops=1000" \
+            "$P_SRV force_version=tls13 auth_mode=required \
+             crt_file=data_files/server5.crt key_file=data_files/server5.key" \
+            "$P_CLI force_version=tls13 \
+             key_file=data_files/server5.key crt_file=data_files/server5.crt  \
+             debug_level=1 ec_max_ops=1000" \
+            0 \
+            -c "x509_verify_cert.*4b00" \
+            -c "mbedtls_pk_verify.*4b00" \
+            -c "mbedtls_pk_sign.*4b00"
+
+requires_config_enabled MBEDTLS_ECP_RESTARTABLE
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "EC restart: TLS 1.3, client max_ops=1000, badsign" \
+            "$P_SRV force_version=tls13 auth_mode=required \
+             crt_file=data_files/server5-badsign.crt \
+             key_file=data_files/server5.key" \
+            "$P_CLI force_version=tls13 \
+             key_file=data_files/server5.key crt_file=data_files/server5.crt  \
+             debug_level=1 ec_max_ops=1000" \
+            1 \
+            -c "x509_verify_cert.*4b00" \
+            -C "mbedtls_pk_verify.*4b00" \
+            -C "mbedtls_pk_sign.*4b00" \
+            -c "! mbedtls_ssl_handshake returned" \
+            -c "X509 - Certificate verification failed"
+
+requires_config_enabled MBEDTLS_ECP_RESTARTABLE
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "EC restart: TLS 1.3, server max_ops=1000" \
+            "$P_SRV force_version=tls13 auth_mode=required \
+             crt_file=data_files/server5.crt key_file=data_files/server5.key \
+             debug_level=1 ec_max_ops=1000" \
+            "$P_CLI force_version=tls13 \
+             key_file=data_files/server5.key crt_file=data_files/server5.crt" \
+            0 \
+            -s "mbedtls_pk_sign.*4b00" \
+            -s "x509_verify_cert.*4b00" \
+            -s "mbedtls_pk_verify.*4b00"
+
 # Tests of asynchronous private key support in SSL
 
 requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
@@ -8822,6 +8887,75 @@ run_test    "SSL async private: renegotiation: server-initiated, decrypt" \
             -s "Async decrypt callback: using key slot " \
             -s "Async resume (slot [0-9]): decrypt done, status=0"
 
+requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "SSL async private: TLS 1.3, sign ECDSA, delay=0" \
+            "$P_SRV force_version=tls13 tickets=0 \
+             crt_file=data_files/server5.crt key_file=data_files/server5.key \
+             async_operations=s async_private_delay1=0" \
+            "$P_CLI force_version=tls13" \
+            0 \
+            -s "Async sign callback: using key slot " \
+            -s "Async sign callback: TLS 1.3 signature algorithm 0x0403" \
+            -s "Async resume (slot [0-9]): sign done, status=0" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "SSL async private: TLS 1.3, sign ECDSA, delay=2" \
+            "$P_SRV force_version=tls13 tickets=0 \
+             crt_file=data_files/server5.crt key_file=data_files/server5.key \
+             async_operations=s async_private_delay1=2" \
+            "$P_CLI force_version=tls13" \
+            0 \
+            -s "Async sign callback: using key slot " \
+            -U "Async sign callback: using key slot " \
+            -s "Async resume (slot [0-9]): call 1 more times." \
+            -s "Async resume (slot [0-9]): call 0 more times." \
+            -s "Async resume (slot [0-9]): sign done, status=0" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+requires_config_enabled MBEDTLS_RSA_C
+requires_config_enabled MBEDTLS_PKCS1_V21
+run_test    "SSL async private: TLS 1.3, sign RSA-PSS, delay=1" \
+            "$P_SRV force_version=tls13 tickets=0 \
+             crt_file=data_files/server2-sha256.crt key_file=data_files/server2.key \
+             async_operations=s async_private_delay1=1" \
+            "$P_CLI force_version=tls13" \
+            0 \
+            -s "Async sign callback: using key slot " \
+            -s "Async sign callback: TLS 1.3 signature algorithm 0x080[456]" \
+            -s "Async resume (slot [0-9]): call 0 more times." \
+            -s "Async resume (slot [0-9]): sign done, status=0" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "SSL async private: TLS 1.3, sign, cancel after start" \
+            "$P_SRV force_version=tls13 tickets=0 \
+             crt_file=data_files/server5.crt key_file=data_files/server5.key \
+             async_operations=s async_private_delay1=1 async_private_error=2" \
+            "$P_CLI force_version=tls13" \
+            1 \
+            -s "Async sign callback: using key slot " \
+            -S "Async resume" \
+            -s "Async cancel"
+
+requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "SSL async private: TLS 1.3, sign, error in resume" \
+            "$P_SRV force_version=tls13 tickets=0 \
+             crt_file=data_files/server5.crt key_file=data_files/server5.key \
+             async_operations=s async_private_delay1=1 async_private_error=3" \
+            "$P_CLI force_version=tls13" \
+            1 \
+            -s "Async sign callback: using key slot " \
+            -s "Async resume callback: sign done but injected error" \
+            -S "Async cancel" \
+            -s "! mbedtls_ssl_handshake returned"
+
 # Tests for ECC extensions (rfc 4492)
 
 requires_config_enabled MBEDTLS_AES_C
@@ -8996,6 +9130,53 @@ run_test    "DTLS client reconnect from same port: attacker-injected" \
             -s "possible client reconnect from the same port" \
             -S "Client initiated reconnection from same port"
 
+# Tests for the DTLS server endpoint
+
+requires_config_enabled MBEDTLS_SSL_DTLS_ENDPOINT_C
+run_test    "DTLS endpoint: ssl_client2" \
+            "$P_DTLS_LOAD server_addr=127.0.0.1 server_port=$SRV_PORT" \
+            "$P_CLI dtls=1 debug_level=2" \
+            0 \
+            -s "association 1 established" \
+            -c "received hello verify request" \
+            -c "Successful connection using"
+
+requires_config_enabled MBEDTLS_SSL_DTLS_ENDPOINT_C
+run_test    "DTLS endpoint: ssl_client2, lossy network" \
+            -p "$P_PXY drop=5" \
+            "$P_DTLS_LOAD server_addr=127.0.0.1 server_port=$SRV_PORT" \
+            "$P_CLI dtls=1 hs_timeout=250-10000" \
+            0 \
+            -s "association 1 established" \
+            -c "Successful connection using"
+
+requires_config_enabled MBEDTLS_SSL_DTLS_ENDPOINT_C
+requires_config_enabled MBEDTLS_SSL_DTLS_CONNECTION_ID
+run_test    "DTLS endpoint: connection ID, lossy network" \
+            -p "$P_PXY drop=5" \
+            "$P_DTLS_LOAD server_addr=127.0.0.1 server_port=$SRV_PORT cid_len=4" \
+            "$P_CLI dtls=1 cid=1 hs_timeout=250-10000" \
+            0 \
+            -s "association 1 established" \
+            -c "Use of Connection ID has been negotiated" \
+            -c "Successful connection using"
+
+requires_config_enabled MBEDTLS_SSL_DTLS_ENDPOINT_C
+run_test    "DTLS endpoint: 50 concurrent clients" \
+            "$P_DTLS_LOAD server_addr=127.0.0.1 server_port=$SRV_PORT" \
+            "$P_DTLS_LOAD role=client server_addr=127.0.0.1 server_port=+SRV_PORT clients=50" \
+            0 \
+            -s "association 50 established" \
+            -c "50/50 handshakes completed"
+
+requires_config_enabled MBEDTLS_SSL_DTLS_ENDPOINT_C
+run_test    "DTLS endpoint: more clients than max_assocs" \
+            "$P_DTLS_LOAD server_addr=127.0.0.1 server_port=$SRV_PORT max_assocs=4" \
+            "$P_DTLS_LOAD role=client server_addr=127.0.0.1 server_port=+SRV_PORT clients=16" \
+            0 \
+            -s "association 16 established" \
+            -c "16/16 handshakes completed"
+
 # Tests for various cases of client authentication with DTLS
 # (focused on handshake flows and message parsing)
 
@@ -10621,6 +10802,47 @@ run_test    "DTLS proxy: duplicate every packet, server anti-replay off" \
             -s "Extra-header:" \
             -c "HTTP/1.0 200 OK"
 
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_SSL_DTLS_ANTI_REPLAY
+run_test    "DTLS proxy: record reordered by 40, default window" \
+            -p "$P_PXY reorder=40" \
+            "$P_SRV dtls=1 debug_level=1 exchanges=50" \
+            "$P_CLI dtls=1 read_timeout=1000 max_resend=1 exchanges=50" \
+            0 \
+            -S "replayed record" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_SSL_DTLS_ANTI_REPLAY
+run_test    "DTLS proxy: record reordered by 40, anti_replay_window=32" \
+            -p "$P_PXY reorder=40" \
+            "$P_SRV dtls=1 debug_level=1 exchanges=50 anti_replay_window=32" \
+            "$P_CLI dtls=1 read_timeout=1000 max_resend=1 exchanges=50" \
+            0 \
+            -s "replayed record" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_SSL_DTLS_ANTI_REPLAY
+run_test    "DTLS proxy: record reordered by 100, default window" \
+            -p "$P_PXY reorder=100" \
+            "$P_SRV dtls=1 debug_level=1 exchanges=110" \
+            "$P_CLI dtls=1 read_timeout=1000 max_resend=1 exchanges=110" \
+            0 \
+            -s "replayed record" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_SSL_DTLS_ANTI_REPLAY
+requires_config_value_at_least "MBEDTLS_SSL_DTLS_ANTI_REPLAY_WINDOW_MAX" 128
+run_test    "DTLS proxy: record reordered by 100, anti_replay_window=128" \
+            -p "$P_PXY reorder=100" \
+            "$P_SRV dtls=1 debug_level=1 exchanges=110 anti_replay_window=128" \
+            "$P_CLI dtls=1 read_timeout=1000 max_resend=1 exchanges=110" \
+            0 \
+            -S "replayed record" \
+            -c "HTTP/1.0 200 OK"
+
 requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
 run_test    "DTLS proxy: multiple records in same datagram" \
             -p "$P_PXY pack=50" \
@@ -10742,6 +10964,23 @@ run_test    "DTLS reordering: Buffer out-of-order handshake message fragment on
             -S "Injecting buffered CCS message" \
             -S "Remember CCS message"
 
+# Several fragments of the Certificate message arrive after the ones that
+# follow them, so that it is reassembled from disjoint ranges.
+requires_certificate_authentication
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+run_test    "DTLS reordering: Reassemble out-of-order fragments of hs msg" \
+            -p "$P_PXY delay_srv=Certificate delay_srv=Certificate \
+                delay_srv=Certificate" \
+            "$P_SRV mtu=256 dgram_packing=0 cookies=0 dtls=1 debug_level=2 \
+            hs_timeout=2500-60000" \
+            "$P_CLI dgram_packing=0 dtls=1 debug_level=2 auth_mode=none \
+            hs_timeout=2500-60000" \
+            0 \
+            -c "found fragmented DTLS handshake message" \
+            -c "Next handshake message has been buffered - load" \
+            -C "too many gaps in message" \
+            -C "resend"
+
 # The client buffers the ServerKeyExchange before receiving the fragmented
 # Certificate message; at the time of writing, together these are aroudn 1200b
 # in size, so that the bound below ensures that the certificate can be reassembled
@@ -12953,6 +13192,142 @@ run_test    "TLS 1.3: NewSessionTicket: Basic check, m->m" \
             -s "key exchange mode: psk_ephemeral" \
             -s "found pre_shared_key extension"
 
+requires_config_enabled MBEDTLS_SSL_SESSION_TICKETS
+requires_config_enabled MBEDTLS_SSL_SRV_C
+requires_config_enabled MBEDTLS_SSL_CLI_C
+requires_config_enabled MBEDTLS_DEBUG_C
+requires_all_configs_enabled MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
+run_test    "TLS 1.3: NewSessionTicket: batch, m->m" \
+            "$P_SRV debug_level=4 crt_file=data_files/server5.crt key_file=data_files/server5.key force_version=tls13 tickets=4 ticket_batch=1" \
+            "$P_CLI debug_level=4 reco_mode=1 reconnect=1" \
+            0 \
+            -c "Protocol is TLSv1.3" \
+            -c "got new session ticket ( 3 )" \
+            -c "Reconnecting with saved session" \
+            -c "HTTP/1.0 200 OK"    \
+            -s "=> write NewSessionTicket msg" \
+            -s "key exchange mode: psk_ephemeral" \
+            -s "found pre_shared_key extension"
+
+requires_config_enabled MBEDTLS_SSL_SESSION_TICKETS
+requires_config_enabled MBEDTLS_SSL_SRV_C
+requires_config_enabled MBEDTLS_SSL_CLI_C
+requires_config_enabled MBEDTLS_DEBUG_C
+requires_all_configs_enabled MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
+run_test    "TLS 1.3: NewSessionTicket: deferred, m->m" \
+            "$P_SRV debug_level=4 crt_file=data_files/server5.crt key_file=data_files/server5.key force_version=tls13 tickets=4 tickets_deferred=1" \
+            "$P_CLI debug_level=4 reco_mode=1 reconnect=1" \
+            0 \
+            -c "Protocol is TLSv1.3" \
+            -c "got new session ticket ( 3 )" \
+            -c "Reconnecting with saved session" \
+            -c "HTTP/1.0 200 OK"    \
+            -s "NewSessionTicket: deferred to the first write" \
+            -s "NewSessionTicket: sending deferred tickets" \
+            -s "key exchange mode: psk_ephemeral" \
+            -s "found pre_shared_key extension"
+
+requires_openssl_tls1_3
+requires_config_enabled MBEDTLS_SSL_EARLY_DATA
+requires_config_enabled MBEDTLS_SSL_SESSION_TICKETS
+requires_config_enabled MBEDTLS_SSL_SRV_C
+requires_config_enabled MBEDTLS_DEBUG_C
+requires_all_configs_enabled MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
+run_test    "TLS 1.3: early data accepted, O->m" \
+            "$P_SRV debug_level=3 force_version=tls13 tickets=1 early_data=1" \
+            "( printf 'early hello' > $SESSION.early; \
+               $O_NEXT_CLI -tls1_3 -ign_eof -sess_out $SESSION; \
+               $O_NEXT_CLI -tls1_3 -sess_in $SESSION -early_data $SESSION.early; \
+               rm -f $SESSION $SESSION.early )" \
+            0 \
+            -s "found early_data extension" \
+            -s "max_early_data_size: 1024" \
+            -s "EarlyData: accepted" \
+            -s "11 bytes of early data read" \
+            -s "Early data accepted" \
+            -c "Early data was accepted"
+
+requires_openssl_tls1_3
+requires_config_enabled MBEDTLS_SSL_EARLY_DATA
+requires_config_enabled MBEDTLS_SSL_SESSION_TICKETS
+requires_config_enabled MBEDTLS_SSL_SRV_C
+requires_config_enabled MBEDTLS_DEBUG_C
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_all_configs_enabled MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
+run_test    "TLS 1.3: early data rejected after HRR, O->m" \
+            "$P_SRV debug_level=3 force_version=tls13 tickets=1 early_data=1
+                    curves=secp256r1" \
+            "( printf 'early hello' > $SESSION.early; \
+               $O_NEXT_CLI -tls1_3 -groups P-256 -ign_eof -sess_out $SESSION; \
+               $O_NEXT_CLI -tls1_3 -groups X25519:P-256 -sess_in $SESSION \
+                           -early_data $SESSION.early; \
+               rm -f $SESSION $SESSION.early )" \
+            0 \
+            -s "EarlyData: rejected, HelloRetryRequest" \
+            -s "skipping rejected early data record" \
+            -s "Early data rejected" \
+            -S "bytes of early data read" \
+            -c "Early data was rejected"
+
+requires_openssl_tls1_3
+requires_config_enabled MBEDTLS_SSL_EARLY_DATA
+requires_config_enabled MBEDTLS_SSL_SESSION_TICKETS
+requires_config_enabled MBEDTLS_SSL_SRV_C
+requires_config_enabled MBEDTLS_DEBUG_C
+requires_config_enabled MBEDTLS_HAVE_TIME
+requires_all_configs_enabled MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
+run_test    "TLS 1.3: early data rejected with the ticket, O->m" \
+            "$P_SRV debug_level=3 force_version=tls13 tickets=1 early_data=1
+                    dummy_ticket=1" \
+            "( printf 'early hello' > $SESSION.early; \
+               $O_NEXT_CLI -tls1_3 -ign_eof -sess_out $SESSION; \
+               $O_NEXT_CLI -tls1_3 -sess_in $SESSION -early_data $SESSION.early; \
+               rm -f $SESSION $SESSION.early )" \
+            0 \
+            -s "EarlyData: rejected, not a 0-RTT resumption" \
+            -s "skipping rejected early data record" \
+            -s "Early data rejected" \
+            -S "bytes of early data read" \
+            -c "Early data was rejected"
+
+requires_config_enabled MBEDTLS_SSL_KEY_POOL_C
+requires_config_enabled MBEDTLS_SSL_SRV_C
+requires_config_enabled MBEDTLS_SSL_CLI_C
+requires_config_enabled MBEDTLS_DEBUG_C
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_all_configs_enabled MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE \
+                             MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "TLS 1.3: server key share from the key pool, m->m" \
+            "$P_SRV debug_level=3 force_version=tls13 key_pool=2 curves=secp256r1" \
+            "$P_CLI debug_level=3 curves=secp256r1" \
+            0 \
+            -c "Protocol is TLSv1.3" \
+            -s "using pre-generated key share, group 0017"
+
+requires_config_enabled MBEDTLS_SSL_KEY_POOL_C
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_USE_PSA_CRYPTO
+requires_config_enabled MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED
+requires_config_enabled MBEDTLS_DEBUG_C
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+run_test    "TLS 1.2: server ECDHE key from the key pool, m->m" \
+            "$P_SRV debug_level=3 force_version=tls12 key_pool=2 curves=secp256r1
+                    crt_file=data_files/server5.crt key_file=data_files/server5.key" \
+            "$P_CLI force_version=tls12 curves=secp256r1" \
+            0 \
+            -c "Protocol is TLSv1.2" \
+            -s "using pre-generated key share, group 0017"
+
 requires_openssl_tls1_3
 requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
 requires_config_enabled MBEDTLS_DEBUG_C